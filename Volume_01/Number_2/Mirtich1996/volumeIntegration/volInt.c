@@ -37,13 +37,21 @@
 	                product terms to center of mass frame.  Changes 
 			confined to function main().  Thanks to 
 			Chris Hecker.
+
+	18 Oct 2026	Made a library (see volInt.h): polyhedra are
+			sized to their input, the integrals are local,
+			faces are summed in parallel with compensated
+			summation, and many polyhedra can be processed
+			in a batch.  main() moved to volIntMain.c.
 */
 
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include "volInt.h"
 
 /*
    ============================================================================
@@ -51,9 +59,9 @@
    ============================================================================
 */
 
-#define MAX_VERTS 100     /* maximum number of polyhedral vertices */
-#define MAX_FACES 100     /* maximum number of polyhedral faces */
-#define MAX_POLYGON_SZ 10 /* maximum number of verts per polygonal face */
+#define FACE_BLOCK_SZ 1024      /* faces per block of the parallel sum */
+#define PARALLEL_FACES 16384    /* batch: sum the faces of larger polyhedra
+				   in parallel */
 
 #define X 0
 #define Y 1
@@ -74,74 +82,69 @@
    ============================================================================
 */
 
+/* projection integrals */
 typedef struct {
-  int numVerts;
-  double norm[3];
-  double w;
-  int verts[MAX_POLYGON_SZ];
-  struct polyhedron *poly;
-} FACE;
-
-typedef struct polyhedron {
-  int numVerts, numFaces;
-  double verts[MAX_VERTS][3];
-  FACE faces[MAX_FACES];
-} POLYHEDRON;
+  double P1, Pa, Pb, Paa, Pab, Pbb, Paaa, Paab, Pabb, Pbbb;
+} PROJECTION_INTEGRALS;
 
+/* face integrals */
+typedef struct {
+  double Fa, Fb, Fc, Faa, Fbb, Fcc, Faaa, Fbbb, Fccc, Faab, Fbbc, Fcca;
+} FACE_INTEGRALS;
 
 /*
-   ============================================================================
-   globals
-   ============================================================================
+   compensated (Neumaier) sums of the face contributions to the volume
+   integrals, in the order T0, T1[X..Z], T2[X..Z], TP[X..Z]
 */
-
-static int A;   /* alpha */
-static int B;   /* beta */
-static int C;   /* gamma */
-
-/* projection integrals */
-static double P1, Pa, Pb, Paa, Pab, Pbb, Paaa, Paab, Pabb, Pbbb;
-
-/* face integrals */
-static double Fa, Fb, Fc, Faa, Fbb, Fcc, Faaa, Fbbb, Fccc, Faab, Fbbc, Fcca;
-
-/* volume integrals */
-static double T0, T1[3], T2[3], TP[3];
+typedef struct {
+  double sum[10], comp[10];
+} VOLUME_SUMS;
 
 
 /*
    ============================================================================
-   read in a polyhedron
+   polyhedra
    ============================================================================
 */
 
-void readPolyhedron(char *name, POLYHEDRON *p)
+int initPolyhedron(POLYHEDRON *p, int numVerts, const double *verts,
+		   int numFaces, const int *faceSizes, const int *faceVerts)
 {
-  FILE *fp;
-  char line[200], *c;
-  int i, j, n;
+  int i, n;
   double dx1, dy1, dz1, dx2, dy2, dz2, nx, ny, nz, len;
   FACE *f;
 
-  
-  if (!(fp = fopen(name, "r"))) {
-    printf("i/o error\n");
-    exit(1);
+  p->verts = NULL;
+  p->faces = NULL;
+  p->faceVerts = NULL;
+  p->numVerts = p->numFaces = 0;
+
+  /* reject the faces the file reader rejects */
+  if (numVerts < 0 || numFaces < 0) return -1;
+  for (n = 0, i = 0; i < numFaces; i++) {
+    if (faceSizes[i] < 3) return -1;
+    n += faceSizes[i];
   }
-  
-  fscanf(fp, "%d", &p->numVerts);
-  printf("Reading in %d vertices\n", p->numVerts);
-  for (i = 0; i < p->numVerts; i++)
-    fscanf(fp, "%lf %lf %lf", 
-	   &p->verts[i][X], &p->verts[i][Y], &p->verts[i][Z]);
-
-  fscanf(fp, "%d", &p->numFaces);
-  printf("Reading in %d faces\n", p->numFaces);
-  for (i = 0; i < p->numFaces; i++) {
+  for (i = 0; i < n; i++)
+    if (faceVerts[i] < 0 || faceVerts[i] >= numVerts) return -1;
+
+  p->numVerts = numVerts;
+  p->numFaces = numFaces;
+  p->verts = (double (*)[3]) malloc((numVerts ? numVerts : 1) * sizeof(*p->verts));
+  p->faces = (FACE *) malloc((numFaces ? numFaces : 1) * sizeof(FACE));
+  p->faceVerts = (int *) malloc((n ? n : 1) * sizeof(int));
+  if (!p->verts || !p->faces || !p->faceVerts) {
+    freePolyhedron(p);
+    return -1;
+  }
+  memcpy(p->verts, verts, numVerts * sizeof(*p->verts));
+  memcpy(p->faceVerts, faceVerts, n * sizeof(int));
+
+  for (n = 0, i = 0; i < numFaces; i++) {
     f = &p->faces[i];
-    f->poly = p;
-    fscanf(fp, "%d", &f->numVerts);
-    for (j = 0; j < f->numVerts; j++) fscanf(fp, "%d", &f->verts[j]);
+    f->numVerts = faceSizes[i];
+    f->verts = p->faceVerts + n;
+    n += f->numVerts;
 
     /* compute face normal and offset w from first 3 vertices */
     dx1 = p->verts[f->verts[1]][X] - p->verts[f->verts[0]][X];
@@ -154,19 +157,82 @@ void readPolyhedron(char *name, POLYHEDRON *p)
     ny = dz1 * dx2 - dz2 * dx1;
     nz = dx1 * dy2 - dx2 * dy1;
     len = sqrt(nx * nx + ny * ny + nz * nz);
-    f->norm[X] = nx / len;
-    f->norm[Y] = ny / len;
-    f->norm[Z] = nz / len;
+
+    /* degenerate faces get a zero normal, and are skipped */
+    if (len > 0.0) {
+      f->norm[X] = nx / len;
+      f->norm[Y] = ny / len;
+      f->norm[Z] = nz / len;
+    }
+    else f->norm[X] = f->norm[Y] = f->norm[Z] = 0.0;
     f->w = - f->norm[X] * p->verts[f->verts[0]][X]
            - f->norm[Y] * p->verts[f->verts[0]][Y]
            - f->norm[Z] * p->verts[f->verts[0]][Z];
+  }
+
+  return 0;
+}
 
+int readPolyhedron(const char *name, POLYHEDRON *p)
+{
+  FILE *fp;
+  int i, j, n, numVerts, numFaces, maxFaceVerts;
+  double *verts = NULL;
+  int *faceSizes = NULL, *faceVerts = NULL, *grown;
+  int result = -1;
+
+  p->verts = NULL;
+  p->faces = NULL;
+  p->faceVerts = NULL;
+  p->numVerts = p->numFaces = 0;
+
+  if (!(fp = fopen(name, "r"))) return -1;
+
+  if (fscanf(fp, "%d", &numVerts) != 1 || numVerts < 0) goto done;
+  if (!(verts = (double *) malloc((numVerts ? numVerts : 1) * 3 * sizeof(double))))
+    goto done;
+  for (i = 0; i < 3 * numVerts; i++)
+    if (fscanf(fp, "%lf", &verts[i]) != 1) goto done;
+
+  if (fscanf(fp, "%d", &numFaces) != 1 || numFaces < 0) goto done;
+  if (!(faceSizes = (int *) malloc((numFaces ? numFaces : 1) * sizeof(int))))
+    goto done;
+  maxFaceVerts = 0;
+  for (n = 0, i = 0; i < numFaces; i++) {
+    if (fscanf(fp, "%d", &faceSizes[i]) != 1 || faceSizes[i] < 3) goto done;
+    if (n + faceSizes[i] > maxFaceVerts) {
+      maxFaceVerts = 2 * (n + faceSizes[i]);
+      if (!(grown = (int *) realloc(faceVerts, maxFaceVerts * sizeof(int))))
+	goto done;
+      faceVerts = grown;
+    }
+    for (j = 0; j < faceSizes[i]; j++, n++)
+      if (fscanf(fp, "%d", &faceVerts[n]) != 1
+	  || faceVerts[n] < 0 || faceVerts[n] >= numVerts) goto done;
   }
 
+  result = initPolyhedron(p, numVerts, verts, numFaces, faceSizes, faceVerts);
+
+ done:
+  free(verts);
+  free(faceSizes);
+  free(faceVerts);
   fclose(fp);
+  return result;
+}
 
+void freePolyhedron(POLYHEDRON *p)
+{
+  free(p->verts);
+  free(p->faces);
+  free(p->faceVerts);
+  p->verts = NULL;
+  p->faces = NULL;
+  p->faceVerts = NULL;
+  p->numVerts = p->numFaces = 0;
 }
 
+
 /*
    ============================================================================
    compute mass properties
@@ -175,7 +241,8 @@ void readPolyhedron(char *name, POLYHEDRON *p)
 
 
 /* compute various integrations over projection of face */
-void compProjectionIntegrals(FACE *f)
+static void compProjectionIntegrals(const POLYHEDRON *p, const FACE *f,
+				    int A, int B, PROJECTION_INTEGRALS *P)
 {
   double a0, a1, da;
   double b0, b1, db;
@@ -185,13 +252,14 @@ void compProjectionIntegrals(FACE *f)
   double Cab, Kab, Caab, Kaab, Cabb, Kabb;
   int i;
 
-  P1 = Pa = Pb = Paa = Pab = Pbb = Paaa = Paab = Pabb = Pbbb = 0.0;
+  P->P1 = P->Pa = P->Pb = P->Paa = P->Pab = P->Pbb
+    = P->Paaa = P->Paab = P->Pabb = P->Pbbb = 0.0;
 
   for (i = 0; i < f->numVerts; i++) {
-    a0 = f->poly->verts[f->verts[i]][A];
-    b0 = f->poly->verts[f->verts[i]][B];
-    a1 = f->poly->verts[f->verts[(i+1) % f->numVerts]][A];
-    b1 = f->poly->verts[f->verts[(i+1) % f->numVerts]][B];
+    a0 = p->verts[f->verts[i]][A];
+    b0 = p->verts[f->verts[i]][B];
+    a1 = p->verts[f->verts[(i+1) % f->numVerts]][A];
+    b1 = p->verts[f->verts[(i+1) % f->numVerts]][B];
     da = a1 - a0;
     db = b1 - b0;
     a0_2 = a0 * a0; a0_3 = a0_2 * a0; a0_4 = a0_3 * a0;
@@ -207,160 +275,210 @@ void compProjectionIntegrals(FACE *f)
     Cabb = 4*b1_3 + 3*b1_2*b0 + 2*b1*b0_2 + b0_3;
     Kabb = b1_3 + 2*b1_2*b0 + 3*b1*b0_2 + 4*b0_3;
 
-    P1 += db*C1;
-    Pa += db*Ca;
-    Paa += db*Caa;
-    Paaa += db*Caaa;
-    Pb += da*Cb;
-    Pbb += da*Cbb;
-    Pbbb += da*Cbbb;
-    Pab += db*(b1*Cab + b0*Kab);
-    Paab += db*(b1*Caab + b0*Kaab);
-    Pabb += da*(a1*Cabb + a0*Kabb);
+    P->P1 += db*C1;
+    P->Pa += db*Ca;
+    P->Paa += db*Caa;
+    P->Paaa += db*Caaa;
+    P->Pb += da*Cb;
+    P->Pbb += da*Cbb;
+    P->Pbbb += da*Cbbb;
+    P->Pab += db*(b1*Cab + b0*Kab);
+    P->Paab += db*(b1*Caab + b0*Kaab);
+    P->Pabb += da*(a1*Cabb + a0*Kabb);
   }
 
-  P1 /= 2.0;
-  Pa /= 6.0;
-  Paa /= 12.0;
-  Paaa /= 20.0;
-  Pb /= -6.0;
-  Pbb /= -12.0;
-  Pbbb /= -20.0;
-  Pab /= 24.0;
-  Paab /= 60.0;
-  Pabb /= -60.0;
+  P->P1 /= 2.0;
+  P->Pa /= 6.0;
+  P->Paa /= 12.0;
+  P->Paaa /= 20.0;
+  P->Pb /= -6.0;
+  P->Pbb /= -12.0;
+  P->Pbbb /= -20.0;
+  P->Pab /= 24.0;
+  P->Paab /= 60.0;
+  P->Pabb /= -60.0;
 }
 
-compFaceIntegrals(FACE *f)
+static void compFaceIntegrals(const POLYHEDRON *p, const FACE *f,
+			      int A, int B, int C, FACE_INTEGRALS *F)
 {
-  double *n, w;
+  PROJECTION_INTEGRALS P;
+  const double *n;
+  double w;
   double k1, k2, k3, k4;
 
-  compProjectionIntegrals(f);
+  compProjectionIntegrals(p, f, A, B, &P);
 
   w = f->w;
   n = f->norm;
   k1 = 1 / n[C]; k2 = k1 * k1; k3 = k2 * k1; k4 = k3 * k1;
 
-  Fa = k1 * Pa;
-  Fb = k1 * Pb;
-  Fc = -k2 * (n[A]*Pa + n[B]*Pb + w*P1);
-
-  Faa = k1 * Paa;
-  Fbb = k1 * Pbb;
-  Fcc = k3 * (SQR(n[A])*Paa + 2*n[A]*n[B]*Pab + SQR(n[B])*Pbb
-	 + w*(2*(n[A]*Pa + n[B]*Pb) + w*P1));
-
-  Faaa = k1 * Paaa;
-  Fbbb = k1 * Pbbb;
-  Fccc = -k4 * (CUBE(n[A])*Paaa + 3*SQR(n[A])*n[B]*Paab 
-	   + 3*n[A]*SQR(n[B])*Pabb + CUBE(n[B])*Pbbb
-	   + 3*w*(SQR(n[A])*Paa + 2*n[A]*n[B]*Pab + SQR(n[B])*Pbb)
-	   + w*w*(3*(n[A]*Pa + n[B]*Pb) + w*P1));
-
-  Faab = k1 * Paab;
-  Fbbc = -k2 * (n[A]*Pabb + n[B]*Pbbb + w*Pbb);
-  Fcca = k3 * (SQR(n[A])*Paaa + 2*n[A]*n[B]*Paab + SQR(n[B])*Pabb
-	 + w*(2*(n[A]*Paa + n[B]*Pab) + w*Pa));
+  F->Fa = k1 * P.Pa;
+  F->Fb = k1 * P.Pb;
+  F->Fc = -k2 * (n[A]*P.Pa + n[B]*P.Pb + w*P.P1);
+
+  F->Faa = k1 * P.Paa;
+  F->Fbb = k1 * P.Pbb;
+  F->Fcc = k3 * (SQR(n[A])*P.Paa + 2*n[A]*n[B]*P.Pab + SQR(n[B])*P.Pbb
+	 + w*(2*(n[A]*P.Pa + n[B]*P.Pb) + w*P.P1));
+
+  F->Faaa = k1 * P.Paaa;
+  F->Fbbb = k1 * P.Pbbb;
+  F->Fccc = -k4 * (CUBE(n[A])*P.Paaa + 3*SQR(n[A])*n[B]*P.Paab 
+	   + 3*n[A]*SQR(n[B])*P.Pabb + CUBE(n[B])*P.Pbbb
+	   + 3*w*(SQR(n[A])*P.Paa + 2*n[A]*n[B]*P.Pab + SQR(n[B])*P.Pbb)
+	   + w*w*(3*(n[A]*P.Pa + n[B]*P.Pb) + w*P.P1));
+
+  F->Faab = k1 * P.Paab;
+  F->Fbbc = -k2 * (n[A]*P.Pabb + n[B]*P.Pbbb + w*P.Pbb);
+  F->Fcca = k3 * (SQR(n[A])*P.Paaa + 2*n[A]*n[B]*P.Paab + SQR(n[B])*P.Pabb
+	 + w*(2*(n[A]*P.Paa + n[B]*P.Pab) + w*P.Pa));
 }
 
-void compVolumeIntegrals(POLYHEDRON *p)
+/* add x to the compensated sum (sum, comp) */
+static void addCompensated(double *sum, double *comp, double x)
 {
-  FACE *f;
-  double nx, ny, nz;
-  int i;
+  double t = *sum + x;
 
-  T0 = T1[X] = T1[Y] = T1[Z] 
-     = T2[X] = T2[Y] = T2[Z] 
-     = TP[X] = TP[Y] = TP[Z] = 0;
+  if (fabs(*sum) >= fabs(x)) *comp += (*sum - t) + x;
+  else *comp += (x - t) + *sum;
+  *sum = t;
+}
+
+/* add the contributions of faces [first, last) to S */
+static void sumFaces(const POLYHEDRON *p, int first, int last, VOLUME_SUMS *S)
+{
+  const FACE *f;
+  FACE_INTEGRALS F;
+  double nx, ny, nz;
+  double t[10];
+  int i, k, A, B, C;
 
-  for (i = 0; i < p->numFaces; i++) {
+  for (i = first; i < last; i++) {
 
     f = &p->faces[i];
 
     nx = fabs(f->norm[X]);
     ny = fabs(f->norm[Y]);
     nz = fabs(f->norm[Z]);
+    if (nx == 0.0 && ny == 0.0 && nz == 0.0) continue;
     if (nx > ny && nx > nz) C = X;
     else C = (ny > nz) ? Y : Z;
     A = (C + 1) % 3;
     B = (A + 1) % 3;
 
-    compFaceIntegrals(f);
+    compFaceIntegrals(p, f, A, B, C, &F);
 
-    T0 += f->norm[X] * ((A == X) ? Fa : ((B == X) ? Fb : Fc));
+    t[0] = f->norm[X] * ((A == X) ? F.Fa : ((B == X) ? F.Fb : F.Fc));
 
-    T1[A] += f->norm[A] * Faa;
-    T1[B] += f->norm[B] * Fbb;
-    T1[C] += f->norm[C] * Fcc;
-    T2[A] += f->norm[A] * Faaa;
-    T2[B] += f->norm[B] * Fbbb;
-    T2[C] += f->norm[C] * Fccc;
-    TP[A] += f->norm[A] * Faab;
-    TP[B] += f->norm[B] * Fbbc;
-    TP[C] += f->norm[C] * Fcca;
-  }
+    t[1+A] = f->norm[A] * F.Faa;
+    t[1+B] = f->norm[B] * F.Fbb;
+    t[1+C] = f->norm[C] * F.Fcc;
+    t[4+A] = f->norm[A] * F.Faaa;
+    t[4+B] = f->norm[B] * F.Fbbb;
+    t[4+C] = f->norm[C] * F.Fccc;
+    t[7+A] = f->norm[A] * F.Faab;
+    t[7+B] = f->norm[B] * F.Fbbc;
+    t[7+C] = f->norm[C] * F.Fcca;
 
-  T1[X] /= 2; T1[Y] /= 2; T1[Z] /= 2;
-  T2[X] /= 3; T2[Y] /= 3; T2[Z] /= 3;
-  TP[X] /= 2; TP[Y] /= 2; TP[Z] /= 2;
+    for (k = 0; k < 10; k++) addCompensated(&S->sum[k], &S->comp[k], t[k]);
+  }
 }
 
+/* add the compensated sums S to total */
+static void mergeSums(VOLUME_SUMS *total, const VOLUME_SUMS *S)
+{
+  int k;
+
+  for (k = 0; k < 10; k++) {
+    addCompensated(&total->sum[k], &total->comp[k], S->sum[k]);
+    total->comp[k] += S->comp[k];
+  }
+}
 
 /*
-   ============================================================================
-   main
-   ============================================================================
+   The faces are summed in blocks of FACE_BLOCK_SZ, and the block sums are
+   merged in order, so that the result is the same whether the blocks are
+   summed in parallel or not.
 */
-
-
-int main(int argc, char *argv[])
+static void sumVolumeIntegrals(const POLYHEDRON *p, VOLUME_INTEGRALS *T,
+			       int parallel)
 {
-  POLYHEDRON p;
-  double density, mass;
-  double r[3];            /* center of mass */
-  double J[3][3];         /* inertia tensor */
-
-  if (argc != 2) {
-    printf("usage:  %s <polyhedron geometry filename>\n", argv[0]);
-    exit(0);
+  VOLUME_SUMS total, S, *blocks = NULL;
+  int numBlocks = (p->numFaces + FACE_BLOCK_SZ - 1) / FACE_BLOCK_SZ;
+  int b;
+
+  memset(&total, 0, sizeof(total));
+  if (parallel && numBlocks > 1)
+    blocks = (VOLUME_SUMS *) calloc(numBlocks, sizeof(VOLUME_SUMS));
+
+  if (blocks) {
+#pragma omp parallel for schedule(dynamic)
+    for (b = 0; b < numBlocks; b++)
+      sumFaces(p, b * FACE_BLOCK_SZ,
+	       (b + 1 < numBlocks) ? (b + 1) * FACE_BLOCK_SZ : p->numFaces,
+	       &blocks[b]);
+    for (b = 0; b < numBlocks; b++) mergeSums(&total, &blocks[b]);
+    free(blocks);
+  }
+  else {
+    for (b = 0; b < numBlocks; b++) {
+      memset(&S, 0, sizeof(S));
+      sumFaces(p, b * FACE_BLOCK_SZ,
+	       (b + 1 < numBlocks) ? (b + 1) * FACE_BLOCK_SZ : p->numFaces,
+	       &S);
+      mergeSums(&total, &S);
+    }
   }
 
-  readPolyhedron(argv[1], &p);
+  T->T0 = total.sum[0] + total.comp[0];
+  for (b = 0; b < 3; b++) {
+    T->T1[b] = (total.sum[1+b] + total.comp[1+b]) / 2;
+    T->T2[b] = (total.sum[4+b] + total.comp[4+b]) / 3;
+    T->TP[b] = (total.sum[7+b] + total.comp[7+b]) / 2;
+  }
+}
 
-  compVolumeIntegrals(&p);
+void compVolumeIntegrals(const POLYHEDRON *p, VOLUME_INTEGRALS *T)
+{
+  sumVolumeIntegrals(p, T, 1);
+}
 
+void compVolumeIntegralsBatch(const POLYHEDRON *p, int numPolys,
+			      VOLUME_INTEGRALS *T)
+{
+  int i;
 
-  printf("\nT1 =   %+20.6f\n\n", T0);
+  for (i = 0; i < numPolys; i++)
+    if (p[i].numFaces >= PARALLEL_FACES) sumVolumeIntegrals(&p[i], &T[i], 1);
 
-  printf("Tx =   %+20.6f\n", T1[X]);
-  printf("Ty =   %+20.6f\n", T1[Y]);
-  printf("Tz =   %+20.6f\n\n", T1[Z]);
-  
-  printf("Txx =  %+20.6f\n", T2[X]);
-  printf("Tyy =  %+20.6f\n", T2[Y]);
-  printf("Tzz =  %+20.6f\n\n", T2[Z]);
+#pragma omp parallel for schedule(dynamic)
+  for (i = 0; i < numPolys; i++)
+    if (p[i].numFaces < PARALLEL_FACES) sumVolumeIntegrals(&p[i], &T[i], 0);
+}
 
-  printf("Txy =  %+20.6f\n", TP[X]);
-  printf("Tyz =  %+20.6f\n", TP[Y]);
-  printf("Tzx =  %+20.6f\n\n", TP[Z]);
+void compMassProperties(const VOLUME_INTEGRALS *T, double density,
+			MASS_PROPERTIES *mp)
+{
+  double mass, *r, (*J)[3];
 
-  density = 1.0;  /* assume unit density */
+  r = mp->r;
+  J = mp->J;
 
-  mass = density * T0;
+  mass = mp->mass = density * T->T0;
 
   /* compute center of mass */
-  r[X] = T1[X] / T0;
-  r[Y] = T1[Y] / T0;
-  r[Z] = T1[Z] / T0;
+  r[X] = T->T1[X] / T->T0;
+  r[Y] = T->T1[Y] / T->T0;
+  r[Z] = T->T1[Z] / T->T0;
 
   /* compute inertia tensor */
-  J[X][X] = density * (T2[Y] + T2[Z]);
-  J[Y][Y] = density * (T2[Z] + T2[X]);
-  J[Z][Z] = density * (T2[X] + T2[Y]);
-  J[X][Y] = J[Y][X] = - density * TP[X];
-  J[Y][Z] = J[Z][Y] = - density * TP[Y];
-  J[Z][X] = J[X][Z] = - density * TP[Z];
+  J[X][X] = density * (T->T2[Y] + T->T2[Z]);
+  J[Y][Y] = density * (T->T2[Z] + T->T2[X]);
+  J[Z][Z] = density * (T->T2[X] + T->T2[Y]);
+  J[X][Y] = J[Y][X] = - density * T->TP[X];
+  J[Y][Z] = J[Z][Y] = - density * T->TP[Y];
+  J[Z][X] = J[X][Z] = - density * T->TP[Z];
 
   /* translate inertia tensor to center of mass */
   J[X][X] -= mass * (r[Y]*r[Y] + r[Z]*r[Z]);
@@ -369,12 +487,4 @@ int main(int argc, char *argv[])
   J[X][Y] = J[Y][X] += mass * r[X] * r[Y]; 
   J[Y][Z] = J[Z][Y] += mass * r[Y] * r[Z]; 
   J[Z][X] = J[X][Z] += mass * r[Z] * r[X]; 
-
-  printf("center of mass:  (%+12.6f,%+12.6f,%+12.6f)\n\n", r[X], r[Y], r[Z]);
-
-  printf("inertia tensor with origin at c.o.m. :\n");
-  printf("%+15.6f  %+15.6f  %+15.6f\n", J[X][X], J[X][Y], J[X][Z]);
-  printf("%+15.6f  %+15.6f  %+15.6f\n", J[Y][X], J[Y][Y], J[Y][Z]);
-  printf("%+15.6f  %+15.6f  %+15.6f\n\n", J[Z][X], J[Z][Y], J[Z][Z]);
-  
 }
@@ -0,0 +1,116 @@
+
+	/*******************************************************
+        *                                                      *
+	*  volInt.h                                            *
+	*                                                      *
+	*  Library interface of volInt.c, which computes the   *
+	*  volume integrals needed for determining mass        *
+	*  properties of polyhedral bodies.                    *
+	*                                                      *
+	*  See the accompanying README file, and the paper     *
+	*                                                      *
+	*  Brian Mirtich, "Fast and Accurate Computation of    *
+	*  Polyhedral Mass Properties," journal of graphics    *
+	*  tools, volume 1, number 2, 1996.                    *
+	*                                                      *
+	*  This source code is public domain, and may be used  *
+	*  in any way, shape or form, free of charge.          *
+	*                                                      *
+	*******************************************************/
+
+#ifndef VOLINT_H
+#define VOLINT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+   ============================================================================
+   data structures
+   ============================================================================
+*/
+
+typedef struct {
+  int numVerts;
+  double norm[3];
+  double w;
+  int *verts;                 /* indices into the polyhedron's verts */
+} FACE;
+
+/*
+   The storage is sized to the polyhedron: the vertex indices of all faces
+   are stored one face after the other in faceVerts, which the faces'
+   verts point into.  The faces do not point back to the polyhedron, so
+   a POLYHEDRON may be copied (but not its arrays shared by two).
+*/
+typedef struct polyhedron {
+  int numVerts, numFaces;
+  double (*verts)[3];
+  FACE *faces;
+  int *faceVerts;
+} POLYHEDRON;
+
+/* the ten volume integrals */
+typedef struct {
+  double T0, T1[3], T2[3], TP[3];
+} VOLUME_INTEGRALS;
+
+typedef struct {
+  double mass;
+  double r[3];                /* center of mass */
+  double J[3][3];             /* inertia tensor with origin at c.o.m. */
+} MASS_PROPERTIES;
+
+/*
+   ============================================================================
+   polyhedra
+   ============================================================================
+*/
+
+/*
+   Build a polyhedron from numVerts vertices (x, y, z each) and numFaces
+   faces, where face i has faceSizes[i] vertices, whose indices follow those
+   of the previous faces in faceVerts.  The arrays are copied.  The vertices
+   of each face must be in counter-clockwise order when looking at the face
+   from outside the polyhedron.  Returns 0 on success, -1 if a face has
+   fewer than 3 vertices or a vertex index out of range, or if out of memory.
+*/
+int initPolyhedron(POLYHEDRON *p, int numVerts, const double *verts,
+		   int numFaces, const int *faceSizes, const int *faceVerts);
+
+/* read a polyhedron geometry file (see README), returns 0 on success */
+int readPolyhedron(const char *name, POLYHEDRON *p);
+
+void freePolyhedron(POLYHEDRON *p);
+
+/*
+   ============================================================================
+   mass properties
+   ============================================================================
+*/
+
+/*
+   Compute the volume integrals of a polyhedron.  The faces are summed in
+   parallel (with OpenMP) and with compensated summation; the result does
+   not depend on the number of threads.
+*/
+void compVolumeIntegrals(const POLYHEDRON *p, VOLUME_INTEGRALS *T);
+
+/*
+   Compute the volume integrals of numPolys polyhedra.  Small polyhedra are
+   processed concurrently, large ones one after the other, each with its
+   faces summed in parallel.
+*/
+void compVolumeIntegralsBatch(const POLYHEDRON *p, int numPolys,
+			      VOLUME_INTEGRALS *T);
+
+/* mass, center of mass and inertia tensor of a body of uniform density */
+void compMassProperties(const VOLUME_INTEGRALS *T, double density,
+			MASS_PROPERTIES *mp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
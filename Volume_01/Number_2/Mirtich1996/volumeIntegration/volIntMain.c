@@ -0,0 +1,113 @@
+
+	/*******************************************************
+        *                                                      *
+	*  volIntMain.c                                        *
+	*                                                      *
+	*  Reads polyhedron geometry files and prints their    *
+	*  volume integrals and mass properties, computed      *
+	*  with volInt.c.  See the accompanying README file.   *
+	*                                                      *
+	*  This source code is public domain, and may be used  *
+	*  in any way, shape or form, free of charge.          *
+	*                                                      *
+	*******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "volInt.h"
+
+#define X 0
+#define Y 1
+#define Z 2
+
+void printMassProperties(const POLYHEDRON *p, const VOLUME_INTEGRALS *T,
+			 const MASS_PROPERTIES *mp)
+{
+  const double *r = mp->r;
+  const double (*J)[3] = (const double (*)[3]) mp->J;
+
+  printf("Reading in %d vertices\n", p->numVerts);
+  printf("Reading in %d faces\n", p->numFaces);
+
+  printf("\nT1 =   %+20.6f\n\n", T->T0);
+
+  printf("Tx =   %+20.6f\n", T->T1[X]);
+  printf("Ty =   %+20.6f\n", T->T1[Y]);
+  printf("Tz =   %+20.6f\n\n", T->T1[Z]);
+
+  printf("Txx =  %+20.6f\n", T->T2[X]);
+  printf("Tyy =  %+20.6f\n", T->T2[Y]);
+  printf("Tzz =  %+20.6f\n\n", T->T2[Z]);
+
+  printf("Txy =  %+20.6f\n", T->TP[X]);
+  printf("Tyz =  %+20.6f\n", T->TP[Y]);
+  printf("Tzx =  %+20.6f\n\n", T->TP[Z]);
+
+  printf("center of mass:  (%+12.6f,%+12.6f,%+12.6f)\n\n", r[X], r[Y], r[Z]);
+
+  printf("inertia tensor with origin at c.o.m. :\n");
+  printf("%+15.6f  %+15.6f  %+15.6f\n", J[X][X], J[X][Y], J[X][Z]);
+  printf("%+15.6f  %+15.6f  %+15.6f\n", J[Y][X], J[Y][Y], J[Y][Z]);
+  printf("%+15.6f  %+15.6f  %+15.6f\n\n", J[Z][X], J[Z][Y], J[Z][Z]);
+}
+
+
+/*
+   ============================================================================
+   main
+   ============================================================================
+*/
+
+
+int main(int argc, char *argv[])
+{
+  POLYHEDRON *p;
+  VOLUME_INTEGRALS *T;
+  MASS_PROPERTIES mp;
+  int *status;
+  double density;
+  int i, numPolys, numRead;
+
+  if (argc < 2) {
+    printf("usage:  %s <polyhedron geometry filename> ...\n", argv[0]);
+    exit(0);
+  }
+
+  numPolys = argc - 1;
+  p = (POLYHEDRON *) malloc(numPolys * sizeof(POLYHEDRON));
+  T = (VOLUME_INTEGRALS *) malloc(numPolys * sizeof(VOLUME_INTEGRALS));
+  status = (int *) malloc(numPolys * sizeof(int));
+  if (!p || !T || !status) {
+    printf("out of memory\n");
+    exit(1);
+  }
+
+  /* read the files concurrently, then drop the ones that could not be read */
+#pragma omp parallel for schedule(dynamic)
+  for (i = 0; i < numPolys; i++) status[i] = readPolyhedron(argv[i + 1], &p[i]);
+
+  for (numRead = 0, i = 0; i < numPolys; i++) {
+    if (status[i]) {
+      printf("%s: i/o error\n", argv[i + 1]);
+      if (numPolys == 1) exit(1);
+    }
+    else p[numRead++] = p[i];
+  }
+
+  compVolumeIntegralsBatch(p, numRead, T);
+
+  density = 1.0;  /* assume unit density */
+
+  for (numRead = 0, i = 0; i < numPolys; i++) {
+    if (status[i]) continue;
+    compMassProperties(&T[numRead], density, &mp);
+    if (numPolys > 1) printf("%s:\n", argv[i + 1]);
+    printMassProperties(&p[numRead], &T[numRead], &mp);
+    freePolyhedron(&p[numRead++]);
+  }
+
+  free(status);
+  free(T);
+  free(p);
+  return 0;
+}
@@ -0,0 +1,356 @@
+/* ========== timing harness for shaft.c ========= */
+/*
+ * Culls a scene of clustered random boxes against random shafts in three
+ * ways, checks that they find the same boxes, and times them:
+ *   - each box with boxOutside
+ *   - the boxes 8 at a time with boxOutside8
+ *   - a bounding volume hierarchy of the boxes with cullHierarchy, then
+ *     the leaves found (8 boxes each) with boxOutside8
+ * and checks boxInside8 against boxInside. With OUTSIDE_ONLY (see shaft.h)
+ * the inside tests are not checked; with INSIDE_ONLY only they are checked,
+ * and nothing is timed.
+ *
+ *   shaftbench [numBoxes [numShafts]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <time.h>
+#include "shaft.h"
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+/* myrand() returns a float in the range [0..1) */
+#define myseedrand(x)	srand(x)
+#define myrand()	((double)rand()/((double)RAND_MAX+1.0))
+
+#define NUM_CLUSTERS	64
+
+static box *gBoxes ;		/* the scene */
+static int *gOrder ;		/* box indices, in the order of the leaves */
+static box8 *gLeafBoxes ;	/* the boxes of each leaf */
+static int *gLeafOf ;		/* leaf index of each hierarchy node, -1 if inner */
+static shaftNode *gNodes ;
+static int gNumNodes ;
+static int gNumLeaves ;
+
+/* random boxes in clusters in the unit cube */
+static void makeScene( int numBoxes )
+{
+	float center[NUM_CLUSTERS][3], size ;
+	int i, k, cl ;
+
+	for ( cl = 0 ; cl < NUM_CLUSTERS ; cl++ ) {
+		for ( k = 0 ; k < 3 ; k++ ) {
+			center[cl][k] = (float)myrand() ;
+		}
+	}
+	for ( i = 0 ; i < numBoxes ; i++ ) {
+		cl = (int)( myrand() * NUM_CLUSTERS ) ;
+		size = 0.002f + 0.01f * (float)myrand() ;
+		for ( k = 0 ; k < 3 ; k++ ) {
+			gBoxes[i].c[k] = center[cl][k] + 0.1f * (float)( myrand() - 0.5 ) ;
+			gBoxes[i].c[k+3] = gBoxes[i].c[k] + size ;
+		}
+	}
+}
+
+static int gSortAxis ;
+
+static int compareCenters( const void *i0, const void *i1 )
+{
+	box *b0 = &gBoxes[*(const int *)i0] ;
+	box *b1 = &gBoxes[*(const int *)i1] ;
+	float c0 = b0->c[gSortAxis] + b0->c[gSortAxis+3] ;
+	float c1 = b1->c[gSortAxis] + b1->c[gSortAxis+3] ;
+
+	return ( c0 < c1 ) ? -1 : ( c0 > c1 ) ? 1 : 0 ;
+}
+
+/* Builds the hierarchy of boxes gOrder[first..first+count-1], splitting at
+ * the median along the longest axis of their box until at most 8 are left.
+ * Returns the index of the node made.
+ */
+static int buildHierarchy( int first, int count )
+{
+	int n = gNumNodes++ ;
+	int i, k, half ;
+	box *bx = &gNodes[n].bx ;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		bx->c[k] = FLT_MAX ;
+		bx->c[k+3] = -FLT_MAX ;
+	}
+	for ( i = first ; i < first + count ; i++ ) {
+		for ( k = 0 ; k < 3 ; k++ ) {
+			if ( gBoxes[gOrder[i]].c[k] < bx->c[k] ) {
+				bx->c[k] = gBoxes[gOrder[i]].c[k] ;
+			}
+			if ( gBoxes[gOrder[i]].c[k+3] > bx->c[k+3] ) {
+				bx->c[k+3] = gBoxes[gOrder[i]].c[k+3] ;
+			}
+		}
+	}
+
+	if ( count <= 8 ) {
+		/* leaf: its boxes, padded with empty ones */
+		gNodes[n].secondChild = -1 ;
+		gLeafOf[n] = gNumLeaves ;
+		for ( i = 0 ; i < 8 ; i++ ) {
+			for ( k = 0 ; k < 3 ; k++ ) {
+				gLeafBoxes[gNumLeaves].c[k][i] =
+					( i < count ) ? gBoxes[gOrder[first+i]].c[k] : FLT_MAX ;
+				gLeafBoxes[gNumLeaves].c[k+3][i] =
+					( i < count ) ? gBoxes[gOrder[first+i]].c[k+3] : -FLT_MAX ;
+			}
+		}
+		gNumLeaves++ ;
+		return n ;
+	}
+
+	gSortAxis = X ;
+	for ( k = Y ; k <= Z ; k++ ) {
+		if ( bx->c[k+3] - bx->c[k] > bx->c[gSortAxis+3] - bx->c[gSortAxis] ) {
+			gSortAxis = k ;
+		}
+	}
+	qsort( gOrder + first, count, sizeof(int), compareCenters ) ;
+
+	/* keep the leaves full: split at a multiple of 8 */
+	half = ( ( count / 2 + 7 ) / 8 ) * 8 ;
+	gLeafOf[n] = -1 ;
+	buildHierarchy( first, half ) ;
+	gNodes[n].secondChild = buildHierarchy( first + half, count - half ) ;
+	return n ;
+}
+
+/* a random box in the unit cube for one end of a shaft */
+static void randomBox( box *bx, float maxSize )
+{
+	float size ;
+	int k ;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		size = maxSize * (float)myrand() ;
+		bx->c[k] = (float)myrand() * ( 1.0f - size ) ;
+		bx->c[k+3] = bx->c[k] + size ;
+	}
+}
+
+#ifndef INSIDE_ONLY
+static double seconds( void )
+{
+	return (double)clock() / CLOCKS_PER_SEC ;
+}
+
+/* The culling methods; each marks the boxes not outside the shaft in hit[]
+ * (indexed by position in gOrder), unless hit is NULL, and returns the
+ * number of them.
+ */
+static int cullBoxes( shaft *s, int numBoxes, char *hit )
+{
+	int i, n = 0 ;
+
+	for ( i = 0 ; i < numBoxes ; i++ ) {
+		if ( !boxOutside( &gBoxes[gOrder[i]], s ) ) {
+			if ( hit ) {
+				hit[i] = TRUE ;
+			}
+			n++ ;
+		}
+	}
+	return n ;
+}
+
+static int markLeaf( int leaf, int out, int numBoxes, char *hit )
+{
+	int k, n = 0 ;
+
+	for ( k = 0 ; k < 8 && leaf * 8 + k < numBoxes ; k++ ) {
+		if ( !( out & ( 1 << k ) ) ) {
+			if ( hit ) {
+				hit[leaf * 8 + k] = TRUE ;
+			}
+			n++ ;
+		}
+	}
+	return n ;
+}
+
+static int cullBoxes8( shaft *s, int numBoxes, char *hit )
+{
+	int leaf, n = 0 ;
+
+	for ( leaf = 0 ; leaf < gNumLeaves ; leaf++ ) {
+		n += markLeaf( leaf, boxOutside8( &gLeafBoxes[leaf], s ), numBoxes, hit ) ;
+	}
+	return n ;
+}
+
+static int cullTree( shaft *s, int numBoxes, int *leaves, char *inside, char *hit )
+{
+	int i, leaf, numFound, n = 0 ;
+
+	numFound = cullHierarchy( gNodes, s, leaves, inside, gNumLeaves ) ;
+	for ( i = 0 ; i < numFound ; i++ ) {
+		leaf = gLeafOf[leaves[i]] ;
+		/* the boxes of a leaf inside the shaft need not be tested */
+		n += markLeaf( leaf, inside[i] ? 0 : boxOutside8( &gLeafBoxes[leaf], s ),
+			numBoxes, hit ) ;
+	}
+	return n ;
+}
+#endif
+
+#ifndef OUTSIDE_ONLY
+/* Checks boxInside8 against boxInside, and that the boxes of the leaves
+ * cullHierarchy found to be inside the shaft are.
+ */
+static int checkInside( shaft *s, int numBoxes, int *leaves, char *inside,
+	int numFound )
+{
+	int leaf, i, k, in ;
+
+	for ( leaf = 0 ; leaf < gNumLeaves ; leaf++ ) {
+		in = boxInside8( &gLeafBoxes[leaf], s ) ;
+		for ( k = 0 ; k < 8 && leaf * 8 + k < numBoxes ; k++ ) {
+			if ( !( in & ( 1 << k ) ) != !boxInside( &gBoxes[gOrder[leaf * 8 + k]], s ) ) {
+				return FALSE ;
+			}
+		}
+	}
+	for ( i = 0 ; i < numFound ; i++ ) {
+		leaf = gLeafOf[leaves[i]] ;
+		for ( k = 0 ; k < 8 && leaf * 8 + k < numBoxes ; k++ ) {
+			if ( inside[i] && !boxInside( &gBoxes[gOrder[leaf * 8 + k]], s ) ) {
+				return FALSE ;
+			}
+		}
+	}
+	return TRUE ;
+}
+#endif
+
+int main( int argc, char *argv[] )
+{
+	int numBoxes = ( argc > 1 ) ? atoi( argv[1] ) : 100000 ;
+	int numShafts = ( argc > 2 ) ? atoi( argv[2] ) : 1000 ;
+	shaft *shafts ;
+	box box0, box1 ;
+	char *hit[3], *inside ;
+	int *leaves ;
+	int i, m, bad = 0 ;
+#ifndef OUTSIDE_ONLY
+	int numFound ;
+#endif
+#ifndef INSIDE_ONLY
+	int j, n[3], total[3] ;
+	double t[3] ;
+	static const char *name[3] = {
+		"boxOutside       ",
+		"boxOutside8      ",
+		"cullHierarchy    " } ;
+#endif
+
+	/* leaves are full except the last, so the boxes are in leaf order */
+	numBoxes = ( numBoxes < 8 ) ? 8 : numBoxes ;
+	gBoxes = (box *)malloc( numBoxes * sizeof(box) ) ;
+	gOrder = (int *)malloc( numBoxes * sizeof(int) ) ;
+	gLeafBoxes = (box8 *)malloc( ( numBoxes / 8 + 1 ) * sizeof(box8) ) ;
+	gNodes = (shaftNode *)malloc( 2 * ( numBoxes / 8 + 1 ) * sizeof(shaftNode) ) ;
+	gLeafOf = (int *)malloc( 2 * ( numBoxes / 8 + 1 ) * sizeof(int) ) ;
+	leaves = (int *)malloc( ( numBoxes / 8 + 1 ) * sizeof(int) ) ;
+	inside = (char *)malloc( numBoxes / 8 + 1 ) ;
+	shafts = (shaft *)malloc( numShafts * sizeof(shaft) ) ;
+	for ( m = 0 ; m < 3 ; m++ ) {
+		hit[m] = (char *)malloc( numBoxes ) ;
+	}
+
+	myseedrand( 12345 ) ;
+	makeScene( numBoxes ) ;
+	for ( i = 0 ; i < numBoxes ; i++ ) {
+		gOrder[i] = i ;
+	}
+	buildHierarchy( 0, numBoxes ) ;
+	printf( "%d boxes, %d leaves, %d nodes, %d shafts\n",
+		numBoxes, gNumLeaves, gNumNodes, numShafts ) ;
+
+	for ( i = 0 ; i < numShafts ; i++ ) {
+		randomBox( &box0, 0.2f ) ;
+		randomBox( &box1, 0.2f ) ;
+		initShaft( &shafts[i], &box0, &box1 ) ;
+	}
+
+	/* check that the methods find the same boxes */
+	for ( i = 0 ; i < numShafts ; i++ ) {
+#ifndef INSIDE_ONLY
+		for ( m = 0 ; m < 3 ; m++ ) {
+			for ( j = 0 ; j < numBoxes ; j++ ) {
+				hit[m][j] = FALSE ;
+			}
+		}
+		n[0] = cullBoxes( &shafts[i], numBoxes, hit[0] ) ;
+		n[1] = cullBoxes8( &shafts[i], numBoxes, hit[1] ) ;
+		n[2] = cullTree( &shafts[i], numBoxes, leaves, inside, hit[2] ) ;
+		for ( j = 0 ; j < numBoxes ; j++ ) {
+			if ( hit[1][j] != hit[0][j] || hit[2][j] != hit[0][j] ) {
+				break ;
+			}
+		}
+		if ( j < numBoxes || n[1] != n[0] || n[2] != n[0] ) {
+			bad++ ;
+			continue ;
+		}
+#endif
+#ifndef OUTSIDE_ONLY
+		numFound = 0 ;
+#ifndef INSIDE_ONLY
+		numFound = cullHierarchy( gNodes, &shafts[i], leaves, inside, gNumLeaves ) ;
+#endif
+		if ( !checkInside( &shafts[i], numBoxes, leaves, inside, numFound ) ) {
+			bad++ ;
+		}
+#endif
+	}
+	printf( "shafts with different results: %d\n", bad ) ;
+
+#ifndef INSIDE_ONLY
+	for ( m = 0 ; m < 3 ; m++ ) {
+		total[m] = 0 ;
+		t[m] = seconds() ;
+		for ( i = 0 ; i < numShafts ; i++ ) {
+			switch ( m ) {
+			case 0:
+				total[m] += cullBoxes( &shafts[i], numBoxes, NULL ) ;
+				break ;
+			case 1:
+				total[m] += cullBoxes8( &shafts[i], numBoxes, NULL ) ;
+				break ;
+			case 2:
+				total[m] += cullTree( &shafts[i], numBoxes, leaves, inside, NULL ) ;
+				break ;
+			}
+		}
+		t[m] = seconds() - t[m] ;
+		printf( "%s %8.4f s  %6.1f Mboxes/s  %d boxes found\n", name[m], t[m],
+			t[m] > 0.0 ? (double)numBoxes * numShafts / t[m] * 1e-6 : 0.0, total[m] ) ;
+	}
+#endif
+
+	for ( m = 0 ; m < 3 ; m++ ) {
+		free( hit[m] ) ;
+	}
+	free( shafts ) ;
+	free( inside ) ;
+	free( leaves ) ;
+	free( gLeafOf ) ;
+	free( gNodes ) ;
+	free( gLeafBoxes ) ;
+	free( gOrder ) ;
+	free( gBoxes ) ;
+	return bad ? 1 : 0 ;
+}
@@ -17,32 +17,30 @@ void dumpBox( char *str, box *b )
 	printf( "hi: %g   %g   %g\n",b->c[HI_X],b->c[HI_Y],b->c[HI_Z] ) ;
 }
 
-void dumpPlaneSet( char *str, planeRec *pr )
+void dumpPlaneSet( char *str, shaft *s, int i )
 {
 	printf( "%s\n", str ) ;
-	printf( "a: %g,  b: %g,  c: %g,  d: %g\n", pr->a, pr->b, pr->c, pr->d ) ;
+	printf( "a: %g,  b: %g,  c: %g,  d: %g\n", s->a[i], s->b[i], s->c[i], s->d[i] ) ;
 #ifndef INSIDE_ONLY
-	printf( "nearCorner: %d %d %d\n", pr->nearCorner[X], pr->nearCorner[Y], pr->nearCorner[Z] ) ;
+	printf( "nearCorner: %d %d %d\n", SHAFT_CORNER( s->nearCorner[X], i, X ),
+		SHAFT_CORNER( s->nearCorner[Y], i, Y ), SHAFT_CORNER( s->nearCorner[Z], i, Z ) ) ;
 #endif
 #ifndef OUTSIDE_ONLY
-	printf( "farCorner:  %d %d %d\n", pr->farCorner[X], pr->farCorner[Y], pr->farCorner[Z] ) ;
+	printf( "farCorner:  %d %d %d\n", SHAFT_CORNER( s->farCorner[X], i, X ),
+		SHAFT_CORNER( s->farCorner[Y], i, Y ), SHAFT_CORNER( s->farCorner[Z], i, Z ) ) ;
 #endif
 }
 
 void dumpShaft( char *str, shaft *s )
 {
-	planeRec *pr ;
 	char plane_no[256] ;
-	int i = 0 ;
+	int i ;
 
 	printf( "\n%s\n", str ) ;
 	dumpBox( "box", &s->bx ) ;
-	pr = s->planeSet ;
-	while ( pr ) {
+	for ( i = 0 ; i < s->numPlanes ; i++ ) {
 		sprintf( plane_no, "plane %d: ", i ) ;
-		dumpPlaneSet( plane_no, pr ) ;
-		i++ ;
-		pr = pr->next ;
+		dumpPlaneSet( plane_no, s, i ) ;
 	}
 }
 
@@ -9,6 +9,10 @@
 #include <stdio.h>
 #include <malloc.h>
 #include <math.h>
+#include <float.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "shaft.h"
 
@@ -57,73 +61,131 @@ typedef struct {
 } boxI ;
 
 
-/* Ax + By + Cz = D */
-void addPlaneToShaft( float a, float b, float c, float d, shaft *s )
+/* Set the corner bits of plane i of the shaft from its normal */
+static void setPlaneCorners( shaft *s, int i )
 {
-	/* possible efficiency: the planeRecs could be allocated once
-	 * for the shaft structure, i.e. always have a set of 8 or 10
-	 * planes for a given shaft and keep track of the number
-	 * currently in use. This saves on allocs and may help caching.
-	 * That said, in one set of tests by Martin Blais the savings
-	 * amounted to a 1% speedup on a MIPS, so...
-	 */
-	planeRec *pr = (planeRec *)malloc( sizeof(planeRec) ) ;
-	STATS(gNumPlanesMade++;)
-	pr->next = s->planeSet ;
-	s->planeSet = pr ;
+	unsigned int bit = 1u << i ;
 
-	pr->a = a ;
-	pr->b = b ;
-	pr->c = c ;
-	pr->d = d ;
-
-	/* If the plane is pointing in the -X direction, set the
-	 * index of nearCorner[0] = 0 (the lo[0] coord location),
-	 * else set nearCorner[0] = 3 (the hi[0] coord location in union).
+	/* If the plane is pointing in the -X direction, clear
+	 * bit i of nearCorner[X] (the lo[0] coord location),
+	 * else set it (the hi[0] coord location in union).
 	 * Do for Y and Z also.
 	 */
 
 /* see shaft.h for information on these defines */
 #ifndef INSIDE_ONLY
-	pr->nearCorner[X] = ( a >= 0.0f ) ? LO_X : HI_X ;
-	pr->nearCorner[Y] = ( b >= 0.0f ) ? LO_Y : HI_Y ;
-	pr->nearCorner[Z] = ( c >= 0.0f ) ? LO_Z : HI_Z ;
+	s->nearCorner[X] = ( s->a[i] >= 0.0f ) ? s->nearCorner[X] & ~bit : s->nearCorner[X] | bit ;
+	s->nearCorner[Y] = ( s->b[i] >= 0.0f ) ? s->nearCorner[Y] & ~bit : s->nearCorner[Y] | bit ;
+	s->nearCorner[Z] = ( s->c[i] >= 0.0f ) ? s->nearCorner[Z] & ~bit : s->nearCorner[Z] | bit ;
 #endif
-	
+
+	/* The far corner is the opposite one, so farCorner could also be
+	 * computed as ~nearCorner when using both inside and outside testing. */
 #ifndef OUTSIDE_ONLY
-	pr->farCorner[X] = ( a < 0.0f ) ? LO_X : HI_X ;
-	pr->farCorner[Y] = ( b < 0.0f ) ? LO_Y : HI_Y ;
-	pr->farCorner[Z] = ( c < 0.0f ) ? LO_Z : HI_Z ;
-
-	/* An alternative when using both inside and outside testing:
-	 * doing "+3)%6" changes LO_X to HI_X or vice versa, etc.
-	 * This may be a little more efficient, as it avoids branches. */
-	/*
-	 * pr->farCorner[X] = (pr->nearCorner[X]+3)%6 ;
-	 * pr->farCorner[Y] = (pr->nearCorner[Y]+3)%6 ;
-	 * pr->farCorner[Z] = (pr->nearCorner[Z]+3)%6 ;
+	s->farCorner[X] = ( s->a[i] < 0.0f ) ? s->farCorner[X] & ~bit : s->farCorner[X] | bit ;
+	s->farCorner[Y] = ( s->b[i] < 0.0f ) ? s->farCorner[Y] & ~bit : s->farCorner[Y] | bit ;
+	s->farCorner[Z] = ( s->c[i] < 0.0f ) ? s->farCorner[Z] & ~bit : s->farCorner[Z] | bit ;
+#endif
+}
+
+/* Ax + By + Cz = D */
+int addPlaneToShaft( float a, float b, float c, float d, shaft *s )
+{
+	int i = s->numPlanes ;
+
+	/* The planes are stored in fixed size arrays in the shaft, so
+	 * forming a shaft allocates nothing and testing a box reads the
+	 * planes from one block of memory (in one set of tests by Martin
+	 * Blais, allocating planes once for a shaft instead of one at a
+	 * time gave only a 1% speedup on a MIPS, but the arrays are also
+	 * what lets the planes be tested 8 at a time).
 	 */
+	if ( i >= MAX_SHAFT_PLANES ) {
+		return FALSE ;
+	}
+	STATS(gNumPlanesMade++;)
+	s->numPlanes++ ;
+
+	s->a[i] = a ;
+	s->b[i] = b ;
+	s->c[i] = c ;
+	s->d[i] = d ;
+	setPlaneCorners( s, i ) ;
+	return TRUE ;
+}
+
+
+#ifdef __AVX2__
+/* lane i is hi if bit i of bits is set, else lo */
+static __m256 selectCorner( float lo, float hi, unsigned int bits )
+{
+	const __m256i sel = _mm256_setr_epi32( 1, 2, 4, 8, 16, 32, 64, 128 ) ;
+	__m256i set = _mm256_cmpeq_epi32(
+		_mm256_and_si256( _mm256_set1_epi32( (int)bits ), sel ), sel ) ;
+
+	return _mm256_blendv_ps( _mm256_set1_ps( lo ), _mm256_set1_ps( hi ),
+		_mm256_castsi256_ps( set ) ) ;
+}
+
+/* Test the corner of box c given by the corner bitmasks against planes
+ * first..first+7 of the shaft; bit i of the result is set if the corner is
+ * outside plane first+i. The products are summed in the same order as in
+ * the one plane at a time tests, so the results are the same. */
+static int planesOutside( float *c, shaft *s, int first, unsigned int corner[3] )
+{
+	__m256 x = selectCorner( c[LO_X], c[HI_X], corner[X] >> first ) ;
+	__m256 y = selectCorner( c[LO_Y], c[HI_Y], corner[Y] >> first ) ;
+	__m256 z = selectCorner( c[LO_Z], c[HI_Z], corner[Z] >> first ) ;
+	__m256 dot = _mm256_add_ps( _mm256_add_ps(
+		_mm256_mul_ps( x, _mm256_loadu_ps( s->a + first ) ),
+		_mm256_mul_ps( y, _mm256_loadu_ps( s->b + first ) ) ),
+		_mm256_mul_ps( z, _mm256_loadu_ps( s->c + first ) ) ) ;
+
+	return _mm256_movemask_ps( _mm256_cmp_ps( dot, _mm256_loadu_ps( s->d + first ),
+		_CMP_GT_OQ ) ) ;
+}
+
+/* the corner of the 8 boxes of c given by the corner bitmasks of plane i,
+ * tested against it; bit k of the result is set if the corner of box k is
+ * outside the plane */
+static int boxesOutsidePlane( __m256 c[6], shaft *s, int i, unsigned int corner[3] )
+{
+	__m256 dot = _mm256_add_ps( _mm256_add_ps(
+		_mm256_mul_ps( c[SHAFT_CORNER( corner[X], i, X )], _mm256_set1_ps( s->a[i] ) ),
+		_mm256_mul_ps( c[SHAFT_CORNER( corner[Y], i, Y )], _mm256_set1_ps( s->b[i] ) ) ),
+		_mm256_mul_ps( c[SHAFT_CORNER( corner[Z], i, Z )], _mm256_set1_ps( s->c[i] ) ) ) ;
+
+	return _mm256_movemask_ps( _mm256_cmp_ps( dot, _mm256_set1_ps( s->d[i] ),
+		_CMP_GT_OQ ) ) ;
+}
 #endif
+
+#if defined(GATHER_STATISTICS) && defined(__AVX2__)
+static int bitCount( unsigned int bits )
+{
+	int n = 0 ;
+
+	while ( bits ) {
+		bits &= bits - 1 ;
+		n++ ;
+	}
+	return n ;
 }
+#endif
 
 #ifdef PLANE_SORTING
-typedef struct {
-	planeRec *pr ;
-	float cost ;
-} planeSortRec ;
-
-static float planeValue( shaft *s, planeRec *pr )
+static float planeValue( shaft *s, int i )
 {
 	float val ;
 
 	/* normalizes plane, which should not affect anything */
 #ifndef INCLUDE_SPHERE_TESTING
-	float len = (float)sqrt(pr->a*pr->a + pr->b*pr->b + pr->c*pr->c);
+	float len = (float)sqrt(s->a[i]*s->a[i] + s->b[i]*s->b[i] + s->c[i]*s->c[i]);
 	len = 1.0f / len ;
-	pr->a *= len ;
-	pr->b *= len ;
-	pr->c *= len ;
-	pr->d *= len ;
+	s->a[i] *= len ;
+	s->b[i] *= len ;
+	s->c[i] *= len ;
+	s->d[i] *= len ;
 #endif
 
 	/* note that far_corner needs to exist in the record to compute this value */
@@ -131,17 +193,17 @@ static float planeValue( shaft *s, planeRec *pr )
 	 * equation; this is the distance to this corner. Squaring it and dividing by
 	 * a*b (or b*c or a*c) gives 2x the area of the triangle cut off the square.
 	 */
-	val = pr->a * s->bx.c[pr->farCorner[X]] +
-		  pr->b * s->bx.c[pr->farCorner[Y]] +
-		  pr->c * s->bx.c[pr->farCorner[Z]] - pr->d ;
+	val = s->a[i] * s->bx.c[SHAFT_CORNER( s->farCorner[X], i, X )] +
+		  s->b[i] * s->bx.c[SHAFT_CORNER( s->farCorner[Y], i, Y )] +
+		  s->c[i] * s->bx.c[SHAFT_CORNER( s->farCorner[Z], i, Z )] - s->d[i] ;
 
 	val *= val ;
-	if ( pr->a == 0.0f ) {
-		val /= (pr->b * pr->c ) ;
-	} else if ( pr->b == 0.0f ) {
-		val /= (pr->a * pr->c ) ;
+	if ( s->a[i] == 0.0f ) {
+		val /= (s->b[i] * s->c[i] ) ;
+	} else if ( s->b[i] == 0.0f ) {
+		val /= (s->a[i] * s->c[i] ) ;
 	} else {
-		val /= (pr->a * pr->b ) ;
+		val /= (s->a[i] * s->b[i] ) ;
 	}
 	if ( val < 0.0f ) {
 		val = -val ;
@@ -174,10 +236,9 @@ static float planeValue( shaft *s, planeRec *pr )
  */
 static void	sortPlanes( shaft *s )
 {
-	int np = 0 ;
-	planeRec *pr ;
-	planeSortRec plns[24] ;	/* there can be up to 8 planes, but just in case more are added */
-	int sortList[24], temp, i, sorted ;
+	int np = s->numPlanes ;
+	float cost[MAX_SHAFT_PLANES], pln[4][MAX_SHAFT_PLANES] ;
+	int sortList[MAX_SHAFT_PLANES], temp, i, sorted ;
 
 #ifdef GATHER_STATISTICS
 	if ( gInitHisto ) {
@@ -188,32 +249,22 @@ static void	sortPlanes( shaft *s )
 	}
 #endif
 
-	pr = s->planeSet ;
 	/* check if 0 or 1 planes on list */
-	if ( pr == NULL || pr->next == NULL ) {
-#ifdef GATHER_STATISTICS
-		if ( pr == NULL ) {
-			gHisto[0]++ ;
-		} else {
-			gHisto[1]++ ;
-		}
-#endif
+	if ( np <= 1 ) {
+		STATS( gHisto[np]++ ;)
 		return ;
 	}
 
-	while ( pr ) {
-		plns[np].pr = pr ;
-		plns[np].cost = planeValue( s, pr ) ;
-		sortList[np] = np ;
-		np++ ;
-		pr = pr->next ;
+	for ( i = 0 ; i < np ; i++ ) {
+		cost[i] = planeValue( s, i ) ;
+		sortList[i] = i ;
 	}
 	STATS( gHisto[np]++ ;)
 
 	do {
 		sorted = TRUE ;
 		for ( i = 0 ; i < np-1 ; i++ ) {
-			if ( plns[sortList[i]].cost < plns[sortList[i+1]].cost ) {
+			if ( cost[sortList[i]] < cost[sortList[i+1]] ) {
 				/* swap */
 				temp = sortList[i+1] ;
 				sortList[i+1] = sortList[i] ;
@@ -223,15 +274,40 @@ static void	sortPlanes( shaft *s )
 		}
 	} while ( !sorted ) ;
 
-	pr = s->planeSet = plns[sortList[0]].pr ;
-	for ( i = 1 ; i < np ; i++ ) {
-		pr->next = plns[sortList[i]].pr ;
-		pr = pr->next ;
+	for ( i = 0 ; i < np ; i++ ) {
+		pln[0][i] = s->a[sortList[i]] ;
+		pln[1][i] = s->b[sortList[i]] ;
+		pln[2][i] = s->c[sortList[i]] ;
+		pln[3][i] = s->d[sortList[i]] ;
+	}
+	for ( i = 0 ; i < np ; i++ ) {
+		s->a[i] = pln[0][i] ;
+		s->b[i] = pln[1][i] ;
+		s->c[i] = pln[2][i] ;
+		s->d[i] = pln[3][i] ;
+		setPlaneCorners( s, i ) ;
 	}
-	pr->next = NULL ;
 }
 #endif
 	
+/* Empty the shaft's plane arrays: all planes cull nothing */
+static void clearPlanes( shaft *s )
+{
+	int i ;
+
+	s->numPlanes = 0 ;
+	for ( i = 0 ; i < MAX_SHAFT_PLANES ; i++ ) {
+		s->a[i] = s->b[i] = s->c[i] = 0.0f ;
+		s->d[i] = FLT_MAX ;
+	}
+#ifndef INSIDE_ONLY
+	s->nearCorner[X] = s->nearCorner[Y] = s->nearCorner[Z] = 0 ;
+#endif
+#ifndef OUTSIDE_ONLY
+	s->farCorner[X] = s->farCorner[Y] = s->farCorner[Z] = 0 ;
+#endif
+}
+
 /* Pass in two boxes, create a shaft between them */
 /* A shaft is formed by a set of planes connecting two boxes.
  * The shaft itself has a bounding box, formed by the union of
@@ -249,7 +325,14 @@ static void	sortPlanes( shaft *s )
  */
 shaft * formShaft( box *box0, box *box1 )
 {
+	shaft *s = (shaft *)malloc( sizeof(shaft) ) ;
+
+	initShaft( s, box0, box1 ) ;
+	return s ;
+}
 
+void initShaft( shaft *s, box *box0, box *box1 )
+{
 
 #ifdef INCLUDE_SPHERE_TESTING
 	float len ;
@@ -285,9 +368,8 @@ shaft * formShaft( box *box0, box *box1 )
 	intPair *ip ;
 	int pairIndex ;
 
-	shaft *s = (shaft *)malloc( sizeof(shaft) ) ;
 	STATS(gNumShaft++;)
-	s->planeSet = NULL ;
+	clearPlanes( s ) ;
 
 	pairIndex = 0 ;
 
@@ -361,9 +443,8 @@ shaft * formShaft( box *box0, box *box1 )
 
 	boxI match, faceTally ;
 
-	shaft *s = (shaft *)malloc( sizeof(shaft) ) ;
 	STATS(gNumShaft++;)
-	s->planeSet = NULL ;
+	clearPlanes( s ) ;
 
 	/* Store union of the two bounding boxes in the shaft's box structure.
 	 * Also set up "match", which tells whether two box coordinates are
@@ -505,14 +586,12 @@ shaft * formShaft( box *box0, box *box1 )
 #ifdef PLANE_SORTING
 	sortPlanes( s ) ;
 #endif
-
-	return s ;
 }
 
 #ifndef INSIDE_ONLY
 int boxOutside( box *box, shaft *s )
 {
-	planeRec *pr ;
+	int i ;
 
 	/* first test if box does not overlap shaft's box */
 	if ( box->c[LO_X] > s->bx.c[HI_X] ||
@@ -530,24 +609,189 @@ int boxOutside( box *box, shaft *s )
 	 * the box must be fully outside the plane and so the box is
 	 * outside the shaft.
 	 */
-	pr = s->planeSet ;
-	while ( pr ) {
+#ifdef __AVX2__
+	/* 8 planes at a time */
+	for ( i = 0 ; i < s->numPlanes ; i += 8 ) {
+		STATS(gNumOutPlanesTested += ( s->numPlanes - i < 8 ) ? s->numPlanes - i : 8 ;)
+		if ( planesOutside( box->c, s, i, s->nearCorner ) ) {
+			return TRUE ;
+		}
+	}
+#else
+	for ( i = 0 ; i < s->numPlanes ; i++ ) {
 		STATS(gNumOutPlanesTested++;)
-		if ( box->c[pr->nearCorner[X]] * pr->a +
-			 box->c[pr->nearCorner[Y]] * pr->b +
-			 box->c[pr->nearCorner[Z]] * pr->c > pr->d ) {
+		if ( box->c[SHAFT_CORNER( s->nearCorner[X], i, X )] * s->a[i] +
+			 box->c[SHAFT_CORNER( s->nearCorner[Y], i, Y )] * s->b[i] +
+			 box->c[SHAFT_CORNER( s->nearCorner[Z], i, Z )] * s->c[i] > s->d[i] ) {
 			return TRUE ;
 		}
-		pr = pr->next ;
 	}
+#endif
 	return FALSE ;
 }
+
+/* bit k of the result is set if box k is outside the shaft */
+int boxOutside8( box8 *boxes, shaft *s )
+{
+#ifdef __AVX2__
+	__m256 c[6] ;
+	int i, out ;
+
+	for ( i = 0 ; i < 6 ; i++ ) {
+		c[i] = _mm256_loadu_ps( boxes->c[i] ) ;
+	}
+
+	/* first test if boxes do not overlap shaft's box */
+	out = _mm256_movemask_ps( _mm256_or_ps( _mm256_or_ps( _mm256_or_ps(
+		_mm256_cmp_ps( c[LO_X], _mm256_set1_ps( s->bx.c[HI_X] ), _CMP_GT_OQ ),
+		_mm256_cmp_ps( c[LO_Y], _mm256_set1_ps( s->bx.c[HI_Y] ), _CMP_GT_OQ ) ),
+		_mm256_or_ps(
+		_mm256_cmp_ps( c[LO_Z], _mm256_set1_ps( s->bx.c[HI_Z] ), _CMP_GT_OQ ),
+		_mm256_cmp_ps( c[HI_X], _mm256_set1_ps( s->bx.c[LO_X] ), _CMP_LT_OQ ) ) ),
+		_mm256_or_ps(
+		_mm256_cmp_ps( c[HI_Y], _mm256_set1_ps( s->bx.c[LO_Y] ), _CMP_LT_OQ ),
+		_mm256_cmp_ps( c[HI_Z], _mm256_set1_ps( s->bx.c[LO_Z] ), _CMP_LT_OQ ) ) ) ) ;
+	STATS(gNumOutShaftsTested += bitCount( ~out & 0xff ) ;)
+
+	/* then each plane against the boxes not yet known to be outside */
+	for ( i = 0 ; i < s->numPlanes && out != 0xff ; i++ ) {
+		STATS(gNumOutPlanesTested += bitCount( ~out & 0xff ) ;)
+		out |= boxesOutsidePlane( c, s, i, s->nearCorner ) ;
+	}
+	return out ;
+#else
+	box bx ;
+	int i, k, out = 0 ;
+
+	for ( k = 0 ; k < 8 ; k++ ) {
+		for ( i = 0 ; i < 6 ; i++ ) {
+			bx.c[i] = boxes->c[i][k] ;
+		}
+		if ( boxOutside( &bx, s ) ) {
+			out |= 1 << k ;
+		}
+	}
+	return out ;
+#endif
+}
+
+/* Cull a bounding volume hierarchy against the shaft, depth first. Each node
+ * is tested against the faces of the shaft box and the planes which its
+ * parent is not fully inside of; those it is fully inside of are not tested
+ * against its children. A leaf which has no faces or planes left to test is
+ * fully inside the shaft.
+ */
+int cullHierarchy( shaftNode *nodes, shaft *s, int *leaves, char *inside,
+	int maxLeaves )
+{
+	struct {
+		int node ;
+		unsigned int planes ;	/* bit i set: plane i to be tested */
+		unsigned int faces ;	/* bit i set: shaft box coordinate i to be tested */
+	} stack[MAX_SHAFT_DEPTH] ;
+	unsigned int farCorner[3], planes, faces ;
+	int sp, n, i, numLeaves = 0, outside ;
+	float *c ;
+
+	/* the far corner of a box for a plane is the opposite of the near one */
+	farCorner[X] = ~s->nearCorner[X] ;
+	farCorner[Y] = ~s->nearCorner[Y] ;
+	farCorner[Z] = ~s->nearCorner[Z] ;
+
+	stack[0].node = 0 ;
+	stack[0].planes = ( 1u << s->numPlanes ) - 1 ;
+	stack[0].faces = 0x3f ;
+	sp = 1 ;
+
+	while ( sp > 0 ) {
+		sp-- ;
+		n = stack[sp].node ;
+		planes = stack[sp].planes ;
+		faces = stack[sp].faces ;
+		c = nodes[n].bx.c ;
+		outside = FALSE ;
+
+		/* test if node does not overlap shaft's box, and drop the faces
+		 * the node is inside of */
+		for ( i = LO_X ; i <= LO_Z ; i++ ) {
+			if ( faces & ( 1u << i ) ) {
+				outside |= ( c[i+3] < s->bx.c[i] ) ;
+				if ( c[i] >= s->bx.c[i] ) {
+					faces &= ~( 1u << i ) ;
+				}
+			}
+		}
+		for ( i = HI_X ; i <= HI_Z ; i++ ) {
+			if ( faces & ( 1u << i ) ) {
+				outside |= ( c[i-3] > s->bx.c[i] ) ;
+				if ( c[i] <= s->bx.c[i] ) {
+					faces &= ~( 1u << i ) ;
+				}
+			}
+		}
+		if ( outside ) {
+			continue ;
+		}
+		STATS(gNumOutShaftsTested++;)
+
+		/* test the node against the planes, dropping those it is inside of */
+#ifdef __AVX2__
+		for ( i = 0 ; i < s->numPlanes && !outside ; i += 8 ) {
+			if ( ( planes >> i ) & 0xff ) {
+				STATS(gNumOutPlanesTested += bitCount( ( planes >> i ) & 0xff ) ;)
+				outside = planesOutside( c, s, i, s->nearCorner ) & ( planes >> i ) ;
+				planes &= ~( ~(unsigned int)planesOutside( c, s, i, farCorner ) & 0xffu ) << i ;
+			}
+		}
+#else
+		for ( i = 0 ; i < s->numPlanes && !outside ; i++ ) {
+			if ( planes & ( 1u << i ) ) {
+				STATS(gNumOutPlanesTested++;)
+				outside = ( c[SHAFT_CORNER( s->nearCorner[X], i, X )] * s->a[i] +
+							c[SHAFT_CORNER( s->nearCorner[Y], i, Y )] * s->b[i] +
+							c[SHAFT_CORNER( s->nearCorner[Z], i, Z )] * s->c[i] > s->d[i] ) ;
+				if ( !( c[SHAFT_CORNER( farCorner[X], i, X )] * s->a[i] +
+						c[SHAFT_CORNER( farCorner[Y], i, Y )] * s->b[i] +
+						c[SHAFT_CORNER( farCorner[Z], i, Z )] * s->c[i] > s->d[i] ) ) {
+					planes &= ~( 1u << i ) ;
+				}
+			}
+		}
+#endif
+		if ( outside ) {
+			continue ;
+		}
+
+		if ( nodes[n].secondChild < 0 ) {
+			if ( numLeaves < maxLeaves ) {
+				leaves[numLeaves] = n ;
+				if ( inside ) {
+					inside[numLeaves] = ( planes == 0 && faces == 0 ) ;
+				}
+			}
+			numLeaves++ ;
+		} else {
+			if ( sp + 2 > MAX_SHAFT_DEPTH ) {
+				return -1 ;
+			}
+			/* the first child, which follows the node, is tested next */
+			stack[sp].node = nodes[n].secondChild ;
+			stack[sp].planes = planes ;
+			stack[sp].faces = faces ;
+			stack[sp+1].node = n + 1 ;
+			stack[sp+1].planes = planes ;
+			stack[sp+1].faces = faces ;
+			sp += 2 ;
+		}
+	}
+	return numLeaves ;
+}
 #endif
 
 #ifndef OUTSIDE_ONLY
 int boxInside( box *box, shaft *s )
 {
-	planeRec *pr ;
+	int i ;
 
 	/* first test if box is fully inside shaft box */
 	if ( box->c[LO_X] < s->bx.c[LO_X] ||
@@ -564,18 +808,71 @@ int boxInside( box *box, shaft *s )
 	 * is outside (i.e. outside the shaft) of the plane. If so, then
 	 * the box is not fully inside the shaft.
 	 */
-	pr = s->planeSet ;
-	while ( pr ) {
+#ifdef __AVX2__
+	/* 8 planes at a time */
+	for ( i = 0 ; i < s->numPlanes ; i += 8 ) {
+		STATS(gNumInPlanesTested += ( s->numPlanes - i < 8 ) ? s->numPlanes - i : 8 ;)
+		if ( planesOutside( box->c, s, i, s->farCorner ) ) {
+			return FALSE ;
+		}
+	}
+#else
+	for ( i = 0 ; i < s->numPlanes ; i++ ) {
 		STATS(gNumInPlanesTested++;)
-		if ( box->c[pr->farCorner[X]] * pr->a +
-			 box->c[pr->farCorner[Y]] * pr->b +
-			 box->c[pr->farCorner[Z]] * pr->c > pr->d ) {
+		if ( box->c[SHAFT_CORNER( s->farCorner[X], i, X )] * s->a[i] +
+			 box->c[SHAFT_CORNER( s->farCorner[Y], i, Y )] * s->b[i] +
+			 box->c[SHAFT_CORNER( s->farCorner[Z], i, Z )] * s->c[i] > s->d[i] ) {
 			return FALSE ;
 		}
-		pr = pr->next ;
 	}
+#endif
 	return TRUE ;
 }
+
+/* bit k of the result is set if box k is fully inside the shaft */
+int boxInside8( box8 *boxes, shaft *s )
+{
+#ifdef __AVX2__
+	__m256 c[6] ;
+	int i, notIn ;
+
+	for ( i = 0 ; i < 6 ; i++ ) {
+		c[i] = _mm256_loadu_ps( boxes->c[i] ) ;
+	}
+
+	/* first test if boxes are fully inside shaft box */
+	notIn = _mm256_movemask_ps( _mm256_or_ps( _mm256_or_ps( _mm256_or_ps(
+		_mm256_cmp_ps( c[LO_X], _mm256_set1_ps( s->bx.c[LO_X] ), _CMP_LT_OQ ),
+		_mm256_cmp_ps( c[LO_Y], _mm256_set1_ps( s->bx.c[LO_Y] ), _CMP_LT_OQ ) ),
+		_mm256_or_ps(
+		_mm256_cmp_ps( c[LO_Z], _mm256_set1_ps( s->bx.c[LO_Z] ), _CMP_LT_OQ ),
+		_mm256_cmp_ps( c[HI_X], _mm256_set1_ps( s->bx.c[HI_X] ), _CMP_GT_OQ ) ) ),
+		_mm256_or_ps(
+		_mm256_cmp_ps( c[HI_Y], _mm256_set1_ps( s->bx.c[HI_Y] ), _CMP_GT_OQ ),
+		_mm256_cmp_ps( c[HI_Z], _mm256_set1_ps( s->bx.c[HI_Z] ), _CMP_GT_OQ ) ) ) ) ;
+	STATS(gNumInShaftsTested += bitCount( ~notIn & 0xff ) ;)
+
+	/* then each plane against the boxes not yet known to be not inside */
+	for ( i = 0 ; i < s->numPlanes && notIn != 0xff ; i++ ) {
+		STATS(gNumInPlanesTested += bitCount( ~notIn & 0xff ) ;)
+		notIn |= boxesOutsidePlane( c, s, i, s->farCorner ) ;
+	}
+	return ~notIn & 0xff ;
+#else
+	box bx ;
+	int i, k, in = 0 ;
+
+	for ( k = 0 ; k < 8 ; k++ ) {
+		for ( i = 0 ; i < 6 ; i++ ) {
+			bx.c[i] = boxes->c[i][k] ;
+		}
+		if ( boxInside( &bx, s ) ) {
+			in |= 1 << k ;
+		}
+	}
+	return in ;
+#endif
+}
 #endif
 
 
@@ -591,7 +888,7 @@ int boxInside( box *box, shaft *s )
  */
 int sphereOutside( sphere *sph, shaft *s )
 {
-	planeRec *pr ;
+	int i ;
 
 	/* first test if sphere does not overlap shaft's box */
 	if ( sph->center[X] - sph->radius > s->bx.c[HI_X] ||
@@ -607,14 +904,12 @@ int sphereOutside( sphere *sph, shaft *s )
 	 * greater than the radius; if so, the sphere is
 	 * fully outside the plane and so outside the shaft.
 	 */
-	pr = s->planeSet ;
-	while ( pr ) {
-		if ( sph->center[X] * pr->a +
-			 sph->center[Y] * pr->b +
-			 sph->center[Z] * pr->c - sph->radius > pr->d ) {
+	for ( i = 0 ; i < s->numPlanes ; i++ ) {
+		if ( sph->center[X] * s->a[i] +
+			 sph->center[Y] * s->b[i] +
+			 sph->center[Z] * s->c[i] - sph->radius > s->d[i] ) {
 			return TRUE ;
 		}
-		pr = pr->next ;
 	}
 	return FALSE ;
 }
@@ -623,7 +918,7 @@ int sphereOutside( sphere *sph, shaft *s )
 #ifndef OUTSIDE_ONLY
 int sphereInside( sphere *sph, shaft *s )
 {
-	planeRec *pr ;
+	int i ;
 
 	/* first test if box is fully inside shaft box */
 	if ( sph->center[X] - sph->radius < s->bx.c[LO_X] ||
@@ -639,14 +934,12 @@ int sphereInside( sphere *sph, shaft *s )
 	 * the plane's normal is outside the plane. If so, then
 	 * the sphere is not fully inside the shaft.
 	 */
-	pr = s->planeSet ;
-	while ( pr ) {
-		if ( sph->center[X] * pr->a +
-			 sph->center[Y] * pr->b +
-			 sph->center[Z] * pr->c + sph->radius > pr->d ) {
+	for ( i = 0 ; i < s->numPlanes ; i++ ) {
+		if ( sph->center[X] * s->a[i] +
+			 sph->center[Y] * s->b[i] +
+			 sph->center[Z] * s->c[i] + sph->radius > s->d[i] ) {
 			return FALSE ;
 		}
-		pr = pr->next ;
 	}
 	return TRUE ;
 }
@@ -656,14 +949,7 @@ int sphereInside( sphere *sph, shaft *s )
 
 void freeShaft( shaft *s )
 {
-	planeRec *pr, *nextPr ;
 	if ( s ) {
-		pr = s->planeSet ;
-		while ( pr ) {
-			nextPr = pr->next ;
-			free( pr ) ;
-			pr = nextPr ;
-		}
 		free( s ) ;
 	}
 }
@@ -19,11 +19,15 @@
  *
  * Main entry points:
  * formShaft - pass in the two boxes you want to form a shaft
+ * initShaft - same, for a shaft structure you allocate
  * addPlaneToShaft - if you want to add more cutting planes (e.g.
  *     the emitter or receiver polygon planes)
  *
  * boxOutside - test if a box is outside of the shaft
  * boxInside - test if a box is fully inside the shaft
+ * boxOutside8, boxInside8 - the same for 8 boxes at once
+ * cullHierarchy - find the leaves of a bounding volume hierarchy which
+ *     are not outside the shaft
  * sphereOutside - test if a sphere is outside of the shaft (see shaft.h)
  * sphereInside - test if a sphere is fully inside the shaft (see shaft.h)
  *
@@ -66,8 +70,35 @@
  * When done with a shaft, free it with:
  *      freeShaft( s ) ;
  *
+ * A shaft holds its planes in fixed size arrays, so it can also live on
+ * the stack or in an array of shafts, without any allocation:
+ *      shaft s ;
+ *      initShaft( &s, &box1, &box2 ) ;
+ *
+ * For many boxes, store them 8 at a time in a box8, coordinate by
+ * coordinate, and test them together; bit k of the result is set for
+ * box k:
+ *      box8 boxes ;
+ *      ... fill in boxes.c[LO_X][k] etc. for k = 0..7 ...
+ *      out = boxOutside8( &boxes, s ) ;
+ * Unused entries can be filled with empty boxes (lo +FLT_MAX, hi -FLT_MAX),
+ * which are always outside.
+ *
+ * For a scene with a bounding volume hierarchy, store the hierarchy as an
+ * array of shaftNodes (see below) and get the leaves not outside the
+ * shaft, and which of these are fully inside it:
+ *      int leaves[MAX_LEAVES] ;
+ *      char inside[MAX_LEAVES] ;
+ *      n = cullHierarchy( nodes, s, leaves, inside, MAX_LEAVES ) ;
+ * Planes which a node is fully inside of are not tested against its
+ * children, nor are the faces of the shaft box it is inside of (see the
+ * last OPTIMIZATIONS note below).
+ *
  *
  * OPTIMIZATIONS:
+ * - Compile with AVX2 (e.g. gcc -mavx2) and a box is tested against 8 planes
+ *   at once, and boxOutside8 and boxInside8 test 8 boxes against each plane
+ *   at once. The results are the same as without AVX2.
  * - Read over the #defines below; if you do not need a test, e.g.
  *   boxInside(), then turn on OUTSIDE_ONLY and shaft formation will take
  *   less time. Test on your own machine whether USE_TABLE is faster or not.
@@ -131,32 +162,77 @@ typedef struct {
 } sphere ;
 
 
-typedef struct planeRec_t {
-	float a,b,c,d ;	/* Ax + By + Cz = D */
+/* 8 boxes: c[LO_X][k] is the lo x of box k, etc. */
+typedef struct {
+	float c[6][8] ;
+} box8 ;
+
+/* The most planes a shaft can have: up to 8 are formed from its two boxes,
+ * the rest are for addPlaneToShaft. A multiple of 8. */
+#define MAX_SHAFT_PLANES 16
+
+/* The planes of a shaft are stored as an array of each coefficient, the
+ * entries past numPlanes being planes which cull nothing (a = b = c = 0,
+ * d = FLT_MAX), so they can be tested 8 at a time.
+ *
+ * The corner of a box to test against each plane is given by a bitmask per
+ * axis: bit i of nearCorner[X] is set if the "nearest in" corner for plane i
+ * has the HI_X coordinate, clear if it has the LO_X one; likewise for Y and
+ * Z, and for the "farthest out" corner in farCorner. SHAFT_CORNER gives the
+ * index into box.c of the coordinate, e.g.
+ *      box->c[SHAFT_CORNER( s->nearCorner[X], i, X )]
+ */
+typedef struct {
+	box	bx ;
+	int	numPlanes ;
+	float a[MAX_SHAFT_PLANES] ;	/* Ax + By + Cz = D */
+	float b[MAX_SHAFT_PLANES] ;
+	float c[MAX_SHAFT_PLANES] ;
+	float d[MAX_SHAFT_PLANES] ;
 #ifndef INSIDE_ONLY
-	int nearCorner[3] ;	/* corner indices, 0/4;1/5;2/6 */
+	unsigned int nearCorner[3] ;
 #endif
 #ifndef OUTSIDE_ONLY
-	int farCorner[3] ;	/* corner indices, 0/4;1/5;2/6 */
+	unsigned int farCorner[3] ;
 #endif
-	struct planeRec_t *next ;
-} planeRec ;
+} shaft ;
+
+#define SHAFT_CORNER(mask,i,axis)	( (axis) + 3 * ( ( (mask) >> (i) ) & 1 ) )
 
+/* Node of a bounding volume hierarchy, for cullHierarchy. The nodes are
+ * stored in an array, node 0 being the root and the first child of an inner
+ * node following it in the array. Each node's box must contain its
+ * children's boxes.
+ */
 typedef struct {
 	box	bx ;
-	planeRec *planeSet ;
-} shaft ;
+	int	secondChild ;	/* index of the second child; -1 for a leaf */
+} shaftNode ;
+
+/* cullHierarchy handles hierarchies up to this deep */
+#define MAX_SHAFT_DEPTH 256
 
 
-void addPlaneToShaft( float a, float b, float c, float d, shaft *s );
+/* returns FALSE if the shaft already has MAX_SHAFT_PLANES planes */
+int addPlaneToShaft( float a, float b, float c, float d, shaft *s );
 shaft * formShaft( box *box0, box *box1 );
+void initShaft( shaft *s, box *box0, box *box1 );
 
 #ifndef INSIDE_ONLY
 int boxOutside( box *box, shaft *s );
+int boxOutside8( box8 *boxes, shaft *s );
+
+/* Puts the indices of the leaves of the hierarchy which are not outside the
+ * shaft in leaves[], and in inside[] (unless NULL) whether each is fully
+ * inside the shaft. At most maxLeaves are stored; returns the number of
+ * leaves found, or -1 if the hierarchy is deeper than MAX_SHAFT_DEPTH. */
+int cullHierarchy( shaftNode *nodes, shaft *s, int *leaves, char *inside,
+	int maxLeaves );
 #endif
 
 #ifndef OUTSIDE_ONLY
 int boxInside( box *box, shaft *s );
+int boxInside8( box8 *boxes, shaft *s );
 #endif
 
 #ifdef INCLUDE_SPHERE_TESTING
@@ -1,48 +1,41 @@
 #include <list>
+#include <vector>
 #include <cmath>
+#include <atomic>
+#include <thread>
 #include "tessellate.h"
 
-/************************************************************
-  Class variables
- ************************************************************/
-template < class T >
-T Tessellate<T>::edge_thresh = 1.0;
-template < class T >
-T Tessellate<T>::split_bias = 0.7;
-template < class T >
-T Tessellate<T>::skew_thresh = 0.0001;
-
 
 /************************************************************
  TriTilef methods
  ************************************************************/
-template < class T >
-void TriTile<T>::dice( Tessellate<T>* tess ) {
+template < class T > template < class Tess >
+void TriTile<T>::dice( Tess* tess, EdgeCache<T>* cache ) {
   //pick a central point
   T cv[2];
   cv[0] = (vt[0][0] + vt[1][0] + vt[2][0])/3.0;
   cv[1] = (vt[0][1] + vt[1][1] + vt[2][1])/3.0;
 
   for( int ed = 0; ed<3; ed++) {
-    list<T> divs;
     int e1 = (ed+1)%3;
 
-    T d[2];
-    d[0] = vt[e1][0] - vt[ed][0];
-    d[1] = vt[e1][1] - vt[ed][1];
-
-    divs.push_front( 1.0 );
-    T beg = 0.0;
-    while( !divs.empty() ) {
-      T a[2],b[2];
-      T end = divs.front();
-      a[0] = vt[ed][0] + d[0]*beg;
-      a[1] = vt[ed][1] + d[1]*beg;
-      b[0] = vt[ed][0] + d[0]*end;
-      b[1] = vt[ed][1] + d[1]*end;
-      if (tess->split_edge( a, b) > tess->edge_thresh) {
+    /*
+     split at mid points as refine() does, so that the points on the
+     edge are the same as those of the tile across it
+     */
+    vector<T> ends; //stack of end points of the pieces after a
+    ends.push_back( vt[e1][0] );
+    ends.push_back( vt[e1][1] );
+    T a[2],b[2];
+    a[0] = vt[ed][0];
+    a[1] = vt[ed][1];
+    while( !ends.empty() ) {
+      b[0] = ends[ends.size()-2];
+      b[1] = ends[ends.size()-1];
+      if (tess->edge_value( tess, cache, a, b) > tess->edge_thresh) {
 	//split edge
-	divs.push_front( 0.5*(beg+end) );
+	ends.push_back( 0.5*(a[0] + b[0]) );
+	ends.push_back( 0.5*(a[1] + b[1]) );
       }
       else {
 	//render it
@@ -51,15 +44,18 @@ void TriTile<T>::dice( Tessellate<T>* tess ) {
 	slice.set_vtx(1,a);
 	slice.set_vtx(2,b);
 	tess->trim_final( &slice );
-	divs.pop_front();
-	beg = end;
+	ends.pop_back();
+	ends.pop_back();
+	a[0] = b[0];
+	a[1] = b[1];
       }
     }//while
   }//for
 }
 
-template < class T >
-int TriTile<T>::refine( Tessellate<T>* tess, TriTile<T>* res[4] ) {
+template < class T > template < class Tess >
+int TriTile<T>::refine( Tess* tess, TriTile<T>* res[4],
+			EdgeCache<T>* cache ) {
   if (tess->tile_culled( this )) return 0;
 
   /***** Measure facet degeneracy ****/
@@ -71,7 +67,7 @@ int TriTile<T>::refine( Tessellate<T>* tess, TriTile<T>* res[4] ) {
   if (area<0) area = -area;
 
   //calc sum of squares of edge lengths
-  T a[2], b[2];
+  T a[2];
   a[0] = vt[0][0] - vt[1][0];
   a[1] = vt[0][1] - vt[1][1];
   T max_ed = a[0]*a[0] + a[1]*a[1];
@@ -84,7 +80,7 @@ int TriTile<T>::refine( Tessellate<T>* tess, TriTile<T>* res[4] ) {
 
   area /= max_ed;
   if (area <= tess->skew_thresh) {
-    dice(tess);
+    dice(tess, cache);
     return 0;
   }
 
@@ -96,11 +92,7 @@ int TriTile<T>::refine( Tessellate<T>* tess, TriTile<T>* res[4] ) {
   for (int i = 0; i<3; i++) {
     int j0 = (i+1)%3;
     int j1 = (i+2)%3;
-    a[0] = vt[j0][0];
-    a[1] = vt[j0][1];
-    b[0] = vt[j1][0];
-    b[1] = vt[j1][1];
-    eds[i] = tess->split_edge( a, b );
+    eds[i] = tess->edge_value( tess, cache, vt[j0], vt[j1] );
     if (eds[i]>max_ed) max_ed = eds[i];
     //cerr << i << ' ' << eds[i] << endl;
   }
@@ -172,7 +164,7 @@ int TriTile<T>::refine( Tessellate<T>* tess, TriTile<T>* res[4] ) {
     for( int i = 0; i<3; i++) {
       res[i] = new TriTile<T>();
       res[i]->set_vtx( 0, vt[i] );
-      res[i]->set_vtx( 1, vt[(i+1)%2] );
+      res[i]->set_vtx( 1, vt[(i+1)%3] );
       res[i]->set_vtx( 2, a );
     }
     return 3;
@@ -183,45 +175,113 @@ int TriTile<T>::refine( Tessellate<T>* tess, TriTile<T>* res[4] ) {
 }
 
 
-template < class T >
-class TTPtr {
-  TriTile<T> *tp;
-public:
-  TTPtr( TriTile<T>* x =0) : tp(x) {}
-  TTPtr( const TTPtr<T>& x) : tp(x.tp) {};
-  TTPtr& operator= ( const TTPtr<T>& x) { tp = x.tp; }
-  TriTile<T>* p() { return tp; }
-  const TriTile<T>* p() const { return tp; }
-};
-
-
 /************************************************************
  Tessellation methods
  ************************************************************/
-template < class T >
-void Tessellate<T>::tessellate( TriTile<T>& root ) {
-  list< TTPtr<T> > work;
+template < class T > template < class Tess >
+T TessBase<T>::edge_value( Tess* tess, EdgeCache<T>* cache,
+			   const T a[2], const T b[2] ) {
+  T p[2], q[2];
+  const T* lo = a;
+  const T* hi = b;
+  if ((b[0]<a[0]) || ((b[0]==a[0]) && (b[1]<a[1]))) {
+    lo = b;
+    hi = a;
+  }
+  p[0] = lo[0]; p[1] = lo[1];
+  q[0] = hi[0]; q[1] = hi[1];
+
+  T v;
+  if (cache && cache->lookup( p, q, v ))
+    return v;
+  v = tess->split_edge( p, q );
+  if (cache)
+    cache->insert( p, q, v );
+  return v;
+}
 
-  //make dynamic copy (deleted during refinement)
-  TriTile<T>* begin = new TriTile<T>(root);
-  work.push_front(TTPtr<T>(begin));
+
+/**********
+ Refine tile and its subtiles depth first, deleting them
+ **********/
+template < class T > template < class Tess >
+void TessBase<T>::refine_subtree( Tess* tess, TriTile<T>* tile,
+				  EdgeCache<T>* cache ) {
+  vector< TriTile<T>* > work( 1, tile );
 
   while( !work.empty() ) {
-    TTPtr<T>& top = work.front();
-    TriTile<T>* curr = top.p();
-    work.pop_front();
+    TriTile<T>* curr = work.back();
+    work.pop_back();
 
     TriTile<T>* piece[4];
-    int n = curr->refine( this, piece );
+    int n = curr->refine( tess, piece, cache );
 
     for( int i = 0; i<n; i++) {
-      work.push_front( TTPtr<T>(piece[i]));
+      work.push_back( piece[i] );
     }
 
     delete curr;
   }
 }
 
+
+/**********
+ Refine the tiles not yet taken by another thread
+ **********/
+template < class T > template < class Tess >
+void TessBase<T>::refine_shared( Tess* tess, vector< TriTile<T>* >* tiles,
+				 atomic<size_t>* taken, bool use_cache ) {
+  EdgeCache<T> cache;
+  size_t i;
+  while( (i = (*taken)++) < tiles->size() )
+    refine_subtree( tess, (*tiles)[i], use_cache ? &cache : 0 );
+}
+
+
+template < class T > template < class Tess >
+void TessBase<T>::run( Tess* tess, TriTile<T>& root ) {
+  int nt = num_threads ? num_threads : (int) thread::hardware_concurrency();
+
+  EdgeCache<T> cache;
+  EdgeCache<T>* c = use_cache ? &cache : 0;
+
+  //make dynamic copy (deleted during refinement)
+  TriTile<T>* begin = new TriTile<T>(root);
+
+  if (nt <= 1)
+    refine_subtree( tess, begin, c );
+  else {
+    /*
+     Refine breadth first until there are enough subtiles to balance
+     the load, then share them among the threads.  The subtiles are
+     independent: tiles sharing an edge split it the same way whichever
+     thread refines them (see edge_value()), so there are no cracks
+     between the tiles of different threads
+     */
+    vector< TriTile<T>* > tiles( 1, begin ), next;
+    while( !tiles.empty() && (tiles.size() < 8 * (size_t) nt) ) {
+      next.clear();
+      for( size_t i = 0; i<tiles.size(); i++) {
+	TriTile<T>* piece[4];
+	int n = tiles[i]->refine( tess, piece, c );
+	for( int j = 0; j<n; j++)
+	  next.push_back( piece[j] );
+	delete tiles[i];
+      }
+      tiles.swap( next );
+    }
+
+    atomic<size_t> taken( 0 );
+    vector< thread > workers;
+    for( int i = 1; i<nt; i++)
+      workers.push_back( thread( refine_shared<Tess>, tess, &tiles, &taken,
+				 use_cache ) );
+    refine_shared( tess, &tiles, &taken, use_cache );
+    for( size_t i = 0; i<workers.size(); i++)
+      workers[i].join();
+  }
+}
+
 /*********************************************************************
  Methods for trimmed tessellations
  *********************************************************************/
@@ -236,7 +296,7 @@ bool TessTrim<T>::refine_trimcurve( int loop, int seg, T beg, T end ) {
   T pa[2], pb[2];
   trim_curve_fn( loop, seg, beg, pa );
   trim_curve_fn( loop, seg, end, pb );
-  return (split_edge( pa, pb ) > edge_thresh);
+  return (this->split_edge( pa, pb ) > this->edge_thresh);
 } 
 
 
@@ -267,12 +327,12 @@ void TessTrim<T>::init_trimming_loops() {
       }
     }
 
-    list< TrimPoint<T> >::iterator x = lp.pts.begin();
+    typename list< TrimPoint<T> >::iterator x = lp.pts.begin();
     while( x != lp.pts.end() ) {
       TrimPoint<T>& p0 = *x;
       T u0 = p0.uval;
 
-      list< TrimPoint<T> >::iterator y = x;
+      typename list< TrimPoint<T> >::iterator y = x;
       y++;
 
       T u1;
@@ -331,15 +391,15 @@ int TessTrim<T>::inout_test( TriTile<T>* tile ) {
     ad[i] = a[i][0]*va[0] + a[i][1]*va[1];
 
     cl[i] = cg[i] = 0;
-    ndx[i] = (abs(a[i][0]) > abs(a[i][1])) ? 1 : 0;
+    ndx[i] = (fabs(a[i][0]) > fabs(a[i][1])) ? 1 : 0;
   }
 
   for( int ilp = 0; ilp < num_loops; ilp++) {
     TrimLoop<T>& lp = loop[ilp];
 
-    for( list< TrimPoint<T> >::iterator ix = lp.pts.begin();
+    for( typename list< TrimPoint<T> >::iterator ix = lp.pts.begin();
 	 ix!=lp.pts.end(); ix++ ) {
-      list< TrimPoint<T> >::iterator iy = ix;
+      typename list< TrimPoint<T> >::iterator iy = ix;
       iy++;
       if (iy==lp.pts.end()) iy = lp.pts.begin();
 
@@ -396,5 +456,5 @@ void TessTrim<T>::trim_final( TriTile<T>* leaf ) {
   if (inout_test(leaf) == 0)
     render_trimmed( *leaf );
   else
-    render_final( *leaf );
+    this->render_final( *leaf );
 }
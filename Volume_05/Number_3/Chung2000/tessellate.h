@@ -2,10 +2,18 @@
 #define _TESSELLATE_
 
 #include <list>
-#include <iostream.h>
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+
+using namespace std;
 
 template < class T > class Tessellate;
 template < class T > class TessTrim;
+template < class T > class TessBase;
+template < class T > class EdgeCache;
 
 
 /***************************************************************
@@ -16,7 +24,8 @@ class TriTile {
   T vt[3][2];
 
 
-  void dice( class Tessellate<T>* );
+  template < class Tess >
+  void dice( Tess*, EdgeCache<T>* );
 
 public:
   TriTile() { }
@@ -34,34 +43,168 @@ public:
     return vt[i];
   }
 
-  //can tile be split; if so, return resulting tiles
-  int refine( class Tessellate<T>*, TriTile<T>*[4] );
+  /*
+   can tile be split; if so, return resulting tiles
+   Tess is the tessellation object (Tessellate, TessTrim or a class
+   derived from TessStatic) whose criteria are called; cache, if not 0,
+   keeps the split_edge() values of the edges
+   */
+  template < class Tess >
+  int refine( Tess*, TriTile<T>*[4], EdgeCache<T>* cache =0 );
 
 };
 
 
 
 /************************************************************
- Abstract base class for surface definition
-  The tessellation object
+ Cache of the split_edge() values of the edges of recently refined
+ tiles, for the tiles sharing them, which are refined soon after
+ (refinement is depth first).  Each edge has one slot, given by a
+ hash of its end points, and replaces the edge in it, so the cache
+ takes a fixed amount of memory.  Each thread refining a tessellation
+ has its own.
+ ************************************************************/
+template < class T >
+class EdgeCache {
+  enum { SLOTS = 4096 };
+
+  struct Slot {
+    T x[4]; //end points
+    T v;
+    bool used;
+  };
+
+  vector<Slot> slot;  //empty until first used
+
+  static size_t bits( T x ) {
+    size_t b = 0;
+    memcpy( &b, &x, (sizeof(T)<sizeof(size_t)) ? sizeof(T) : sizeof(size_t) );
+    return b;
+  }
+
+  static size_t index( const T a[2], const T b[2] ) {
+    size_t s = bits(a[0]);
+    s = s*0x9e3779b1 ^ bits(a[1]);
+    s = s*0x9e3779b1 ^ bits(b[0]);
+    s = s*0x9e3779b1 ^ bits(b[1]);
+    s *= 0x9e3779b1;
+    return (s ^ (s>>16)) % SLOTS;
+  }
+
+public:
+  bool lookup( const T a[2], const T b[2], T& v ) const {
+    if (slot.empty()) return false;
+    const Slot& e = slot[index( a, b )];
+    if (!e.used || (e.x[0]!=a[0]) || (e.x[1]!=a[1]) ||
+	(e.x[2]!=b[0]) || (e.x[3]!=b[1]))
+      return false;
+    v = e.v;
+    return true;
+  }
+
+  void insert( const T a[2], const T b[2], T v ) {
+    if (slot.empty()) slot.resize( SLOTS, Slot() );
+    Slot& e = slot[index( a, b )];
+    e.x[0] = a[0]; e.x[1] = a[1];
+    e.x[2] = b[0]; e.x[3] = b[1];
+    e.v = v;
+    e.used = true;
+  }
+};
+
+
+
+/************************************************************
+ Settings and refinement driver common to the tessellation
+ objects.  The settings belong to each object, so objects with
+ different settings may tessellate concurrently (but one object
+ may only tessellate one root tile at a time).
  ************************************************************/
 template < class T >
-class Tessellate {
+class TessBase {
+
+protected:
+  T edge_thresh; //for deciding when an edge short enough
+
+  T split_bias;  /**********
+		     for deciding which edges to split;
+		     0 to 1.0
+		     Low values cause all edges that exceed the
+		     threshold to be split.
+		     High values cause only the longer edges to be
+		     split
+		     **********/
+
+  T skew_thresh; /* for deciding when a facet is approaching
+		    degeneracy.  To avoid infinite recursion
+		    facet is diced non-recursively */
+
+  int num_threads;  //threads refining a root tile; 0 for all cores
+
+  bool use_cache;   //keep split_edge() values in an EdgeCache
+
+  /*
+   split_edge() of the edge ab of a tile, called with the end points in
+   the same order whichever tile they come from, so that tiles sharing
+   the edge always agree on splitting it (and so on its mid point),
+   even if split_edge() is not exactly comutative in floating point or
+   the tiles are refined on different threads.  cache may be 0.
+   */
+  template < class Tess >
+  static T edge_value( Tess*, EdgeCache<T>* cache, const T a[2], const T b[2] );
+
+  /*
+   Refines root and its subtiles on num_threads threads, calling the
+   criteria of tess
+   */
+  template < class Tess >
+  void run( Tess*, TriTile<T>& root );
 
-  static T edge_thresh; //for deciding when an edge short enough
+  template < class Tess >
+  static void refine_subtree( Tess*, TriTile<T>*, EdgeCache<T>* );
 
-  static T split_bias;  /**********
-			     for deciding which edges to split;
-			     0 to 1.0
-			     Low values cause all edges that exceed the
-			     threshold to be split.
-			     High values cause only the longer edges to be
-			     split
-			     **********/
+  template < class Tess >
+  static void refine_shared( Tess*, vector< TriTile<T>* >*, atomic<size_t>*,
+			     bool use_cache );
 
-  static T skew_thresh; /* for deciding when a facet is approaching
-			   degeneracy.  To avoid infinite recursion
-			   facet is diced non-recursively */
+public:
+  TessBase() : edge_thresh(1.0), split_bias(0.7), skew_thresh(0.0001),
+    num_threads(1), use_cache(false) {}
+
+  void set_threshold( T t ) { if (t>0.) edge_thresh = t; }
+  void set_splitbias( T t ) {
+    if ((t>=0.) && (t<1.0))
+      split_bias = t;
+  }
+  void set_skewness( T t ) { if (t>0.) skew_thresh = t; }
+
+  /*
+   Number of threads refining each root tile (1 by default; 0 for one
+   per core).  With more than one the user functions are called
+   concurrently from several threads, and render_final() and
+   render_trimmed() get the tiles in no particular order.
+   */
+  void set_threads( int n ) { if (n>=0) num_threads = n; }
+
+  /*
+   Keep the split_edge() values of the edges of recent tiles for the
+   tiles sharing them, which saves about half the calls to split_edge(),
+   at the cost of a table lookup per edge; worth it for expensive
+   split_edge() functions
+   */
+  void set_edge_cache( bool on ) { use_cache = on; }
+
+  template < class U > friend class TriTile;
+};
+
+
+
+/************************************************************
+ Abstract base class for surface definition
+  The tessellation object
+ ************************************************************/
+template < class T >
+class Tessellate : public TessBase<T> {
 
 public:
 
@@ -88,15 +231,10 @@ public:
    */
   virtual void render_final( TriTile<T>& ) =0;
 
-  static void set_threshold( T t ) { if (t>0.) edge_thresh = t; }
-  static void set_splitbias( T t ) {
-    if ((t>=0.) && (t<1.0))
-      split_bias = t;
-  }
-  static void set_skewness( T t ) { if (t>0.) skew_thresh = t; }
 
+  virtual ~Tessellate() {}
 
-  void tessellate( TriTile<T>& );
+  void tessellate( TriTile<T>& root ) { this->run( this, root ); }
 
 protected:
   virtual void trim_final( TriTile<T>* leaf ) { render_final(*leaf); }
@@ -108,6 +246,32 @@ protected:
 
 
 
+/************************************************************
+ Base class for surface definition without virtual calls
+  S derives from TessStatic<S,T> and defines (public, non virtual)
+    T split_edge( T[2], T[2] );
+    bool split_cen( T[3][2] );
+    void render_final( TriTile<T>& );
+  as for Tessellate; they are called through S, so the compiler can
+  inline them into the refinement.  S may also redefine trim_final()
+  and tile_culled().
+ ************************************************************/
+template < class S, class T >
+class TessStatic : public TessBase<T> {
+
+public:
+  void tessellate( TriTile<T>& root ) {
+    this->run( static_cast<S*>(this), root );
+  }
+
+  void trim_final( TriTile<T>* leaf ) {
+    static_cast<S*>(this)->render_final(*leaf);
+  }
+  bool tile_culled( TriTile<T>* ) { return false; }
+};
+
+
+
 /************************************************************
  Auxiliary objects for Trimming
  ************************************************************/
@@ -139,9 +303,11 @@ public:
 
 /************************************************************
  Abstract base class for trimmed surface tesselation
+  The trimming loops are approximated once, before the tiles are
+  refined, and are only read during refinement
  ************************************************************/
 template < class T >
-class TessTrim<T> : public Tessellate<T> {
+class TessTrim : public Tessellate<T> {
   int num_loops;
   TrimLoop<T>* loop;
 
@@ -153,14 +319,14 @@ public:
 
   ~TessTrim() { if (num_loops) delete[] loop; }
 
-  set_num_loops( int n ) {
+  void set_num_loops( int n ) {
     if (!num_loops && (n>num_loops)) {
       num_loops = n;
       loop = new TrimLoop<T>[n];
     }
   }
 
-  set_num_segs( int i, int n ) {
+  void set_num_segs( int i, int n ) {
     if ((i>=0) && (i<num_loops) && (n>0)) {
       loop[i].num_segs = n;
     }
@@ -178,7 +344,7 @@ public:
 
   /*
     Function to decide if straight edge approximation of the trim curve
-    should be refined more.  A default function using 
+    should be refined more.  A default function using
     Tessellationf::split_edge() is provided but can be overided by the user
    */
   virtual bool refine_trimcurve( int, int, T, T );
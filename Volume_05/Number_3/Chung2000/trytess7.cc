@@ -0,0 +1,276 @@
+/*
+ Times and checks the tessellation of the surface of trytess6 (and of
+ the trimmed surface of trytess2):
+  - with virtual (Tessellate) and inlined (TessStatic) user functions
+  - on one thread and on several, with and without the edge cache
+ The tiles of the parallel tessellations must be the same as those of
+ the serial one, and no edge inside the domain may be left without a
+ tile on its other side (a crack).  Two surfaces with different
+ thresholds are then tessellated at the same time.
+
+   trytess7 [threshold [steps [threads]]]
+
+ steps is the number of pieces split_edge() integrates an edge in (the
+ cost of the criterion); threads 0 for one per core.
+*/
+#include "tessellate.h"
+#include "tessellate.cc"
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <map>
+#include <algorithm>
+#include <mutex>
+
+
+struct Tri {
+  float x[6];
+
+  bool operator<( const Tri& t ) const {
+    return lexicographical_compare( x, x+6, t.x, t.x+6 );
+  }
+  bool operator==( const Tri& t ) const { return equal( x, x+6, t.x ); }
+};
+
+/*
+ Triangles of a tessellation, with the vertices of each in increasing
+ lexicographic order
+ */
+class Output {
+  mutex lock;
+public:
+  vector<Tri> tris;
+
+  void add( TriTile<float>& tile ) {
+    float* v[3] = { tile[0], tile[1], tile[2] };
+    for (int i = 0; i<2; i++)
+      for (int j = 2; j>i; j--)
+	if ((v[j][0]<v[j-1][0]) || ((v[j][0]==v[j-1][0]) && (v[j][1]<v[j-1][1])))
+	  swap( v[j], v[j-1] );
+    Tri t;
+    for (int i = 0; i<3; i++) {
+      t.x[2*i] = v[i][0];
+      t.x[2*i+1] = v[i][1];
+    }
+    lock_guard<mutex> hold(lock);
+    tris.push_back(t);
+  }
+};
+
+static int steps = 10;
+static atomic<long> edge_calls( 0 );
+
+static float fun0( float x ) { x = 3-x; return 10-(x+7)*(x+7)/17.0;}
+static float fun1( float y ) { return 18.0-200.0/(y+15.0);}
+
+//length of the image of ab, integrated from a to b
+static inline float edge_length( float a[2], float b[2] ) {
+  edge_calls++;
+  float d = 0.0;
+  for (int i = 0; i<steps; i++) {
+    float d0 = fun0((a[0]*(steps-i)+b[0]*i)/steps)
+      - fun0((a[0]*(steps-i-1)+b[0]*(i+1))/steps);
+    float d1 = fun1((a[1]*(steps-i)+b[1]*i)/steps)
+      - fun1((a[1]*(steps-i-1)+b[1]*(i+1))/steps);
+    d += sqrt( d0*d0 + d1*d1);
+  }
+  return d;
+}
+
+
+class VirtualTess : public Tessellate<float> {
+public:
+  Output out;
+
+  float split_edge( float a[2], float b[2] ) { return edge_length( a, b ); }
+  bool split_cen( float[3][2] ) { return false; }
+  void render_final( TriTile<float>& tile ) { out.add( tile ); }
+};
+
+class StaticTess : public TessStatic<StaticTess,float> {
+public:
+  Output out;
+
+  float split_edge( float a[2], float b[2] ) { return edge_length( a, b ); }
+  bool split_cen( float[3][2] ) { return false; }
+  void render_final( TriTile<float>& tile ) { out.add( tile ); }
+};
+
+
+static float func( float x[2] ) {
+  float a = 0.5+20.0/(40.0 + 12*(x[0]+3)*(x[0]+3));
+  float b = 1.-20.0/(40.0 + 16*(x[0]-2)*(x[0]-2));
+  return a*(2.0-x[1]) + b*x[1];
+}
+
+static float tcurve[7][3][2] = {{{0.,4.},{0.,.5},{4.,0.}},
+			  {{4.,0.},{0.,-.5},{0.,-4.}},
+			  {{0.,-4.},{-4.,0.},{0.,4.}},
+			  {{-6.,-6.},{0.,-8.},{4.,-4.}},
+			  {{4.,-4.},{8.,0.},{4.,4.}},
+			  {{4.,4.},{0.,8.},{-6.,6.}},
+			  {{-6.,6.},{-2.,0.},{-6.,-6.}}};
+
+class TrimTess : public TessTrim<float> {
+public:
+  Output out;
+
+  float split_edge( float a[2], float b[2] ) {
+    float d = func(a) - func(b);
+    float d0 = a[0] - b[0];
+    float d1 = a[1] - b[1];
+    return d*d + d0*d0 + d1*d1;
+  }
+  bool split_cen( float[3][2] ) { return false; }
+  void render_final( TriTile<float>& tile ) { out.add( tile ); }
+  void render_trimmed( TriTile<float>& tile ) { out.add( tile ); }
+
+  void trim_curve_fn( int loop, int seg, float u, float v[2] ) {
+    float b2 = u*u;
+    float b1 = (1.-u);
+    float b0 = b1*b1;
+    b1 *= 2*u;
+
+    int i = loop*3+seg;
+    v[0] = b0*tcurve[i][0][0] + b1*tcurve[i][1][0] + b2*tcurve[i][2][0];
+    v[1] = b0*tcurve[i][0][1] + b1*tcurve[i][1][1] + b2*tcurve[i][2][1];
+  }
+};
+
+
+static double seconds() {
+  timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+//tessellate the square [lo,hi]^2 as two root tiles
+template < class Tess >
+static double square( Tess& surf, float lo, float hi ) {
+  float c[4][2] = {{lo,lo},{hi,lo},{hi,hi},{lo,hi}};
+  TriTile<float> root;
+
+  surf.out.tris.clear();
+  double start = seconds();
+  root.set_vtx(0,c[0]);
+  root.set_vtx(1,c[1]);
+  root.set_vtx(2,c[3]);
+  surf.tessellate( root );
+  root.set_vtx(0,c[1]);
+  root.set_vtx(1,c[2]);
+  root.set_vtx(2,c[3]);
+  surf.tessellate( root );
+  double t = seconds() - start;
+
+  sort( surf.out.tris.begin(), surf.out.tris.end() );
+  return t;
+}
+
+//number of edges inside the square [lo,hi]^2 with a tile on one side only
+static int cracks( const vector<Tri>& tris, float lo, float hi ) {
+  map< vector<float>, int > count;
+  for (size_t t = 0; t<tris.size(); t++)
+    for (int i = 0; i<3; i++) {
+      int j = (i+1)%3;
+      const float* a = tris[t].x + 2*min(i,j);
+      const float* b = tris[t].x + 2*max(i,j);
+      vector<float> e( 4 );
+      e[0] = a[0]; e[1] = a[1]; e[2] = b[0]; e[3] = b[1];
+      count[e]++;
+    }
+
+  int n = 0;
+  for (map< vector<float>, int >::iterator e = count.begin();
+       e!=count.end(); e++) {
+    const vector<float>& v = e->first;
+    bool boundary = ((v[0]==lo) && (v[2]==lo)) || ((v[0]==hi) && (v[2]==hi))
+      || ((v[1]==lo) && (v[3]==lo)) || ((v[1]==hi) && (v[3]==hi));
+    if ((e->second==1) && !boundary) n++;
+  }
+  return n;
+}
+
+template < class Tess >
+static void report( const char* name, Tess& surf, const vector<Tri>& serial,
+		    double t, long calls ) {
+  cout << name << t << " s  " << surf.out.tris.size() << " tiles  "
+       << calls << " split_edge calls  "
+       << ((surf.out.tris==serial) ? "same" : "DIFFERENT") << endl;
+}
+
+template < class Tess >
+static void time_surface( const char* name, float thresh, int threads,
+			  vector<Tri>& serial ) {
+  Tess surf;
+  double t;
+  long calls;
+
+  surf.set_threshold( thresh );
+  cout << name << endl;
+  for (int cache = 0; cache<2; cache++) {
+    surf.set_edge_cache( cache );
+
+    surf.set_threads( 1 );
+    edge_calls = 0;
+    t = square( surf, -7., 10. );
+    calls = edge_calls;
+    if (serial.empty()) {
+      serial = surf.out.tris;
+      cout << "  cracks: " << cracks( serial, -7., 10. ) << endl;
+    }
+    report( cache ? "  serial, cache:    " : "  serial:           ",
+	    surf, serial, t, calls );
+
+    surf.set_threads( threads );
+    edge_calls = 0;
+    t = square( surf, -7., 10. );
+    calls = edge_calls;
+    report( cache ? "  parallel, cache:  " : "  parallel:         ",
+	    surf, serial, t, calls );
+  }
+}
+
+static void run_square( VirtualTess* surf ) { square( *surf, -7., 10. ); }
+
+int main( int argc, char* argv[] ) {
+  float thresh = (argc>1) ? atof(argv[1]) : 0.05;
+  if (argc>2) steps = atoi(argv[2]);
+  int threads = (argc>3) ? atoi(argv[3]) : 0;
+
+  cout << "threshold " << thresh << ", " << steps << " steps, "
+       << (threads ? threads : (int) thread::hardware_concurrency())
+       << " threads" << endl;
+
+  vector<Tri> serial;
+  time_surface<VirtualTess>( "Tessellate (virtual calls)", thresh, threads, serial );
+  time_surface<StaticTess>( "TessStatic (inlined calls)", thresh, threads, serial );
+
+  //trimmed surface
+  TrimTess trim;
+  trim.set_num_loops(2);
+  trim.set_num_segs(0,3);
+  trim.set_num_segs(1,4);
+  trim.set_threshold( 0.02 );
+  trim.set_splitbias( 0.6 );
+  square( trim, -12., 12. );
+  vector<Tri> trim_serial = trim.out.tris;
+  trim.set_threads( threads );
+  trim.set_edge_cache( true );
+  square( trim, -12., 12. );
+  cout << "TessTrim: " << trim.out.tris.size() << " tiles  "
+       << ((trim.out.tris==trim_serial) ? "same" : "DIFFERENT")
+       << " in parallel" << endl;
+
+  //two surfaces with different thresholds at once
+  VirtualTess coarse, fine;
+  coarse.set_threshold( 4*thresh );
+  fine.set_threshold( thresh );
+  square( coarse, -7., 10. );
+  vector<Tri> coarse_alone = coarse.out.tris;
+  thread other( run_square, &coarse );
+  square( fine, -7., 10. );
+  other.join();
+  cout << "concurrent surfaces: "
+       << ((coarse.out.tris==coarse_alone) && (fine.out.tris==serial) ?
+	   "same" : "DIFFERENT") << " as alone" << endl;
+}
@@ -9,14 +9,7 @@
 /******************************************************************/
 
 #include   <math.h>
-
-typedef struct  {
-	float   b[3] ; /* base vector */
-	float   a[3] ; /* normalized axis */
-	float   l ; /* length  */
-	float   s ; /* s is used to control the width of the Cauchy kernel */
-	float   q0, q1, q2, q3 ; /* the control points of Bezier profile curve */
-} LINE ;
+#include   "Code.h"
 
 /* 
  *  This function calculates the field of point (px,py,pz) 
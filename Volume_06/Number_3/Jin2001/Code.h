@@ -0,0 +1,28 @@
+
+/******************************************************************/
+/*                                                                */ 
+/*  Convolution surface field computation for line-skeleton with  */ 
+/*  polynomial weight distributions using Cauchy kernel           */
+/*                                                                */
+/*                      By Xiaogang Jin, January 2001             */
+/*                                                                */
+/******************************************************************/
+
+#ifndef CODE_H
+#define CODE_H
+
+typedef struct  {
+	float   b[3] ; /* base vector */
+	float   a[3] ; /* normalized axis */
+	float   l ; /* length  */
+	float   s ; /* s is used to control the width of the Cauchy kernel */
+	float   q0, q1, q2, q3 ; /* the control points of Bezier profile curve */
+} LINE ;
+
+/* 
+ *  This function calculates the field of point (px,py,pz) 
+ *  generated by skeleton *line 
+ */
+float KernelCauchy(float px, float py,  float pz, LINE *line) ;
+
+#endif
@@ -0,0 +1,483 @@
+
+/******************************************************************/
+/*                                                                */
+/*  Convolution surface field of many line skeletons, for         */
+/*  polygonisers sampling the field on a grid                     */
+/*                                                                */
+/*  See Field.h.  Compile with -fopenmp for threads, and -mavx2   */
+/*  for the vectorized evaluation.                                */
+/*                                                                */
+/******************************************************************/
+
+#include   <math.h>
+#include   <stdlib.h>
+#include   "Field.h"
+#if defined(__AVX2__)
+#include   <immintrin.h>
+#endif
+#ifdef _OPENMP
+#include   <omp.h>
+#endif
+
+#define PI         3.14159265358979f
+#define LEAF_SIZE  4  /* most LINEs in a leaf */
+#define BLOCK      8  /* grid points per block side, one AVX row */
+#define MAX_DEPTH  64 /* larger than the depth of any hierarchy */
+
+/* number of float arrays of a FIELD */
+#define NUM_ARRAYS 19
+
+
+/*
+ *  Effective radius of *line: the distance beyond which its field is
+ *  less than epsilon (see Field.h).
+ */
+static float EffectiveRadius(const LINE *line, float epsilon)
+{
+	float qmax, c ;
+
+	qmax = fabsf(line->q0) ;
+	if (fabsf(line->q1) > qmax) qmax = fabsf(line->q1) ;
+	if (fabsf(line->q2) > qmax) qmax = fabsf(line->q2) ;
+	if (fabsf(line->q3) > qmax) qmax = fabsf(line->q3) ;
+
+	c = qmax * PI / (2.0f * line->s * epsilon) ;
+	if (c <= 1.0f) return 0.0f ;
+	return sqrtf(powf(c, 2.0f / 3.0f) - 1.0f) / line->s ;
+}
+
+
+/* moves the nth smallest key (centroid coordinate axis) to order[nth] */
+static void SelectNth(int *order, int count, int nth, const float *cent, int axis)
+{
+	int lo = 0, hi = count - 1, i, j, t ;
+	float pivot ;
+
+	while (lo < hi) {
+		pivot = cent[3*order[(lo + hi) / 2] + axis] ;
+		i = lo ; j = hi ;
+		while (i <= j) {
+			while (cent[3*order[i] + axis] < pivot) i++ ;
+			while (cent[3*order[j] + axis] > pivot) j-- ;
+			if (i <= j) {
+				t = order[i] ; order[i] = order[j] ; order[j] = t ;
+				i++ ; j-- ;
+			}
+		}
+		if (nth <= j) hi = j ;
+		else if (nth >= i) lo = i ;
+		else break ;
+	}
+}
+
+
+/*
+ *  Builds node 'node' over the LINEs order[first..first+count), whose
+ *  capsule bounds are bounds[6*line] (min, max) and centroids cent[3*line].
+ *  Nodes are numbered in depth first order, so a left child follows its
+ *  parent.
+ */
+static void BuildNode(FIELD *field, int node, int *order, int first, int count,
+                      const float *bounds, const float *cent)
+{
+	FIELDNODE *n = &field->nodes[node] ;
+	float cmin[3], cmax[3], extent ;
+	int i, k, axis, half, right ;
+
+	for (k = 0 ; k < 3 ; k++) {
+		n->min[k] = cmin[k] = HUGE_VALF ;
+		n->max[k] = cmax[k] = -HUGE_VALF ;
+	}
+	for (i = first ; i < first + count ; i++) {
+		const float *b = &bounds[6*order[i]], *c = &cent[3*order[i]] ;
+		for (k = 0 ; k < 3 ; k++) {
+			if (b[k] < n->min[k]) n->min[k] = b[k] ;
+			if (b[3+k] > n->max[k]) n->max[k] = b[3+k] ;
+			if (c[k] < cmin[k]) cmin[k] = c[k] ;
+			if (c[k] > cmax[k]) cmax[k] = c[k] ;
+		}
+	}
+
+	/* split at the median centroid along the longest axis */
+	axis = 0 ; extent = cmax[0] - cmin[0] ;
+	for (k = 1 ; k < 3 ; k++)
+		if (cmax[k] - cmin[k] > extent) { axis = k ; extent = cmax[k] - cmin[k] ; }
+	if (count <= LEAF_SIZE || extent <= 0.0f) {
+		n->first = first ; n->count = count ;
+		return ;
+	}
+	half = count / 2 ;
+	SelectNth(order + first, count, half, cent, axis) ;
+
+	BuildNode(field, field->numNodes++, order, first, half, bounds, cent) ;
+	right = field->numNodes++ ;
+	n->first = right ; n->count = 0 ;
+	BuildNode(field, right, order, first + half, count - half, bounds, cent) ;
+}
+
+
+int FieldInit(FIELD *field, const LINE *lines, int numLines, float epsilon)
+{
+	float *arrays, *bounds, *cent ;
+	int *order ;
+	int i, j, k, n = numLines > 0 ? numLines : 1 ;
+
+	field->numLines = numLines ;
+	field->numNodes = 0 ;
+	field->lines = (LINE *) malloc(n * sizeof(LINE)) ;
+	field->nodes = (FIELDNODE *) malloc(2 * n * sizeof(FIELDNODE)) ;
+	arrays = (float *) malloc(NUM_ARRAYS * n * sizeof(float)) ;
+	bounds = (float *) malloc(9 * n * sizeof(float)) ;
+	order = (int *) malloc(n * sizeof(int)) ;
+	if (!field->lines || !field->nodes || !arrays || !bounds || !order) {
+		free(field->lines) ; free(field->nodes) ; free(arrays) ;
+		free(bounds) ; free(order) ;
+		field->lines = NULL ; field->nodes = NULL ; field->bx = NULL ;
+		return -1 ;
+	}
+	cent = bounds + 6 * n ;
+
+	field->bx = arrays ;             field->by = arrays + n ;
+	field->bz = arrays + 2 * n ;     field->ax = arrays + 3 * n ;
+	field->ay = arrays + 4 * n ;     field->az = arrays + 5 * n ;
+	field->l  = arrays + 6 * n ;     field->s  = arrays + 7 * n ;
+	field->p0 = arrays + 8 * n ;     field->p1 = arrays + 9 * n ;
+	field->p2 = arrays + 10 * n ;    field->p3 = arrays + 11 * n ;
+	field->radius = arrays + 12 * n ;
+	for (k = 0 ; k < 3 ; k++) {
+		field->lo[k] = arrays + (13 + k) * n ;
+		field->hi[k] = arrays + (16 + k) * n ;
+	}
+
+	/* capsule bounds and centroids */
+	for (i = 0 ; i < numLines ; i++) {
+		const LINE *line = &lines[i] ;
+		float r = EffectiveRadius(line, epsilon), e ;
+
+		for (k = 0 ; k < 3 ; k++) {
+			e = line->b[k] + line->l * line->a[k] ;
+			bounds[6*i + k]   = (line->b[k] < e ? line->b[k] : e) - r ;
+			bounds[6*i + 3+k] = (line->b[k] < e ? e : line->b[k]) + r ;
+			cent[3*i + k] = 0.5f * (line->b[k] + e) ;
+		}
+		order[i] = i ;
+	}
+
+	if (numLines > 0) {
+		field->numNodes = 1 ;
+		BuildNode(field, 0, order, 0, numLines, bounds, cent) ;
+	}
+
+	/* store the LINEs in leaf order */
+	for (j = 0 ; j < numLines ; j++) {
+		const LINE *line = &lines[order[j]] ;
+		float q0 = line->q0, q1 = line->q1, q2 = line->q2, q3 = line->q3 ;
+		float l = line->l ;
+
+		field->lines[j] = *line ;
+		field->bx[j] = line->b[0] ; field->by[j] = line->b[1] ; field->bz[j] = line->b[2] ;
+		field->ax[j] = line->a[0] ; field->ay[j] = line->a[1] ; field->az[j] = line->a[2] ;
+		field->l[j] = l ;
+		field->s[j] = line->s ;
+		field->p0[j] = q0 ;
+		field->p1[j] = (-3.0f*q0 + 3.0f*q1) / l ;
+		field->p2[j] = (3.0f*q0 - 6.0f*q1 + 3.0f*q2) / (l*l) ;
+		field->p3[j] = (-q0 + 3.0f*q1 - 3.0f*q2 + q3) / (l*l*l) ;
+		field->radius[j] = EffectiveRadius(line, epsilon) ;
+		for (k = 0 ; k < 3 ; k++) {
+			field->lo[k][j] = bounds[6*order[j] + k] ;
+			field->hi[k][j] = bounds[6*order[j] + 3+k] ;
+		}
+	}
+
+	free(bounds) ;
+	free(order) ;
+	return 0 ;
+}
+
+
+void FieldFree(FIELD *field)
+{
+	free(field->lines) ;
+	free(field->nodes) ;
+	free(field->bx) ;   /* the first of the arrays */
+	field->lines = NULL ; field->nodes = NULL ; field->bx = NULL ;
+	field->numLines = field->numNodes = 0 ;
+}
+
+
+/*
+ *  Stores in lines the LINEs whose capsule bounds overlap the box
+ *  [bmin, bmax], in leaf order, and returns their number.
+ */
+static int CollectLines(const FIELD *field, const float bmin[3], const float bmax[3],
+                        int *lines)
+{
+	int stack[MAX_DEPTH], top = 0, node, i, numLines = 0 ;
+	const FIELDNODE *n ;
+
+	if (field->numNodes == 0) return 0 ;
+	stack[top++] = 0 ;
+	while (top > 0) {
+		node = stack[--top] ;
+		n = &field->nodes[node] ;
+		if (n->min[0] > bmax[0] || n->max[0] < bmin[0] ||
+		    n->min[1] > bmax[1] || n->max[1] < bmin[1] ||
+		    n->min[2] > bmax[2] || n->max[2] < bmin[2]) continue ;
+		if (n->count > 0) {
+			for (i = n->first ; i < n->first + n->count ; i++) lines[numLines++] = i ;
+		}
+		else {
+			stack[top++] = n->first ;  /* right child, visited after the left one */
+			stack[top++] = node + 1 ;
+		}
+	}
+	return numLines ;
+}
+
+
+/* the field of LINE i at a point, or 0 beyond its effective radius */
+static float LineField(const FIELD *field, int i, float px, float py, float pz)
+{
+	float dx = px - field->bx[i], dy = py - field->by[i], dz = pz - field->bz[i] ;
+	float d2 = dx*dx + dy*dy + dz*dz ;
+	float h = dx*field->ax[i] + dy*field->ay[i] + dz*field->az[i] ;
+	float hc = h < 0.0f ? 0.0f : (h > field->l[i] ? field->l[i] : h) ;
+	float r = field->radius[i] ;
+
+	/* squared distance to the segment */
+	if (d2 - hc*(2.0f*h - hc) >= r*r) return 0.0f ;
+	return KernelCauchy(px, py, pz, &field->lines[i]) ;
+}
+
+
+float FieldEval(const FIELD *field, float px, float py, float pz)
+{
+	int stack[MAX_DEPTH], top = 0, node, i ;
+	const FIELDNODE *n ;
+	float sum = 0.0f ;
+
+	if (field->numNodes == 0) return 0.0f ;
+	stack[top++] = 0 ;
+	while (top > 0) {
+		node = stack[--top] ;
+		n = &field->nodes[node] ;
+		if (n->min[0] > px || n->max[0] < px ||
+		    n->min[1] > py || n->max[1] < py ||
+		    n->min[2] > pz || n->max[2] < pz) continue ;
+		if (n->count > 0) {
+			for (i = n->first ; i < n->first + n->count ; i++)
+				sum += LineField(field, i, px, py, pz) ;
+		}
+		else {
+			stack[top++] = n->first ;
+			stack[top++] = node + 1 ;
+		}
+	}
+	return sum ;
+}
+
+
+#if defined(__AVX2__)
+
+/* arctangent, as Cephes' atanf */
+static __m256 Atan8(__m256 x)
+{
+	const __m256 signBit = _mm256_set1_ps(-0.0f), one = _mm256_set1_ps(1.0f) ;
+	__m256 sign = _mm256_and_ps(x, signBit) ;
+	__m256 big, mid, y, z ;
+
+	x = _mm256_andnot_ps(signBit, x) ;
+	big = _mm256_cmp_ps(x, _mm256_set1_ps(2.414213562373095f), _CMP_GT_OQ) ;
+	mid = _mm256_cmp_ps(x, _mm256_set1_ps(0.4142135623730950f), _CMP_GT_OQ) ;
+
+	/* x > tan(3pi/8): pi/2 + atan(-1/x); x > tan(pi/8): pi/4 + atan((x-1)/(x+1)) */
+	y = _mm256_blendv_ps(_mm256_setzero_ps(), _mm256_set1_ps(0.25f * PI), mid) ;
+	y = _mm256_blendv_ps(y, _mm256_set1_ps(0.5f * PI), big) ;
+	x = _mm256_blendv_ps(_mm256_blendv_ps(x,
+	        _mm256_div_ps(_mm256_sub_ps(x, one), _mm256_add_ps(x, one)), mid),
+	        _mm256_div_ps(_mm256_set1_ps(-1.0f), x), big) ;
+
+	z = _mm256_mul_ps(x, x) ;
+	y = _mm256_add_ps(y, _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(z, x),
+	    _mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(
+	        _mm256_mul_ps(_mm256_set1_ps(8.05374449538e-2f), z),
+	        _mm256_set1_ps(1.38776856032e-1f)), z),
+	        _mm256_set1_ps(1.99777106478e-1f)), z),
+	        _mm256_set1_ps(3.33329491539e-1f))))) ;
+	return _mm256_xor_ps(y, sign) ;
+}
+
+
+/* natural logarithm of positive normal numbers, as Cephes' logf */
+static __m256 Log8(__m256 x)
+{
+	static const float c[9] = {
+		7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f,
+		-1.2420140846e-1f, 1.4249322787e-1f, -1.6668057665e-1f,
+		2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f } ;
+	const __m256 one = _mm256_set1_ps(1.0f) ;
+	__m256i xi = _mm256_castps_si256(x) ;
+	__m256 e, small, z, y ;
+	int k ;
+
+	/* x = m 2^e with m in [0.5, 1), then in [sqrt(1/2), sqrt(2)) */
+	e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(xi, 23),
+	                                        _mm256_set1_epi32(126))) ;
+	x = _mm256_castsi256_ps(_mm256_or_si256(
+	    _mm256_and_si256(xi, _mm256_set1_epi32(0x007fffff)),
+	    _mm256_set1_epi32(0x3f000000))) ;
+	small = _mm256_cmp_ps(x, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ) ;
+	e = _mm256_sub_ps(e, _mm256_and_ps(one, small)) ;
+	x = _mm256_add_ps(_mm256_sub_ps(x, one), _mm256_and_ps(x, small)) ;
+
+	z = _mm256_mul_ps(x, x) ;
+	y = _mm256_set1_ps(c[0]) ;
+	for (k = 1 ; k < 9 ; k++)
+		y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(c[k])) ;
+	y = _mm256_mul_ps(_mm256_mul_ps(y, x), z) ;
+	y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(-2.12194440e-4f))) ;
+	y = _mm256_sub_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.5f), z)) ;
+	return _mm256_add_ps(_mm256_add_ps(x, y), _mm256_mul_ps(e, _mm256_set1_ps(0.693359375f))) ;
+}
+
+
+/*
+ *  Adds the field of LINE i to the BLOCK points row[k] at
+ *  (ox + spacing*(i0 + k), py, pz), as KernelCauchy but 8 points at a time.
+ */
+static void AddLineRow(const FIELD *field, int i, float ox, float spacing, int i0,
+                       float py, float pz, int count, float *row)
+{
+	float s = field->s[i], l = field->l[i], r = field->radius[i] ;
+	float dy = py - field->by[i], dz = pz - field->bz[i] ;
+	float s2 = s*s, is = 1.0f / s, is2 = 1.0f / s2 ;
+	__m256 px, dx, d2, h, hc, mask, h2, lmh, pp, ww, qq, p, ip, sdp, isp ;
+	__m256 term, iww, iqq, dw, Fline1, Flinet, Flinet2, Flinet3, v ;
+	const __m256 zero = _mm256_setzero_ps() ;
+
+	(void) count ;
+	px = _mm256_add_ps(_mm256_set1_ps(ox), _mm256_mul_ps(_mm256_set1_ps(spacing),
+	     _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i0),
+	                                         _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))))) ;
+	dx = _mm256_sub_ps(px, _mm256_set1_ps(field->bx[i])) ;
+	d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_set1_ps(dy*dy + dz*dz)) ;
+	h  = _mm256_add_ps(_mm256_mul_ps(dx, _mm256_set1_ps(field->ax[i])),
+	                   _mm256_set1_ps(dy*field->ay[i] + dz*field->az[i])) ;
+
+	/* points within the effective radius */
+	hc = _mm256_min_ps(_mm256_max_ps(h, zero), _mm256_set1_ps(l)) ;
+	mask = _mm256_cmp_ps(_mm256_sub_ps(d2, _mm256_mul_ps(hc,
+	       _mm256_sub_ps(_mm256_add_ps(h, h), hc))), _mm256_set1_ps(r*r), _CMP_LT_OQ) ;
+	if (_mm256_movemask_ps(mask) == 0) return ;
+
+	h2  = _mm256_mul_ps(h, h) ;
+	lmh = _mm256_sub_ps(_mm256_set1_ps(l), h) ;
+	pp  = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(s2), _mm256_sub_ps(d2, h2))) ;
+	ww  = _mm256_add_ps(pp, _mm256_mul_ps(_mm256_set1_ps(s2), h2)) ;
+	qq  = _mm256_add_ps(pp, _mm256_mul_ps(_mm256_set1_ps(s2), _mm256_mul_ps(lmh, lmh))) ;
+	p   = _mm256_sqrt_ps(pp) ;
+	ip  = _mm256_div_ps(_mm256_set1_ps(1.0f), p) ;
+	sdp = _mm256_mul_ps(_mm256_set1_ps(s), ip) ;
+	isp = _mm256_mul_ps(_mm256_set1_ps(is), ip) ;  /* 1/(s p) */
+	term = _mm256_add_ps(Atan8(_mm256_mul_ps(sdp, h)), Atan8(_mm256_mul_ps(sdp, lmh))) ;
+	iww = _mm256_div_ps(_mm256_set1_ps(1.0f), ww) ;
+	iqq = _mm256_div_ps(_mm256_set1_ps(1.0f), qq) ;
+	dw  = _mm256_sub_ps(iww, iqq) ;
+
+	/* Fline1 = (h/ww + lmh/qq + term/sp) / (2 pp) */
+	Fline1 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(h, iww),
+	         _mm256_mul_ps(lmh, iqq)), _mm256_mul_ps(term, isp)),
+	         _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(ip, ip))) ;
+	Flinet = _mm256_add_ps(_mm256_mul_ps(h, Fline1), _mm256_mul_ps(dw, _mm256_set1_ps(0.5f * is2))) ;
+	Flinet2 = _mm256_add_ps(_mm256_sub_ps(
+	          _mm256_mul_ps(_mm256_add_ps(h, h), Flinet),
+	          _mm256_mul_ps(_mm256_add_ps(h2, _mm256_mul_ps(pp, _mm256_set1_ps(is2))), Fline1)),
+	          _mm256_mul_ps(term, _mm256_mul_ps(isp, _mm256_set1_ps(is2)))) ;
+	Flinet3 = _mm256_add_ps(_mm256_add_ps(_mm256_sub_ps(
+	          _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), h), Flinet2),
+	          _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), h2), Flinet)),
+	          _mm256_mul_ps(_mm256_mul_ps(h2, h), Fline1)),
+	          _mm256_mul_ps(_mm256_sub_ps(Log8(_mm256_mul_ps(qq, iww)), _mm256_mul_ps(pp, dw)),
+	                        _mm256_set1_ps(0.5f * is2 * is2))) ;
+
+	v = _mm256_add_ps(_mm256_add_ps(
+	    _mm256_mul_ps(_mm256_set1_ps(field->p0[i]), Fline1),
+	    _mm256_mul_ps(_mm256_set1_ps(field->p1[i]), Flinet)), _mm256_add_ps(
+	    _mm256_mul_ps(_mm256_set1_ps(field->p2[i]), Flinet2),
+	    _mm256_mul_ps(_mm256_set1_ps(field->p3[i]), Flinet3))) ;
+	_mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), _mm256_and_ps(v, mask))) ;
+}
+
+#else
+
+/* adds the field of LINE i to the count points row[k] at (ox + spacing*(i0 + k), py, pz) */
+static void AddLineRow(const FIELD *field, int i, float ox, float spacing, int i0,
+                       float py, float pz, int count, float *row)
+{
+	int k ;
+
+	for (k = 0 ; k < count ; k++)
+		row[k] += LineField(field, i, ox + spacing*(float)(i0 + k), py, pz) ;
+}
+
+#endif
+
+
+int FieldSampleGrid(const FIELD *field, const float origin[3], float spacing,
+                    int nx, int ny, int nz, float *values)
+{
+	int bx = (nx + BLOCK - 1) / BLOCK, by = (ny + BLOCK - 1) / BLOCK ;
+	int bz = (nz + BLOCK - 1) / BLOCK, numThreads = 1 ;
+	long numBlocks = (long) bx * by * bz, b ;
+	int *lines ;
+
+#ifdef _OPENMP
+	numThreads = omp_get_max_threads() ;
+#endif
+	lines = (int *) malloc((size_t) numThreads * (field->numLines > 0 ? field->numLines : 1) * sizeof(int)) ;
+	if (!lines) return -1 ;
+
+#pragma omp parallel for schedule(dynamic)
+	for (b = 0 ; b < numBlocks ; b++) {
+		int *blockLines = lines ;
+		int i0 = (int) (b % bx) * BLOCK, j0 = (int) (b / bx % by) * BLOCK ;
+		int k0 = (int) (b / ((long) bx * by)) * BLOCK ;
+		int ni = nx - i0 < BLOCK ? nx - i0 : BLOCK ;
+		int nj = ny - j0 < BLOCK ? ny - j0 : BLOCK ;
+		int nk = nz - k0 < BLOCK ? nz - k0 : BLOCK ;
+		float bmin[3], bmax[3], row[BLOCK], py, pz ;
+		int numLines, j, k, c, i ;
+
+#ifdef _OPENMP
+		blockLines += (size_t) omp_get_thread_num() * field->numLines ;
+#endif
+		bmin[0] = origin[0] + spacing * (float) i0 ;
+		bmin[1] = origin[1] + spacing * (float) j0 ;
+		bmin[2] = origin[2] + spacing * (float) k0 ;
+		bmax[0] = origin[0] + spacing * (float) (i0 + ni - 1) ;
+		bmax[1] = origin[1] + spacing * (float) (j0 + nj - 1) ;
+		bmax[2] = origin[2] + spacing * (float) (k0 + nk - 1) ;
+		numLines = CollectLines(field, bmin, bmax, blockLines) ;
+
+		for (k = k0 ; k < k0 + nk ; k++) {
+			pz = origin[2] + spacing * (float) k ;
+			for (j = j0 ; j < j0 + nj ; j++) {
+				py = origin[1] + spacing * (float) j ;
+				for (i = 0 ; i < BLOCK ; i++) row[i] = 0.0f ;
+				for (c = 0 ; c < numLines ; c++) {
+					int line = blockLines[c] ;
+					if (field->lo[1][line] > py || field->hi[1][line] < py ||
+					    field->lo[2][line] > pz || field->hi[2][line] < pz ||
+					    field->lo[0][line] > bmax[0] || field->hi[0][line] < bmin[0]) continue ;
+					AddLineRow(field, line, origin[0], spacing, i0, py, pz, ni, row) ;
+				}
+				for (i = 0 ; i < ni ; i++)
+					values[((long) k * ny + j) * nx + i0 + i] = row[i] ;
+			}
+		}
+	}
+
+	free(lines) ;
+	return 0 ;
+}
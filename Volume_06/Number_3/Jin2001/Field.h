@@ -0,0 +1,81 @@
+
+/******************************************************************/
+/*                                                                */
+/*  Convolution surface field of many line skeletons, for         */
+/*  polygonisers sampling the field on a grid                     */
+/*                                                                */
+/******************************************************************/
+
+/*
+ *  The field of a skeleton at a point at distance r from it is at most
+ *
+ *      qmax * pi / (2 s (1 + s^2 r^2)^(3/2))
+ *
+ *  where qmax is the largest |q0|..|q3| (the Bezier profile lies within
+ *  its control points).  Given the largest contribution epsilon that
+ *  may be neglected, each LINE gets the effective radius beyond which
+ *  its field is below epsilon, and is only evaluated at points within
+ *  that radius.  The LINEs are stored as arrays of each member, in the
+ *  order of the leaves of a bounding volume hierarchy over their
+ *  capsules (the segments grown by their radius).
+ *
+ *  FieldSampleGrid evaluates blocks of 8x8x8 grid points in parallel
+ *  (with OpenMP) against the LINEs whose capsules overlap the block,
+ *  8 points of a row at a time with AVX2 when compiled for it.
+ */
+
+#ifndef FIELD_H
+#define FIELD_H
+
+#include "Code.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	float   min[3], max[3] ; /* bounds of the capsules below this node */
+	int     first ; /* leaf: first LINE; inner node: right child */
+	int     count ; /* leaf: number of LINEs; inner node: 0 */
+} FIELDNODE ;
+
+typedef struct {
+	int     numLines ;
+	LINE   *lines ; /* the LINEs, in leaf order */
+
+	/* the LINEs as arrays, in leaf order */
+	float  *bx, *by, *bz ; /* base */
+	float  *ax, *ay, *az ; /* axis */
+	float  *l, *s ;
+	float  *p0, *p1, *p2, *p3 ; /* profile polynomial coefficients */
+	float  *radius ; /* effective radius */
+	float  *lo[3], *hi[3] ; /* bounds of the capsule */
+
+	int     numNodes ;
+	FIELDNODE *nodes ; /* the left child of a node follows it */
+} FIELD ;
+
+/*
+ *  Builds the field of numLines skeletons, neglecting contributions
+ *  smaller than epsilon.  Returns 0 on success, -1 if out of memory.
+ */
+int FieldInit(FIELD *field, const LINE *lines, int numLines, float epsilon) ;
+
+void FieldFree(FIELD *field) ;
+
+/* the field at point (px,py,pz) */
+float FieldEval(const FIELD *field, float px, float py, float pz) ;
+
+/*
+ *  Samples the field at the points origin + spacing * (i, j, k) of an
+ *  nx by ny by nz grid, writing value (i, j, k) at
+ *  values[(k*ny + j)*nx + i].  Returns 0 on success, -1 if out of memory.
+ */
+int FieldSampleGrid(const FIELD *field, const float origin[3], float spacing,
+                     int nx, int ny, int nz, float *values) ;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
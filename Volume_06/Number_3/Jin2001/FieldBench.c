@@ -0,0 +1,164 @@
+
+/******************************************************************/
+/*                                                                */
+/*  Performance program for Field.c.  Samples the field of        */
+/*  random line skeletons on a grid, and compares the samples at  */
+/*  random grid points with the sum of KernelCauchy over all the  */
+/*  skeletons.                                                    */
+/*                                                                */
+/*      FieldBench [numLines [gridSize [epsilon]]]                */
+/*                                                                */
+/*  Compile with gcc -O2 -mavx2 -fopenmp FieldBench.c Field.c     */
+/*  Code.c -lm                                                    */
+/*                                                                */
+/******************************************************************/
+
+#include   <math.h>
+#include   <stdio.h>
+#include   <stdlib.h>
+#include   <time.h>
+#include   "Field.h"
+#ifdef _OPENMP
+#include   <omp.h>
+#endif
+
+#define S           150.0f  /* kernel width parameter */
+#define NUM_SAMPLES 1000
+
+
+static double Seconds(void)
+{
+#ifdef _OPENMP
+	return omp_get_wtime() ;
+#else
+	return (double) clock() / CLOCKS_PER_SEC ;
+#endif
+}
+
+
+static float Random(float lo, float hi)
+{
+	return lo + (hi - lo) * (float) rand() / (float) RAND_MAX ;
+}
+
+
+/*
+ *  Random strands of skeletons in the unit cube, with weights scaled so
+ *  that the field is around 1 near them.
+ */
+static void MakeLines(LINE *lines, int numLines)
+{
+	float p[3], a[3], len, scale = 2.0f * S / 3.14159265f ;
+	int i, k ;
+
+	for (i = 0 ; i < numLines ; i++) {
+		if (i % 20 == 0)
+			for (k = 0 ; k < 3 ; k++) p[k] = Random(0.1f, 0.9f) ;
+		do {
+			for (k = 0 ; k < 3 ; k++) a[k] = Random(-1.0f, 1.0f) ;
+			len = sqrtf(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]) ;
+		} while (len < 0.1f || len > 1.0f) ;
+
+		lines[i].l = Random(0.01f, 0.04f) ;
+		lines[i].s = S ;
+		for (k = 0 ; k < 3 ; k++) {
+			lines[i].b[k] = p[k] ;
+			lines[i].a[k] = a[k] / len ;
+			p[k] += lines[i].l * lines[i].a[k] ;
+			if (p[k] < 0.05f || p[k] > 0.95f) p[k] = Random(0.1f, 0.9f) ;
+		}
+		lines[i].q0 = scale * Random(0.5f, 1.0f) ;
+		lines[i].q1 = scale * Random(0.5f, 1.0f) ;
+		lines[i].q2 = scale * Random(0.5f, 1.0f) ;
+		lines[i].q3 = scale * Random(0.5f, 1.0f) ;
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	int numLines = argc > 1 ? atoi(argv[1]) : 10000 ;
+	int n = argc > 2 ? atoi(argv[2]) : 256 ;
+	float epsilon = argc > 3 ? (float) atof(argv[3]) : 1e-3f ;  /* largest contribution neglected */
+	float origin[3] = { 0.0f, 0.0f, 0.0f }, spacing = 1.0f / (n - 1) ;
+	float *values, p[3], grid, eval, maxField = 0.0f, gridError = 0.0f ;
+	float evalError = 0.0f, gridEval = 0.0f ;
+	double start, buildTime, gridTime, bruteTime, evalTime, brute ;
+	long points = (long) n * n * n, index ;
+	int s, i, k, ijk[3] ;
+	LINE *lines ;
+	FIELD field ;
+
+	lines = (LINE *) malloc(numLines * sizeof(LINE)) ;
+	values = (float *) malloc(points * sizeof(float)) ;
+	if (!lines || !values) {
+		printf("out of memory\n") ;
+		return 1 ;
+	}
+	srand(1) ;
+	MakeLines(lines, numLines) ;
+
+	start = Seconds() ;
+	if (FieldInit(&field, lines, numLines, epsilon)) {
+		printf("out of memory\n") ;
+		return 1 ;
+	}
+	buildTime = Seconds() - start ;
+
+	start = Seconds() ;
+	if (FieldSampleGrid(&field, origin, spacing, n, n, n, values)) {
+		printf("out of memory\n") ;
+		return 1 ;
+	}
+	gridTime = Seconds() - start ;
+
+	/* compare random grid points with the sum over all the skeletons */
+	bruteTime = evalTime = 0.0 ;
+	for (s = 0 ; s < NUM_SAMPLES ; s++) {
+		for (k = 0 ; k < 3 ; k++) {
+			ijk[k] = rand() % n ;
+			p[k] = origin[k] + spacing * (float) ijk[k] ;
+		}
+		index = ((long) ijk[2] * n + ijk[1]) * n + ijk[0] ;
+
+		start = Seconds() ;
+		brute = 0.0 ;
+		for (i = 0 ; i < numLines ; i++)
+			brute += KernelCauchy(p[0], p[1], p[2], &lines[i]) ;
+		bruteTime += Seconds() - start ;
+
+		start = Seconds() ;
+		eval = FieldEval(&field, p[0], p[1], p[2]) ;
+		evalTime += Seconds() - start ;
+
+		grid = values[index] ;
+		if (fabs(brute) > maxField) maxField = (float) fabs(brute) ;
+		if (fabs(grid - brute) > gridError) gridError = (float) fabs(grid - brute) ;
+		if (fabs(eval - brute) > evalError) evalError = (float) fabs(eval - brute) ;
+		if (fabsf(grid - eval) > gridEval) gridEval = fabsf(grid - eval) ;
+	}
+
+	printf("%d skeletons, %d^3 grid, %d threads\n", numLines, n,
+#ifdef _OPENMP
+	       omp_get_max_threads()) ;
+#else
+	       1) ;
+#endif
+	printf("FieldInit:                %10.3f s\n", buildTime) ;
+	printf("FieldSampleGrid:          %10.3f s  %8.2f Mpoints/s\n",
+	       gridTime, points * 1e-6 / gridTime) ;
+	printf("FieldEval (estimated):    %10.3f s  %8.2f Mpoints/s\n",
+	       evalTime / NUM_SAMPLES * points, NUM_SAMPLES * 1e-6 / evalTime) ;
+	printf("KernelCauchy, all (est.): %10.3f s  %8.4f Mpoints/s\n",
+	       bruteTime / NUM_SAMPLES * points, NUM_SAMPLES * 1e-6 / bruteTime) ;
+	printf("\nat %d grid points, largest field %g, epsilon %g\n",
+	       NUM_SAMPLES, maxField, epsilon) ;
+	printf("  |FieldSampleGrid - all|  %g\n", gridError) ;
+	printf("  |FieldEval - all|        %g\n", evalError) ;
+	printf("  |FieldSampleGrid - FieldEval| %g\n", gridEval) ;
+
+	FieldFree(&field) ;
+	free(values) ;
+	free(lines) ;
+	return 0 ;
+}
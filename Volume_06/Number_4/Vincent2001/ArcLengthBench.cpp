@@ -0,0 +1,350 @@
+//
+//	Performance program for the arc length and area tables of CurveLength.c
+//	and SurfaceArea.c.
+//
+//	Builds the tables of random cubic Bezier curves and maps random arc
+//	lengths back to parameters, one at a time and in batches, compared with
+//	inverting GetCurveLength by bisection. The arc length at the parameters
+//	found is compared with an accurate integration of the curve's speed.
+//	Then builds the area tables of random bicubic patches and maps random
+//	area fractions to ( u , v ).
+//
+//	SurfaceArea.c needs a GetSectionArea routine, which is not part of this
+//	code : the one here sums the areas of the 8 triangles of the 3 x 3 points
+//	of a section.
+//
+//		ArcLengthBench [n_curves [n_queries]]
+//
+//	Compile with g++ -O2 -mavx2 ArcLengthBench.cpp for the batched lookups.
+
+#include <stdlib.h>
+#include <time.h>
+#include "CurveLength.c"
+
+typedef struct
+{
+	TPoint3		p [ 4 ];
+} TBezier;
+
+void GetPoint ( double u , double v , TPoint3* pt );
+
+static double TriangleArea ( const TPoint3& a , const TPoint3& b , const TPoint3& c )
+{
+	double	ux = b.x - a.x , uy = b.y - a.y , uz = b.z - a.z;
+	double	vx = c.x - a.x , vy = c.y - a.y , vz = c.z - a.z;
+
+	return ( 0.5 * sqrt ( Sqr ( uy * vz - uz * vy ) + Sqr ( uz * vx - ux * vz ) +
+						  Sqr ( ux * vy - uy * vx ) ) );
+}
+
+static double GetSectionArea
+					( double , double , double , double ,
+					  TPoint3 p00 , TPoint3 p10 , TPoint3 p20 ,
+					  TPoint3 p01 , TPoint3 p11 , TPoint3 p21 ,
+					  TPoint3 p02 , TPoint3 p12 , TPoint3 p22 )
+{
+	return ( TriangleArea ( p00 , p10 , p11 ) + TriangleArea ( p00 , p11 , p01 ) +
+			 TriangleArea ( p10 , p20 , p21 ) + TriangleArea ( p10 , p21 , p11 ) +
+			 TriangleArea ( p01 , p11 , p12 ) + TriangleArea ( p01 , p12 , p02 ) +
+			 TriangleArea ( p11 , p21 , p22 ) + TriangleArea ( p11 , p22 , p12 ) );
+}
+
+#include "SurfaceArea.c"
+
+static const TBezier*	g_curve;			//	the curve of GetPoint ( t )
+static const TBezier*	g_patch;			//	4 rows of the patch of GetPoint ( u , v )
+
+static void Bernstein ( double t , double b [ 4 ] )
+{
+	double	s = 1 - t;
+
+	b [0] = s * s * s;
+	b [1] = 3 * s * s * t;
+	b [2] = 3 * s * t * t;
+	b [3] = t * t * t;
+}
+
+static void BezierPoint ( double t , TPoint3* pt , void* data )
+{
+	const TBezier*	c = ( const TBezier* ) data;
+	double			b [ 4 ];
+
+	Bernstein ( t , b );
+	pt->x = b [0] * c->p [0].x + b [1] * c->p [1].x + b [2] * c->p [2].x + b [3] * c->p [3].x;
+	pt->y = b [0] * c->p [0].y + b [1] * c->p [1].y + b [2] * c->p [2].y + b [3] * c->p [3].y;
+	pt->z = b [0] * c->p [0].z + b [1] * c->p [1].z + b [2] * c->p [2].z + b [3] * c->p [3].z;
+}
+
+void GetPoint ( double t , TPoint3* pt )
+{
+	BezierPoint ( t , pt , ( void* ) g_curve );
+}
+
+void GetPoint ( double u , double v , TPoint3* pt )
+{
+	double		b [ 4 ];
+	TBezier		column;
+	int			i;
+
+	Bernstein ( v , b );
+	for ( i = 0 ; i < 4 ; i++ )
+	{
+		column.p [i].x = b [0] * g_patch [0].p [i].x + b [1] * g_patch [1].p [i].x +
+						 b [2] * g_patch [2].p [i].x + b [3] * g_patch [3].p [i].x;
+		column.p [i].y = b [0] * g_patch [0].p [i].y + b [1] * g_patch [1].p [i].y +
+						 b [2] * g_patch [2].p [i].y + b [3] * g_patch [3].p [i].y;
+		column.p [i].z = b [0] * g_patch [0].p [i].z + b [1] * g_patch [1].p [i].z +
+						 b [2] * g_patch [2].p [i].z + b [3] * g_patch [3].p [i].z;
+	}
+	BezierPoint ( u , pt , &column );
+}
+
+static double BezierSpeed ( const TBezier* c , double t )
+{
+	double	s = 1 - t;
+	double	b0 = 3 * s * s , b1 = 6 * s * t , b2 = 3 * t * t;
+	double	dx = b0 * ( c->p [1].x - c->p [0].x ) + b1 * ( c->p [2].x - c->p [1].x ) + b2 * ( c->p [3].x - c->p [2].x );
+	double	dy = b0 * ( c->p [1].y - c->p [0].y ) + b1 * ( c->p [2].y - c->p [1].y ) + b2 * ( c->p [3].y - c->p [2].y );
+	double	dz = b0 * ( c->p [1].z - c->p [0].z ) + b1 * ( c->p [2].z - c->p [1].z ) + b2 * ( c->p [3].z - c->p [2].z );
+
+	return ( sqrt ( dx * dx + dy * dy + dz * dz ) );
+}
+
+static double ExactLength ( const TBezier* c , double t )
+
+//	Arc length from 0 to t by 5 point Gauss-Legendre quadrature on 256 panels
+
+{
+	static const double	x [ 5 ] = { -0.9061798459386640 , -0.5384693101056831 , 0 ,
+									 0.5384693101056831 , 0.9061798459386640 };
+	static const double	w [ 5 ] = { 0.2369268850561891 , 0.4786286704993665 ,
+									 0.5688888888888889 ,
+									 0.4786286704993665 , 0.2369268850561891 };
+	const int			n_panels = 256;
+	double				len = 0 , h = t / n_panels;
+	int					i , j;
+
+	for ( i = 0 ; i < n_panels ; i++ )
+		for ( j = 0 ; j < 5 ; j++ )
+			len += 0.5 * h * w [j] * BezierSpeed ( c , h * ( i + 0.5 + 0.5 * x [j] ) );
+
+	return len;
+}
+
+static double Random ( void )
+{
+	return ( (double) rand () / RAND_MAX );
+}
+
+static void RandomBezier ( TBezier* c )
+{
+	int		i;
+
+	for ( i = 0 ; i < 4 ; i++ )
+	{
+		c->p [i].x = Random ();
+		c->p [i].y = Random ();
+		c->p [i].z = Random ();
+	}
+}
+
+static double Seconds ( void )
+{
+	return ( (double) clock () / CLOCKS_PER_SEC );
+}
+
+int main ( int argc , char* argv [] )
+{
+	const int			n_eval_pts = 31;
+	int					n_curves = argc > 1 ? atoi ( argv [1] ) : 4000;
+	int					n_queries = argc > 2 ? atoi ( argv [2] ) : 64;	//	per curve
+	int					n_bisect = 200;
+	TBezier*			curves = new TBezier [ n_curves ];
+	TArcLengthTable*	tables = new TArcLengthTable [ n_curves ];
+	double*				lengths = new double [ n_curves ];
+	double*				s = new double [ n_curves * n_queries ];
+	double*				t = new double [ n_curves * n_queries ];
+	double*				t_batch = new double [ n_curves * n_queries ];
+	double				start , build_time , rebuild_time , scalar_time , batch_time , bisect_time;
+	double				error = 0 , length_error = 0 , batch_diff = 0 , sum = 0;
+	long				n_knots = 0;
+	int					i , j , k;
+	TCurve				curve;
+
+	srand ( 1 );
+	for ( i = 0 ; i < n_curves ; i++ )
+	{
+		RandomBezier ( &curves [i] );
+		InitArcLengthTable ( &tables [i] );
+	}
+	curve.get_point = BezierPoint;
+
+	//	Tables, built the first time and rebuilt
+
+	start = Seconds ();
+	for ( i = 0 ; i < n_curves ; i++ )
+	{
+		curve.data = &curves [i];
+		lengths [i] = BuildArcLengthTable ( &tables [i] , &curve , 0 , 1 , n_eval_pts );
+	}
+	build_time = Seconds () - start;
+
+	start = Seconds ();
+	for ( i = 0 ; i < n_curves ; i++ )
+	{
+		curve.data = &curves [i];
+		lengths [i] = BuildArcLengthTable ( &tables [i] , &curve , 0 , 1 , n_eval_pts );
+		n_knots += tables [i].n_knots;
+	}
+	rebuild_time = Seconds () - start;
+
+	for ( i = 0 ; i < n_curves ; i++ )
+		for ( j = 0 ; j < n_queries ; j++ )
+			s [ i * n_queries + j ] = Random () * lengths [i];
+
+	//	Lookups
+
+	start = Seconds ();
+	for ( i = 0 ; i < n_curves ; i++ )
+		for ( j = 0 ; j < n_queries ; j++ )
+			t [ i * n_queries + j ] = GetCurveParam ( &tables [i] , s [ i * n_queries + j ] );
+	scalar_time = Seconds () - start;
+
+	start = Seconds ();
+	for ( i = 0 ; i < n_curves ; i++ )
+		GetCurveParams ( &tables [i] , s + i * n_queries , t_batch + i * n_queries , n_queries );
+	batch_time = Seconds () - start;
+
+	//	Inverting GetCurveLength by bisection , for the first curves
+
+	start = Seconds ();
+	for ( k = 0 ; k < n_bisect ; k++ )
+	{
+		double	lo = 0 , hi = 1 , mid;
+
+		i = k % n_curves;
+		g_curve = &curves [i];
+		for ( j = 0 ; j < 40 ; j++ )
+		{
+			mid = ( lo + hi ) / 2;
+			if ( GetCurveLength ( 0 , mid , n_eval_pts ) < s [ i * n_queries ] )
+				lo = mid;
+			else
+				hi = mid;
+		}
+		sum += lo;
+	}
+	bisect_time = Seconds () - start;
+
+	//	Accuracy
+
+	for ( i = 0 ; i < n_curves ; i++ )
+	{
+		double	len = ExactLength ( &curves [i] , 1 );
+
+		if ( Abs ( lengths [i] - len ) / len > length_error )
+			length_error = Abs ( lengths [i] - len ) / len;
+
+		for ( j = 0 ; j < n_queries && j < 8 ; j++ )
+		{
+			k = i * n_queries + j;
+			if ( Abs ( ExactLength ( &curves [i] , t [k] ) - s [k] ) / len > error )
+				error = Abs ( ExactLength ( &curves [i] , t [k] ) - s [k] ) / len;
+		}
+		for ( j = 0 ; j < n_queries ; j++ )
+		{
+			k = i * n_queries + j;
+			if ( Abs ( t [k] - t_batch [k] ) > batch_diff )
+				batch_diff = Abs ( t [k] - t_batch [k] );
+		}
+	}
+
+	printf ( "%d cubic Bezier curves , %.1f knots per table\n" , n_curves , (double) n_knots / n_curves );
+	printf ( "BuildArcLengthTable  first : %10.0f tables/s\n" , n_curves / build_time );
+	printf ( "                   rebuild : %10.0f tables/s\n" , n_curves / rebuild_time );
+	printf ( "GetCurveParam              : %10.3g queries/s\n" , n_curves * (double) n_queries / scalar_time );
+	printf ( "GetCurveParams ( batch )   : %10.3g queries/s\n" , n_curves * (double) n_queries / batch_time );
+	printf ( "bisection on GetCurveLength: %10.3g queries/s\n" , n_bisect / bisect_time );
+	printf ( "largest error in length / length           : %g\n" , length_error );
+	printf ( "largest error in s at t ( s ) / length     : %g\n" , error );
+	printf ( "largest difference of batch and single t   : %g\n" , batch_diff );
+
+	//	Area tables of patches , whose rows of control points are 4 curves
+
+	{
+		int			n_patches = n_curves / 16 > 0 ? n_curves / 16 : 1;
+		int			n_samples = 1024;
+		TAreaTable	area_table;
+		double*		fu = new double [ n_samples ];
+		double*		fv = new double [ n_samples ];
+		double*		u = new double [ n_samples ];
+		double*		v = new double [ n_samples ];
+		double*		u_batch = new double [ n_samples ];
+		double*		v_batch = new double [ n_samples ];
+		double		area , area_diff = 0 , uv_diff = 0;
+		double		area_time = 0 , single_time = 0 , multi_time = 0;
+
+		InitAreaTable ( &area_table );
+		for ( j = 0 ; j < n_samples ; j++ )
+		{
+			fu [j] = Random ();
+			fv [j] = Random ();
+		}
+
+		for ( i = 0 ; i < n_patches ; i++ )
+		{
+			g_patch = &curves [ ( 4 * i ) % ( n_curves - 3 > 0 ? n_curves - 3 : 1 ) ];
+
+			start = Seconds ();
+			area = BuildAreaTable ( &area_table , 0 , 1 , n_eval_pts , 0 , 1 , n_eval_pts );
+			area_time += Seconds () - start;
+
+			if ( Abs ( area - SurfaceArea ( 0 , 1 , n_eval_pts , 0 , 1 , n_eval_pts ) ) / area > area_diff )
+				area_diff = Abs ( area - SurfaceArea ( 0 , 1 , n_eval_pts , 0 , 1 , n_eval_pts ) ) / area;
+
+			start = Seconds ();
+			for ( j = 0 ; j < n_samples ; j++ )
+				GetSurfaceParam ( &area_table , fu [j] , fv [j] , &u [j] , &v [j] );
+			single_time += Seconds () - start;
+
+			start = Seconds ();
+			GetSurfaceParams ( &area_table , fu , fv , u_batch , v_batch , n_samples );
+			multi_time += Seconds () - start;
+
+			for ( j = 0 ; j < n_samples ; j++ )
+			{
+				if ( Abs ( u [j] - u_batch [j] ) > uv_diff ) uv_diff = Abs ( u [j] - u_batch [j] );
+				if ( Abs ( v [j] - v_batch [j] ) > uv_diff ) uv_diff = Abs ( v [j] - v_batch [j] );
+			}
+		}
+
+		printf ( "\n%d bicubic patches\n" , n_patches );
+		printf ( "BuildAreaTable             : %10.0f tables/s\n" , n_patches / area_time );
+		printf ( "GetSurfaceParam            : %10.3g queries/s\n" , n_patches * (double) n_samples / single_time );
+		printf ( "GetSurfaceParams ( batch ) : %10.3g queries/s\n" , n_patches * (double) n_samples / multi_time );
+		printf ( "largest difference of table and SurfaceArea : %g\n" , area_diff );
+		printf ( "largest difference of batch and single u, v : %g\n" , uv_diff );
+
+		FreeAreaTable ( &area_table );
+		delete [] v_batch;
+		delete [] u_batch;
+		delete [] v;
+		delete [] u;
+		delete [] fv;
+		delete [] fu;
+	}
+
+	if ( sum < 0 )
+		printf ( "\n" );
+
+	for ( i = 0 ; i < n_curves ; i++ )
+		FreeArcLengthTable ( &tables [i] );
+	delete [] t_batch;
+	delete [] t;
+	delete [] s;
+	delete [] lengths;
+	delete [] tables;
+	delete [] curves;
+
+	return 0;
+}
@@ -15,6 +15,9 @@
 
 #include <stdio.h>
 #include <math.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #define	Sqr(x)			((x) *(x))
 #define	Abs(x)			((x) > 0 ? (x) : -(x))
@@ -32,6 +35,34 @@ typedef struct
 
 extern void GetPoint ( double t , TPoint3*	pt );
 
+//	A curve for the routines that take the evaluator as an argument rather
+//	than calling GetPoint , so that the points of many curves can be computed.
+
+typedef struct
+{
+	void	( *get_point ) ( double t , TPoint3* pt , void* data );
+	void*	data;
+} TCurve;
+
+//	Arc length parameterization table : the knots found by the adaptive
+//	subdivision of GetCurveLength , with the arc length s from the start
+//	of the curve ( non-decreasing ) and the parameter t at each knot. dt_ds
+//	is the slope of a monotone cubic interpolating t as a function of s.
+
+typedef struct
+{
+	double	s;
+	double	t;
+	double	dt_ds;
+} TArcLengthKnot;
+
+typedef struct
+{
+	int				n_knots;
+	int				capacity;
+	TArcLengthKnot*	knots;
+} TArcLengthTable;
+
 double Distance ( TPoint3*	pt_a , TPoint3*	pt_b )
 
 {
@@ -40,17 +71,103 @@ double Distance ( TPoint3*	pt_a , TPoint3*	pt_b )
 			  		Sqr ( pt_a->z - pt_b->z ) ) );
 }
 
-static double GetSectionLength
-					( double		t0 ,
+static void GetGlobalPoint ( double t , TPoint3* pt , void* data )
+{
+	( void ) data;
+	GetPoint ( t , pt );
+}
+
+static const TCurve		kGlobalCurve = { GetGlobalPoint , NULL };
+
+static void ReserveKnots ( TArcLengthTable* table , int n_knots );
+
+static double DifferenceSpeed
+					( const TPoint3*	pt0 ,
+					  const TPoint3*	pt1 ,
+					  const TPoint3*	pt2 ,
+					  double			w0 ,
+					  double			w1 ,
+					  double			w2 ,
+					  double			h )
+
+//	| w0 pt0 + w1 pt1 + w2 pt2 | / h
+
+{
+	return ( sqrt ( Sqr ( w0 * pt0->x + w1 * pt1->x + w2 * pt2->x ) +
+					Sqr ( w0 * pt0->y + w1 * pt1->y + w2 * pt2->y ) +
+					Sqr ( w0 * pt0->z + w1 * pt1->z + w2 * pt2->z ) ) / h );
+}
+
+static double AddSectionKnots
+					( TArcLengthTable*	table ,
+					  double			t0 ,
+					  double			t1 ,
+					  double			t2 ,
+					  double			len ,
+					  double			da ,
+					  double			d2 ,
+					  const TPoint3*	pt0 ,
+					  const TPoint3*	pt1 ,
+					  const TPoint3*	pt2 )
+
+//	Appends the knots at t1 and t2 of a section of length len , whose
+//	first knot ( at t0 ) is the last one of the table , splitting len between
+//	the two halves in proportion to their chords da and d2 - da. Returns len.
+
+//	Until SetKnotSlopes the knots hold the speed | dC/dt | in dt_ds : from
+//	the central difference at t1 and the one sided differences at t0 and t2.
+//	The estimates of the sections on either side of a knot are averaged with
+//	weights inversely proportional to their error , which goes as the square
+//	of the length of the section.
+
+{
+	TArcLengthKnot*	knot;
+	double			s0 , h , h_prev , v;
+	
+	if ( table == NULL )
+		return len;
+	
+	ReserveKnots ( table , table->n_knots + 2 );
+	knot = &table->knots [ table->n_knots ];
+	s0 = knot [-1].s;
+	h = t2 - t0;
+	
+	v = DifferenceSpeed ( pt0 , pt1 , pt2 , -3 , 4 , -1 , h );
+	if ( table->n_knots > 1 )
+	{
+		h_prev = 2 * ( knot [-1].t - knot [-2].t );
+		knot [-1].dt_ds = ( knot [-1].dt_ds * h * h + v * h_prev * h_prev ) /
+						  ( h * h + h_prev * h_prev );
+	}
+	else
+		knot [-1].dt_ds = v;
+	
+	knot [0].t = t1;
+	knot [0].s = s0 + ( d2 > 0 ? len * da / d2 : len / 2 );
+	knot [0].dt_ds = DifferenceSpeed ( pt0 , pt1 , pt2 , -1 , 0 , 1 , h );
+	knot [1].t = t2;
+	knot [1].s = s0 + len;
+	knot [1].dt_ds = DifferenceSpeed ( pt0 , pt1 , pt2 , 1 , -4 , 3 , h );
+	table->n_knots += 2;
+	
+	return len;
+}
+
+static double GetCurveSectionLength
+					( const TCurve*		curve ,
+					  double		t0 ,
 					  double		t1 ,
 					  double		t2 ,
 					  TPoint3		pt0 ,
 					  TPoint3		pt1 ,
-					  TPoint3		pt2 )
+					  TPoint3		pt2 ,
+					  TArcLengthTable*	table )
 
 //	Compute the length of a small section of a parametric curve from
 //	t0 to t2 , recursing if necessary. t1 is the mid-point.
 //	The 3 points at these parametric values are precomputed.
+//	If table is not NULL the knots of the sections that are not
+//	subdivided further are appended to it.
 
 {
 
@@ -73,7 +190,8 @@ static double GetSectionLength
 	if ( d2 < kEpsilon )
 	{
 	
-		return ( d2 + ( d2 - d1 ) / 3 );
+		return ( AddSectionKnots ( table , t0 , t1 , t2 , d2 + ( d2 - d1 ) / 3 , da , d2 ,
+								   &pt0 , &pt1 , &pt2 ) );
 			 
 	}
 	else if ( ( d1 < kEpsilon || d2/d1 > kMaxArc ) ||
@@ -109,37 +227,56 @@ static double GetSectionLength
 		TPoint3		pt_mid;
 		double		mid_t = ( t0 + t1 ) / 2;
 
-		GetPoint ( mid_t , &pt_mid );
+		curve->get_point ( mid_t , &pt_mid , curve->data );
 
-		len_1 = GetSectionLength
-						( t0 ,
+		len_1 = GetCurveSectionLength
+						( curve ,
+						  t0 ,
 						  mid_t ,
 						  t1 ,
 						  pt0 ,
 						  pt_mid ,
-						  pt1 );						 
+						  pt1 ,
+						  table );						 
 	
 		mid_t = ( t1 + t2 ) / 2;
-		GetPoint ( mid_t , &pt_mid );
+		curve->get_point ( mid_t , &pt_mid , curve->data );
 
-		len_2 = GetSectionLength 
-					   ( t1 ,
+		len_2 = GetCurveSectionLength 
+					   ( curve ,
+						 t1 ,
 						 mid_t ,
 						 t2 ,
 						 pt1 ,
 						 pt_mid ,
-						 pt2 );						 
+						 pt2 ,
+						 table );						 
 	
 		return	( len_1 + len_2 );
 
 	}
 	else
 	{
-		return ( d2 + ( d2 - d1 ) / 3 );	 
+		return ( AddSectionKnots ( table , t0 , t1 , t2 , d2 + ( d2 - d1 ) / 3 , da , d2 ,
+								   &pt0 , &pt1 , &pt2 ) );	 
 	}
 	
 }
 
+static double GetSectionLength
+					( double		t0 ,
+					  double		t1 ,
+					  double		t2 ,
+					  TPoint3		pt0 ,
+					  TPoint3		pt1 ,
+					  TPoint3		pt2 )
+
+//	GetCurveSectionLength for the curve of GetPoint
+
+{
+	return ( GetCurveSectionLength ( &kGlobalCurve , t0 , t1 , t2 , pt0 , pt1 , pt2 , NULL ) );
+}
+
 double GetCurveLength ( double	min_t ,
 						double	max_t ,
 						int		n_eval_pts )
@@ -340,3 +477,299 @@ double GetCurveLengthSlidingWindow
 	return len;
 	
 }
+
+//	Arc length parameterization tables.
+//	A table is built with the adaptive subdivision of GetCurveLength , and
+//	maps arc lengths back to parameters with a search for the knot interval
+//	followed by the evaluation of a monotone cubic in that interval.
+//	GetCurveParams does 4 lookups at a time with AVX2 when compiled for it.
+
+static const int	kKnotStride = sizeof ( TArcLengthKnot ) / sizeof ( double );
+
+void InitArcLengthTable ( TArcLengthTable* table )
+{
+	table->n_knots = 0;
+	table->capacity = 0;
+	table->knots = NULL;
+}
+
+void FreeArcLengthTable ( TArcLengthTable* table )
+{
+	delete [] table->knots;
+	InitArcLengthTable ( table );
+}
+
+static void ReserveKnots ( TArcLengthTable* table , int n_knots )
+
+//	Grows the storage of the table to at least n_knots knots , keeping
+//	the knots it has.
+
+{
+	TArcLengthKnot*	knots;
+	int				i;
+	
+	if ( n_knots <= table->capacity )
+		return;
+	
+	if ( n_knots < 2 * table->capacity )
+		n_knots = 2 * table->capacity;
+	
+	knots = new TArcLengthKnot [ n_knots ];
+	for ( i = 0 ; i < table->n_knots ; i++ )
+		knots [i] = table->knots [i];
+	
+	delete [] table->knots;
+	table->knots = knots;
+	table->capacity = n_knots;
+}
+
+static void SetKnotSlopes ( TArcLengthTable* table )
+
+//	Turns the speeds at the knots into the slopes dt/ds = 1 / speed of a
+//	monotone cubic , by limiting them to 3 times the slopes of the chords
+//	on either side ( Fritsch and Carlson ). Zero length intervals ( at cusps )
+//	do not limit the slopes.
+
+{
+	TArcLengthKnot*	k = table->knots;
+	int				n = table->n_knots;
+	int				i;
+	double			h , limit , m;
+	
+	for ( i = 0 ; i < n ; i++ )
+	{
+		limit = -1;
+		
+		if ( i > 0 && ( h = k [i].s - k [i-1].s ) > 0 )
+			limit = 3 * ( k [i].t - k [i-1].t ) / h;
+		
+		if ( i < n - 1 && ( h = k [i+1].s - k [i].s ) > 0 &&
+			 ( limit < 0 || 3 * ( k [i+1].t - k [i].t ) / h < limit ) )
+			limit = 3 * ( k [i+1].t - k [i].t ) / h;
+		
+		if ( limit < 0 )
+			limit = 0;
+		
+		m = ( k [i].dt_ds * limit > 1 ) ? 1 / k [i].dt_ds : limit;
+		k [i].dt_ds = m;
+	}
+}
+
+double BuildArcLengthTable
+				( TArcLengthTable*	table ,
+				  const TCurve*		curve ,
+				  double			min_t ,
+				  double			max_t ,
+				  int				n_eval_pts )
+
+//	Builds the arc length table of a curve from min_t to max_t , with the
+//	knots of GetCurveLength : n_eval_pts points to begin with , more where
+//	the curve is subdivided. The storage of the table is reused , so that
+//	rebuilding the table of a moving curve allocates memory only when it
+//	needs more knots than before. Returns the length of the curve.
+
+{
+	int			i;
+	double		t0 , t1 , t2;
+	TPoint3		pt0 , pt1 , pt2;
+	
+	if ( !Odd ( n_eval_pts ) )
+	  n_eval_pts++;
+	if ( n_eval_pts < 3 )
+	  n_eval_pts = 3;
+	
+	ReserveKnots ( table , n_eval_pts );
+	
+	t0 = min_t;
+	curve->get_point ( t0 , &pt0 , curve->data );
+	table->knots [0].s = 0;
+	table->knots [0].t = t0;
+	table->knots [0].dt_ds = 0;
+	table->n_knots = 1;
+	
+	//	The points are computed as they are needed rather than all at first
+	
+	for ( i = 0 ; i < n_eval_pts - 1 ; i += 2 )
+	{
+	
+		t1 = min_t + ( max_t - min_t ) * (double)( i + 1 ) / ( n_eval_pts - 1 );
+		t2 = min_t + ( max_t - min_t ) * (double)( i + 2 ) / ( n_eval_pts - 1 );
+		curve->get_point ( t1 , &pt1 , curve->data );
+		curve->get_point ( t2 , &pt2 , curve->data );
+		
+		GetCurveSectionLength ( curve , t0 , t1 , t2 , pt0 , pt1 , pt2 , table );
+		
+		t0 = t2;
+		pt0 = pt2;
+	
+	}
+	
+	SetKnotSlopes ( table );
+	
+	return ( table->knots [ table->n_knots - 1 ].s );
+}
+
+static int FindInterval ( const double* x , int stride , int n , double value )
+
+//	Index k in [ 0 , n - 2 ] of the last of the n non-decreasing values
+//	x [ k * stride ] that is not greater than value ( 0 if there is none ).
+//	The search does not branch on the values , so that its steps only
+//	depend on n.
+
+{
+	int		base = 0;
+	int		len = n - 1;
+	int		half;
+	
+	while ( len > 1 )
+	{
+		half = len / 2;
+		base = ( x [ ( base + half ) * stride ] <= value ) ? base + half : base;
+		len -= half;
+	}
+	
+	return base;
+}
+
+static double IntervalFraction ( double x0 , double x1 , double value )
+
+//	Position of value in the interval [ x0 , x1 ] , clamped to [ 0 , 1 ]
+
+{
+	double		u;
+	
+	if ( x1 - x0 <= 0 )
+		return ( value >= x1 ? 1 : 0 );
+	
+	u = ( value - x0 ) / ( x1 - x0 );
+	return ( u < 0 ? 0 : ( u > 1 ? 1 : u ) );
+}
+
+double GetCurveParam ( const TArcLengthTable* table , double s )
+
+//	The parameter t at arc length s from the start of the curve. s is
+//	clamped to [ 0 , length of the curve ].
+
+{
+	const TArcLengthKnot*	k;
+	double					h , u;
+	
+	k = &table->knots [ FindInterval ( &table->knots [0].s , kKnotStride , table->n_knots , s ) ];
+	
+	h = k [1].s - k [0].s;
+	u = IntervalFraction ( k [0].s , k [1].s , s );
+	
+	//	Cubic Hermite interpolation of t
+	
+	return ( k [0].t + u * u * ( 3 - 2 * u ) * ( k [1].t - k [0].t ) +
+			 h * u * ( 1 - u ) * ( ( 1 - u ) * k [0].dt_ds - u * k [1].dt_ds ) );
+}
+
+#if defined(__AVX2__)
+
+static __m256d GatherDoubles ( const double* x , __m128i index )
+{
+	return ( _mm256_mask_i32gather_pd ( _mm256_setzero_pd () , x , index ,
+										_mm256_castsi256_pd ( _mm256_set1_epi64x ( -1 ) ) , 8 ) );
+}
+
+static __m128i FindIntervals4
+				( const double*	x ,
+				  int			stride ,
+				  __m128i		first ,
+				  int			n ,
+				  __m256d		value )
+
+//	FindInterval for 4 values , each in the n values from x [ first * stride ]
+//	on. Returns first + k.
+
+{
+	const __m256i	low_halves = _mm256_setr_epi32 ( 0 , 2 , 4 , 6 , 0 , 2 , 4 , 6 );
+	__m128i			base = first;
+	__m128i			index;
+	__m256d			le;
+	int				len = n - 1;
+	int				half;
+	
+	while ( len > 1 )
+	{
+		half = len / 2;
+		index = _mm_add_epi32 ( base , _mm_set1_epi32 ( half ) );
+		le = _mm256_cmp_pd ( GatherDoubles ( x , _mm_mullo_epi32 ( index , _mm_set1_epi32 ( stride ) ) ) ,
+							 value , _CMP_LE_OQ );
+		
+		//	The 64 bit comparison masks as 32 bit masks
+		
+		base = _mm_add_epi32 ( base , _mm_and_si128 ( _mm_set1_epi32 ( half ) ,
+			   _mm256_castsi256_si128 ( _mm256_permutevar8x32_epi32 ( _mm256_castpd_si256 ( le ) , low_halves ) ) ) );
+		len -= half;
+	}
+	
+	return base;
+}
+
+static __m256d IntervalFraction4 ( __m256d x0 , __m256d x1 , __m256d value )
+
+//	IntervalFraction for 4 values
+
+{
+	const __m256d	zero = _mm256_setzero_pd ();
+	const __m256d	one = _mm256_set1_pd ( 1 );
+	__m256d			h = _mm256_sub_pd ( x1 , x0 );
+	__m256d			u = _mm256_div_pd ( _mm256_sub_pd ( value , x0 ) , h );
+	
+	u = _mm256_min_pd ( _mm256_max_pd ( u , zero ) , one );
+	return ( _mm256_blendv_pd ( u , _mm256_and_pd ( one , _mm256_cmp_pd ( value , x1 , _CMP_GE_OQ ) ) ,
+								_mm256_cmp_pd ( h , zero , _CMP_LE_OQ ) ) );
+}
+
+static __m256d GetCurveParams4 ( const TArcLengthTable* table , __m256d s )
+
+//	GetCurveParam for 4 arc lengths
+
+{
+	const double*	x = &table->knots [0].s;
+	__m128i			i0 , i1;
+	__m256d			s0 , s1 , t0 , t1 , m0 , m1 , h , u , v;
+	
+	i0 = FindIntervals4 ( x , kKnotStride , _mm_setzero_si128 () , table->n_knots , s );
+	i0 = _mm_mullo_epi32 ( i0 , _mm_set1_epi32 ( kKnotStride ) );
+	i1 = _mm_add_epi32 ( i0 , _mm_set1_epi32 ( kKnotStride ) );
+	
+	s0 = GatherDoubles ( x , i0 );			s1 = GatherDoubles ( x , i1 );
+	t0 = GatherDoubles ( x + 1 , i0 );		t1 = GatherDoubles ( x + 1 , i1 );
+	m0 = GatherDoubles ( x + 2 , i0 );		m1 = GatherDoubles ( x + 2 , i1 );
+	
+	h = _mm256_sub_pd ( s1 , s0 );
+	u = IntervalFraction4 ( s0 , s1 , s );
+	v = _mm256_sub_pd ( _mm256_set1_pd ( 1 ) , u );		//	1 - u
+	
+	return ( _mm256_add_pd ( _mm256_add_pd ( t0 ,
+			 _mm256_mul_pd ( _mm256_mul_pd ( _mm256_mul_pd ( u , u ) ,
+							 _mm256_sub_pd ( _mm256_set1_pd ( 3 ) , _mm256_add_pd ( u , u ) ) ) ,
+							 _mm256_sub_pd ( t1 , t0 ) ) ) ,
+			 _mm256_mul_pd ( _mm256_mul_pd ( _mm256_mul_pd ( h , u ) , v ) ,
+							 _mm256_sub_pd ( _mm256_mul_pd ( v , m0 ) , _mm256_mul_pd ( u , m1 ) ) ) ) );
+}
+
+#endif
+
+void GetCurveParams
+				( const TArcLengthTable*	table ,
+				  const double*				s ,
+				  double*					t ,
+				  int						n )
+
+//	GetCurveParam for n arc lengths s [i] , stored in t [i]
+
+{
+	int		i = 0;
+	
+#if defined(__AVX2__)
+	for ( ; i + 4 <= n ; i += 4 )
+		_mm256_storeu_pd ( t + i , GetCurveParams4 ( table , _mm256_loadu_pd ( s + i ) ) );
+#endif
+	
+	for ( ; i < n ; i++ )
+		t [i] = GetCurveParam ( table , s [i] );
+}
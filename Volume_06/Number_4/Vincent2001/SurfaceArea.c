@@ -95,4 +95,222 @@ static double SurfaceArea
     delete [] u;
 
     return area;
-}
\ No newline at end of file
+}
+
+// Area parameterization table of a surface patch. The areas of the
+// sections of SurfaceArea are accumulated along u for whole columns of
+// sections, and along v within each column, so that area fractions can be
+// mapped to ( u , v ) : uniformly distributed fractions give points
+// uniformly distributed over the surface, to the resolution of the
+// sections ( within a section u and v are interpolated linearly ).
+// The table uses the routines of CurveLength.c.
+
+typedef struct
+{
+    int n_u;                // columns of sections along u
+    int n_v;                // sections along v in each column
+    double min_u;
+    double max_u;
+    double min_v;
+    double max_v;
+    double* column_area;    // [ n_u + 1 ] : area left of each column boundary
+    double* section_area;   // [ n_u * ( n_v + 1 ) ] : area below each section
+                            // boundary, column after column
+    TPoint3* rows;          // 3 rows of points while building
+    int capacity;           // of column_area and section_area together
+    int row_capacity;       // points in each of the 3 rows
+} TAreaTable;
+
+void InitAreaTable ( TAreaTable* table )
+{
+    table->n_u = 0;
+    table->n_v = 0;
+    table->column_area = NULL;
+    table->section_area = NULL;
+    table->rows = NULL;
+    table->capacity = 0;
+    table->row_capacity = 0;
+}
+
+void FreeAreaTable ( TAreaTable* table )
+{
+    delete [] table->column_area;
+    delete [] table->rows;
+    InitAreaTable ( table );
+}
+
+double BuildAreaTable
+    ( TAreaTable* table ,
+    double min_u ,
+    double max_u ,
+    int n_eval_pts_u ,
+    double min_v ,
+    double max_v ,
+    int n_eval_pts_v )
+
+// Builds the area table of the surface from SurfaceArea's sections, and
+// returns the area. The storage of the table is reused when it is rebuilt
+// with as many points or fewer, and only 3 rows of points are kept.
+
+{
+    int u_idx;
+    int v_idx;
+    int n_u;
+    int n_v;
+    int size;
+    double u [ 3 ];
+    double v;
+    double* column;
+    TPoint3* row [ 3 ];
+    TPoint3* swap;
+
+    if ( !Odd ( n_eval_pts_u ) )
+        n_eval_pts_u++;
+
+    if ( !Odd ( n_eval_pts_v ) )
+        n_eval_pts_v++;
+
+    if ( n_eval_pts_u < 3 )
+        n_eval_pts_u = 3;
+
+    if ( n_eval_pts_v < 3 )
+        n_eval_pts_v = 3;
+
+    n_u = ( n_eval_pts_u - 1 ) / 2;
+    n_v = ( n_eval_pts_v - 1 ) / 2;
+    size = ( n_u + 1 ) + n_u * ( n_v + 1 );
+
+    if ( size > table->capacity )
+    {
+        delete [] table->column_area;
+        table->column_area = new double [ size ];
+        table->capacity = size;
+    }
+
+    if ( n_eval_pts_u > table->row_capacity )
+    {
+        delete [] table->rows;
+        table->rows = new TPoint3 [ 3 * n_eval_pts_u ];
+        table->row_capacity = n_eval_pts_u;
+    }
+
+    table->n_u = n_u;
+    table->n_v = n_v;
+    table->min_u = min_u;
+    table->max_u = max_u;
+    table->min_v = min_v;
+    table->max_v = max_v;
+    table->section_area = table->column_area + n_u + 1;
+
+    for ( u_idx = 0 ; u_idx < 3 ; u_idx++ )
+        row [ u_idx ] = table->rows + u_idx * table->row_capacity;
+
+    for ( u_idx = 0 ; u_idx < n_eval_pts_u ; ++u_idx )
+        GetPoint ( min_u + ( max_u - min_u ) * (double)u_idx / ( n_eval_pts_u - 1 ) ,
+            min_v , &row [ 0 ] [ u_idx ] );
+
+    for ( u_idx = 0 ; u_idx < n_u ; ++u_idx )
+        table->section_area [ u_idx * ( n_v + 1 ) ] = 0.0;
+
+    for ( v_idx = 0 ; v_idx < n_eval_pts_v - 1 ; v_idx += 2 )
+    {
+
+        // The next 2 rows of points; the first is the last of the
+        // previous sections.
+
+        for ( u_idx = 0 ; u_idx < n_eval_pts_u ; ++u_idx )
+        {
+            u [ 0 ] = min_u + ( max_u - min_u ) * (double)u_idx / ( n_eval_pts_u - 1 );
+            v = min_v + ( max_v - min_v ) * (double)( v_idx + 1 ) / ( n_eval_pts_v - 1 );
+            GetPoint ( u [ 0 ] , v , &row [ 1 ] [ u_idx ] );
+            v = min_v + ( max_v - min_v ) * (double)( v_idx + 2 ) / ( n_eval_pts_v - 1 );
+            GetPoint ( u [ 0 ] , v , &row [ 2 ] [ u_idx ] );
+        }
+
+        for ( u_idx = 0 ; u_idx < n_eval_pts_u - 1 ; u_idx += 2 )
+        {
+
+            u [ 0 ] = min_u + ( max_u - min_u ) * (double)u_idx / ( n_eval_pts_u - 1 );
+            u [ 2 ] = min_u + ( max_u - min_u ) * (double)( u_idx + 2 ) / ( n_eval_pts_u - 1 );
+            column = table->section_area + ( u_idx / 2 ) * ( n_v + 1 ) + v_idx / 2;
+
+            column [ 1 ] = column [ 0 ] + GetSectionArea
+                ( u [ 0 ] ,
+                u [ 2 ] ,
+                min_v + ( max_v - min_v ) * (double)v_idx / ( n_eval_pts_v - 1 ) ,
+                min_v + ( max_v - min_v ) * (double)( v_idx + 2 ) / ( n_eval_pts_v - 1 ) ,
+                row [ 0 ] [ u_idx ] ,
+                row [ 0 ] [ u_idx + 1 ] ,
+                row [ 0 ] [ u_idx + 2 ] ,
+                row [ 1 ] [ u_idx ] ,
+                row [ 1 ] [ u_idx + 1 ] ,
+                row [ 1 ] [ u_idx + 2 ] ,
+                row [ 2 ] [ u_idx ] ,
+                row [ 2 ] [ u_idx + 1 ] ,
+                row [ 2 ] [ u_idx + 2 ] );
+
+        }
+
+        swap = row [ 0 ];
+        row [ 0 ] = row [ 2 ];
+        row [ 2 ] = swap;
+
+    }
+
+    table->column_area [ 0 ] = 0.0;
+
+    for ( u_idx = 0 ; u_idx < n_u ; ++u_idx )
+        table->column_area [ u_idx + 1 ] = table->column_area [ u_idx ] +
+            table->section_area [ u_idx * ( n_v + 1 ) + n_v ];
+
+    return table->column_area [ n_u ];
+}
+
+void GetSurfaceParam
+    ( const TAreaTable* table ,
+    double frac_u ,
+    double frac_v ,
+    double* u ,
+    double* v )
+
+// The point ( u , v ) such that the area left of u is frac_u of the area
+// of the surface, and the area below v in the column of sections of u is
+// frac_v of the area of that column. The fractions are clamped to [ 0 , 1 ].
+
+{
+    const double* column;
+    double a;
+    int i;
+
+    a = frac_u * table->column_area [ table->n_u ];
+    i = FindInterval ( table->column_area , 1 , table->n_u + 1 , a );
+    *u = table->min_u + ( table->max_u - table->min_u ) *
+        ( i + IntervalFraction ( table->column_area [ i ] , table->column_area [ i + 1 ] , a ) ) /
+        table->n_u;
+
+    column = table->section_area + i * ( table->n_v + 1 );
+    a = frac_v * column [ table->n_v ];
+    i = FindInterval ( column , 1 , table->n_v + 1 , a );
+    *v = table->min_v + ( table->max_v - table->min_v ) *
+        ( i + IntervalFraction ( column [ i ] , column [ i + 1 ] , a ) ) /
+        table->n_v;
+}
+
+void GetSurfaceParams
+    ( const TAreaTable* table ,
+    const double* frac_u ,
+    const double* frac_v ,
+    double* u ,
+    double* v ,
+    int n )
+
+// GetSurfaceParam for n pairs of fractions. Unlike GetCurveParams this is
+// not vectorized : with two dependent searches per pair the gathers cost
+// more than they save.
+
+{
+    int i;
+
+    for ( i = 0 ; i < n ; i++ )
+        GetSurfaceParam ( table , frac_u [ i ] , frac_v [ i ] , &u [ i ] , &v [ i ] );
+}
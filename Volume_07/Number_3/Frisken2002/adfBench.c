@@ -0,0 +1,151 @@
+//-------------------------------------------------------------------------------
+//  Performance program for adfJGT.c. Builds the ADFs of a set of random circles
+//  (quadtree) and spheres (octree), and reports the size of the fields, the
+//  construction time, the batch sampling rate and the largest difference from
+//  the exact distance near the surface.
+//
+//      adfBench [maxError [nShapes]]
+//
+//  Compile with OpenMP enabled (e.g. gcc -O2 -fopenmp adfBench.c adfJGT.c -lm)
+//  for the parallel construction and sampling.
+//-------------------------------------------------------------------------------
+#include "adfJGT.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+static double seconds (void)
+{
+#ifdef _OPENMP
+    return(omp_get_wtime());
+#else
+    return((double) clock() / CLOCKS_PER_SEC);
+#endif
+}
+
+static float unitRandom (void)
+{
+    return((float) rand() / ((float) RAND_MAX + 1.0f));
+}
+
+
+//-------------------------------------------------------------------------------
+//  Signed distance to the union of circles (spheres): (x, y, z, radius) each
+//-------------------------------------------------------------------------------
+typedef struct _shapes {
+    unsigned int    nShapes;
+    float           *shapes;
+}   shapes;
+
+static float circlesDistance (const float *p, void *userData)
+{
+    const shapes *s = (const shapes *) userData;
+    float d = 1e30f;
+    unsigned int i;
+    for (i = 0; i < s->nShapes; i++) {
+        const float *c = &s->shapes[4 * i];
+        float dx = p[0] - c[0], dy = p[1] - c[1];
+        float di = sqrtf(dx * dx + dy * dy) - c[3];
+        if (di < d) d = di;
+    }
+    return(d);
+}
+
+static float spheresDistance (const float *p, void *userData)
+{
+    const shapes *s = (const shapes *) userData;
+    float d = 1e30f;
+    unsigned int i;
+    for (i = 0; i < s->nShapes; i++) {
+        const float *c = &s->shapes[4 * i];
+        float dx = p[0] - c[0], dy = p[1] - c[1], dz = p[2] - c[2];
+        float di = sqrtf(dx * dx + dy * dy + dz * dz) - c[3];
+        if (di < d) d = di;
+    }
+    return(d);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Build and sample the field of the shapes in dims dimensions
+//-------------------------------------------------------------------------------
+static void benchmark (unsigned int dims, shapes *s, float maxError, unsigned int nSamples)
+{
+    adfDistanceFunc distance = (dims == 2) ? circlesDistance : spheresDistance;
+    unsigned int i, k;
+    adf field;
+
+    double start = seconds();
+    if (adfBuild(&field, dims, distance, s, maxError, 0, ADF_ROOT_LEVEL - 3)) {
+        printf("out of memory\n");
+        return;
+    }
+    double buildTime = seconds() - start;
+    printf("%s: %u cells, %u leaves, %.1f MB, built in %.3f s\n",
+        (dims == 2) ? "circles" : "spheres", field.nCells, field.nLeaves,
+        (field.nCells * sizeof(adfCell) + field.nLeaves * (1 << dims) * sizeof(float)) / 1e6,
+        buildTime);
+
+    float *points = (float *) malloc(dims * nSamples * sizeof(float));
+    float *distances = (float *) malloc(nSamples * sizeof(float));
+    for (i = 0; i < dims * nSamples; i++) points[i] = unitRandom();
+
+    start = seconds();
+    adfSampleBatch(&field, points, nSamples, distances);
+    double sampleTime = seconds() - start;
+
+    //----Error within a band around the surface, where the field is most refined
+    float bandError = 0.0f;
+    unsigned int nBand = 0;
+    for (i = 0; i < nSamples; i++) {
+        float d = distance(&points[dims * i], s);
+        if (fabsf(d) < 0.01f) {
+            nBand++;
+            if (fabsf(d - distances[i]) > bandError) bandError = fabsf(d - distances[i]);
+        }
+    }
+    printf("    batch sampling %.2f Msamples/s, largest error %g near the surface "
+        "(%u samples)\n", nSamples * 1e-6 / sampleTime, bandError, nBand);
+
+    //----The single point queries give the same result
+    for (k = 0, i = 0; i < nSamples; i += 97) {
+        float d = (dims == 2) ? adfSample2(&field, &points[2 * i]) :
+            adfSample3(&field, &points[3 * i]);
+        if (d != distances[i]) k++;
+    }
+    if (k) printf("    %u single point samples differ from the batch\n", k);
+
+    free(distances);
+    free(points);
+    adfFree(&field);
+}
+
+
+int main (int argc, char **argv)
+{
+    float maxError = (argc > 1) ? (float) atof(argv[1]) : 1e-4f;
+    unsigned int nShapes = (argc > 2) ? (unsigned int) atoi(argv[2]) : 16;
+    unsigned int i;
+
+    shapes s;
+    s.nShapes = nShapes;
+    s.shapes = (float *) malloc(4 * nShapes * sizeof(float));
+    srand(1);
+    for (i = 0; i < nShapes; i++) {
+        s.shapes[4 * i] = 0.2f + 0.6f * unitRandom();
+        s.shapes[4 * i + 1] = 0.2f + 0.6f * unitRandom();
+        s.shapes[4 * i + 2] = 0.2f + 0.6f * unitRandom();
+        s.shapes[4 * i + 3] = 0.02f + 0.15f * unitRandom();
+    }
+
+    benchmark(2, &s, maxError, 1 << 22);
+    benchmark(3, &s, maxError, 1 << 22);
+
+    free(s.shapes);
+    return(0);
+}
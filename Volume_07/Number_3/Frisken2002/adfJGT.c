@@ -0,0 +1,404 @@
+//-------------------------------------------------------------------------------
+//  Adaptively sampled distance fields on quadtrees and octrees. See adfJGT.h.
+//-------------------------------------------------------------------------------
+#include "adfJGT.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//-------------------------------------------------------------------------------
+//  Number of levels built serially before the subtrees are built in parallel,
+//  giving up to 4096 subtrees for both quadtrees (4^6) and octrees (8^4)
+//-------------------------------------------------------------------------------
+#define ADF_TASK_DEPTH(dims) (12 / (dims))
+
+
+//-------------------------------------------------------------------------------
+//  Macros to traverse an ADF from a specified cell (typically the root cell) to
+//  a leaf cell by following the locational codes, as QT_TRAVERSE. cell is an
+//  index into cells and nextLevel is a signed integer; upon entering, nextLevel
+//  is one less than the level of the specified cell. Upon termination, cell is
+//  the leaf cell and nextLevel is one less than the level of the leaf cell.
+//-------------------------------------------------------------------------------
+#define ADF_TRAVERSE(cells,cell,nextLevel,xLocCode,yLocCode)                      \
+{                                                                                 \
+    while ((cells)[cell].children) {                                              \
+        unsigned int childIndex = (((xLocCode) >> (nextLevel)) & 1)               \
+        + ((((yLocCode) >> (nextLevel)) & 1) << 1);                               \
+        (cell) = (cells)[cell].children + childIndex;                             \
+        (nextLevel)--;                                                            \
+    }                                                                             \
+}
+
+#define ADF_TRAVERSE3(cells,cell,nextLevel,xLocCode,yLocCode,zLocCode)            \
+{                                                                                 \
+    while ((cells)[cell].children) {                                              \
+        unsigned int childIndex = (((xLocCode) >> (nextLevel)) & 1)               \
+        + ((((yLocCode) >> (nextLevel)) & 1) << 1)                                \
+        + ((((zLocCode) >> (nextLevel)) & 1) << 2);                               \
+        (cell) = (cells)[cell].children + childIndex;                             \
+        (nextLevel)--;                                                            \
+    }                                                                             \
+}
+
+
+//-------------------------------------------------------------------------------
+//  Growable cell and value pools. On failure to grow, error is set and the
+//  returned index is not valid.
+//-------------------------------------------------------------------------------
+typedef struct _adfPool {
+    adfCell         *cells;
+    unsigned int    nCells, maxCells;
+    float           *values;
+    unsigned int    nValues, maxValues;
+    int             error;
+}   adfPool;
+
+static unsigned int adfAllocCells (adfPool *pool, unsigned int n)
+{
+    if (pool->nCells + n > pool->maxCells) {
+        unsigned int maxCells = pool->maxCells ? 2 * pool->maxCells : 64;
+        adfCell *cells = (adfCell *) realloc(pool->cells, maxCells * sizeof(adfCell));
+        if (!cells) {
+            pool->error = 1;
+            return(0);
+        }
+        pool->cells = cells;
+        pool->maxCells = maxCells;
+    }
+    pool->nCells += n;
+    return(pool->nCells - n);
+}
+
+static unsigned int adfAllocValues (adfPool *pool, unsigned int n)
+{
+    if (pool->nValues + n > pool->maxValues) {
+        unsigned int maxValues = pool->maxValues ? 2 * pool->maxValues : 256;
+        float *values = (float *) realloc(pool->values, maxValues * sizeof(float));
+        if (!values) {
+            pool->error = 1;
+            return(0);
+        }
+        pool->values = values;
+        pool->maxValues = maxValues;
+    }
+    pool->nValues += n;
+    return(pool->nValues - n);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Top-down construction. Each cell samples the distance function on the 3^dims
+//  grid of its corners, edge midpoints, face centers and center; grid point g has
+//  the coordinates a[k] = (g / 3^k) % 3 in units of half the cell size. The grid
+//  points other than the corners are the test points for the reconstruction
+//  error and, if the cell is subdivided, give the children's corner distances.
+//  In the serial top phase (tasks not null), the cells at taskLevel are recorded
+//  as tasks and built in parallel afterwards.
+//-------------------------------------------------------------------------------
+typedef struct _adfBuilder {
+    unsigned int    dims;
+    unsigned int    nCorners;       // 2^dims
+    unsigned int    nGrid;          // 3^dims
+    adfDistanceFunc distance;
+    void            *userData;
+    float           maxError;
+    unsigned int    minLevel;
+    unsigned int    maxLevel;
+    unsigned int    taskLevel;
+}   adfBuilder;
+
+typedef struct _adfTask {
+    unsigned int    cell;           // Index of the task's cell in the top pool
+    unsigned int    locCode[3];
+    unsigned int    level;
+    float           corners[8];
+    adfPool         pool;           // The task's cells, its cell is cells[0]
+}   adfTask;
+
+static void adfBuildCell (const adfBuilder *b, adfPool *pool, unsigned int cell,
+const unsigned int locCode[3], unsigned int level, const float *corners,
+adfTask *tasks, unsigned int *nTasks)
+{
+    unsigned int g, c, k;
+
+    //----Continue in parallel below the top phase
+    if (tasks && level == b->taskLevel) {
+        adfTask *task = &tasks[(*nTasks)++];
+        task->cell = cell;
+        task->level = level;
+        for (k = 0; k < 3; k++) task->locCode[k] = locCode[k];
+        for (c = 0; c < b->nCorners; c++) task->corners[c] = corners[c];
+        return;
+    }
+
+
+    //----Sample the grid and determine the largest reconstruction error
+    float grid[27];
+    int subdivide = 0;
+    if (level > b->minLevel) {
+        unsigned int halfSize = 1 << (level - 1);
+        float error = 0.0f;
+        for (g = 0; g < b->nGrid; g++) {
+            unsigned int a[3], corner = 0, isCorner = 1, m = g;
+            for (k = 0; k < b->dims; k++, m /= 3) {
+                a[k] = m % 3;
+                if (a[k] == 1) isCorner = 0;
+                corner |= (a[k] >> 1) << k;
+            }
+            if (isCorner) {
+                grid[g] = corners[corner];
+                continue;
+            }
+
+            float p[3], interp = 0.0f;
+            for (k = 0; k < b->dims; k++)
+                p[k] = (locCode[k] + a[k] * halfSize) / ADF_MAX_VAL;
+            grid[g] = b->distance(p, b->userData);
+            for (c = 0; c < b->nCorners; c++) {
+                float w = 1.0f;
+                for (k = 0; k < b->dims; k++)
+                    w *= ((c >> k) & 1) ? 0.5f * a[k] : 1.0f - 0.5f * a[k];
+                interp += w * corners[c];
+            }
+            if (fabsf(grid[g] - interp) > error) error = fabsf(grid[g] - interp);
+        }
+
+        //----Only cells that may contain the surface are refined for accuracy:
+        //----elsewhere, the creases of the distance (e.g. where the distances to
+        //----two shapes are equal) would be refined down to the smallest cells
+        float nearest = fabsf(corners[0]);
+        for (c = 1; c < b->nCorners; c++)
+            if (fabsf(corners[c]) < nearest) nearest = fabsf(corners[c]);
+        float diagonal = sqrtf((float) b->dims) * (2 * halfSize) / ADF_MAX_VAL;
+        subdivide = (level > b->maxLevel) || (error > b->maxError && nearest <= diagonal);
+    }
+
+
+    //----Store the corner distances of a leaf
+    if (!subdivide) {
+        unsigned int data = adfAllocValues(pool, b->nCorners);
+        if (pool->error) return;
+        memcpy(pool->values + data, corners, b->nCorners * sizeof(float));
+        pool->cells[cell].children = 0;
+        pool->cells[cell].data = data;
+        return;
+    }
+
+
+    //----Subdivide into contiguous children, whose corners are on the grid
+    unsigned int children = adfAllocCells(pool, b->nCorners);
+    if (pool->error) return;
+    pool->cells[cell].children = children;
+    pool->cells[cell].data = 0;
+    for (c = 0; c < b->nCorners; c++) {
+        unsigned int childLocCode[3] = {0, 0, 0};
+        float childCorners[8];
+        unsigned int corner;
+        for (k = 0; k < b->dims; k++)
+            childLocCode[k] = locCode[k] + (((c >> k) & 1) << (level - 1));
+        for (corner = 0; corner < b->nCorners; corner++) {
+            unsigned int gridIndex = 0, scale = 1;
+            for (k = 0; k < b->dims; k++, scale *= 3)
+                gridIndex += (((c >> k) & 1) + ((corner >> k) & 1)) * scale;
+            childCorners[corner] = grid[gridIndex];
+        }
+        adfBuildCell(b, pool, children + c, childLocCode, level - 1, childCorners,
+            tasks, nTasks);
+        if (pool->error) return;
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+//  Copy a cell of a task's pool into the final pools, relocating its indices
+//-------------------------------------------------------------------------------
+static adfCell adfRelocateCell (adfCell cell, unsigned int cellBase, unsigned int valueBase)
+{
+    if (cell.children) cell.children = cellBase + cell.children - 1;
+    else cell.data += valueBase;
+    return(cell);
+}
+
+
+int adfBuild (adf *field, unsigned int dims, adfDistanceFunc distance, void *userData,
+float maxError, unsigned int minLevel, unsigned int maxLevel)
+{
+    adfBuilder b;
+    b.dims = dims;
+    b.nCorners = 1 << dims;
+    b.nGrid = (dims == 2) ? 9 : 27;
+    b.distance = distance;
+    b.userData = userData;
+    b.maxError = maxError;
+    b.minLevel = minLevel;
+    b.maxLevel = maxLevel;
+    b.taskLevel = ADF_ROOT_LEVEL - ADF_TASK_DEPTH(dims);
+
+    field->dims = dims;
+    field->nCells = field->nLeaves = 0;
+    field->cells = 0;
+    field->values = 0;
+
+    unsigned int maxTasks = 1 << (dims * ADF_TASK_DEPTH(dims));
+    adfTask *tasks = (adfTask *) calloc(maxTasks, sizeof(adfTask));
+    if (!tasks) return(-1);
+
+
+    //----Build the top levels serially, starting with the root's corners
+    adfPool top;
+    memset(&top, 0, sizeof(top));
+    float corners[8];
+    unsigned int c, k, nTasks = 0;
+    for (c = 0; c < b.nCorners; c++) {
+        float p[3];
+        for (k = 0; k < dims; k++) p[k] = (float) ((c >> k) & 1);
+        corners[c] = distance(p, userData);
+    }
+    unsigned int rootLocCode[3] = {0, 0, 0};
+    adfAllocCells(&top, 1);
+    if (!top.error)
+        adfBuildCell(&b, &top, 0, rootLocCode, ADF_ROOT_LEVEL, corners, tasks, &nTasks);
+
+
+    //----Build the subtrees below the top levels in parallel, each in its own pool
+    int i;
+    #pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < (int) nTasks; i++) {
+        adfTask *task = &tasks[i];
+        adfAllocCells(&task->pool, 1);
+        if (!task->pool.error)
+            adfBuildCell(&b, &task->pool, 0, task->locCode, task->level, task->corners, 0, 0);
+    }
+
+
+    //----Concatenate the pools: the top pool, then the tasks' pools, whose cells
+    //----other than the first (stored in the top pool) are appended
+    int error = top.error;
+    unsigned int nCells = top.nCells, nValues = top.nValues;
+    unsigned int *cellBase = (unsigned int *) malloc((nTasks + 1) * 2 * sizeof(unsigned int));
+    if (!cellBase) error = 1;
+    for (i = 0; i < (int) nTasks && !error; i++) {
+        if (tasks[i].pool.error) error = 1;
+        cellBase[2 * i] = nCells;
+        cellBase[2 * i + 1] = nValues;
+        nCells += tasks[i].pool.nCells - 1;
+        nValues += tasks[i].pool.nValues;
+    }
+    if (!error) {
+        field->cells = (adfCell *) malloc(nCells * sizeof(adfCell));
+        field->values = (float *) malloc((nValues ? nValues : 1) * sizeof(float));
+        if (!field->cells || !field->values) error = 1;
+    }
+    if (!error) {
+        memcpy(field->cells, top.cells, top.nCells * sizeof(adfCell));
+        memcpy(field->values, top.values, top.nValues * sizeof(float));
+        #pragma omp parallel for schedule(dynamic)
+        for (i = 0; i < (int) nTasks; i++) {
+            adfPool *pool = &tasks[i].pool;
+            unsigned int base = cellBase[2 * i], valueBase = cellBase[2 * i + 1], j;
+            field->cells[tasks[i].cell] = adfRelocateCell(pool->cells[0], base, valueBase);
+            for (j = 1; j < pool->nCells; j++)
+                field->cells[base + j - 1] = adfRelocateCell(pool->cells[j], base, valueBase);
+            memcpy(field->values + valueBase, pool->values, pool->nValues * sizeof(float));
+        }
+        field->nCells = nCells;
+        field->nLeaves = nValues / b.nCorners;
+    }
+
+    for (i = 0; i < (int) nTasks; i++) {
+        free(tasks[i].pool.cells);
+        free(tasks[i].pool.values);
+    }
+    free(tasks);
+    free(cellBase);
+    free(top.cells);
+    free(top.values);
+    if (error) {
+        adfFree(field);
+        return(-1);
+    }
+    return(0);
+}
+
+void adfFree (adf *field)
+{
+    free(field->cells);
+    free(field->values);
+    field->cells = 0;
+    field->values = 0;
+    field->nCells = field->nLeaves = 0;
+}
+
+
+//-------------------------------------------------------------------------------
+//  Sampling. The position is scaled to locational code units and clamped to the
+//  root cell; the leaf containing it is found by descending from the root, and
+//  its corner distances are interpolated.
+//-------------------------------------------------------------------------------
+static float adfScale (float v)
+{
+    v *= ADF_MAX_VAL;
+    return((v > 0.0f) ? ((v < ADF_MAX_VAL) ? v : ADF_MAX_VAL) : 0.0f);
+}
+
+static unsigned int adfLocCode (float v)
+{
+    unsigned int locCode = (unsigned int) v;
+    return((locCode < (1u << ADF_ROOT_LEVEL)) ? locCode : (1u << ADF_ROOT_LEVEL) - 1);
+}
+
+float adfSample2 (const adf *field, const float p[2])
+{
+    float x = adfScale(p[0]), y = adfScale(p[1]);
+    unsigned int xLocCode = adfLocCode(x), yLocCode = adfLocCode(y);
+
+    unsigned int cell = 0;
+    int nextLevel = ADF_ROOT_LEVEL - 1;
+    ADF_TRAVERSE(field->cells,cell,nextLevel,xLocCode,yLocCode);
+
+    //----Bilinear interpolation within the leaf
+    unsigned int binaryCellSize = 1u << (nextLevel + 1);
+    unsigned int mask = ~(binaryCellSize - 1);
+    float invSize = 1.0f / (float) binaryCellSize;
+    float u = (x - (float) (xLocCode & mask)) * invSize;
+    float v = (y - (float) (yLocCode & mask)) * invSize;
+    const float *d = field->values + field->cells[cell].data;
+    return((1.0f - v) * ((1.0f - u) * d[0] + u * d[1]) + v * ((1.0f - u) * d[2] + u * d[3]));
+}
+
+float adfSample3 (const adf *field, const float p[3])
+{
+    float x = adfScale(p[0]), y = adfScale(p[1]), z = adfScale(p[2]);
+    unsigned int xLocCode = adfLocCode(x), yLocCode = adfLocCode(y), zLocCode = adfLocCode(z);
+
+    unsigned int cell = 0;
+    int nextLevel = ADF_ROOT_LEVEL - 1;
+    ADF_TRAVERSE3(field->cells,cell,nextLevel,xLocCode,yLocCode,zLocCode);
+
+    //----Trilinear interpolation within the leaf
+    unsigned int binaryCellSize = 1u << (nextLevel + 1);
+    unsigned int mask = ~(binaryCellSize - 1);
+    float invSize = 1.0f / (float) binaryCellSize;
+    float u = (x - (float) (xLocCode & mask)) * invSize;
+    float v = (y - (float) (yLocCode & mask)) * invSize;
+    float w = (z - (float) (zLocCode & mask)) * invSize;
+    const float *d = field->values + field->cells[cell].data;
+    float d0 = (1.0f - v) * ((1.0f - u) * d[0] + u * d[1]) + v * ((1.0f - u) * d[2] + u * d[3]);
+    float d1 = (1.0f - v) * ((1.0f - u) * d[4] + u * d[5]) + v * ((1.0f - u) * d[6] + u * d[7]);
+    return((1.0f - w) * d0 + w * d1);
+}
+
+void adfSampleBatch (const adf *field, const float *points, unsigned int nPoints,
+float *distances)
+{
+    int i;
+    if (field->dims == 2) {
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < (int) nPoints; i++) distances[i] = adfSample2(field, points + 2 * i);
+    } else {
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < (int) nPoints; i++) distances[i] = adfSample3(field, points + 3 * i);
+    }
+}
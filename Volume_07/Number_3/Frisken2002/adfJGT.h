@@ -0,0 +1,95 @@
+//-------------------------------------------------------------------------------
+//  Adaptively sampled distance fields (ADFs) on quadtrees and octrees.
+//
+//  The field is built top-down from a signed distance function: a cell that may
+//  contain the surface (the zero set) is subdivided while the bilinear (trilinear)
+//  reconstruction from its corner distances differs from the distance function by
+//  more than a tolerance at the cell's edge midpoints, face centers and center.
+//  Each leaf stores the distances at its corners, which are interpolated to
+//  sample the field.
+//
+//  Instead of the parent, children and data pointers of qtCell, the cells are
+//  kept in one contiguous pool, children referring to the first of their 4 (8)
+//  contiguous child cells by index, and the leaves' corner distances in a second
+//  pool. The sampling queries descend from the root by following the branching
+//  patterns of the locational codes, as QT_TRAVERSE in treeTraversalJGT.c, and
+//  use the same levels and locational codes: the root cell has level
+//  ADF_ROOT_LEVEL and covers [0,1)^2 ([0,1)^3).
+//
+//  Construction and batch sampling are parallel when OpenMP is enabled.
+//-------------------------------------------------------------------------------
+#ifndef ADF_JGT_H
+#define ADF_JGT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//-------------------------------------------------------------------------------
+//  Maximum tree depth and related constants (as in treeTraversalJGT.c)
+//-------------------------------------------------------------------------------
+#define ADF_N_LEVELS   16       // Number of possible levels in the tree
+#define ADF_ROOT_LEVEL 15       // Level of root cell (ADF_N_LEVELS - 1)
+#define ADF_MAX_VAL    32768.0f // For converting positions to locational codes
+                                // (ADF_MAX_VAL = 2^ADF_ROOT_LEVEL)
+
+
+//-------------------------------------------------------------------------------
+//  Signed distance function, called with a position in [0,1]^dims and the user
+//  data passed to adfBuild. It is called from several threads at once when
+//  OpenMP is enabled.
+//-------------------------------------------------------------------------------
+typedef float (*adfDistanceFunc)(const float *p, void *userData);
+
+
+//-------------------------------------------------------------------------------
+//  ADF cell. A leaf has no children; its corner distances are values[data],
+//  ..., values[data + 2^dims - 1], in the order of the child cells (x + 2y + 4z).
+//-------------------------------------------------------------------------------
+typedef struct _adfCell {
+    unsigned int    children;   // Index of the first of the contiguous child cells,
+                                // 0 for a leaf
+    unsigned int    data;       // Index of a leaf's corner distances in values
+}   adfCell;
+
+typedef struct _adf {
+    unsigned int    dims;       // 2 (quadtree) or 3 (octree)
+    unsigned int    nCells;     // Number of cells, cells[0] is the root
+    unsigned int    nLeaves;
+    adfCell         *cells;
+    float           *values;    // Corner distances, 2^dims per leaf
+}   adf;
+
+
+//-------------------------------------------------------------------------------
+//  Build the ADF of a signed distance function in dims = 2 or 3 dimensions.
+//  Cells above maxLevel are always subdivided (so that small features are not
+//  missed), cells at minLevel are never subdivided, and the cells in between are
+//  subdivided while the reconstruction error exceeds maxError, if the distance
+//  at one of their corners is within the cell diagonal. Returns 0 on
+//  success and -1 if out of memory. adfFree releases the pools of a field.
+//-------------------------------------------------------------------------------
+int  adfBuild (adf *field, unsigned int dims, adfDistanceFunc distance, void *userData,
+               float maxError, unsigned int minLevel, unsigned int maxLevel);
+void adfFree  (adf *field);
+
+
+//-------------------------------------------------------------------------------
+//  Reconstruct the distance at a point by bilinear (adfSample2) or trilinear
+//  (adfSample3) interpolation of the corner distances of the leaf cell
+//  containing the point. Points outside [0,1)^dims are clamped to it.
+//  adfSampleBatch samples the nPoints points (dims coordinates each) in
+//  parallel.
+//-------------------------------------------------------------------------------
+float adfSample2     (const adf *field, const float p[2]);
+float adfSample3     (const adf *field, const float p[3]);
+void  adfSampleBatch (const adf *field, const float *points, unsigned int nPoints,
+                      float *distances);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
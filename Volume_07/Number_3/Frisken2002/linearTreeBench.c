@@ -0,0 +1,660 @@
+//-------------------------------------------------------------------------------
+//  Performance program for linearTreeJGT.c. Builds a linear quadtree over a set
+//  of clustered points, builds the same tree with the qtCell pointers of
+//  treeTraversalJGT.c, checks that the queries of both trees agree, and reports
+//  the memory per cell and the queries per second of each. Does the same for a
+//  linear octree and an octree of otCell pointers. Exits with status 1 if any
+//  query of a linear tree differs from the pointer tree.
+//
+//      linearTreeBench [nPoints [maxPointsPerCell]]
+//
+//  nPoints must be at least 2 and greater than maxPointsPerCell, so that the
+//  root cell is subdivided (the pointer tree queries assume it is not a leaf).
+//  With one point per cell (the default), the tree has roughly 2-3 leaves per
+//  point; e.g. 400000 points give about 10^6 leaves and 40000000 points about
+//  10^8 leaves, which takes about 6 GB for the pointer tree. Compile with OpenMP
+//  enabled (e.g. gcc -O2 -fopenmp linearTreeBench.c linearTreeJGT.c) for the
+//  parallel construction and batch location.
+//-------------------------------------------------------------------------------
+#include "treeTraversalJGT.c"
+#include "linearTreeJGT.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+//-------------------------------------------------------------------------------
+//  Wall clock time in seconds
+//-------------------------------------------------------------------------------
+static double seconds (void)
+{
+#ifdef _OPENMP
+    return(omp_get_wtime());
+#else
+    return((double) clock() / CLOCKS_PER_SEC);
+#endif
+}
+
+
+//-------------------------------------------------------------------------------
+//  Random points in [0,1)x[0,1): half uniform and half in small clusters, so that
+//  the tree is adaptive
+//-------------------------------------------------------------------------------
+static float unitRandom (void)
+{
+    return((float) rand() / ((float) RAND_MAX + 1.0f));
+}
+
+static void randomPoints (float *points, unsigned int nPoints)
+{
+    float centers[64][2];
+    unsigned int i;
+    for (i = 0; i < 64; i++) {
+        centers[i][0] = 0.1f + 0.8f * unitRandom();
+        centers[i][1] = 0.1f + 0.8f * unitRandom();
+    }
+    for (i = 0; i < nPoints; i++) {
+        if (i & 1) {
+            points[2 * i] = unitRandom();
+            points[2 * i + 1] = unitRandom();
+        } else {
+            float *c = centers[rand() & 63];
+            points[2 * i] = c[0] + 0.02f * (unitRandom() + unitRandom() - 1.0f);
+            points[2 * i + 1] = c[1] + 0.02f * (unitRandom() + unitRandom() - 1.0f);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+//  Build the pointer tree with the same leaves as the linear tree; cell is at
+//  the specified level and its first leaf is *leaf. Returns the number of cells
+//  allocated below cell.
+//-------------------------------------------------------------------------------
+static unsigned int buildPointerCell (qtCell *cell, unsigned int level,
+const lqtTree *tree, unsigned int *leaf)
+{
+    cell->level = level;
+    cell->children = 0;
+    cell->data = 0;
+    if (lqtLeafLevel(tree, *leaf) == level) {
+        cell->data = (void *) (size_t) (*leaf)++;
+        return(0);
+    }
+
+    unsigned int nCells = 4, i;
+    cell->children = (qtCell *) malloc(4 * sizeof(qtCell));
+    for (i = 0; i < 4; i++) {
+        qtCell *child = &cell->children[i];
+        child->xLocCode = cell->xLocCode + ((i & 1) << (level - 1));
+        child->yLocCode = cell->yLocCode + ((i >> 1) << (level - 1));
+        child->parent = cell;
+        nCells += buildPointerCell(child, level - 1, tree, leaf);
+    }
+    return(nCells);
+}
+
+static void freePointerCell (qtCell *cell)
+{
+    if (cell->children) {
+        unsigned int i;
+        for (i = 0; i < 4; i++) freePointerCell(&cell->children[i]);
+        free(cell->children);
+    }
+}
+
+static void collectPointerLeaves (qtCell *cell, qtCell **leaves, unsigned int *n)
+{
+    if (!cell->children) leaves[(*n)++] = cell;
+    else {
+        unsigned int i;
+        for (i = 0; i < 4; i++) collectPointerLeaves(&cell->children[i], leaves, n);
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+//  Locate the neighbor of the same size or larger than cell in the direction
+//  (dx,dy) in the pointer tree, as lqtLocateNeighbor: the smallest common
+//  ancestor of cell and the position just outside cell in that direction, then
+//  down towards that position to the level of cell. Unlike QT_TRAVERSE_TO_LEVEL,
+//  the y locational code is not shifted at level 0.
+//-------------------------------------------------------------------------------
+static qtCell *qtLocateNeighbor (qtCell *cell, int dx, int dy)
+{
+    unsigned int binaryCellSize = 1 << cell->level;
+    unsigned int xLocCode = cell->xLocCode, yLocCode = cell->yLocCode;
+    if (dx < 0) {
+        if (xLocCode == 0) return(0);
+        xLocCode--;
+    } else if (dx > 0) {
+        xLocCode += binaryCellSize;
+        if (xLocCode >= (1 << QT_ROOT_LEVEL)) return(0);
+    }
+    if (dy < 0) {
+        if (yLocCode == 0) return(0);
+        yLocCode--;
+    } else if (dy > 0) {
+        yLocCode += binaryCellSize;
+        if (yLocCode >= (1 << QT_ROOT_LEVEL)) return(0);
+    }
+
+    qtCell *pCell = cell;
+    while (((xLocCode ^ pCell->xLocCode) | (yLocCode ^ pCell->yLocCode)) >> pCell->level)
+        pCell = pCell->parent;
+    while (pCell->children && pCell->level > cell->level) {
+        unsigned int nextLevel = pCell->level - 1;
+        pCell = &pCell->children[((xLocCode >> nextLevel) & 1) +
+            (((yLocCode >> nextLevel) & 1) << 1)];
+    }
+    return(pCell);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Octree of pointers with the same leaves as a linear octree, for comparing the
+//  octree queries. The children of a cell are ordered as the leaves of the linear
+//  octree (x, then y, then z); first and count are the leaves in the cell, as in
+//  lotCell.
+//-------------------------------------------------------------------------------
+typedef struct _otCell {
+    unsigned int    xLocCode;
+    unsigned int    yLocCode;
+    unsigned int    zLocCode;
+    unsigned int    level;
+    unsigned int    first;      // Index of the first leaf in the cell
+    unsigned int    count;      // Number of leaves in the cell
+    struct _otCell  *parent;
+    struct _otCell  *children;  // Pointer to first of 8 contiguous child cells
+}   otCell;
+
+static unsigned int buildPointerOctCell (otCell *cell, unsigned int level,
+const lotTree *tree, unsigned int *leaf)
+{
+    cell->level = level;
+    cell->children = 0;
+    cell->first = *leaf;
+    if (lotLeafLevel(tree, *leaf) == level) {
+        (*leaf)++;
+        cell->count = 1;
+        return(0);
+    }
+
+    unsigned int nCells = 8, i;
+    cell->children = (otCell *) malloc(8 * sizeof(otCell));
+    for (i = 0; i < 8; i++) {
+        otCell *child = &cell->children[i];
+        child->xLocCode = cell->xLocCode + ((i & 1) << (level - 1));
+        child->yLocCode = cell->yLocCode + (((i >> 1) & 1) << (level - 1));
+        child->zLocCode = cell->zLocCode + ((i >> 2) << (level - 1));
+        child->parent = cell;
+        nCells += buildPointerOctCell(child, level - 1, tree, leaf);
+    }
+    cell->count = *leaf - cell->first;
+    return(nCells);
+}
+
+static void freePointerOctCell (otCell *cell)
+{
+    if (cell->children) {
+        unsigned int i;
+        for (i = 0; i < 8; i++) freePointerOctCell(&cell->children[i]);
+        free(cell->children);
+    }
+}
+
+static void collectPointerOctLeaves (otCell *cell, otCell **leaves, unsigned int *n)
+{
+    if (!cell->children) leaves[(*n)++] = cell;
+    else {
+        unsigned int i;
+        for (i = 0; i < 8; i++) collectPointerOctLeaves(&cell->children[i], leaves, n);
+    }
+}
+
+//----Follow the locational codes down from cell to the specified level, or to a
+//----leaf if a leaf is reached first
+static otCell *otTraverseToLevel (otCell *cell, unsigned int xLocCode,
+unsigned int yLocCode, unsigned int zLocCode, unsigned int level)
+{
+    while (cell->children && cell->level > level) {
+        unsigned int nextLevel = cell->level - 1;
+        cell = &cell->children[((xLocCode >> nextLevel) & 1) +
+            (((yLocCode >> nextLevel) & 1) << 1) + (((zLocCode >> nextLevel) & 1) << 2)];
+    }
+    return(cell);
+}
+
+static otCell *otLocateCell (otCell *root, const float p[3])
+{
+    return(otTraverseToLevel(root, (unsigned int) (p[0] * LT_MAX_VAL),
+        (unsigned int) (p[1] * LT_MAX_VAL), (unsigned int) (p[2] * LT_MAX_VAL), 0));
+}
+
+static otCell *otLocateRegion (otCell *root, const float v0[3], const float v1[3])
+{
+    unsigned int x0LocCode = (unsigned int) (v0[0] * LT_MAX_VAL);
+    unsigned int y0LocCode = (unsigned int) (v0[1] * LT_MAX_VAL);
+    unsigned int z0LocCode = (unsigned int) (v0[2] * LT_MAX_VAL);
+    unsigned int diff = (x0LocCode ^ (unsigned int) (v1[0] * LT_MAX_VAL)) |
+        (y0LocCode ^ (unsigned int) (v1[1] * LT_MAX_VAL)) |
+        (z0LocCode ^ (unsigned int) (v1[2] * LT_MAX_VAL));
+    unsigned int level = 0;
+    while (diff >> level) level++;
+    return(otTraverseToLevel(root, x0LocCode, y0LocCode, z0LocCode, level));
+}
+
+static otCell *otLocateNeighbor (otCell *cell, int dx, int dy, int dz)
+{
+    unsigned int binaryCellSize = 1 << cell->level;
+    unsigned int locCode[3];
+    int d[3], k;
+    locCode[0] = cell->xLocCode; d[0] = dx;
+    locCode[1] = cell->yLocCode; d[1] = dy;
+    locCode[2] = cell->zLocCode; d[2] = dz;
+    for (k = 0; k < 3; k++) {
+        if (d[k] < 0) {
+            if (locCode[k] == 0) return(0);
+            locCode[k]--;
+        } else if (d[k] > 0) {
+            locCode[k] += binaryCellSize;
+            if (locCode[k] >= (1 << LT_ROOT_LEVEL)) return(0);
+        }
+    }
+
+    otCell *pCell = cell;
+    while (((locCode[0] ^ pCell->xLocCode) | (locCode[1] ^ pCell->yLocCode) |
+        (locCode[2] ^ pCell->zLocCode)) >> pCell->level) pCell = pCell->parent;
+    return(otTraverseToLevel(pCell, locCode[0], locCode[1], locCode[2], cell->level));
+}
+
+
+//-------------------------------------------------------------------------------
+//  Compare a cell of the pointer tree with a cell of the linear tree. The results
+//  involving level 0 cells are not compared: QT_TRAVERSE and QT_TRAVERSE_TO_LEVEL
+//  shift the y locational code by -1 when stepping to a level 0 child, so the
+//  pointer tree does not find level 0 cells with odd y locational codes.
+//-------------------------------------------------------------------------------
+static int isLevelZero (const lqtTree *tree, unsigned int i)
+{
+    return(i != LT_NO_CELL && lqtLeafLevel(tree, i) == 0);
+}
+
+static int sameCell (const qtCell *a, const lqtCell *b)
+{
+    return(a->xLocCode == b->xLocCode && a->yLocCode == b->yLocCode && a->level == b->level);
+}
+
+static int sameLeaf (const lqtTree *tree, const qtCell *a, unsigned int i)
+{
+    lqtCell b;
+    if (i == LT_NO_CELL) return(a == 0);
+    if (!a || a->children || (size_t) a->data != i) return(0);
+    lqtGetLeaf(tree, i, &b);
+    return(sameCell(a, &b));
+}
+
+static int sameOctCell (const otCell *a, const lotCell *b)
+{
+    return(a->xLocCode == b->xLocCode && a->yLocCode == b->yLocCode &&
+        a->zLocCode == b->zLocCode && a->level == b->level && a->first == b->first &&
+        a->count == b->count);
+}
+
+
+int main (int argc, char **argv)
+{
+    unsigned int nPoints = (argc > 1) ? (unsigned int) atoi(argv[1]) : 400000;
+    unsigned int maxPointsPerCell = (argc > 2) ? (unsigned int) atoi(argv[2]) : 1;
+    unsigned int nQueries = 1 << 22;
+    unsigned int i, errors, skipped, totalErrors = 0;
+    double start;
+
+    if (nPoints < 2 || nPoints <= maxPointsPerCell) {
+        printf("nPoints must be at least 2 and greater than maxPointsPerCell\n");
+        return(1);
+    }
+
+    float *points = (float *) malloc(2 * nPoints * sizeof(float));
+    srand(1);
+    randomPoints(points, nPoints);
+
+
+    //----Construction
+    lqtTree tree;
+    start = seconds();
+    if (lqtBuildFromPoints(&tree, points, nPoints, maxPointsPerCell)) {
+        printf("out of memory\n");
+        return(1);
+    }
+    double linearBuildTime = seconds() - start;
+
+    qtCell root;
+    unsigned int leaf = 0;
+    root.xLocCode = root.yLocCode = 0;
+    root.parent = 0;
+    start = seconds();
+    unsigned int nPointerCells = 1 + buildPointerCell(&root, QT_ROOT_LEVEL, &tree, &leaf);
+    double pointerBuildTime = seconds() - start;
+
+    qtCell **pointerLeaves = (qtCell **) malloc(tree.nCells * sizeof(qtCell *));
+    unsigned int nPointerLeaves = 0;
+    collectPointerLeaves(&root, pointerLeaves, &nPointerLeaves);
+
+    size_t linearBytes = tree.nCells * sizeof(unsigned int) +
+        ((1 << LQT_BUCKET_BITS) + 1) * sizeof(unsigned int);
+    size_t pointerBytes = nPointerCells * sizeof(qtCell);
+    printf("%u points, %u leaves (%u cells in the pointer tree)\n", nPoints, tree.nCells,
+        nPointerCells);
+    printf("linear  tree: %.2f bytes per leaf, built in %.3f s from the points\n",
+        (double) linearBytes / tree.nCells, linearBuildTime);
+    printf("pointer tree: %.2f bytes per leaf, built in %.3f s from the linear tree\n",
+        (double) pointerBytes / tree.nCells, pointerBuildTime);
+
+
+    //----Point location, on both uniform and clustered points
+    float *queries = (float *) malloc(2 * nQueries * sizeof(float));
+    unsigned int *cells = (unsigned int *) malloc(nQueries * sizeof(unsigned int));
+    unsigned int *batchCells = (unsigned int *) malloc(nQueries * sizeof(unsigned int));
+    qtCell **pointerCells = (qtCell **) malloc(nQueries * sizeof(qtCell *));
+    srand(2);
+    randomPoints(queries, nQueries);
+
+    start = seconds();
+    for (i = 0; i < nQueries; i++) pointerCells[i] = qtLocateCell(&root, &queries[2 * i]);
+    double pointerTime = seconds() - start;
+
+    start = seconds();
+    for (i = 0; i < nQueries; i++) cells[i] = lqtLocateCell(&tree, &queries[2 * i]);
+    double linearTime = seconds() - start;
+
+    start = seconds();
+    lqtLocateCells(&tree, queries, nQueries, batchCells);
+    double batchTime = seconds() - start;
+
+    for (errors = skipped = 0, i = 0; i < nQueries; i++) {
+        if (batchCells[i] != cells[i]) errors++;
+        else if (isLevelZero(&tree, cells[i])) skipped++;
+        else if (!sameLeaf(&tree, pointerCells[i], cells[i])) errors++;
+    }
+    totalErrors += errors;
+    printf("point location (Mqueries/s): pointer %.2f, linear %.2f, linear batch %.2f, "
+        "errors %u (%u at level 0 not compared)\n", nQueries * 1e-6 / pointerTime,
+        nQueries * 1e-6 / linearTime, nQueries * 1e-6 / batchTime, errors, skipped);
+
+
+    //----Region location, boxes of up to 1/256 to 1/32768 of the root size
+    for (i = 0; i < nQueries / 2; i++) {
+        float *v = &queries[4 * i];
+        float scale = 1.0f / (256 << (rand() & 7));
+        float w = unitRandom() * scale, h = unitRandom() * scale;
+        if (v[0] + w >= 1.0f) v[0] = 1.0f - w - 1e-6f;
+        if (v[1] + h >= 1.0f) v[1] = 1.0f - h - 1e-6f;
+        v[2] = v[0] + w;
+        v[3] = v[1] + h;
+    }
+    lqtCell *regions = (lqtCell *) malloc((nQueries / 2) * sizeof(lqtCell));
+
+    start = seconds();
+    for (i = 0; i < nQueries / 2; i++)
+        pointerCells[i] = qtLocateRegion(&root, &queries[4 * i], &queries[4 * i + 2]);
+    pointerTime = seconds() - start;
+
+    start = seconds();
+    for (i = 0; i < nQueries / 2; i++)
+        lqtLocateRegion(&tree, &queries[4 * i], &queries[4 * i + 2], &regions[i]);
+    linearTime = seconds() - start;
+
+    //----qtLocateRegion never returns level 0 cells, which only matters for regions
+    //----within a single level 0 cell
+    for (errors = 0, i = 0; i < nQueries / 2; i++)
+        if (!sameCell(pointerCells[i], &regions[i]) && regions[i].level != 0) errors++;
+    totalErrors += errors;
+    printf("region location (Mqueries/s): pointer %.2f, linear %.2f, errors %u\n",
+        nQueries * 0.5e-6 / pointerTime, nQueries * 0.5e-6 / linearTime, errors);
+
+
+    //----Neighbor location for every leaf
+    lqtCell *leaves = (lqtCell *) malloc(tree.nCells * sizeof(lqtCell));
+    lqtCell *nbrs = (lqtCell *) malloc(tree.nCells * sizeof(lqtCell));
+    int *found = (int *) malloc(tree.nCells * sizeof(int));
+    qtCell **pointerNbrs = (qtCell **) malloc(tree.nCells * sizeof(qtCell *));
+    for (i = 0; i < tree.nCells; i++) lqtGetLeaf(&tree, i, &leaves[i]);
+
+    start = seconds();
+    for (i = 0; i < tree.nCells; i++) pointerNbrs[i] = qtLocateLeftNeighbor(pointerLeaves[i]);
+    pointerTime = seconds() - start;
+
+    start = seconds();
+    for (i = 0; i < tree.nCells; i++)
+        found[i] = lqtLocateLeftNeighbor(&tree, &leaves[i], &nbrs[i]);
+    linearTime = seconds() - start;
+
+    for (errors = skipped = 0, i = 0; i < tree.nCells; i++) {
+        if (leaves[i].level == 0) skipped++;
+        else if (!sameCell(pointerLeaves[i], &leaves[i])) errors++;
+        else if (found[i] ? !(pointerNbrs[i] && sameCell(pointerNbrs[i], &nbrs[i]))
+            : pointerNbrs[i] != 0) errors++;
+    }
+    totalErrors += errors;
+    printf("left neighbor (Mqueries/s): pointer %.2f, linear %.2f, errors %u "
+        "(%u at level 0 not compared)\n", tree.nCells * 1e-6 / pointerTime,
+        tree.nCells * 1e-6 / linearTime, errors, skipped);
+
+    for (errors = skipped = 0, i = 0; i < tree.nCells; i++) {
+        qtCell *nbr = qtLocateRightNeighbor(pointerLeaves[i]);
+        int isFound = lqtLocateRightNeighbor(&tree, &leaves[i], &nbrs[i]);
+        if (leaves[i].level == 0) skipped++;
+        else if (isFound ? !(nbr && sameCell(nbr, &nbrs[i])) : nbr != 0) errors++;
+    }
+    totalErrors += errors;
+    printf("right neighbor: errors %u (%u at level 0 not compared)\n", errors, skipped);
+
+    //----All 8 directions, with the pointer search above, which handles level 0
+    for (errors = 0, i = 0; i < tree.nCells; i++) {
+        int dx, dy;
+        for (dy = -1; dy <= 1; dy++) {
+            for (dx = -1; dx <= 1; dx++) {
+                if (!dx && !dy) continue;
+                qtCell *nbr = qtLocateNeighbor(pointerLeaves[i], dx, dy);
+                if (lqtLocateNeighbor(&tree, &leaves[i], dx, dy, &nbrs[i]) ?
+                    !(nbr && sameCell(nbr, &nbrs[i]) &&
+                    (nbr->children || (size_t) nbr->data == nbrs[i].first)) : nbr != 0)
+                    errors++;
+            }
+        }
+    }
+    totalErrors += errors;
+    printf("edge and vertex neighbors, 8 directions: errors %u\n", errors);
+
+    for (errors = skipped = 0, i = 0; i < tree.nCells; i++) {
+        qtCell *b, *r, *rb;
+        unsigned int bi, ri, rbi;
+        qtLocateRBVertexNeighbors(pointerLeaves[i], &b, &r, &rb);
+        lqtLocateRBVertexNeighbors(&tree, &leaves[i], &bi, &ri, &rbi);
+        if (leaves[i].level == 0 || isLevelZero(&tree, bi) || isLevelZero(&tree, ri) ||
+            isLevelZero(&tree, rbi)) skipped++;
+        else if (!sameLeaf(&tree, b, bi) || !sameLeaf(&tree, r, ri) || !sameLeaf(&tree, rb, rbi))
+            errors++;
+    }
+    totalErrors += errors;
+    printf("right-bottom vertex neighbors: errors %u (%u at level 0 not compared)\n",
+        errors, skipped);
+
+
+    //----Octree over the same points, lifted to 3D
+    float *points3 = (float *) malloc(3 * nPoints * sizeof(float));
+    for (i = 0; i < nPoints; i++) {
+        points3[3 * i] = points[2 * i];
+        points3[3 * i + 1] = points[2 * i + 1];
+        points3[3 * i + 2] = 0.5f * (points[2 * i] + points[2 * i + 1]);
+    }
+    lotTree octree;
+    start = seconds();
+    if (lotBuildFromPoints(&octree, points3, nPoints, maxPointsPerCell) == 0) {
+        double octreeBuildTime = seconds() - start;
+
+        otCell octRoot;
+        leaf = 0;
+        octRoot.xLocCode = octRoot.yLocCode = octRoot.zLocCode = 0;
+        octRoot.parent = 0;
+        start = seconds();
+        unsigned int nPointerOctCells = 1 + buildPointerOctCell(&octRoot, LT_ROOT_LEVEL,
+            &octree, &leaf);
+        double pointerOctBuildTime = seconds() - start;
+        otCell **pointerOctLeaves = (otCell **) malloc(octree.nCells * sizeof(otCell *));
+        unsigned int nPointerOctLeaves = 0;
+        collectPointerOctLeaves(&octRoot, pointerOctLeaves, &nPointerOctLeaves);
+
+        printf("octree: %u leaves (%u cells in the pointer tree)\n", octree.nCells,
+            nPointerOctCells);
+        printf("linear  octree: %.2f bytes per leaf, built in %.3f s from the points\n",
+            (double) (octree.nCells * sizeof(unsigned long long) +
+            ((1 << LOT_BUCKET_BITS) + 1) * sizeof(unsigned int)) / octree.nCells,
+            octreeBuildTime);
+        printf("pointer octree: %.2f bytes per leaf, built in %.3f s from the linear tree\n",
+            (double) (nPointerOctCells * sizeof(otCell)) / octree.nCells,
+            pointerOctBuildTime);
+
+        //----Point location, half uniform and half near the points
+        float *queries3 = (float *) malloc(6 * nQueries * sizeof(float));
+        for (i = 0; i < nQueries; i++) {
+            float *q = &queries3[3 * i];
+            q[0] = queries[2 * i];
+            q[1] = queries[2 * i + 1];
+            if (i & 1) q[2] = unitRandom();
+            else {
+                q[2] = 0.5f * (q[0] + q[1]) + 0.001f * (unitRandom() - 0.5f);
+                if (q[2] < 0.0f) q[2] = 0.0f;
+                if (q[2] >= 1.0f) q[2] = 1.0f - 1e-6f;
+            }
+        }
+        otCell **pointerOctCells = (otCell **) malloc(nQueries * sizeof(otCell *));
+
+        start = seconds();
+        for (i = 0; i < nQueries; i++)
+            pointerOctCells[i] = otLocateCell(&octRoot, &queries3[3 * i]);
+        pointerTime = seconds() - start;
+
+        start = seconds();
+        for (i = 0; i < nQueries; i++) cells[i] = lotLocateCell(&octree, &queries3[3 * i]);
+        linearTime = seconds() - start;
+
+        start = seconds();
+        lotLocateCells(&octree, queries3, nQueries, batchCells);
+        batchTime = seconds() - start;
+
+        for (errors = 0, i = 0; i < nQueries; i++) {
+            if (batchCells[i] != cells[i] || pointerOctCells[i]->children ||
+                pointerOctCells[i]->first != cells[i]) errors++;
+        }
+        totalErrors += errors;
+        printf("octree point location (Mqueries/s): pointer %.2f, linear %.2f, "
+            "linear batch %.2f, errors %u\n", nQueries * 1e-6 / pointerTime,
+            nQueries * 1e-6 / linearTime, nQueries * 1e-6 / batchTime, errors);
+
+        //----Region location, boxes of up to 1/256 to 1/32768 of the root size
+        for (i = 0; i < nQueries / 2; i++) {
+            float *v = &queries3[6 * i];
+            float scale = 1.0f / (256 << (rand() & 7)), s[3];
+            int k;
+            for (k = 0; k < 3; k++) {
+                s[k] = unitRandom() * scale;
+                if (v[k] + s[k] >= 1.0f) v[k] = 1.0f - s[k] - 1e-6f;
+            }
+            for (k = 0; k < 3; k++) v[3 + k] = v[k] + s[k];
+        }
+        lotCell *octRegions = (lotCell *) malloc((nQueries / 2) * sizeof(lotCell));
+
+        start = seconds();
+        for (i = 0; i < nQueries / 2; i++)
+            pointerOctCells[i] = otLocateRegion(&octRoot, &queries3[6 * i], &queries3[6 * i + 3]);
+        pointerTime = seconds() - start;
+
+        start = seconds();
+        for (i = 0; i < nQueries / 2; i++)
+            lotLocateRegion(&octree, &queries3[6 * i], &queries3[6 * i + 3], &octRegions[i]);
+        linearTime = seconds() - start;
+
+        for (errors = 0, i = 0; i < nQueries / 2; i++)
+            if (!sameOctCell(pointerOctCells[i], &octRegions[i])) errors++;
+        totalErrors += errors;
+        printf("octree region location (Mqueries/s): pointer %.2f, linear %.2f, errors %u\n",
+            nQueries * 0.5e-6 / pointerTime, nQueries * 0.5e-6 / linearTime, errors);
+
+        //----Neighbor location for every leaf; the left neighbors are timed, all 26
+        //----directions are compared
+        lotCell *octLeaves = (lotCell *) malloc(octree.nCells * sizeof(lotCell));
+        lotCell *octNbrs = (lotCell *) malloc(octree.nCells * sizeof(lotCell));
+        int *octFound = (int *) malloc(octree.nCells * sizeof(int));
+        otCell **pointerOctNbrs = (otCell **) malloc(octree.nCells * sizeof(otCell *));
+        for (i = 0; i < octree.nCells; i++) lotGetLeaf(&octree, i, &octLeaves[i]);
+
+        start = seconds();
+        for (i = 0; i < octree.nCells; i++)
+            pointerOctNbrs[i] = otLocateNeighbor(pointerOctLeaves[i], -1, 0, 0);
+        pointerTime = seconds() - start;
+
+        start = seconds();
+        for (i = 0; i < octree.nCells; i++)
+            octFound[i] = lotLocateNeighbor(&octree, &octLeaves[i], -1, 0, 0, &octNbrs[i]);
+        linearTime = seconds() - start;
+
+        for (errors = 0, i = 0; i < octree.nCells; i++) {
+            int dx, dy, dz;
+            if (!sameOctCell(pointerOctLeaves[i], &octLeaves[i])) errors++;
+            for (dz = -1; dz <= 1; dz++) {
+                for (dy = -1; dy <= 1; dy++) {
+                    for (dx = -1; dx <= 1; dx++) {
+                        if (!dx && !dy && !dz) continue;
+                        otCell *nbr = otLocateNeighbor(pointerOctLeaves[i], dx, dy, dz);
+                        if (lotLocateNeighbor(&octree, &octLeaves[i], dx, dy, dz, &octNbrs[i]) ?
+                            !(nbr && sameOctCell(nbr, &octNbrs[i])) : nbr != 0) errors++;
+                    }
+                }
+            }
+        }
+        totalErrors += errors;
+        printf("octree left neighbor (Mqueries/s): pointer %.2f, linear %.2f; "
+            "26 directions: errors %u\n", octree.nCells * 1e-6 / pointerTime,
+            octree.nCells * 1e-6 / linearTime, errors);
+
+        free(pointerOctNbrs);
+        free(octFound);
+        free(octNbrs);
+        free(octLeaves);
+        free(octRegions);
+        free(pointerOctCells);
+        free(queries3);
+        free(pointerOctLeaves);
+        freePointerOctCell(&octRoot);
+        lotFree(&octree);
+    } else {
+        printf("octree: out of memory\n");
+        totalErrors++;
+    }
+
+    free(points3);
+    free(pointerNbrs);
+    free(found);
+    free(nbrs);
+    free(leaves);
+    free(regions);
+    free(pointerCells);
+    free(batchCells);
+    free(cells);
+    free(queries);
+    free(pointerLeaves);
+    freePointerCell(&root);
+    lqtFree(&tree);
+    free(points);
+
+    if (totalErrors) {
+        printf("FAILED: %u queries differ from the pointer trees\n", totalErrors);
+        return(1);
+    }
+    return(0);
+}
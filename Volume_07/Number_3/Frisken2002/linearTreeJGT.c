@@ -0,0 +1,784 @@
+//-------------------------------------------------------------------------------
+//  Linear (pointerless) quadtrees and octrees using locational codes. See
+//  linearTreeJGT.h for the representation and treeTraversalJGT.c for the
+//  pointer based traversal that these functions mirror.
+//-------------------------------------------------------------------------------
+#include "linearTreeJGT.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+//-------------------------------------------------------------------------------
+//  Number of levels split serially before the subtrees are built in parallel,
+//  giving up to 4096 subtrees for both quadtrees (4^6) and octrees (8^4)
+//-------------------------------------------------------------------------------
+#define LT_TASK_DEPTH(dims) (12 / (dims))
+
+
+//-------------------------------------------------------------------------------
+//  Interleave the bits of 15-bit locational codes into Morton keys, and back.
+//  The x bits come first, so the child index of a key is the same as in
+//  QT_TRAVERSE (x + 2y, and x + 2y + 4z for octrees).
+//-------------------------------------------------------------------------------
+static unsigned int lqtSpread (unsigned int v)
+{
+    v &= 0x00007fff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return(v);
+}
+
+static unsigned int lqtCompact (unsigned int v)
+{
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return(v);
+}
+
+static unsigned long long lotSpread (unsigned int x)
+{
+    unsigned long long v = x & 0x00007fff;
+    v = (v | (v << 32)) & 0x001f00000000ffffULL;
+    v = (v | (v << 16)) & 0x001f0000ff0000ffULL;
+    v = (v | (v << 8))  & 0x100f00f00f00f00fULL;
+    v = (v | (v << 4))  & 0x10c30c30c30c30c3ULL;
+    v = (v | (v << 2))  & 0x1249249249249249ULL;
+    return(v);
+}
+
+static unsigned int lotCompact (unsigned long long v)
+{
+    v &= 0x1249249249249249ULL;
+    v = (v | (v >> 2))  & 0x10c30c30c30c30c3ULL;
+    v = (v | (v >> 4))  & 0x100f00f00f00f00fULL;
+    v = (v | (v >> 8))  & 0x001f0000ff0000ffULL;
+    v = (v | (v >> 16)) & 0x001f00000000ffffULL;
+    v = (v | (v >> 32)) & 0x00000000001fffffULL;
+    return((unsigned int) v);
+}
+
+static unsigned int lqtKey (unsigned int xLocCode, unsigned int yLocCode)
+{
+    return(lqtSpread(xLocCode) | (lqtSpread(yLocCode) << 1));
+}
+
+static unsigned long long lotKey (unsigned int xLocCode, unsigned int yLocCode,
+unsigned int zLocCode)
+{
+    return(lotSpread(xLocCode) | (lotSpread(yLocCode) << 1) | (lotSpread(zLocCode) << 2));
+}
+
+
+//-------------------------------------------------------------------------------
+//  Base 2 logarithm of a power of 2
+//-------------------------------------------------------------------------------
+static unsigned int ltLog2 (unsigned long long v)
+{
+#if defined(__GNUC__)
+    return((unsigned int) __builtin_ctzll(v));
+#else
+    unsigned int n = 0;
+    while (v >>= 1) n++;
+    return(n);
+#endif
+}
+
+
+//-------------------------------------------------------------------------------
+//  Parallel LSD radix sort of n keys with nBits significant bits, 8 bits per
+//  pass. tmp must have room for n keys.
+//-------------------------------------------------------------------------------
+static int ltRadixSort (unsigned long long *keys, unsigned long long *tmp, unsigned int n,
+unsigned int nBits)
+{
+    int nThreads = 1;
+#ifdef _OPENMP
+    nThreads = omp_get_max_threads();
+#endif
+    unsigned int *counts = (unsigned int *) malloc(nThreads * 256 * sizeof(unsigned int));
+    if (!counts) return(-1);
+
+    unsigned long long *src = keys, *dst = tmp;
+    unsigned int shift;
+    for (shift = 0; shift < nBits; shift += 8) {
+        #pragma omp parallel num_threads(nThreads)
+        {
+            int t = 0, nt = 1;
+#ifdef _OPENMP
+            t = omp_get_thread_num();
+            nt = omp_get_num_threads();
+#endif
+            unsigned int lo = (unsigned int) (((unsigned long long) n * t) / nt);
+            unsigned int hi = (unsigned int) (((unsigned long long) n * (t + 1)) / nt);
+            unsigned int *count = counts + 256 * t;
+            unsigned int i;
+
+            //----Count the digits of this thread's keys
+            memset(count, 0, 256 * sizeof(unsigned int));
+            for (i = lo; i < hi; i++) count[(src[i] >> shift) & 0xff]++;
+            #pragma omp barrier
+
+            //----Turn the counts into start positions, by digit, then by thread
+            #pragma omp single
+            {
+                unsigned int sum = 0, d;
+                int j;
+                for (d = 0; d < 256; d++) {
+                    for (j = 0; j < nt; j++) {
+                        unsigned int c = counts[256 * j + d];
+                        counts[256 * j + d] = sum;
+                        sum += c;
+                    }
+                }
+            }
+
+            //----Scatter, keeping the order of equal digits
+            for (i = lo; i < hi; i++) dst[count[(src[i] >> shift) & 0xff]++] = src[i];
+        }
+        unsigned long long *swap = src; src = dst; dst = swap;
+    }
+    if (src != keys) memcpy(keys, src, n * sizeof(unsigned long long));
+    free(counts);
+    return(0);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Index of the first of the sorted keys in [lo,hi) that is not less than key
+//-------------------------------------------------------------------------------
+static unsigned int ltLowerBound (const unsigned long long *keys, unsigned int lo,
+unsigned int hi, unsigned long long key)
+{
+    while (lo < hi) {
+        unsigned int mid = lo + ((hi - lo) >> 1);
+        if (keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return(lo);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Leaf construction from the sorted point keys in [lo,hi), which lie in the
+//  cell with the specified key and level. A cell is split into its 2^dims
+//  children while it contains more than maxPoints points and is above level 0.
+//  ltCountLeaves returns the number of leaves and ltEmitLeaves writes their keys.
+//  ltGatherTasks collects the cells at which the construction is continued in
+//  parallel: leaves, and the cells taskDepth levels below the root.
+//-------------------------------------------------------------------------------
+typedef struct _ltTask {
+    unsigned long long  key;
+    unsigned int        level;
+    unsigned int        lo, hi;         // Range of the point keys in the cell
+    unsigned int        first;          // Index of the task's first leaf
+}   ltTask;
+
+static unsigned int ltCountLeaves (const unsigned long long *keys, unsigned int lo,
+unsigned int hi, unsigned long long key, unsigned int level, unsigned int dims,
+unsigned int maxPoints)
+{
+    if (hi - lo <= maxPoints || level == 0) return(1);
+
+    unsigned long long childSize = 1ULL << (dims * (level - 1));
+    unsigned int nChildren = 1 << dims, n = 0, c;
+    for (c = 0; c < nChildren; c++) {
+        unsigned long long childKey = key + c * childSize;
+        unsigned int childHi = (c == nChildren - 1) ? hi :
+            ltLowerBound(keys, lo, hi, childKey + childSize);
+        n += ltCountLeaves(keys, lo, childHi, childKey, level - 1, dims, maxPoints);
+        lo = childHi;
+    }
+    return(n);
+}
+
+static unsigned int ltEmitLeaves (const unsigned long long *keys, unsigned int lo,
+unsigned int hi, unsigned long long key, unsigned int level, unsigned int dims,
+unsigned int maxPoints, unsigned long long *leaves)
+{
+    if (hi - lo <= maxPoints || level == 0) {
+        leaves[0] = key;
+        return(1);
+    }
+
+    unsigned long long childSize = 1ULL << (dims * (level - 1));
+    unsigned int nChildren = 1 << dims, n = 0, c;
+    for (c = 0; c < nChildren; c++) {
+        unsigned long long childKey = key + c * childSize;
+        unsigned int childHi = (c == nChildren - 1) ? hi :
+            ltLowerBound(keys, lo, hi, childKey + childSize);
+        n += ltEmitLeaves(keys, lo, childHi, childKey, level - 1, dims, maxPoints, leaves + n);
+        lo = childHi;
+    }
+    return(n);
+}
+
+static void ltGatherTasks (const unsigned long long *keys, unsigned int lo, unsigned int hi,
+unsigned long long key, unsigned int level, unsigned int dims, unsigned int maxPoints,
+unsigned int taskLevel, ltTask *tasks, unsigned int *nTasks)
+{
+    if (hi - lo <= maxPoints || level <= taskLevel) {
+        ltTask *task = &tasks[(*nTasks)++];
+        task->key = key;
+        task->level = level;
+        task->lo = lo;
+        task->hi = hi;
+        return;
+    }
+
+    unsigned long long childSize = 1ULL << (dims * (level - 1));
+    unsigned int nChildren = 1 << dims, c;
+    for (c = 0; c < nChildren; c++) {
+        unsigned long long childKey = key + c * childSize;
+        unsigned int childHi = (c == nChildren - 1) ? hi :
+            ltLowerBound(keys, lo, hi, childKey + childSize);
+        ltGatherTasks(keys, lo, childHi, childKey, level - 1, dims, maxPoints, taskLevel,
+            tasks, nTasks);
+        lo = childHi;
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+//  Build the sorted leaf keys of the tree over the nPoints point keys, which are
+//  sorted in place. Returns the leaf keys (to be freed by the caller), or null if
+//  out of memory.
+//-------------------------------------------------------------------------------
+static unsigned long long *ltBuildLeaves (unsigned long long *keys, unsigned int nPoints,
+unsigned int dims, unsigned int maxPoints, unsigned int *nLeaves)
+{
+    //----Sort the point keys
+    unsigned long long *tmp = (unsigned long long *) malloc(
+        (nPoints ? nPoints : 1) * sizeof(unsigned long long));
+    if (!tmp) return(0);
+    if (ltRadixSort(keys, tmp, nPoints, dims * LT_ROOT_LEVEL)) {
+        free(tmp);
+        return(0);
+    }
+    free(tmp);
+
+
+    //----Split the top levels serially into independent subtrees
+    unsigned int maxTasks = 1 << (dims * LT_TASK_DEPTH(dims));
+    ltTask *tasks = (ltTask *) malloc(maxTasks * sizeof(ltTask));
+    if (!tasks) return(0);
+    unsigned int nTasks = 0;
+    ltGatherTasks(keys, 0, nPoints, 0, LT_ROOT_LEVEL, dims, maxPoints,
+        LT_ROOT_LEVEL - LT_TASK_DEPTH(dims), tasks, &nTasks);
+
+
+    //----Count the leaves of each subtree in parallel, and place them
+    int i;
+    #pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < (int) nTasks; i++) {
+        ltTask *task = &tasks[i];
+        task->first = ltCountLeaves(keys, task->lo, task->hi, task->key, task->level,
+            dims, maxPoints);
+    }
+    unsigned int n = 0;
+    for (i = 0; i < (int) nTasks; i++) {
+        unsigned int count = tasks[i].first;
+        tasks[i].first = n;
+        n += count;
+    }
+
+
+    //----Write the leaf keys of each subtree in parallel
+    unsigned long long *leaves = (unsigned long long *) malloc(n * sizeof(unsigned long long));
+    if (leaves) {
+        #pragma omp parallel for schedule(dynamic)
+        for (i = 0; i < (int) nTasks; i++) {
+            ltTask *task = &tasks[i];
+            ltEmitLeaves(keys, task->lo, task->hi, task->key, task->level, dims, maxPoints,
+                leaves + task->first);
+        }
+    }
+    free(tasks);
+    *nLeaves = n;
+    return(leaves);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Quadtree construction
+//-------------------------------------------------------------------------------
+static int lqtBuildBuckets (lqtTree *tree)
+{
+    unsigned int nBuckets = 1 << LQT_BUCKET_BITS;
+    tree->bucketStart = (unsigned int *) malloc((nBuckets + 1) * sizeof(unsigned int));
+    if (!tree->bucketStart) return(-1);
+
+    int b;
+    #pragma omp parallel for schedule(static)
+    for (b = 0; b < (int) nBuckets; b++) {
+        unsigned int key = (unsigned int) b << (LQT_KEY_BITS - LQT_BUCKET_BITS);
+        unsigned int lo = 0, hi = tree->nCells;
+        while (lo < hi) {
+            unsigned int mid = lo + ((hi - lo) >> 1);
+            if (tree->keys[mid] < key) lo = mid + 1;
+            else hi = mid;
+        }
+        tree->bucketStart[b] = lo;
+    }
+    tree->bucketStart[nBuckets] = tree->nCells;
+    return(0);
+}
+
+int lqtBuildFromKeys (lqtTree *tree, const unsigned int *keys, unsigned int nCells)
+{
+    tree->nCells = nCells;
+    tree->bucketStart = 0;
+    tree->keys = (unsigned int *) malloc(nCells * sizeof(unsigned int));
+    if (!tree->keys) {
+        lqtFree(tree);
+        return(-1);
+    }
+    memcpy(tree->keys, keys, nCells * sizeof(unsigned int));
+    if (lqtBuildBuckets(tree)) {
+        lqtFree(tree);
+        return(-1);
+    }
+    return(0);
+}
+
+int lqtBuildFromPoints (lqtTree *tree, const float *points, unsigned int nPoints,
+unsigned int maxPointsPerCell)
+{
+    tree->nCells = 0;
+    tree->keys = 0;
+    tree->bucketStart = 0;
+
+    //----Determine the keys of the points' positions
+    unsigned long long *keys = (unsigned long long *) malloc(
+        (nPoints ? nPoints : 1) * sizeof(unsigned long long));
+    if (!keys) return(-1);
+    int i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < (int) nPoints; i++) {
+        unsigned int xLocCode = (unsigned int) (points[2 * i] * LT_MAX_VAL);
+        unsigned int yLocCode = (unsigned int) (points[2 * i + 1] * LT_MAX_VAL);
+        keys[i] = lqtKey(xLocCode, yLocCode);
+    }
+
+
+    //----Build the leaves and store their keys
+    unsigned int nCells;
+    unsigned long long *leaves = ltBuildLeaves(keys, nPoints, 2, maxPointsPerCell, &nCells);
+    free(keys);
+    if (!leaves) return(-1);
+    tree->nCells = nCells;
+    tree->keys = (unsigned int *) malloc(nCells * sizeof(unsigned int));
+    if (!tree->keys) {
+        free(leaves);
+        return(-1);
+    }
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < (int) nCells; i++) tree->keys[i] = (unsigned int) leaves[i];
+    free(leaves);
+
+    if (lqtBuildBuckets(tree)) {
+        lqtFree(tree);
+        return(-1);
+    }
+    return(0);
+}
+
+void lqtFree (lqtTree *tree)
+{
+    free(tree->keys);
+    free(tree->bucketStart);
+    tree->keys = 0;
+    tree->bucketStart = 0;
+    tree->nCells = 0;
+}
+
+
+//-------------------------------------------------------------------------------
+//  Quadtree leaves and searches. lqtFindLeaf returns the index of the leaf
+//  containing key, i.e. of the last leaf key not greater than key, searching
+//  only the keys in key's bucket. If the bucket has no such key, the leaf starts
+//  in an earlier bucket and is the one before the bucket. lqtLowerBound returns
+//  the index of the first leaf key not less than key.
+//-------------------------------------------------------------------------------
+unsigned int lqtLeafLevel (const lqtTree *tree, unsigned int i)
+{
+    unsigned int next = (i + 1 < tree->nCells) ? tree->keys[i + 1] : (1u << LQT_KEY_BITS);
+    return(ltLog2(next - tree->keys[i]) >> 1);
+}
+
+void lqtGetLeaf (const lqtTree *tree, unsigned int i, lqtCell *cell)
+{
+    unsigned int key = tree->keys[i];
+    cell->xLocCode = lqtCompact(key);
+    cell->yLocCode = lqtCompact(key >> 1);
+    cell->level = lqtLeafLevel(tree, i);
+    cell->first = i;
+    cell->count = 1;
+}
+
+static unsigned int lqtFindLeaf (const lqtTree *tree, unsigned int key)
+{
+    unsigned int b = key >> (LQT_KEY_BITS - LQT_BUCKET_BITS);
+    unsigned int lo = tree->bucketStart[b], hi = tree->bucketStart[b + 1];
+    while (lo < hi) {
+        unsigned int mid = lo + ((hi - lo) >> 1);
+        if (tree->keys[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    return(lo - 1);
+}
+
+static unsigned int lqtLowerBound (const lqtTree *tree, unsigned int key)
+{
+    if (key >= (1u << LQT_KEY_BITS)) return(tree->nCells);
+    unsigned int b = key >> (LQT_KEY_BITS - LQT_BUCKET_BITS);
+    unsigned int lo = tree->bucketStart[b], hi = tree->bucketStart[b + 1];
+    while (lo < hi) {
+        unsigned int mid = lo + ((hi - lo) >> 1);
+        if (tree->keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return(lo);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Set cell to the cell at the specified level containing the position with the
+//  locational codes xLocCode and yLocCode, or to the leaf containing it (given
+//  by its index, leaf) if that leaf is at the level or above it.
+//-------------------------------------------------------------------------------
+static void lqtMakeCell (const lqtTree *tree, unsigned int xLocCode, unsigned int yLocCode,
+unsigned int level, unsigned int leaf, lqtCell *cell)
+{
+    unsigned int leafLevel = lqtLeafLevel(tree, leaf);
+    if (leafLevel >= level) {
+        unsigned int key = tree->keys[leaf];
+        cell->xLocCode = lqtCompact(key);
+        cell->yLocCode = lqtCompact(key >> 1);
+        cell->level = leafLevel;
+        cell->first = leaf;
+        cell->count = 1;
+    } else {
+        unsigned int mask = ~((1u << level) - 1);
+        cell->xLocCode = xLocCode & mask;
+        cell->yLocCode = yLocCode & mask;
+        cell->level = level;
+        unsigned int key = lqtKey(cell->xLocCode, cell->yLocCode);
+        cell->first = lqtLowerBound(tree, key);
+        cell->count = lqtLowerBound(tree, key + (1u << (2 * level))) - cell->first;
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+//  Quadtree point and region location
+//-------------------------------------------------------------------------------
+unsigned int lqtLocateCell (const lqtTree *tree, const float p[2])
+{
+    unsigned int xLocCode = (unsigned int) (p[0] * LT_MAX_VAL);
+    unsigned int yLocCode = (unsigned int) (p[1] * LT_MAX_VAL);
+    return(lqtFindLeaf(tree, lqtKey(xLocCode, yLocCode)));
+}
+
+void lqtLocateCells (const lqtTree *tree, const float *points, unsigned int nPoints,
+unsigned int *cells)
+{
+    int i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < (int) nPoints; i++) cells[i] = lqtLocateCell(tree, points + 2 * i);
+}
+
+void lqtLocateRegion (const lqtTree *tree, const float v0[2], const float v1[2],
+lqtCell *cell)
+{
+    unsigned int x0LocCode = (unsigned int) (v0[0] * LT_MAX_VAL);
+    unsigned int y0LocCode = (unsigned int) (v0[1] * LT_MAX_VAL);
+    unsigned int x1LocCode = (unsigned int) (v1[0] * LT_MAX_VAL);
+    unsigned int y1LocCode = (unsigned int) (v1[1] * LT_MAX_VAL);
+
+
+    //----The smallest cell containing the region is at the level above the
+    //----highest bit in which the locational codes of v0 and v1 differ
+    unsigned int diff = (x0LocCode ^ x1LocCode) | (y0LocCode ^ y1LocCode);
+    unsigned int level = 0;
+    while (diff >> level) level++;
+
+    unsigned int leaf = lqtFindLeaf(tree, lqtKey(x0LocCode, y0LocCode));
+    lqtMakeCell(tree, x0LocCode, y0LocCode, level, leaf, cell);
+}
+
+
+//-------------------------------------------------------------------------------
+//  Quadtree neighbor location. The neighbor in direction (dx,dy) contains the
+//  position just outside cell in that direction; locate the leaf containing it,
+//  and take its ancestor at cell's level if the leaf is smaller than cell.
+//-------------------------------------------------------------------------------
+int lqtLocateNeighbor (const lqtTree *tree, const lqtCell *cell, int dx, int dy,
+lqtCell *nbr)
+{
+    unsigned int binaryCellSize = 1 << cell->level;
+    unsigned int xLocCode = cell->xLocCode;
+    unsigned int yLocCode = cell->yLocCode;
+
+    if (dx < 0) {
+        if (xLocCode == 0) return(0);
+        xLocCode--;
+    } else if (dx > 0) {
+        xLocCode += binaryCellSize;
+        if (xLocCode >= (1 << LT_ROOT_LEVEL)) return(0);
+    }
+    if (dy < 0) {
+        if (yLocCode == 0) return(0);
+        yLocCode--;
+    } else if (dy > 0) {
+        yLocCode += binaryCellSize;
+        if (yLocCode >= (1 << LT_ROOT_LEVEL)) return(0);
+    }
+
+    unsigned int leaf = lqtFindLeaf(tree, lqtKey(xLocCode, yLocCode));
+    lqtMakeCell(tree, xLocCode, yLocCode, cell->level, leaf, nbr);
+    return(1);
+}
+
+int lqtLocateLeftNeighbor (const lqtTree *tree, const lqtCell *cell, lqtCell *nbr)
+{
+    return(lqtLocateNeighbor(tree, cell, -1, 0, nbr));
+}
+
+int lqtLocateRightNeighbor (const lqtTree *tree, const lqtCell *cell, lqtCell *nbr)
+{
+    return(lqtLocateNeighbor(tree, cell, 1, 0, nbr));
+}
+
+void lqtLocateRBVertexNeighbors (const lqtTree *tree, const lqtCell *cell,
+unsigned int *bVtxNbr, unsigned int *rVtxNbr, unsigned int *rbVtxNbr)
+{
+    //----There are no right neighbors if this is the right side of the quadtree and
+    //----no bottom neighbors if this is the bottom of the quadtree
+    unsigned int binCellSize = 1 << cell->level;
+    unsigned int noRight = ((cell->xLocCode + binCellSize) >= (1 << LT_ROOT_LEVEL)) ? 1 : 0;
+    unsigned int noBottom = (cell->yLocCode == 0) ? 1 : 0;
+
+
+    //----The vertex neighbors are the leaves containing the positions just
+    //----outside the right-bottom vertex
+    unsigned int xRightLocCode = cell->xLocCode + binCellSize;
+    unsigned int xLocCode = xRightLocCode - 0x00000001;
+    unsigned int yLocCode = cell->yLocCode;
+    unsigned int yBottomLocCode = yLocCode - 0x00000001;
+
+    *rVtxNbr = noRight ? LT_NO_CELL : lqtFindLeaf(tree, lqtKey(xRightLocCode, yLocCode));
+    *bVtxNbr = noBottom ? LT_NO_CELL : lqtFindLeaf(tree, lqtKey(xLocCode, yBottomLocCode));
+    *rbVtxNbr = (noRight || noBottom) ? LT_NO_CELL :
+        lqtFindLeaf(tree, lqtKey(xRightLocCode, yBottomLocCode));
+}
+
+
+//-------------------------------------------------------------------------------
+//  Octree construction
+//-------------------------------------------------------------------------------
+static int lotBuildBuckets (lotTree *tree)
+{
+    unsigned int nBuckets = 1 << LOT_BUCKET_BITS;
+    tree->bucketStart = (unsigned int *) malloc((nBuckets + 1) * sizeof(unsigned int));
+    if (!tree->bucketStart) return(-1);
+
+    int b;
+    #pragma omp parallel for schedule(static)
+    for (b = 0; b < (int) nBuckets; b++) {
+        unsigned long long key = (unsigned long long) b << (LOT_KEY_BITS - LOT_BUCKET_BITS);
+        tree->bucketStart[b] = ltLowerBound(tree->keys, 0, tree->nCells, key);
+    }
+    tree->bucketStart[nBuckets] = tree->nCells;
+    return(0);
+}
+
+int lotBuildFromKeys (lotTree *tree, const unsigned long long *keys, unsigned int nCells)
+{
+    tree->nCells = nCells;
+    tree->bucketStart = 0;
+    tree->keys = (unsigned long long *) malloc(nCells * sizeof(unsigned long long));
+    if (!tree->keys) {
+        lotFree(tree);
+        return(-1);
+    }
+    memcpy(tree->keys, keys, nCells * sizeof(unsigned long long));
+    if (lotBuildBuckets(tree)) {
+        lotFree(tree);
+        return(-1);
+    }
+    return(0);
+}
+
+int lotBuildFromPoints (lotTree *tree, const float *points, unsigned int nPoints,
+unsigned int maxPointsPerCell)
+{
+    tree->nCells = 0;
+    tree->keys = 0;
+    tree->bucketStart = 0;
+
+    //----Determine the keys of the points' positions
+    unsigned long long *keys = (unsigned long long *) malloc(
+        (nPoints ? nPoints : 1) * sizeof(unsigned long long));
+    if (!keys) return(-1);
+    int i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < (int) nPoints; i++) {
+        unsigned int xLocCode = (unsigned int) (points[3 * i] * LT_MAX_VAL);
+        unsigned int yLocCode = (unsigned int) (points[3 * i + 1] * LT_MAX_VAL);
+        unsigned int zLocCode = (unsigned int) (points[3 * i + 2] * LT_MAX_VAL);
+        keys[i] = lotKey(xLocCode, yLocCode, zLocCode);
+    }
+
+
+    //----Build the leaves, whose keys are stored as they are
+    unsigned int nCells;
+    tree->keys = ltBuildLeaves(keys, nPoints, 3, maxPointsPerCell, &nCells);
+    free(keys);
+    if (!tree->keys) return(-1);
+    tree->nCells = nCells;
+
+    if (lotBuildBuckets(tree)) {
+        lotFree(tree);
+        return(-1);
+    }
+    return(0);
+}
+
+void lotFree (lotTree *tree)
+{
+    free(tree->keys);
+    free(tree->bucketStart);
+    tree->keys = 0;
+    tree->bucketStart = 0;
+    tree->nCells = 0;
+}
+
+
+//-------------------------------------------------------------------------------
+//  Octree leaves and searches, as for quadtrees
+//-------------------------------------------------------------------------------
+unsigned int lotLeafLevel (const lotTree *tree, unsigned int i)
+{
+    unsigned long long next = (i + 1 < tree->nCells) ? tree->keys[i + 1] :
+        (1ULL << LOT_KEY_BITS);
+    return(ltLog2(next - tree->keys[i]) / 3);
+}
+
+void lotGetLeaf (const lotTree *tree, unsigned int i, lotCell *cell)
+{
+    unsigned long long key = tree->keys[i];
+    cell->xLocCode = lotCompact(key);
+    cell->yLocCode = lotCompact(key >> 1);
+    cell->zLocCode = lotCompact(key >> 2);
+    cell->level = lotLeafLevel(tree, i);
+    cell->first = i;
+    cell->count = 1;
+}
+
+static unsigned int lotFindLeaf (const lotTree *tree, unsigned long long key)
+{
+    unsigned int b = (unsigned int) (key >> (LOT_KEY_BITS - LOT_BUCKET_BITS));
+    unsigned int lo = tree->bucketStart[b], hi = tree->bucketStart[b + 1];
+    while (lo < hi) {
+        unsigned int mid = lo + ((hi - lo) >> 1);
+        if (tree->keys[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    return(lo - 1);
+}
+
+static unsigned int lotLowerBound (const lotTree *tree, unsigned long long key)
+{
+    if (key >= (1ULL << LOT_KEY_BITS)) return(tree->nCells);
+    unsigned int b = (unsigned int) (key >> (LOT_KEY_BITS - LOT_BUCKET_BITS));
+    return(ltLowerBound(tree->keys, tree->bucketStart[b], tree->bucketStart[b + 1], key));
+}
+
+static void lotMakeCell (const lotTree *tree, unsigned int xLocCode, unsigned int yLocCode,
+unsigned int zLocCode, unsigned int level, unsigned int leaf, lotCell *cell)
+{
+    unsigned int leafLevel = lotLeafLevel(tree, leaf);
+    if (leafLevel >= level) {
+        lotGetLeaf(tree, leaf, cell);
+    } else {
+        unsigned int mask = ~((1u << level) - 1);
+        cell->xLocCode = xLocCode & mask;
+        cell->yLocCode = yLocCode & mask;
+        cell->zLocCode = zLocCode & mask;
+        cell->level = level;
+        unsigned long long key = lotKey(cell->xLocCode, cell->yLocCode, cell->zLocCode);
+        cell->first = lotLowerBound(tree, key);
+        cell->count = lotLowerBound(tree, key + (1ULL << (3 * level))) - cell->first;
+    }
+}
+
+
+//-------------------------------------------------------------------------------
+//  Octree point, region and neighbor location
+//-------------------------------------------------------------------------------
+unsigned int lotLocateCell (const lotTree *tree, const float p[3])
+{
+    unsigned int xLocCode = (unsigned int) (p[0] * LT_MAX_VAL);
+    unsigned int yLocCode = (unsigned int) (p[1] * LT_MAX_VAL);
+    unsigned int zLocCode = (unsigned int) (p[2] * LT_MAX_VAL);
+    return(lotFindLeaf(tree, lotKey(xLocCode, yLocCode, zLocCode)));
+}
+
+void lotLocateCells (const lotTree *tree, const float *points, unsigned int nPoints,
+unsigned int *cells)
+{
+    int i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < (int) nPoints; i++) cells[i] = lotLocateCell(tree, points + 3 * i);
+}
+
+void lotLocateRegion (const lotTree *tree, const float v0[3], const float v1[3],
+lotCell *cell)
+{
+    unsigned int x0LocCode = (unsigned int) (v0[0] * LT_MAX_VAL);
+    unsigned int y0LocCode = (unsigned int) (v0[1] * LT_MAX_VAL);
+    unsigned int z0LocCode = (unsigned int) (v0[2] * LT_MAX_VAL);
+    unsigned int x1LocCode = (unsigned int) (v1[0] * LT_MAX_VAL);
+    unsigned int y1LocCode = (unsigned int) (v1[1] * LT_MAX_VAL);
+    unsigned int z1LocCode = (unsigned int) (v1[2] * LT_MAX_VAL);
+
+    unsigned int diff = (x0LocCode ^ x1LocCode) | (y0LocCode ^ y1LocCode) |
+        (z0LocCode ^ z1LocCode);
+    unsigned int level = 0;
+    while (diff >> level) level++;
+
+    unsigned int leaf = lotFindLeaf(tree, lotKey(x0LocCode, y0LocCode, z0LocCode));
+    lotMakeCell(tree, x0LocCode, y0LocCode, z0LocCode, level, leaf, cell);
+}
+
+int lotLocateNeighbor (const lotTree *tree, const lotCell *cell, int dx, int dy, int dz,
+lotCell *nbr)
+{
+    unsigned int binaryCellSize = 1 << cell->level;
+    unsigned int locCode[3];
+    int d[3], k;
+    locCode[0] = cell->xLocCode; d[0] = dx;
+    locCode[1] = cell->yLocCode; d[1] = dy;
+    locCode[2] = cell->zLocCode; d[2] = dz;
+    for (k = 0; k < 3; k++) {
+        if (d[k] < 0) {
+            if (locCode[k] == 0) return(0);
+            locCode[k]--;
+        } else if (d[k] > 0) {
+            locCode[k] += binaryCellSize;
+            if (locCode[k] >= (1 << LT_ROOT_LEVEL)) return(0);
+        }
+    }
+
+    unsigned int leaf = lotFindLeaf(tree, lotKey(locCode[0], locCode[1], locCode[2]));
+    lotMakeCell(tree, locCode[0], locCode[1], locCode[2], cell->level, leaf, nbr);
+    return(1);
+}
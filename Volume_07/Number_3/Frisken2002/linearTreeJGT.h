@@ -0,0 +1,171 @@
+//-------------------------------------------------------------------------------
+//  Linear (pointerless) quadtrees and octrees using locational codes.
+//
+//  Companion to treeTraversalJGT.c. The tree is stored as the sorted array of
+//  the Morton keys of its leaf cells, i.e. the x, y (and z) locational codes of
+//  each leaf's bottom-left corner with their bits interleaved. Since the leaves
+//  tile the root cell, a leaf covers the keys from its own key up to the next
+//  leaf's key, which also determines its level; no parent, children or level
+//  fields are stored. Leaf cells are identified by their index in the key array,
+//  which applications use to index their own per-cell data arrays (replacing the
+//  data pointer of qtCell).
+//
+//  Point location is a binary search for the last key not greater than the
+//  point's key, narrowed by a table indexed by the top key bits. Region and
+//  neighbor location reduce to point location followed by clamping the result
+//  to the required level. Levels and locational codes follow treeTraversalJGT.c:
+//  the smallest cell has level 0 and the root cell has level QT_ROOT_LEVEL.
+//
+//  The functions prefixed with lqt operate on quadtrees, those prefixed with lot
+//  on octrees. Batch location and construction use OpenMP when it is enabled.
+//-------------------------------------------------------------------------------
+#ifndef LINEAR_TREE_JGT_H
+#define LINEAR_TREE_JGT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//-------------------------------------------------------------------------------
+//  Maximum tree depth and related constants (as in treeTraversalJGT.c)
+//-------------------------------------------------------------------------------
+#define LT_N_LEVELS   16        // Number of possible levels in the tree
+#define LT_ROOT_LEVEL 15        // Level of root cell (LT_N_LEVELS - 1)
+#define LT_MAX_VAL    32768.0f  // For converting positions to locational codes
+                                // (LT_MAX_VAL = 2^LT_ROOT_LEVEL)
+
+#define LQT_KEY_BITS      30    // 2 * LT_ROOT_LEVEL
+#define LQT_BUCKET_BITS   16    // Top key bits used to index the bucket table
+#define LOT_KEY_BITS      45    // 3 * LT_ROOT_LEVEL
+#define LOT_BUCKET_BITS   18
+
+
+//-------------------------------------------------------------------------------
+//  Linear quadtree and octree. keys[i] is the Morton key of leaf i; the keys are
+//  sorted, keys[0] is 0 and each leaf covers the keys in [keys[i], keys[i+1]),
+//  with keys[nCells] taken to be 2^LQT_KEY_BITS (2^LOT_KEY_BITS). bucketStart[b]
+//  is the index of the first key whose top bits equal b.
+//-------------------------------------------------------------------------------
+typedef struct _lqtTree {
+    unsigned int        nCells;         // Number of leaf cells
+    unsigned int        *keys;          // Sorted Morton keys of the leaf cells
+    unsigned int        *bucketStart;   // (1 << LQT_BUCKET_BITS) + 1 entries
+}   lqtTree;
+
+typedef struct _lotTree {
+    unsigned int        nCells;
+    unsigned long long  *keys;
+    unsigned int        *bucketStart;   // (1 << LOT_BUCKET_BITS) + 1 entries
+}   lotTree;
+
+
+//-------------------------------------------------------------------------------
+//  A cell returned by the region and neighbor queries: either a leaf (count is 1
+//  and first is the leaf's index) or an interior cell, which contains the count
+//  leaves starting at index first.
+//-------------------------------------------------------------------------------
+typedef struct _lqtCell {
+    unsigned int    xLocCode;   // X locational code
+    unsigned int    yLocCode;   // Y locational code
+    unsigned int    level;      // Cell level in hierarchy (smallest cell has level 0)
+    unsigned int    first;      // Index of the first leaf in the cell
+    unsigned int    count;      // Number of leaves in the cell
+}   lqtCell;
+
+typedef struct _lotCell {
+    unsigned int    xLocCode;
+    unsigned int    yLocCode;
+    unsigned int    zLocCode;
+    unsigned int    level;
+    unsigned int    first;
+    unsigned int    count;
+}   lotCell;
+
+
+//-------------------------------------------------------------------------------
+//  Construction. lqtBuildFromPoints builds the tree in which each leaf contains
+//  at most maxPointsPerCell of the nPoints points (x,y pairs in [0,1)x[0,1)),
+//  except for leaves at level 0. lqtBuildFromKeys builds a tree from the sorted
+//  keys of leaves that tile the root cell; the keys are copied. Both return 0 on
+//  success and -1 if out of memory. lqtFree releases the arrays of a tree.
+//-------------------------------------------------------------------------------
+int  lqtBuildFromPoints (lqtTree *tree, const float *points, unsigned int nPoints,
+                         unsigned int maxPointsPerCell);
+int  lqtBuildFromKeys   (lqtTree *tree, const unsigned int *keys, unsigned int nCells);
+void lqtFree            (lqtTree *tree);
+
+int  lotBuildFromPoints (lotTree *tree, const float *points, unsigned int nPoints,
+                         unsigned int maxPointsPerCell);
+int  lotBuildFromKeys   (lotTree *tree, const unsigned long long *keys, unsigned int nCells);
+void lotFree            (lotTree *tree);
+
+
+//-------------------------------------------------------------------------------
+//  Leaf cells. lqtGetLeaf fills in the locational codes and level of leaf i.
+//-------------------------------------------------------------------------------
+unsigned int lqtLeafLevel (const lqtTree *tree, unsigned int i);
+void         lqtGetLeaf   (const lqtTree *tree, unsigned int i, lqtCell *cell);
+
+unsigned int lotLeafLevel (const lotTree *tree, unsigned int i);
+void         lotGetLeaf   (const lotTree *tree, unsigned int i, lotCell *cell);
+
+
+//-------------------------------------------------------------------------------
+//  Point location. lqtLocateCell returns the index of the leaf cell containing
+//  the point p in [0,1)x[0,1); lqtLocateCells does so for the nPoints points
+//  (x,y pairs) in parallel.
+//-------------------------------------------------------------------------------
+unsigned int lqtLocateCell  (const lqtTree *tree, const float p[2]);
+void         lqtLocateCells (const lqtTree *tree, const float *points, unsigned int nPoints,
+                             unsigned int *cells);
+
+unsigned int lotLocateCell  (const lotTree *tree, const float p[3]);
+void         lotLocateCells (const lotTree *tree, const float *points, unsigned int nPoints,
+                             unsigned int *cells);
+
+
+//-------------------------------------------------------------------------------
+//  Region location. Finds the smallest cell that entirely contains the box
+//  with the bottom-left vertex v0 and the top-right vertex v1, or the leaf cell
+//  containing the box if that cell is smaller than a leaf.
+//-------------------------------------------------------------------------------
+void lqtLocateRegion (const lqtTree *tree, const float v0[2], const float v1[2],
+                      lqtCell *cell);
+void lotLocateRegion (const lotTree *tree, const float v0[3], const float v1[3],
+                      lotCell *cell);
+
+
+//-------------------------------------------------------------------------------
+//  Neighbor location. Finds the neighbor of the same size or larger than cell in
+//  the direction (dx,dy), where dx and dy are -1, 0 or 1; i.e. (-1,0) is the left
+//  edge neighbor and (1,-1) the right-bottom vertex neighbor. If the neighbors in
+//  that direction are smaller than cell, their common ancestor of the same size
+//  as cell is returned. Returns 0 if there is no such neighbor, 1 otherwise.
+//-------------------------------------------------------------------------------
+int lqtLocateNeighbor      (const lqtTree *tree, const lqtCell *cell, int dx, int dy,
+                            lqtCell *nbr);
+int lqtLocateLeftNeighbor  (const lqtTree *tree, const lqtCell *cell, lqtCell *nbr);
+int lqtLocateRightNeighbor (const lqtTree *tree, const lqtCell *cell, lqtCell *nbr);
+
+int lotLocateNeighbor      (const lotTree *tree, const lotCell *cell, int dx, int dy, int dz,
+                            lotCell *nbr);
+
+
+//-------------------------------------------------------------------------------
+//  Locate the three leaf cell vertex neighbors touching the right-bottom vertex
+//  of a specified cell, as qtLocateRBVertexNeighbors. The indices are set to
+//  LT_NO_CELL if the corresponding neighbor does not exist.
+//-------------------------------------------------------------------------------
+#define LT_NO_CELL 0xffffffffu
+
+void lqtLocateRBVertexNeighbors (const lqtTree *tree, const lqtCell *cell,
+                                 unsigned int *bVtxNbr, unsigned int *rVtxNbr,
+                                 unsigned int *rbVtxNbr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
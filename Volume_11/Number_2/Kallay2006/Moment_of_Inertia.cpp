@@ -30,6 +30,32 @@ when the origin lies on the inner side of this facet's plane.
         _zy += v * (z1*y1 + z2*y2 + z3*y3 + z4*y4);        
     }
 
+/**********************************************************************
+Add the contributions of all the triangles of an indexed mesh.
+vertices holds x, y, z for each vertex (float or double), and indices
+holds 3 vertex indices per triangle, ordered as for
+AddTriangleContribution.  Include Moment_of_Inertia_Mesh.h before
+this class; the triangles are processed 4 at a time with AVX2, on
+several threads for large meshes (threadCount = 0 uses all hardware
+threads).
+**********************************************************************/
+    template <typename Real>
+    void AddMeshContribution(
+        const Real * vertices,                // 3 coordinates per vertex
+        const unsigned int * indices,         // 3 indices per triangle
+        size_t triangleCount,
+        unsigned int threadCount = 0)
+    {
+        double s[MeshMoments::NumSums];
+        MeshMoments::AccumulateMeshMoments(vertices, indices, triangleCount, s,
+            threadCount);
+
+        _m += s[0];
+        _Cx += s[1];    _Cy += s[2];    _Cz += s[3];
+        _xx += s[4];    _yy += s[5];    _zz += s[6];
+        _yx += s[7];    _zx += s[8];    _zy += s[9];
+    }
+
  
 /**********************************************************************
 This method is called to obtain the results.
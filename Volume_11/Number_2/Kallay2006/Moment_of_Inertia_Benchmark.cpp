@@ -0,0 +1,215 @@
+/**********************************************************************
+Performance and accuracy program for AddMeshContribution.
+
+Computes the mass properties of a triangulated sphere with per-triangle
+calls to AddTriangleContribution, and with AddMeshContribution on one
+thread and on all hardware threads, timing each as if the mesh was
+deforming and its inertia was recomputed every simulation step.  The
+results are compared to sums accumulated in long double.
+
+    Moment_of_Inertia_Benchmark [triangleCount]
+
+Compile with AVX2 for the SIMD path, for example
+    g++ -O2 -mavx2 -std=c++11 -pthread Moment_of_Inertia_Benchmark.cpp
+**********************************************************************/
+#include "Moment_of_Inertia_Mesh.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// The accumulator, whose methods and members are in Moment_of_Inertia.cpp.
+class MassProperties
+{
+public:
+    MassProperties()
+        : _m(0), _Cx(0), _Cy(0), _Cz(0),
+          _xx(0), _yy(0), _zz(0), _yx(0), _zx(0), _zy(0)
+    {
+    }
+
+#include "Moment_of_Inertia.cpp"
+
+// The ten results of GetResults.
+struct Results
+{
+    double value[10];
+
+    void Get(MassProperties & mp)
+    {
+        double * r = value;
+        mp.GetResults(r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9]);
+    }
+};
+
+// A sphere with rings * segments * 2 triangles (some degenerate at the
+// poles), off the origin, with the triangles in a shuffled order.
+static void MakeSphere(int rings, int segments, std::vector<double> & vertices,
+    std::vector<unsigned int> & indices)
+{
+    const double pi = 3.14159265358979323846;
+    for (int i = 0; i <= rings; i++)
+    {
+        double theta = pi * i / rings;
+        for (int j = 0; j < segments; j++)
+        {
+            double phi = 2 * pi * j / segments;
+            vertices.push_back(0.5 + std::sin(theta) * std::cos(phi));
+            vertices.push_back(-0.25 + std::sin(theta) * std::sin(phi));
+            vertices.push_back(0.125 + std::cos(theta));
+        }
+    }
+    std::vector<unsigned int> quads;
+    for (int i = 0; i < rings; i++)
+        for (int j = 0; j < segments; j++)
+            quads.push_back(i * segments + j);
+    std::srand(1);
+    for (size_t k = quads.size(); k > 1; k--)
+        std::swap(quads[k - 1], quads[std::rand() % k]);
+    for (size_t k = 0; k < quads.size(); k++)
+    {
+        unsigned int i = quads[k] / segments, j = quads[k] % segments;
+        unsigned int a = i * segments + j, b = i * segments + (j + 1) % segments;
+        unsigned int c = a + segments, d = b + segments;
+        indices.push_back(a); indices.push_back(c); indices.push_back(b);
+        indices.push_back(b); indices.push_back(c); indices.push_back(d);
+    }
+}
+
+// Sums of AddTriangleContribution in long double, as a reference.
+static void ReferenceResults(const std::vector<double> & vertices,
+    const std::vector<unsigned int> & indices, Results & results)
+{
+    long double s[10] = { 0 };
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        const double * p1 = &vertices[3 * indices[t]];
+        const double * p2 = &vertices[3 * indices[t + 1]];
+        const double * p3 = &vertices[3 * indices[t + 2]];
+        long double x1 = p1[0], y1 = p1[1], z1 = p1[2];
+        long double x2 = p2[0], y2 = p2[1], z2 = p2[2];
+        long double x3 = p3[0], y3 = p3[1], z3 = p3[2];
+        long double v = x1*y2*z3 + y1*z2*x3 + x2*y3*z1 -
+                       (x3*y2*z1 + x2*y1*z3 + y3*z2*x1);
+        long double x4 = x1 + x2 + x3, y4 = y1 + y2 + y3, z4 = z1 + z2 + z3;
+        s[0] += v;
+        s[1] += v * x4;     s[2] += v * y4;     s[3] += v * z4;
+        s[4] += v * (x1*x1 + x2*x2 + x3*x3 + x4*x4);
+        s[5] += v * (y1*y1 + y2*y2 + y3*y3 + y4*y4);
+        s[6] += v * (z1*z1 + z2*z2 + z3*z3 + z4*z4);
+        s[7] += v * (y1*x1 + y2*x2 + y3*x3 + y4*x4);
+        s[8] += v * (z1*x1 + z2*x2 + z3*x3 + z4*x4);
+        s[9] += v * (z1*y1 + z2*y2 + z3*y3 + z4*y4);
+    }
+
+    // As GetResults
+    long double m = s[0] / 6, r = 1 / (4 * s[0]);
+    long double Cx = s[1] * r, Cy = s[2] * r, Cz = s[3] * r;
+    long double xx = s[4] / 120 - m * Cx*Cx;
+    long double yy = s[5] / 120 - m * Cy*Cy;
+    long double zz = s[6] / 120 - m * Cz*Cz;
+    double * out = results.value;
+    out[0] = (double)m;
+    out[1] = (double)Cx;  out[2] = (double)Cy;  out[3] = (double)Cz;
+    out[4] = (double)(yy + zz);  out[5] = (double)(zz + xx);  out[6] = (double)(xx + yy);
+    out[7] = (double)(s[7] / 120 - m * Cy*Cx);
+    out[8] = (double)(s[8] / 120 - m * Cz*Cx);
+    out[9] = (double)(s[9] / 120 - m * Cz*Cy);
+}
+
+// Largest error relative to the largest reference result of each kind
+// (mass, centroid, inertia).
+static double MaxError(const Results & results, const Results & reference)
+{
+    double scale[3] = { 0, 0, 0 }, error = 0;
+    for (int k = 0; k < 10; k++)
+    {
+        int kind = (k == 0) ? 0 : (k < 4 ? 1 : 2);
+        scale[kind] = std::max(scale[kind], std::fabs(reference.value[k]));
+    }
+    for (int k = 0; k < 10; k++)
+    {
+        int kind = (k == 0) ? 0 : (k < 4 ? 1 : 2);
+        error = std::max(error,
+            std::fabs(results.value[k] - reference.value[k]) / scale[kind]);
+    }
+    return error;
+}
+
+static double Seconds()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char ** argv)
+{
+    size_t triangleCount = (argc > 1) ? (size_t)std::atof(argv[1]) : 2000000;
+    int rings = std::max(2, (int)std::sqrt(triangleCount / 4.0));
+    int segments = std::max(3, (int)(triangleCount / (2 * rings)));
+
+    std::vector<double> vertices;
+    std::vector<unsigned int> indices;
+    MakeSphere(rings, segments, vertices, indices);
+    std::vector<float> verticesF(vertices.begin(), vertices.end());
+    triangleCount = indices.size() / 3;
+    const int steps = 10;
+    std::printf("%u triangles, %u vertices, %u hardware threads, AVX2 %s\n",
+        (unsigned int)triangleCount, (unsigned int)(vertices.size() / 3),
+        std::thread::hardware_concurrency(),
+#if defined(__AVX2__)
+        "on");
+#else
+        "off");
+#endif
+
+    Results reference, results;
+    ReferenceResults(vertices, indices, reference);
+
+    // Per-triangle calls
+    double start = Seconds();
+    for (int step = 0; step < steps; step++)
+    {
+        MassProperties mp;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const double * p1 = &vertices[3 * indices[3 * t]];
+            const double * p2 = &vertices[3 * indices[3 * t + 1]];
+            const double * p3 = &vertices[3 * indices[3 * t + 2]];
+            mp.AddTriangleContribution(p1[0], p1[1], p1[2], p2[0], p2[1], p2[2],
+                p3[0], p3[1], p3[2]);
+        }
+        results.Get(mp);
+    }
+    double time = (Seconds() - start) / steps;
+    std::printf("AddTriangleContribution      : %8.3f ms, %7.1f Mtri/s, error %.3g\n",
+        time * 1e3, triangleCount * 1e-6 / time, MaxError(results, reference));
+
+    // One thread, all threads, and all threads with float vertices (whose
+    // error includes rounding the vertices to float)
+    for (int pass = 0; pass < 3; pass++)
+    {
+        unsigned int threadCount = (pass == 0) ? 1 : 0;
+        start = Seconds();
+        for (int step = 0; step < steps; step++)
+        {
+            MassProperties mp;
+            if (pass < 2)
+                mp.AddMeshContribution(&vertices[0], &indices[0], triangleCount,
+                    threadCount);
+            else
+                mp.AddMeshContribution(&verticesF[0], &indices[0], triangleCount,
+                    threadCount);
+            results.Get(mp);
+        }
+        time = (Seconds() - start) / steps;
+        std::printf("%s: %8.3f ms, %7.1f Mtri/s, error %.3g\n",
+            pass == 0 ? "AddMeshContribution, 1 thread" :
+            pass == 1 ? "AddMeshContribution, threads " :
+                        "float vertices, threads      ",
+            time * 1e3, triangleCount * 1e-6 / time, MaxError(results, reference));
+    }
+    return 0;
+}
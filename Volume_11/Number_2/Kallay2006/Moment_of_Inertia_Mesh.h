@@ -0,0 +1,212 @@
+/**********************************************************************
+Mass properties of indexed triangle meshes.
+
+AccumulateMeshMoments computes the same ten sums as calling
+AddTriangleContribution (see Moment_of_Inertia.cpp) for each triangle
+of a mesh given by vertex and index buffers, which is what
+AddMeshContribution does.  The vertices of 4 triangles at a time are
+gathered into AVX2 registers, each lane accumulating the sums of one
+triangle; large meshes are split among threads, whose partial sums are
+added at the end in a fixed order.  Without AVX2 (compile with -mavx2,
+or /arch:AVX2 with MSVC) the triangles are accumulated one at a time.
+
+The sums are added in a different order than with per-triangle calls,
+so the results differ from those by rounding errors only.
+**********************************************************************/
+#ifndef MOMENT_OF_INERTIA_MESH_H
+#define MOMENT_OF_INERTIA_MESH_H
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace MeshMoments
+{
+    // The sums, in the order of the members of the accumulator class:
+    // _m, _Cx, _Cy, _Cz, _xx, _yy, _zz, _yx, _zx, _zy.
+    enum { NumSums = 10 };
+
+    // Meshes are split among threads in ranges of at least this many
+    // triangles; smaller meshes are accumulated on the calling thread.
+    const size_t MinTrianglesPerThread = 1 << 15;
+
+    // Contribution of one triangle, as in AddTriangleContribution.
+    template <typename Real>
+    inline void AddTriangle(const Real * p1, const Real * p2, const Real * p3,
+        double sums[NumSums])
+    {
+        double x1 = p1[0], y1 = p1[1], z1 = p1[2];
+        double x2 = p2[0], y2 = p2[1], z2 = p2[2];
+        double x3 = p3[0], y3 = p3[1], z3 = p3[2];
+
+        double v = x1*y2*z3 + y1*z2*x3 + x2*y3*z1 -
+                  (x3*y2*z1 + x2*y1*z3 + y3*z2*x1);
+        sums[0] += v;
+
+        double x4 = x1 + x2 + x3;           sums[1] += (v * x4);
+        double y4 = y1 + y2 + y3;           sums[2] += (v * y4);
+        double z4 = z1 + z2 + z3;           sums[3] += (v * z4);
+
+        sums[4] += v * (x1*x1 + x2*x2 + x3*x3 + x4*x4);
+        sums[5] += v * (y1*y1 + y2*y2 + y3*y3 + y4*y4);
+        sums[6] += v * (z1*z1 + z2*z2 + z3*z3 + z4*z4);
+        sums[7] += v * (y1*x1 + y2*x2 + y3*x3 + y4*x4);
+        sums[8] += v * (z1*x1 + z2*x2 + z3*x3 + z4*x4);
+        sums[9] += v * (z1*y1 + z2*y2 + z3*y3 + z4*y4);
+    }
+
+#if defined(__AVX2__)
+    // Gather coordinate k of the vertices at offsets (3 * vertex index).
+    // The masked gathers with a zero source are the same as the unmasked
+    // ones, without the uninitialized source of some compilers' headers.
+    inline __m256d Gather(const double * vertices, __m128i offsets, int k)
+    {
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), vertices + k, offsets,
+            _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+    }
+
+    inline __m256d Gather(const float * vertices, __m128i offsets, int k)
+    {
+        return _mm256_cvtps_pd(_mm_mask_i32gather_ps(_mm_setzero_ps(), vertices + k,
+            offsets, _mm_castsi128_ps(_mm_set1_epi32(-1)), 4));
+    }
+
+    // Contributions of the 4 triangles with the 12 vertex indices at
+    // 'indices', one triangle per lane.
+    template <typename Real>
+    inline void AddTriangles4(const Real * vertices, const unsigned int * indices,
+        __m256d sums[NumSums])
+    {
+        const __m128i stride = _mm_setr_epi32(0, 3, 6, 9);
+        const int * ind = reinterpret_cast<const int *>(indices);
+        __m128i i1 = _mm_i32gather_epi32(ind, stride, 4);
+        __m128i i2 = _mm_i32gather_epi32(ind + 1, stride, 4);
+        __m128i i3 = _mm_i32gather_epi32(ind + 2, stride, 4);
+        i1 = _mm_add_epi32(i1, _mm_add_epi32(i1, i1));
+        i2 = _mm_add_epi32(i2, _mm_add_epi32(i2, i2));
+        i3 = _mm_add_epi32(i3, _mm_add_epi32(i3, i3));
+
+        __m256d x1 = Gather(vertices, i1, 0), y1 = Gather(vertices, i1, 1),
+            z1 = Gather(vertices, i1, 2);
+        __m256d x2 = Gather(vertices, i2, 0), y2 = Gather(vertices, i2, 1),
+            z2 = Gather(vertices, i2, 2);
+        __m256d x3 = Gather(vertices, i3, 0), y3 = Gather(vertices, i3, 1),
+            z3 = Gather(vertices, i3, 2);
+
+        // Signed volume of the tetrahedra
+        __m256d pos = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(_mm256_mul_pd(x1, y2), z3),
+            _mm256_mul_pd(_mm256_mul_pd(y1, z2), x3)),
+            _mm256_mul_pd(_mm256_mul_pd(x2, y3), z1));
+        __m256d neg = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(_mm256_mul_pd(x3, y2), z1),
+            _mm256_mul_pd(_mm256_mul_pd(x2, y1), z3)),
+            _mm256_mul_pd(_mm256_mul_pd(y3, z2), x1));
+        __m256d v = _mm256_sub_pd(pos, neg);
+        sums[0] = _mm256_add_pd(sums[0], v);
+
+        // Centroid
+        __m256d x4 = _mm256_add_pd(_mm256_add_pd(x1, x2), x3);
+        __m256d y4 = _mm256_add_pd(_mm256_add_pd(y1, y2), y3);
+        __m256d z4 = _mm256_add_pd(_mm256_add_pd(z1, z2), z3);
+        sums[1] = _mm256_add_pd(sums[1], _mm256_mul_pd(v, x4));
+        sums[2] = _mm256_add_pd(sums[2], _mm256_mul_pd(v, y4));
+        sums[3] = _mm256_add_pd(sums[3], _mm256_mul_pd(v, z4));
+
+        // Moment of inertia monomials, a1*b1 + a2*b2 + a3*b3 + a4*b4
+        #define MESH_MOMENTS_DOT4(a, b) _mm256_add_pd(_mm256_add_pd(_mm256_add_pd( \
+            _mm256_mul_pd(a##1, b##1), _mm256_mul_pd(a##2, b##2)),                 \
+            _mm256_mul_pd(a##3, b##3)), _mm256_mul_pd(a##4, b##4))
+        sums[4] = _mm256_add_pd(sums[4], _mm256_mul_pd(v, MESH_MOMENTS_DOT4(x, x)));
+        sums[5] = _mm256_add_pd(sums[5], _mm256_mul_pd(v, MESH_MOMENTS_DOT4(y, y)));
+        sums[6] = _mm256_add_pd(sums[6], _mm256_mul_pd(v, MESH_MOMENTS_DOT4(z, z)));
+        sums[7] = _mm256_add_pd(sums[7], _mm256_mul_pd(v, MESH_MOMENTS_DOT4(y, x)));
+        sums[8] = _mm256_add_pd(sums[8], _mm256_mul_pd(v, MESH_MOMENTS_DOT4(z, x)));
+        sums[9] = _mm256_add_pd(sums[9], _mm256_mul_pd(v, MESH_MOMENTS_DOT4(z, y)));
+        #undef MESH_MOMENTS_DOT4
+    }
+#endif
+
+    // Sums of the triangles [first, last) on the calling thread.
+    template <typename Real>
+    inline void AccumulateRange(const Real * vertices, const unsigned int * indices,
+        size_t first, size_t last, double sums[NumSums])
+    {
+        for (int k = 0; k < NumSums; k++)
+            sums[k] = 0;
+
+        size_t t = first;
+#if defined(__AVX2__)
+        __m256d lanes[NumSums];
+        for (int k = 0; k < NumSums; k++)
+            lanes[k] = _mm256_setzero_pd();
+        for (; t + 4 <= last; t += 4)
+            AddTriangles4(vertices, indices + 3 * t, lanes);
+        for (int k = 0; k < NumSums; k++)
+        {
+            double lane[4];
+            _mm256_storeu_pd(lane, lanes[k]);
+            sums[k] = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+        }
+#endif
+        for (; t < last; t++)
+        {
+            const unsigned int * tri = indices + 3 * t;
+            AddTriangle(vertices + 3 * tri[0], vertices + 3 * tri[1],
+                vertices + 3 * tri[2], sums);
+        }
+    }
+
+    /******************************************************************
+    Sets sums to the sums of the triangleCount triangles of a mesh, for
+    which 'vertices' holds x, y, z for each vertex and 'indices' three
+    vertex indices per triangle, ordered as for AddTriangleContribution.
+    The number of vertices must be less than 2^31 / 3.  threadCount = 0
+    uses all hardware threads.
+    ******************************************************************/
+    template <typename Real>
+    inline void AccumulateMeshMoments(const Real * vertices,
+        const unsigned int * indices, size_t triangleCount, double sums[NumSums],
+        unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        size_t maxThreads = triangleCount / MinTrianglesPerThread;
+        if (threadCount > maxThreads)
+            threadCount = (unsigned int)maxThreads;
+        if (threadCount <= 1)
+        {
+            AccumulateRange(vertices, indices, 0, triangleCount, sums);
+            return;
+        }
+
+        // Ranges of multiples of 4 triangles; the calling thread takes the
+        // first one.
+        std::vector<double> partial(NumSums * threadCount);
+        std::vector<std::thread> threads;
+        size_t blocks = (triangleCount + 3) / 4;
+        for (unsigned int i = 1; i < threadCount; i++)
+        {
+            size_t first = 4 * (blocks * i / threadCount);
+            size_t last = (i + 1 < threadCount) ?
+                4 * (blocks * (i + 1) / threadCount) : triangleCount;
+            threads.push_back(std::thread(AccumulateRange<Real>, vertices, indices,
+                first, last, &partial[NumSums * i]));
+        }
+        AccumulateRange(vertices, indices, 0, 4 * (blocks / threadCount), &partial[0]);
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+
+        for (int k = 0; k < NumSums; k++)
+        {
+            sums[k] = 0;
+            for (unsigned int i = 0; i < threadCount; i++)
+                sums[k] += partial[NumSums * i + k];
+        }
+    }
+}
+
+#endif
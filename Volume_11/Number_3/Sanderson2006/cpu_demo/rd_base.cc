@@ -153,6 +153,8 @@ bool rd_base::next_step_implicit_euler( )
     implicit_solve( morphigen[m], rhs_func[m], theta_*diff_rate[m] );
   }
 #endif
+
+  return false;
 }
 
 
@@ -233,7 +235,9 @@ relax - relaxation using XXX relaxation
 ******************************************************************************/
 inline bool rd_base::relax( float **u, float **rhs, float diff )
 {
-  if( relaxation_ == RED_BLACK )
+  // There is no multigrid solver here (see rd_grid), it relaxes with
+  // red-black instead.
+  if( relaxation_ == RED_BLACK || relaxation_ == MULTIGRID )
     return relax_gs_rb( u, rhs, diff );
 
   else if( relaxation_ == GAUSS_SEIDEL )
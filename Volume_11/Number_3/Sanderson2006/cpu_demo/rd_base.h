@@ -30,7 +30,7 @@ public:
 
   enum { NORMALIZED=0, VARIABLE=1 };
   enum diffusion_type  { ISOTROPIC=0, ANISOTROPIC=1 };
-  enum relaxation_type { JACOBI=0, GAUSS_SEIDEL=1, RED_BLACK=2 };
+  enum relaxation_type { JACOBI=0, GAUSS_SEIDEL=1, RED_BLACK=2, MULTIGRID=3 };
   enum reaction_type   { TURING=0, GRAY_SCOTT=1, MEINHARDT=2, OREGONATOR=3 };
   enum laplacian_type  { INHOMOGENEOUS=0, UNIFORM=1, ARS=2 };
   enum solution_type   { EXPLICIT=0, IMPLICIT=1, THETA=2, };
@@ -165,6 +165,15 @@ public:
   virtual float reaction( unsigned n,
 			  unsigned int i, unsigned int j ) = 0;
 
+  // Reaction of n consecutive cells held in flat arrays (see rd_grid),
+  // rc0 and rc1 are the two per cell reaction constants.
+  virtual void reaction_row( const float *a, const float *b,
+			     const float *rc0, const float *rc1,
+			     float *ra, float *rb, unsigned int n ) = 0;
+
+  // The per cell reaction constants (c = 0 or 1).
+  virtual float **reaction_constants( unsigned int c ) = 0;
+
   virtual bool next_step_explicit_euler( );
   virtual bool next_step_implicit_euler( );
   virtual void implicit_euler_rhs( float **rhs, morphigen_type morphigen );
@@ -0,0 +1,319 @@
+/*****************************************************************************/
+/*								             */
+/*	Copyright (c) 2005	Allen R. Sanderson		             */
+/*								             */
+/*				Scientific Computing and Imaging Institute   */
+/*				University of Utah		             */
+/*				Salt Lake City, Utah		             */
+/*								             */
+/*            							             */
+/*  Permission is granted to modify and/or distribute this program so long   */
+/*  as the program is distributed free of charge and this header is retained */
+/*  as part of the program.                                                  */
+/*								             */
+/*****************************************************************************/
+
+#include <iostream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "rd_turing.h"
+#include "rd_gray_scott.h"
+#include "rd_grid.h"
+
+using namespace std;
+
+// The -mg step: time step as a multiple of the model's default one
+// (its time_mult_ of 25 becomes 1000) and the residual every relaxation
+// is solved to.
+#define RD_BENCH_MG_TIME_SCALE 40.0
+#define RD_BENCH_MG_TOLERANCE  1.0e-5
+
+/******************************************************************************
+Wall clock time in seconds.
+******************************************************************************/
+static double bench_time()
+{
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double) clock() / (double) CLOCKS_PER_SEC;
+#endif
+}
+
+
+/******************************************************************************
+Create the circular vector field of Main.cpp.
+******************************************************************************/
+static float ***create_vector_data( unsigned int size )
+{
+  float mid = size / 2;
+
+  float ***vector = (float ***) malloc( sizeof(float**) * size );
+
+  for( unsigned int j=0; j<size; j++) {
+    vector[j] = (float **) malloc( sizeof(float*) * size );
+
+    for( unsigned int i=0; i<size; i++) {
+      vector[j][i] = (float *) malloc( sizeof(float) * 4 );
+
+      vector[j][i][0] = -((float) j - mid) / mid;
+      vector[j][i][1] =  ((float) i - mid) / mid;
+      vector[j][i][2] = 0;
+      vector[j][i][3] = sqrt( vector[j][i][0] * vector[j][i][0] +
+			      vector[j][i][1] * vector[j][i][1] );
+
+      if( vector[j][i][3] < MIN_FLOAT ) {
+	vector[j][i][0] = 0;
+	vector[j][i][1] = 1;
+	vector[j][i][3] = MIN_FLOAT;
+      } else {
+	vector[j][i][0] /= vector[j][i][3];
+	vector[j][i][1] /= vector[j][i][3];
+      }
+    }
+  }
+
+  return vector;
+}
+
+
+/******************************************************************************
+(Re)start the model as Main.cpp does for the given solution type.
+******************************************************************************/
+static void restart( rd_base *rd, float ***vector, int solution, int relaxation )
+{
+  rd->setSolution( solution );
+  rd->setRelaxation( relaxation );
+
+  rd->initialize( vector, 1 );
+  rd->set_rates( rd_base::VARIABLE );
+  rd->set_diffusion( rd_base::ANISOTROPIC );
+}
+
+
+/******************************************************************************
+Largest difference between the model and the first slice of the grid.
+******************************************************************************/
+static float max_difference( rd_base *rd, rd_grid &grid )
+{
+  float max_diff = 0;
+
+  for( unsigned int n=0; n<2; n++ )
+    for( unsigned int j=0; j<rd->height_; j++ )
+      for( unsigned int i=0; i<rd->width_; i++ ) {
+	float diff = fabs( rd->morphigen[n][j][i] - grid.value( n, i, j ) );
+
+	if( max_diff < diff )
+	  max_diff = diff;
+      }
+
+  return max_diff;
+}
+
+
+/******************************************************************************
+Print one result line.
+******************************************************************************/
+static void report( const char *model, const char *step, const char *solver,
+		    unsigned int size, unsigned int depth,
+		    unsigned int steps, double seconds, const char *extra )
+{
+  double cells = (double) size * size * depth * steps;
+
+  fprintf( stdout, "%-11s %-13s %-8s %4ux%ux%-4u %9.2f Mcells/s  %s\n",
+	   model, step, solver, size, size, depth,
+	   cells / seconds * 1.0e-6, extra );
+}
+
+
+/******************************************************************************
+Benchmark one model: the explicit step and the implicit step with each
+relaxation, for rd_base, the 2D grid and the 3D grid.
+******************************************************************************/
+static void benchmark( rd_base *rd, const char *name, float ***vector,
+		       unsigned int size, unsigned int depth, unsigned int steps )
+{
+  char extra[256];
+  double t0;
+
+  rd_grid grid, volume;
+
+  // Explicit
+  restart( rd, vector, rd_base::EXPLICIT, rd_base::RED_BLACK );
+
+  grid.setup( rd );
+  volume.setup( rd, depth );
+
+  t0 = bench_time();
+  for( unsigned int s=0; s<steps; s++ )
+    rd->next_step_explicit_euler( );
+  report( name, "explicit", "rd_base", size, 1, steps, bench_time() - t0, "" );
+
+  t0 = bench_time();
+  for( unsigned int s=0; s<steps; s++ )
+    grid.next_step_explicit_euler( );
+  sprintf( extra, "max diff %g", max_difference( rd, grid ) );
+  report( name, "explicit", "rd_grid", size, 1, steps, bench_time() - t0, extra );
+
+  t0 = bench_time();
+  for( unsigned int s=0; s<steps; s++ )
+    volume.next_step_explicit_euler( );
+  report( name, "explicit", "rd_grid", size, depth, steps, bench_time() - t0, "" );
+
+  // Implicit, one line per relaxation.
+  const char *relax_name[3] = { "jacobi", "gauss-seidel", "red-black" };
+
+  for( int r=rd_base::JACOBI; r<=rd_base::RED_BLACK; r++ ) {
+
+    restart( rd, vector, rd_base::IMPLICIT, r );
+
+    grid.setup( rd );
+    volume.setup( rd, depth );
+
+    t0 = bench_time();
+    for( unsigned int s=0; s<steps; s++ )
+      rd->next_step_implicit_euler( );
+    report( name, relax_name[r], "rd_base", size, 1, steps, bench_time() - t0, "" );
+
+    unsigned int sweeps = 0;
+
+    t0 = bench_time();
+    for( unsigned int s=0; s<steps; s++ ) {
+      grid.next_step_implicit_euler( );
+      sweeps += grid.sweeps_;
+    }
+    sprintf( extra, "%u sweeps, residual %g, max diff %g",
+	     sweeps, grid.residual_, max_difference( rd, grid ) );
+    report( name, relax_name[r], "rd_grid", size, 1, steps, bench_time() - t0, extra );
+
+    sweeps = 0;
+
+    t0 = bench_time();
+    for( unsigned int s=0; s<steps; s++ ) {
+      volume.next_step_implicit_euler( );
+      sweeps += volume.sweeps_;
+    }
+    sprintf( extra, "%u sweeps, residual %g", sweeps, volume.residual_ );
+    report( name, relax_name[r], "rd_grid", size, depth, steps, bench_time() - t0, extra );
+  }
+}
+
+
+/******************************************************************************
+Time one large implicit step of a grid for each relaxation, all solved to
+the same residual.
+******************************************************************************/
+static void equal_residual( rd_base *rd, const char *name, float ***vector,
+			    unsigned int size, unsigned int depth,
+			    float time_scale, float tolerance )
+{
+  char extra[256];
+
+  float time_mult = time_scale * rd->getTimeMult();
+
+  const char *relax_name[4] =
+    { "jacobi", "gauss-seidel", "red-black", "multigrid" };
+
+  for( int r=rd_base::JACOBI; r<=rd_base::MULTIGRID; r++ ) {
+
+    restart( rd, vector, rd_base::IMPLICIT, r );
+    rd->setTimeMult( time_mult );
+
+    rd_grid grid;
+
+    grid.setup( rd, depth );
+    grid.tolerance_ = tolerance;
+
+    double t0 = bench_time();
+    grid.next_step_implicit_euler( );
+    double seconds = bench_time() - t0;
+
+    sprintf( extra, "%.3f s, %u sweeps, %u cycles, residual %g%s",
+	     seconds, grid.sweeps_, grid.cycles_, grid.residual_,
+	     grid.residual_ < tolerance ? "" : " (not converged)" );
+    report( name, relax_name[r], "rd_grid", size, depth, 1, seconds, extra );
+  }
+}
+
+
+/******************************************************************************
+Main
+******************************************************************************/
+int main( int argc, char* argv[] )
+{
+  unsigned int size  = 512;
+  unsigned int depth = 64;
+  unsigned int steps = 10;
+
+  // -mg: a single large implicit step of each relaxation, solved to the
+  // same residual (depth 1 is a 2D grid).
+  const char *prog = argv[0];
+
+  bool mg = (argc > 1 && strcmp( argv[1], "-mg" ) == 0);
+
+  if( mg ) {
+    argc--;
+    argv++;
+    depth = 1;
+  }
+
+  if( argc > 1 ) size  = atoi( argv[1] );
+  if( argc > 2 ) depth = atoi( argv[2] );
+  if( argc > 3 ) steps = atoi( argv[3] );
+
+  if( size < 8 || depth < 1 || (depth < 2 && !mg) || steps < 1 ) {
+    cerr << "usage: " << prog << " [size] [depth] [steps]" << endl
+	 << "       " << prog << " -mg [size] [depth]" << endl;
+    return -1;
+  }
+
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+
+  float ***vector = create_vector_data( size );
+
+  if( mg )
+    fprintf( stdout, "1 step, time step x %g, tolerance %g, %d threads\n\n",
+	     RD_BENCH_MG_TIME_SCALE, RD_BENCH_MG_TOLERANCE, threads );
+  else
+    fprintf( stdout, "%u steps, %d threads\n\n", steps, threads );
+
+  unsigned int dims[2] = { size, size };
+
+  rd_turing turing;
+  turing.setReaction( rd_base::TURING );
+  turing.alloc( dims, 1 );
+  turing.setBoundary( rd_base::ZERO_FLUX );
+
+  if( mg )
+    equal_residual( &turing, "turing", vector, size, depth,
+		    RD_BENCH_MG_TIME_SCALE, RD_BENCH_MG_TOLERANCE );
+  else
+    benchmark( &turing, "turing", vector, size, depth, steps );
+
+  fprintf( stdout, "\n" );
+
+  rd_gray_scott gray_scott;
+  gray_scott.setReaction( rd_base::GRAY_SCOTT );
+  gray_scott.alloc( dims, 1 );
+  gray_scott.setBoundary( rd_base::ZERO_FLUX );
+
+  if( mg )
+    equal_residual( &gray_scott, "gray-scott", vector, size, depth,
+		    RD_BENCH_MG_TIME_SCALE, RD_BENCH_MG_TOLERANCE );
+  else
+    benchmark( &gray_scott, "gray-scott", vector, size, depth, steps );
+
+  return 0;
+}
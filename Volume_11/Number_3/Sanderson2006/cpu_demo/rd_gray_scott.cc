@@ -188,3 +188,27 @@ inline float rd_gray_scott::reaction( unsigned int n,
     return (F - aVal * aVal * bVal -  F * bVal);
   }
 }
+
+
+/******************************************************************************
+Gray-Scott's reaction equations over a row, rc0 is K and rc1 F.
+******************************************************************************/
+void rd_gray_scott::reaction_row( const float * __restrict a,
+				  const float * __restrict b,
+				  const float * __restrict rc0,
+				  const float * __restrict rc1,
+				  float * __restrict ra,
+				  float * __restrict rb, unsigned int n )
+{
+  for( unsigned int i=0; i<n; i++ ) {
+    float aab = a[i] * a[i] * b[i];
+
+    ra[i] =          aab - rc0[i] * a[i];
+    rb[i] = rc1[i] - aab - rc1[i] * b[i];
+  }
+}
+
+float **rd_gray_scott::reaction_constants( unsigned int c )
+{
+  return c ? feed : conv;
+}
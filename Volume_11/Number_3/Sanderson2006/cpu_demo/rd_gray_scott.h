@@ -33,6 +33,12 @@ public:
   virtual float reaction( unsigned int n,
 			  unsigned int i, unsigned int j);
 
+  virtual void reaction_row( const float *a, const float *b,
+			     const float *rc0, const float *rc1,
+			     float *ra, float *rb, unsigned int n );
+
+  virtual float **reaction_constants( unsigned int c );
+
   float **feed;   /* Feed rate parameter. */
   float **conv;  /*  Conversion rate parameter. */
 
@@ -0,0 +1,1317 @@
+/*****************************************************************************/
+/*								             */
+/*	Copyright (c) 2005	Allen R. Sanderson		             */
+/*								             */
+/*				Scientific Computing and Imaging Institute   */
+/*				University of Utah		             */
+/*				Salt Lake City, Utah		             */
+/*								             */
+/*            							             */
+/*  Permission is granted to modify and/or distribute this program so long   */
+/*  as the program is distributed free of charge and this header is retained */
+/*  as part of the program.                                                  */
+/*								             */
+/*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "rd_grid.h"
+
+#define RESTRICT __restrict
+
+// The row loops are kept out of line, once inlined the compiler drops
+// the restrict qualifiers and gives up on vectorizing them.
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+enum { LAPLACIAN_INHOMOGENEOUS=0, LAPLACIAN_TEMPLATE=1, LAPLACIAN_ISOTROPIC=2 };
+
+
+/******************************************************************************
+Aligned memory allocation
+******************************************************************************/
+static float *alloc_floats( long n )
+{
+  void *p = 0;
+
+#ifdef _WIN32
+  p = _aligned_malloc( n * sizeof( float ), 64 );
+#else
+  if( posix_memalign( &p, 64, n * sizeof( float ) ) )
+    p = 0;
+#endif
+
+  if( p )
+    memset( p, 0, n * sizeof( float ) );
+
+  return (float *) p;
+}
+
+static void free_floats( float *p )
+{
+#ifdef _WIN32
+  _aligned_free( p );
+#else
+  free( p );
+#endif
+}
+
+
+/******************************************************************************
+Uniform random number in [0,1) for the slice noise.
+******************************************************************************/
+static float grid_rand( unsigned int &seed )
+{
+  seed = seed * 1664525u + 1013904223u;
+
+  return (float) (seed >> 8) / (float) (1 << 24);
+}
+
+
+/******************************************************************************
+Diffusion at a single cell - the same finite differences as
+rd_base::diffusion, with u and the tensors pointing at the cell and P
+and S the row and slice strides.
+******************************************************************************/
+template< int L, bool Z >
+static inline float diffusion_cell( const float *u, long P, long S,
+				    const float *dxx, const float *dyy,
+				    const float *dxy, const float *dzz )
+{
+  float c = u[0];
+
+  if( L == LAPLACIAN_INHOMOGENEOUS ) {
+    float f1 =
+      (dxx[ 1] + dxx[0]) * (u[ 1] - c) +
+      (dxx[-1] + dxx[0]) * (u[-1] - c) +
+      (dyy[ P] + dyy[0]) * (u[ P] - c) +
+      (dyy[-P] + dyy[0]) * (u[-P] - c);
+
+    if( Z )
+      f1 +=
+	(dzz[ S] + dzz[0]) * (u[ S] - c) +
+	(dzz[-S] + dzz[0]) * (u[-S] - c);
+
+    float f3 =
+      dxy[ 1] * (u[P+1] - u[-P+1]) - dxy[-1] * (u[P-1] - u[-P-1]) +
+      dxy[ P] * (u[P+1] - u[ P-1]) - dxy[-P] * (u[1-P] - u[-P-1]);
+
+    return f1 + f3;
+
+  } else if( L == LAPLACIAN_TEMPLATE ) {
+    // The 8 neighborhood template of rd_base::set_diffusion_uniform.
+    float f = 0.25 * dxy[0];
+
+    float diff =
+      f * (u[-P-1] - u[1-P] - u[P-1] + u[P+1]) +
+      dyy[0] * (u[-P] + u[P]) +
+      dxx[0] * (u[-1] + u[1]) -
+      2.0 * (dxx[0] + dyy[0]) * c;
+
+    if( Z )
+      diff += dzz[0] * (u[-S] + u[S] - 2.0 * c);
+
+    return diff;
+
+  } else {
+    float diff = u[-P] + u[P] + u[-1] + u[1] - 4.0 * c;
+
+    if( Z )
+      diff += u[-S] + u[S] - 2.0 * c;
+
+    return diff;
+  }
+}
+
+
+/******************************************************************************
+Relaxation at a single cell - rd_base::implicit_euler_relax. The u
+strides (UP, US) may differ from the tensor strides (P, S) when u is a
+copy of a tile.
+******************************************************************************/
+template< bool Z >
+static inline float relax_cell( const float *RESTRICT u, long UP, long US,
+				const float *RESTRICT dxx, const float *RESTRICT dyy,
+				const float *RESTRICT dxy, const float *RESTRICT dzz,
+				long P, long S,
+				float rhs, float tsi, float diff )
+{
+  float f3 =
+    dxy[ 1] * (u[UP+1] - u[-UP+1]) - dxy[-1] * (u[UP-1] - u[-UP-1]) +
+    dxy[ P] * (u[UP+1] - u[ UP-1]) - dxy[-P] * (u[1-UP] - u[-UP-1]);
+
+  float d_t0 = dxx[ 1] + dxx[0];
+  float d_t1 = dxx[-1] + dxx[0];
+  float d_t2 = dyy[ P] + dyy[0];
+  float d_t3 = dyy[-P] + dyy[0];
+
+  float f1a = d_t0 * u[1] + d_t1 * u[-1] + d_t2 * u[UP] + d_t3 * u[-UP];
+  float f1b = d_t0 + d_t1 + d_t2 + d_t3;
+
+  if( Z ) {
+    float d_t4 = dzz[ S] + dzz[0];
+    float d_t5 = dzz[-S] + dzz[0];
+
+    f1a += d_t4 * u[US] + d_t5 * u[-US];
+    f1b += d_t4 + d_t5;
+  }
+
+  return (rhs + diff * (f1a + f3)) / (tsi + diff * f1b);
+}
+
+
+/******************************************************************************
+Row loops - unit stride, so they are vectorized.
+******************************************************************************/
+template< int L, bool Z >
+static NOINLINE void diffusion_run( float *RESTRICT out, const float *RESTRICT u,
+			   const float *RESTRICT dxx, const float *RESTRICT dyy,
+			   const float *RESTRICT dxy, const float *RESTRICT dzz,
+			   long P, long S, int n )
+{
+  for( int i=0; i<n; i++ )
+    out[i] = diffusion_cell< L, Z >( u+i, P, S, dxx+i, dyy+i, dxy+i, dzz+i );
+}
+
+template< bool Z >
+static NOINLINE void relax_run( float *RESTRICT out, const float *RESTRICT u,
+		       const float *RESTRICT rhs,
+		       const float *RESTRICT dxx, const float *RESTRICT dyy,
+		       const float *RESTRICT dxy, const float *RESTRICT dzz,
+		       long P, long S, int n, float tsi, float diff )
+{
+  for( int i=0; i<n; i++ )
+    out[i] = relax_cell< Z >( u+i, P, S, dxx+i, dyy+i, dxy+i, dzz+i, P, S,
+			      rhs[i], tsi, diff );
+}
+
+static int count_changes( const float *RESTRICT u_new,
+			  const float *RESTRICT u_old, int n, float error )
+{
+  int changed = 0;
+
+  for( int i=0; i<n; i++ )
+    changed += ( fabsf( u_new[i] - u_old[i] ) > error );
+
+  return changed;
+}
+
+
+/******************************************************************************
+rd_grid
+******************************************************************************/
+rd_grid::rd_grid( ) :
+  width_(0), height_(0), depth_(0),
+  sweeps_(0), residual_(0), cycles_(0),
+  tolerance_(0),
+  model_(0),
+  pitch_(0), slab_(0), size_(0), zghost_(0),
+  tile_x_(0), tile_y_(0), tile_z_(0),
+  mg_valid_(false),
+  react_rate(0),
+  d_xx(0), d_yy(0), d_xy(0), d_zz(0),
+  boundary_(-1)
+{
+  for( unsigned int n=0; n<2; n++ ) {
+    morphigen[n] = next[n] = rhs_func[n] = react_const[n] = 0;
+  }
+}
+
+rd_grid::~rd_grid( )
+{
+  release( );
+}
+
+void rd_grid::release( )
+{
+  release_levels( );
+
+  for( unsigned int n=0; n<2; n++ ) {
+    free_floats( morphigen[n] );
+    free_floats( next[n] );
+    free_floats( rhs_func[n] );
+    free_floats( react_const[n] );
+
+    morphigen[n] = next[n] = rhs_func[n] = react_const[n] = 0;
+  }
+
+  free_floats( react_rate );
+  free_floats( d_xx );
+  free_floats( d_yy );
+  free_floats( d_xy );
+  free_floats( d_zz );
+
+  react_rate = d_xx = d_yy = d_xy = d_zz = 0;
+}
+
+void rd_grid::release_levels( )
+{
+  for( unsigned int l=1; l<levels_.size(); l++ ) {
+    free_floats( levels_[l].u );
+    free_floats( levels_[l].rhs );
+    free_floats( levels_[l].r );
+    free_floats( levels_[l].d_xx );
+    free_floats( levels_[l].d_yy );
+    free_floats( levels_[l].d_xy );
+    free_floats( levels_[l].d_zz );
+  }
+
+  levels_.clear();
+}
+
+
+/******************************************************************************
+Allocate the grid and copy the model.
+******************************************************************************/
+void rd_grid::setup( rd_base *model, unsigned int depth, float variance )
+{
+  release( );
+
+  model_ = model;
+
+  width_  = model->width_;
+  height_ = model->height_;
+  depth_  = depth ? depth : 1;
+
+  zghost_ = (depth_ > 1);
+
+  // Rows are padded to a whole number of cache lines.
+  pitch_ = (width_ + 2 + 15) & ~15;
+  slab_  = pitch_ * (height_ + 2);
+  size_  = slab_ * (depth_ + 2 * zghost_);
+
+  for( unsigned int n=0; n<2; n++ ) {
+    morphigen[n]   = alloc_floats( size_ );
+    next[n]        = alloc_floats( size_ );
+    rhs_func[n]    = alloc_floats( size_ );
+    react_const[n] = alloc_floats( size_ );
+  }
+
+  react_rate = alloc_floats( size_ );
+
+  d_xx = alloc_floats( size_ );
+  d_yy = alloc_floats( size_ );
+  d_xy = alloc_floats( size_ );
+
+  if( zghost_ )
+    d_zz = alloc_floats( size_ );
+
+  make_tiles( tiles_, width_, height_, depth_ );
+
+  // Level 0 of the multigrid hierarchy is the grid itself, the coarse
+  // levels are only made by the first multigrid solve.
+  level L;
+
+  L.nx = width_;  L.ny = height_;  L.nz = depth_;
+  L.fx = L.fy = L.fz = 1;
+  L.zghost = zghost_;
+  L.pitch = pitch_;  L.slab = slab_;  L.size = size_;
+  L.tiles = tiles_;
+  L.u = L.rhs = L.r = 0;
+  L.d_xx = d_xx;  L.d_yy = d_yy;  L.d_xy = d_xy;  L.d_zz = d_zz;
+
+  levels_.push_back( L );
+
+  // The slices of a volume get some noise so that they do not stay
+  // copies of each other.
+  unsigned int seed = 1;
+
+  for( unsigned int k=0; k<depth_; k++ )
+    for( unsigned int j=0; j<height_; j++ )
+      for( unsigned int i=0; i<width_; i++ )
+	for( unsigned int n=0; n<2; n++ ) {
+	  float val = model_->morphigen[n][j][i];
+
+	  if( zghost_ )
+	    val *= 1.0 + variance * (2.0 * grid_rand( seed ) - 1.0);
+
+	  morphigen[n][index( i, j, k )] = val;
+	}
+
+  set_rates( );
+  set_diffusion( );
+}
+
+
+/******************************************************************************
+Tiles
+******************************************************************************/
+void rd_grid::set_tile_size( unsigned int tx, unsigned int ty, unsigned int tz )
+{
+  tile_x_ = tx;
+  tile_y_ = ty;
+  tile_z_ = tz;
+
+  if( model_ ) {
+    make_tiles( tiles_, width_, height_, depth_ );
+
+    for( unsigned int l=0; l<levels_.size(); l++ )
+      if( l )
+	make_tiles( levels_[l].tiles, levels_[l].nx, levels_[l].ny, levels_[l].nz );
+      else
+	levels_[l].tiles = tiles_;
+  }
+}
+
+void rd_grid::make_tiles( std::vector< tile > &tiles, int nx, int ny, int nz )
+{
+  int tx = tile_x_, ty = tile_y_, tz = tile_z_;
+
+  if( tx == 0 || ty == 0 || tz == 0 ) {
+    tx = zghost_ ? RD_GRID_TILE_X_3D : RD_GRID_TILE_X;
+    ty = zghost_ ? RD_GRID_TILE_Y_3D : RD_GRID_TILE_Y;
+    tz = zghost_ ? RD_GRID_TILE_Z_3D : 1;
+  }
+
+  tiles.clear();
+
+  for( int k=0; k<nz; k+=tz )
+    for( int j=0; j<ny; j+=ty )
+      for( int i=0; i<nx; i+=tx ) {
+	tile t;
+
+	t.i0 = i;  t.i1 = (i+tx < nx) ? i+tx : nx;
+	t.j0 = j;  t.j1 = (j+ty < ny) ? j+ty : ny;
+	t.k0 = k;  t.k1 = (k+tz < nz) ? k+tz : nz;
+
+	tiles.push_back( t );
+      }
+}
+
+
+/******************************************************************************
+Copy the reaction rates and constants from the model.
+******************************************************************************/
+void rd_grid::set_rates( )
+{
+  float **rc0 = model_->reaction_constants( 0 );
+  float **rc1 = model_->reaction_constants( 1 );
+
+#pragma omp parallel for
+  for( int k=0; k<(int) depth_; k++ )
+    for( unsigned int j=0; j<height_; j++ ) {
+      long c = index( 0, j, k );
+
+      memcpy( react_rate     + c, model_->react_rate[j], width_ * sizeof( float ) );
+      memcpy( react_const[0] + c, rc0[j],               width_ * sizeof( float ) );
+      memcpy( react_const[1] + c, rc1[j],               width_ * sizeof( float ) );
+    }
+}
+
+
+/******************************************************************************
+Copy the diffusion tensors from the model.
+******************************************************************************/
+void rd_grid::set_diffusion( )
+{
+#pragma omp parallel for
+  for( int k=0; k<(int) depth_; k++ )
+    for( unsigned int j=0; j<height_; j++ )
+      for( unsigned int i=0; i<width_; i++ ) {
+	long c = index( i, j, k );
+
+	d_xx[c] = model_->d_tensor[j][i][0][0];
+	d_xy[c] = model_->d_tensor[j][i][0][1];
+	d_yy[c] = model_->d_tensor[j][i][1][1];
+
+	if( zghost_ )
+	  d_zz[c] = 0.5 * (d_xx[c] + d_yy[c]);
+      }
+
+  boundary_ = -1;
+  mg_valid_ = false;
+}
+
+
+/******************************************************************************
+Copy a slice back to the model.
+******************************************************************************/
+void rd_grid::copy_to_model( unsigned int slice )
+{
+  for( unsigned int n=0; n<2; n++ )
+    for( unsigned int j=0; j<height_; j++ )
+      memcpy( model_->morphigen[n][j], morphigen[n] + index( 0, j, slice ),
+	      width_ * sizeof( float ) );
+}
+
+
+/******************************************************************************
+exchange - fill the ghost layer of f according to the boundary. Zero flux
+repeats the edge cell (iminus1ZeroFlux[0] == 0), periodic wraps around.
+******************************************************************************/
+void rd_grid::exchange( float *f, const level &L )
+{
+  int periodic = (model_->boundary_ == rd_base::PERIODIC);
+
+  int nx = L.nx, ny = L.ny, nz = L.nz;
+
+  // Left and right of each row.
+#pragma omp parallel for if( nz * ny > 64 )
+  for( int k=0; k<nz; k++ )
+    for( int j=0; j<ny; j++ ) {
+      float *row = f + L.index( 0, j, k );
+
+      row[-1] = periodic ? row[nx-1] : row[0];
+      row[nx] = periodic ? row[0]    : row[nx-1];
+    }
+
+  // Rows below and above, ghosts included so the corners are filled.
+  for( int k=0; k<nz; k++ ) {
+    memcpy( f + L.index( -1, -1, k ),
+	    f + L.index( -1, periodic ? ny-1 : 0, k ), (nx + 2) * sizeof( float ) );
+    memcpy( f + L.index( -1, ny, k ),
+	    f + L.index( -1, periodic ? 0 : ny-1, k ), (nx + 2) * sizeof( float ) );
+  }
+
+  // Slices in front and behind.
+  if( L.zghost ) {
+    memcpy( f + L.index( -1, -1, -1 ),
+	    f + L.index( -1, -1, periodic ? nz-1 : 0 ), L.slab * sizeof( float ) );
+    memcpy( f + L.index( -1, -1, nz ),
+	    f + L.index( -1, -1, periodic ? 0 : nz-1 ), L.slab * sizeof( float ) );
+  }
+}
+
+
+/******************************************************************************
+Refresh the ghosts if the boundary of the model was changed.
+******************************************************************************/
+void rd_grid::check_boundary( )
+{
+  if( boundary_ == (int) model_->boundary_ )
+    return;
+
+  exchange( d_xx );
+  exchange( d_yy );
+  exchange( d_xy );
+
+  if( zghost_ )
+    exchange( d_zz );
+
+  exchange( morphigen[0] );
+  exchange( morphigen[1] );
+
+  boundary_ = model_->boundary_;
+  mg_valid_ = false;
+}
+
+
+/******************************************************************************
+Diffusion of the n cells starting at c.
+******************************************************************************/
+void rd_grid::diffusion_row( float *out, const float *u, long c, int n )
+{
+  const float *dzz = zghost_ ? d_zz : d_xx;
+
+  int L;
+
+  if( model_->laplacian_ == rd_base::INHOMOGENEOUS )
+    L = LAPLACIAN_INHOMOGENEOUS;
+  else if( model_->neighborhood == 4 )
+    L = LAPLACIAN_ISOTROPIC;
+  else
+    L = LAPLACIAN_TEMPLATE;
+
+#define DIFFUSION_RUN( L, Z )						\
+  diffusion_run< L, Z >( out, u+c, d_xx+c, d_yy+c, d_xy+c, dzz+c,	\
+			 pitch_, slab_, n )
+
+  if( zghost_ ) {
+    if( L == LAPLACIAN_INHOMOGENEOUS ) DIFFUSION_RUN( LAPLACIAN_INHOMOGENEOUS, true );
+    else if( L == LAPLACIAN_TEMPLATE ) DIFFUSION_RUN( LAPLACIAN_TEMPLATE,      true );
+    else                               DIFFUSION_RUN( LAPLACIAN_ISOTROPIC,     true );
+  } else {
+    if( L == LAPLACIAN_INHOMOGENEOUS ) DIFFUSION_RUN( LAPLACIAN_INHOMOGENEOUS, false );
+    else if( L == LAPLACIAN_TEMPLATE ) DIFFUSION_RUN( LAPLACIAN_TEMPLATE,      false );
+    else                               DIFFUSION_RUN( LAPLACIAN_ISOTROPIC,     false );
+  }
+
+#undef DIFFUSION_RUN
+}
+
+
+/******************************************************************************
+Relaxed values of the n cells starting at c.
+******************************************************************************/
+void rd_grid::relax_row( float *out, const float *u, const float *rhs,
+			 long c, int n, float diff )
+{
+  float tsi = model_->time_step_inv_;
+
+  if( zghost_ )
+    relax_run< true  >( out, u+c, rhs+c, d_xx+c, d_yy+c, d_xy+c, d_zz+c,
+			pitch_, slab_, n, tsi, diff );
+  else
+    relax_run< false >( out, u+c, rhs+c, d_xx+c, d_yy+c, d_xy+c, d_xx+c,
+			pitch_, slab_, n, tsi, diff );
+}
+
+
+/******************************************************************************
+Explicit euler step.
+******************************************************************************/
+static void euler_run( float *RESTRICT out, const float *RESTRICT u,
+		       const float *RESTRICT rate, const float *RESTRICT r,
+		       const float *RESTRICT l, float diff, int n )
+{
+  for( int i=0; i<n; i++ ) {
+    float val = u[i] + (rate[i] * r[i] + diff * l[i]);
+
+    out[i] = val < 0.0f ? 0.0f : val;
+  }
+}
+
+bool rd_grid::next_step_explicit_euler( )
+{
+  check_boundary( );
+
+  float diff0 = model_->diff_rate[0];
+  float diff1 = model_->diff_rate[1];
+
+  int nTiles = tiles_.size();
+
+#pragma omp parallel
+  {
+    float *ra = alloc_floats( 4 * width_ );
+    float *rb = ra + width_;
+    float *la = rb + width_;
+    float *lb = la + width_;
+
+#pragma omp for schedule(dynamic)
+    for( int t=0; t<nTiles; t++ ) {
+      const tile &T = tiles_[t];
+
+      int n = T.i1 - T.i0;
+
+      for( int k=T.k0; k<T.k1; k++ )
+	for( int j=T.j0; j<T.j1; j++ ) {
+	  long c = index( T.i0, j, k );
+
+	  model_->reaction_row( morphigen[0] + c, morphigen[1] + c,
+				react_const[0] + c, react_const[1] + c,
+				ra, rb, n );
+
+	  diffusion_row( la, morphigen[0], c, n );
+	  diffusion_row( lb, morphigen[1], c, n );
+
+	  euler_run( next[0] + c, morphigen[0] + c, react_rate + c, ra, la, diff0, n );
+	  euler_run( next[1] + c, morphigen[1] + c, react_rate + c, rb, lb, diff1, n );
+	}
+    }
+
+    free_floats( ra );
+  }
+
+  for( unsigned int n=0; n<2; n++ ) {
+    float *swap = morphigen[n];
+    morphigen[n] = next[n];
+    next[n] = swap;
+
+    exchange( morphigen[n] );
+  }
+
+  return false;
+}
+
+
+/******************************************************************************
+Semi implicit euler step - both RHS first (LOCK_STEP) then the solves.
+******************************************************************************/
+bool rd_grid::next_step_implicit_euler( )
+{
+  check_boundary( );
+
+  implicit_rhs( );
+
+  sweeps_ = 0;
+  cycles_ = 0;
+  residual_ = 0;
+
+  for( unsigned int m=0; m<2; m++ )
+    implicit_solve( m, model_->theta_ * model_->diff_rate[m] );
+
+  return false;
+}
+
+
+/******************************************************************************
+Implicit RHS Calculation.
+******************************************************************************/
+static void rhs_run( float *RESTRICT rhs, const float *RESTRICT u,
+		     const float *RESTRICT rate, const float *RESTRICT r,
+		     const float *RESTRICT l, float tsi, float diff, int n )
+{
+  if( l )
+    for( int i=0; i<n; i++ )
+      rhs[i] = u[i] * tsi + rate[i] * r[i] + diff * l[i];
+  else
+    for( int i=0; i<n; i++ )
+      rhs[i] = u[i] * tsi + rate[i] * r[i];
+}
+
+void rd_grid::implicit_rhs( )
+{
+  float tsi = model_->time_step_inv_;
+
+  bool explicit_part = ( model_->theta_ != 1.0 );
+
+  float diff0 = (1.0 - model_->theta_) * model_->diff_rate[0];
+  float diff1 = (1.0 - model_->theta_) * model_->diff_rate[1];
+
+  int nTiles = tiles_.size();
+
+#pragma omp parallel
+  {
+    float *ra = alloc_floats( 4 * width_ );
+    float *rb = ra + width_;
+    float *la = rb + width_;
+    float *lb = la + width_;
+
+#pragma omp for schedule(dynamic)
+    for( int t=0; t<nTiles; t++ ) {
+      const tile &T = tiles_[t];
+
+      int n = T.i1 - T.i0;
+
+      for( int k=T.k0; k<T.k1; k++ )
+	for( int j=T.j0; j<T.j1; j++ ) {
+	  long c = index( T.i0, j, k );
+
+	  model_->reaction_row( morphigen[0] + c, morphigen[1] + c,
+				react_const[0] + c, react_const[1] + c,
+				ra, rb, n );
+
+	  if( explicit_part ) {
+	    diffusion_row( la, morphigen[0], c, n );
+	    diffusion_row( lb, morphigen[1], c, n );
+	  }
+
+	  rhs_run( rhs_func[0] + c, morphigen[0] + c, react_rate + c, ra,
+		   explicit_part ? la : 0, tsi, diff0, n );
+	  rhs_run( rhs_func[1] + c, morphigen[1] + c, react_rate + c, rb,
+		   explicit_part ? lb : 0, tsi, diff1, n );
+	}
+    }
+
+    free_floats( ra );
+  }
+}
+
+
+/******************************************************************************
+implicit_solve - the stopping rules of rd_base::implicit_solve.
+******************************************************************************/
+void rd_grid::implicit_solve( unsigned int m, float diff )
+{
+  int nr_steps = 20; // Number of smoothing steps for the exact solution.
+
+  int cc = 0, dd = 0, max_iterations = 100;
+  float current_residual = 1.0e4, last_residual = 1.0e5;
+  float max_difference = model_->min_error_, max_residual = model_->min_error_;
+
+  if( tolerance_ > 0 )
+    max_residual = tolerance_;
+
+  if( model_->relaxation_ == rd_base::MULTIGRID )
+    current_residual = mg_solve( m, diff );
+
+  else while( cc++ < max_iterations ) {
+
+    bool converged = false;
+
+    for( int i=0; i<nr_steps && !converged; i++ ) {
+      converged = relax( m, diff ) && tolerance_ <= 0;
+      sweeps_++;
+    }
+
+    current_residual = implicit_residual( m, diff );
+
+    if( current_residual < max_residual )
+      break;
+
+    if( tolerance_ > 0 )
+      continue;
+
+    if( fabs(last_residual-current_residual) > max_difference ) {
+      dd = 1;
+
+      last_residual = current_residual;
+
+    } else if( ++dd == 5 )
+      break;
+  }
+
+  if( residual_ < current_residual )
+    residual_ = current_residual;
+
+  // Clamp any negative results to zero
+  float *u = morphigen[m];
+
+#pragma omp parallel for
+  for( long c=0; c<size_; c++ )
+    if( u[c] < 0 )
+      u[c] = 0;
+}
+
+
+/******************************************************************************
+Root mean square of the residual.
+******************************************************************************/
+float rd_grid::implicit_residual( unsigned int m, float diff )
+{
+  float tsi = model_->time_step_inv_;
+
+  const float *u   = morphigen[m];
+  const float *rhs = rhs_func[m];
+
+  int nTiles = tiles_.size();
+
+  double sum = 0;
+
+#pragma omp parallel reduction(+:sum)
+  {
+    float *l = alloc_floats( width_ );
+
+#pragma omp for schedule(dynamic)
+    for( int t=0; t<nTiles; t++ ) {
+      const tile &T = tiles_[t];
+
+      int n = T.i1 - T.i0;
+
+      for( int k=T.k0; k<T.k1; k++ )
+	for( int j=T.j0; j<T.j1; j++ ) {
+	  long c = index( T.i0, j, k );
+
+	  diffusion_row( l, u, c, n );
+
+	  float row_sum = 0;
+
+	  for( int i=0; i<n; i++ ) {
+	    float resid = rhs[c+i] - (u[c+i] * tsi - diff * l[i]);
+
+	    row_sum += resid * resid;
+	  }
+
+	  sum += row_sum;
+	}
+    }
+
+    free_floats( l );
+  }
+
+  return sqrt( sum / ((double) width_ * height_ * depth_) );
+}
+
+
+/******************************************************************************
+relax - relaxation using the model's relaxation type
+******************************************************************************/
+bool rd_grid::relax( unsigned int m, float diff )
+{
+  if( model_->relaxation_ == rd_base::GAUSS_SEIDEL )
+    return relax_gs( m, diff );
+
+  else if( model_->relaxation_ == rd_base::JACOBI )
+    return relax_jacobi( m, diff );
+
+  else
+    return relax_gs_rb( m, diff );
+}
+
+
+/******************************************************************************
+relax_jacobi - relaxation using Jacobi relaxation
+******************************************************************************/
+bool rd_grid::relax_jacobi( unsigned int m, float diff )
+{
+  const float *u = morphigen[m];
+  float *u_new = next[m];
+
+  float error = model_->min_error_;
+
+  int nTiles = tiles_.size();
+  int changed = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:changed)
+  for( int t=0; t<nTiles; t++ ) {
+    const tile &T = tiles_[t];
+
+    int n = T.i1 - T.i0;
+
+    for( int k=T.k0; k<T.k1; k++ )
+      for( int j=T.j0; j<T.j1; j++ ) {
+	long c = index( T.i0, j, k );
+
+	relax_row( u_new + c, u, rhs_func[m], c, n, diff );
+
+	changed += count_changes( u_new + c, u + c, n, error );
+      }
+  }
+
+  morphigen[m] = u_new;
+  next[m] = (float *) u;
+
+  exchange( morphigen[m] );
+
+  return changed == 0;
+}
+
+
+/******************************************************************************
+relax_gs_rb - relaxation using Gauss-Seidel red-black relaxation. Each
+colour is computed from the values before its pass, so the result does
+not depend on the order the tiles are processed in. With the cross
+derivative terms (which reach cells of the same colour) this differs
+slightly from the sequential rd_base::relax_gs_rb.
+******************************************************************************/
+bool rd_grid::relax_gs_rb( unsigned int m, float diff )
+{
+  level &L = levels_[0];
+
+  L.u   = morphigen[m];
+  L.r   = next[m];
+  L.rhs = rhs_func[m];
+
+  int changed = relax_rb( L, diff );
+
+  morphigen[m] = L.u;
+  next[m] = L.r;
+
+  return changed == 0;
+}
+
+
+/******************************************************************************
+relax_rb - one red-black sweep of a level, L.r is the second buffer.
+Returns the number of cells that changed by more than the minimum error.
+******************************************************************************/
+int rd_grid::relax_rb( level &L, float diff )
+{
+  float tsi = model_->time_step_inv_;
+  float error = model_->min_error_;
+
+  int nTiles = L.tiles.size();
+  int changed = 0;
+
+  for( int pass=0; pass<2; pass++ ) {
+
+    const float *u = L.u;
+    float *u_new = L.r;
+
+#pragma omp parallel reduction(+:changed) if( L.size > 4096 )
+    {
+      float *val = alloc_floats( L.nx );
+
+#pragma omp for schedule(dynamic)
+      for( int t=0; t<nTiles; t++ ) {
+	const tile &T = L.tiles[t];
+
+	int n = T.i1 - T.i0;
+
+	for( int k=T.k0; k<T.k1; k++ )
+	  for( int j=T.j0; j<T.j1; j++ ) {
+	    long c = L.index( T.i0, j, k );
+
+	    if( L.zghost )
+	      relax_run< true  >( val, u+c, L.rhs+c, L.d_xx+c, L.d_yy+c,
+				  L.d_xy+c, L.d_zz+c, L.pitch, L.slab, n,
+				  tsi, diff );
+	    else
+	      relax_run< false >( val, u+c, L.rhs+c, L.d_xx+c, L.d_yy+c,
+				  L.d_xy+c, L.d_xx+c, L.pitch, L.slab, n,
+				  tsi, diff );
+
+	    memcpy( u_new + c, u + c, n * sizeof( float ) );
+
+	    // Cells with i+j+k even on the first pass, odd on the second.
+	    for( int i=(T.i0+j+k+pass)&1; i<n; i+=2 ) {
+	      if( fabsf( val[i] - u[c+i] ) > error )
+		changed++;
+
+	      u_new[c+i] = val[i];
+	    }
+	  }
+      }
+
+      free_floats( val );
+    }
+
+    L.u = u_new;
+    L.r = (float *) u;
+
+    exchange( L.u, L );
+  }
+
+  return changed;
+}
+
+
+/******************************************************************************
+relax_gs - relaxation using Gauss-Seidel relaxation. Each tile is
+copied with its halo and swept in place, so within a tile this is the
+sequential rd_base::relax_gs while the tiles see each other's values of
+the previous sweep (block Gauss-Seidel).
+******************************************************************************/
+bool rd_grid::relax_gs( unsigned int m, float diff )
+{
+  const float *u = morphigen[m];
+  float *u_new = next[m];
+
+  const float *rhs = rhs_func[m];
+  const float *dzz = zghost_ ? d_zz : d_xx;
+
+  float tsi = model_->time_step_inv_;
+  float error = model_->min_error_;
+
+  int nTiles = tiles_.size();
+  int changed = 0;
+
+  int max_x = 0, max_y = 0, max_z = 0;
+
+  for( int t=0; t<nTiles; t++ ) {
+    if( max_x < tiles_[t].i1 - tiles_[t].i0 ) max_x = tiles_[t].i1 - tiles_[t].i0;
+    if( max_y < tiles_[t].j1 - tiles_[t].j0 ) max_y = tiles_[t].j1 - tiles_[t].j0;
+    if( max_z < tiles_[t].k1 - tiles_[t].k0 ) max_z = tiles_[t].k1 - tiles_[t].k0;
+  }
+
+#pragma omp parallel reduction(+:changed)
+  {
+    float *buf = alloc_floats( (long) (max_x+2) * (max_y+2) * (max_z+2*zghost_) );
+
+#pragma omp for schedule(dynamic)
+    for( int t=0; t<nTiles; t++ ) {
+      const tile &T = tiles_[t];
+
+      int nx = T.i1 - T.i0, ny = T.j1 - T.j0, nz = T.k1 - T.k0;
+
+      long bp = nx + 2;
+      long bs = bp * (ny + 2);
+
+      // Gather the tile and its halo.
+      for( int k=-zghost_; k<nz+zghost_; k++ )
+	for( int j=-1; j<=ny; j++ )
+	  memcpy( buf + (k+zghost_) * bs + (j+1) * bp,
+		  u + index( T.i0-1, T.j0+j, T.k0+k ), bp * sizeof( float ) );
+
+      for( int k=0; k<nz; k++ )
+	for( int j=0; j<ny; j++ ) {
+	  float *b = buf + (k+zghost_) * bs + (j+1) * bp + 1;
+
+	  long c = index( T.i0, T.j0+j, T.k0+k );
+
+	  for( int i=0; i<nx; i++, c++ ) {
+	    float val = zghost_ ?
+	      relax_cell< true  >( b+i, bp, bs, d_xx+c, d_yy+c, d_xy+c, dzz+c,
+				   pitch_, slab_, rhs[c], tsi, diff ) :
+	      relax_cell< false >( b+i, bp, bs, d_xx+c, d_yy+c, d_xy+c, dzz+c,
+				   pitch_, slab_, rhs[c], tsi, diff );
+
+	    if( fabsf( val - b[i] ) > error )
+	      changed++;
+
+	    b[i] = val;
+	    u_new[c] = val;
+	  }
+	}
+    }
+
+    free_floats( buf );
+  }
+
+  morphigen[m] = u_new;
+  next[m] = (float *) u;
+
+  exchange( morphigen[m] );
+
+  return changed == 0;
+}
+
+
+/******************************************************************************
+make_levels - the coarse grids of the multigrid hierarchy. Each dimension
+that is even is halved until nothing can be halved or the grid is small
+enough to be solved by a few sweeps.
+******************************************************************************/
+void rd_grid::make_levels( )
+{
+  for( ;; ) {
+    const level &F = levels_.back();
+
+    level C;
+
+    C.fx = (F.nx % 2 == 0 && F.nx >= 4) ? 2 : 1;
+    C.fy = (F.ny % 2 == 0 && F.ny >= 4) ? 2 : 1;
+    C.fz = (F.zghost && F.nz % 2 == 0 && F.nz >= 4) ? 2 : 1;
+
+    if( C.fx * C.fy * C.fz == 1 || (long) F.nx * F.ny * F.nz <= 64 )
+      break;
+
+    C.nx = F.nx / C.fx;
+    C.ny = F.ny / C.fy;
+    C.nz = F.nz / C.fz;
+
+    C.zghost = F.zghost;
+
+    C.pitch = (C.nx + 2 + 15) & ~15;
+    C.slab  = C.pitch * (C.ny + 2);
+    C.size  = C.slab * (C.nz + 2 * C.zghost);
+
+    make_tiles( C.tiles, C.nx, C.ny, C.nz );
+
+    C.u    = alloc_floats( C.size );
+    C.rhs  = alloc_floats( C.size );
+    C.r    = alloc_floats( C.size );
+    C.d_xx = alloc_floats( C.size );
+    C.d_yy = alloc_floats( C.size );
+    C.d_xy = alloc_floats( C.size );
+    C.d_zz = C.zghost ? alloc_floats( C.size ) : 0;
+
+    levels_.push_back( C );
+  }
+
+  mg_valid_ = false;
+}
+
+
+/******************************************************************************
+mg_coefficients - the coarse grid tensors, the mean of the finer tensors
+scaled by the coarse cell size (the fine grid spacing is one).
+******************************************************************************/
+void rd_grid::mg_coefficients( )
+{
+  for( unsigned int l=1; l<levels_.size(); l++ ) {
+    const level &F = levels_[l-1];
+    level &C = levels_[l];
+
+    mg_average( F, F.d_xx, C, C.d_xx, 1.0 / (C.fx * C.fx) );
+    mg_average( F, F.d_yy, C, C.d_yy, 1.0 / (C.fy * C.fy) );
+    mg_average( F, F.d_xy, C, C.d_xy, 1.0 / (C.fx * C.fy) );
+
+    exchange( C.d_xx, C );
+    exchange( C.d_yy, C );
+    exchange( C.d_xy, C );
+
+    if( C.zghost ) {
+      mg_average( F, F.d_zz, C, C.d_zz, 1.0 / (C.fz * C.fz) );
+      exchange( C.d_zz, C );
+    }
+  }
+}
+
+
+/******************************************************************************
+mg_average - each coarse cell gets the mean of its finer cells times scale
+(restriction).
+******************************************************************************/
+void rd_grid::mg_average( const level &F, const float *src,
+			  const level &C, float *dst, float scale )
+{
+  float w = scale / (C.fx * C.fy * C.fz);
+
+  int nx = C.nx;
+
+#pragma omp parallel for if( C.size > 4096 )
+  for( int k=0; k<C.nz; k++ )
+    for( int j=0; j<C.ny; j++ ) {
+      float *d = dst + C.index( 0, j, k );
+
+      for( int i=0; i<nx; i++ )
+	d[i] = 0;
+
+      for( int dk=0; dk<C.fz; dk++ )
+	for( int dj=0; dj<C.fy; dj++ ) {
+	  const float *s = src + F.index( 0, j * C.fy + dj, k * C.fz + dk );
+
+	  if( C.fx == 2 )
+	    for( int i=0; i<nx; i++ )
+	      d[i] += s[2*i] + s[2*i+1];
+	  else
+	    for( int i=0; i<nx; i++ )
+	      d[i] += s[i];
+	}
+
+      for( int i=0; i<nx; i++ )
+	d[i] *= w;
+    }
+}
+
+
+/******************************************************************************
+mg_residual - L.r = L.rhs - (L.u * tsi - diff * laplacian(L.u)), with the
+same inhomogeneous finite differences as the relaxation.
+******************************************************************************/
+void rd_grid::mg_residual( level &L, float diff )
+{
+  float tsi = model_->time_step_inv_;
+
+  const float *u = L.u;
+  const float *rhs = L.rhs;
+  float *r = L.r;
+
+  const float *dzz = L.zghost ? L.d_zz : L.d_xx;
+
+  int nTiles = L.tiles.size();
+
+#pragma omp parallel if( L.size > 4096 )
+  {
+    float *l = alloc_floats( L.nx );
+
+#pragma omp for schedule(dynamic)
+    for( int t=0; t<nTiles; t++ ) {
+      const tile &T = L.tiles[t];
+
+      int n = T.i1 - T.i0;
+
+      for( int k=T.k0; k<T.k1; k++ )
+	for( int j=T.j0; j<T.j1; j++ ) {
+	  long c = L.index( T.i0, j, k );
+
+	  if( L.zghost )
+	    diffusion_run< LAPLACIAN_INHOMOGENEOUS, true  >
+	      ( l, u+c, L.d_xx+c, L.d_yy+c, L.d_xy+c, dzz+c, L.pitch, L.slab, n );
+	  else
+	    diffusion_run< LAPLACIAN_INHOMOGENEOUS, false >
+	      ( l, u+c, L.d_xx+c, L.d_yy+c, L.d_xy+c, dzz+c, L.pitch, L.slab, n );
+
+	  for( int i=0; i<n; i++ )
+	    r[c+i] = rhs[c+i] - (u[c+i] * tsi - diff * l[i]);
+	}
+    }
+
+    free_floats( l );
+  }
+}
+
+
+/******************************************************************************
+mg_prolong - add the linear interpolation of the coarse correction to the
+finer level. Cell centered, so each fine cell takes 3/4 of its parent
+and 1/4 of the parent's neighbour on its side along every halved
+dimension. The coarse ghost layer supplies the neighbours at the border.
+******************************************************************************/
+void rd_grid::mg_prolong( const level &C, level &F )
+{
+  const float *e = C.u;
+
+  float w1x = (C.fx == 2) ? 0.25 : 0, w0x = 1.0 - w1x;
+  float w1y = (C.fy == 2) ? 0.25 : 0, w0y = 1.0 - w1y;
+  float w1z = (C.fz == 2) ? 0.25 : 0, w0z = 1.0 - w1z;
+
+#pragma omp parallel for if( F.size > 4096 )
+  for( int k=0; k<F.nz; k++ )
+    for( int j=0; j<F.ny; j++ ) {
+      int K0 = k / C.fz, K1 = K0 + ((C.fz == 2) ? ((k & 1) ? 1 : -1) : 0);
+      int J0 = j / C.fy, J1 = J0 + ((C.fy == 2) ? ((j & 1) ? 1 : -1) : 0);
+
+      const float *e00 = e + C.index( 0, J0, K0 );
+      const float *e01 = e + C.index( 0, J1, K0 );
+      const float *e10 = e + C.index( 0, J0, K1 );
+      const float *e11 = e + C.index( 0, J1, K1 );
+
+      float w00 = w0y * w0z, w01 = w1y * w0z;
+      float w10 = w0y * w1z, w11 = w1y * w1z;
+
+      float *u = F.u + F.index( 0, j, k );
+
+      for( int i=0; i<F.nx; i++ ) {
+	int I0 = i / C.fx, I1 = I0 + ((C.fx == 2) ? ((i & 1) ? 1 : -1) : 0);
+
+	u[i] +=
+	  w00 * (w0x * e00[I0] + w1x * e00[I1]) +
+	  w01 * (w0x * e01[I0] + w1x * e01[I1]) +
+	  w10 * (w0x * e10[I0] + w1x * e10[I1]) +
+	  w11 * (w0x * e11[I0] + w1x * e11[I1]);
+      }
+    }
+
+  exchange( F.u, F );
+}
+
+
+/******************************************************************************
+mg_cycle - one V-cycle from level l down. On level 0 u is the solution,
+on the coarser levels the correction.
+******************************************************************************/
+void rd_grid::mg_cycle( unsigned int l, float diff )
+{
+  level &F = levels_[l];
+
+  if( l + 1 == levels_.size() ) {
+    for( int s=0; s<RD_GRID_MG_COARSE; s++ )
+      relax_rb( F, diff );
+
+    return;
+  }
+
+  for( int s=0; s<RD_GRID_MG_PRE; s++ )
+    relax_rb( F, diff );
+
+  mg_residual( F, diff );
+
+  level &C = levels_[l+1];
+
+  mg_average( F, F.r, C, C.rhs, 1.0 );
+
+  memset( C.u, 0, C.size * sizeof( float ) );
+
+  mg_cycle( l+1, diff );
+
+  // relax_rb leaves the ghost layer of the correction up to date.
+  mg_prolong( C, F );
+
+  for( int s=0; s<RD_GRID_MG_POST; s++ )
+    relax_rb( F, diff );
+
+  if( l == 0 )
+    sweeps_ += RD_GRID_MG_PRE + RD_GRID_MG_POST;
+}
+
+
+/******************************************************************************
+mg_solve - V-cycles until the residual is below the tolerance (or the
+model's minimum error). Returns the final residual.
+******************************************************************************/
+float rd_grid::mg_solve( unsigned int m, float diff )
+{
+  if( levels_.size() == 1 )
+    make_levels( );
+
+  if( !mg_valid_ ) {
+    mg_coefficients( );
+    mg_valid_ = true;
+  }
+
+  level &F = levels_[0];
+
+  F.u   = morphigen[m];
+  F.r   = next[m];
+  F.rhs = rhs_func[m];
+
+  float max_residual = (tolerance_ > 0) ? tolerance_ : model_->min_error_;
+
+  float residual = implicit_residual( m, diff );
+
+  for( int c=0; c<RD_GRID_MG_CYCLES && residual >= max_residual; c++ ) {
+    mg_cycle( 0, diff );
+
+    morphigen[m] = F.u;
+    next[m] = F.r;
+
+    cycles_++;
+
+    residual = implicit_residual( m, diff );
+  }
+
+  return residual;
+}
@@ -0,0 +1,183 @@
+/*****************************************************************************/
+/*								             */
+/*	Copyright (c) 2005	Allen R. Sanderson		             */
+/*								             */
+/*				Scientific Computing and Imaging Institute   */
+/*				University of Utah		             */
+/*				Salt Lake City, Utah		             */
+/*								             */
+/*            							             */
+/*  Permission is granted to modify and/or distribute this program so long   */
+/*  as the program is distributed free of charge and this header is retained */
+/*  as part of the program.                                                  */
+/*								             */
+/*****************************************************************************/
+
+#ifndef DEFINE_RD_GRID_H
+#define DEFINE_RD_GRID_H 1
+
+#include <vector>
+
+#include "rd_base.h"
+
+// Default tile sizes (in cells). A tile of the two morphigens, their
+// next values and the rate and tensor coefficients is about 200KB,
+// so that it stays in the L2 cache while it is swept.
+#define RD_GRID_TILE_X    256
+#define RD_GRID_TILE_Y     16
+#define RD_GRID_TILE_X_3D  64
+#define RD_GRID_TILE_Y_3D  16
+#define RD_GRID_TILE_Z_3D   4
+
+// Multigrid V-cycle: red-black sweeps before and after the coarse grid
+// correction, sweeps on the coarsest grid and the most cycles per solve.
+#define RD_GRID_MG_PRE      2
+#define RD_GRID_MG_POST     2
+#define RD_GRID_MG_COARSE  16
+#define RD_GRID_MG_CYCLES  20
+
+/******************************************************************************
+rd_grid class
+
+Flat array solver for an rd_base model. The morphigens and coefficients
+are stored in contiguous, 64 byte aligned arrays with a one cell ghost
+layer, so that every stencil is a unit stride loop over a row that the
+compiler turns into SIMD code. The domain is cut into cache sized tiles
+which are handed out to the OpenMP threads; the ghost layer is refreshed
+(halo exchange) after every sweep according to the model boundary.
+
+The grid may also be a volume: each slice starts as a copy of the 2D
+model (plus some noise so that the slices differ) and diffuses along z
+with the mean of the in plane principal diffusivities.
+
+With the MULTIGRID relaxation the implicit diffusion is solved with
+geometric multigrid V-cycles: cell centered coarse grids (each even
+dimension halved), tensors averaged and scaled by the coarse spacing,
+red-black smoothing, averaging restriction and linear prolongation.
+The ghost layers of every level follow the model boundary.
+
+The solution, relaxation, laplacian and boundary types as well as the
+time step, theta and diffusion rates are read from the model at every
+step, the per cell rates and tensors are copied by setup, set_rates and
+set_diffusion.
+******************************************************************************/
+class rd_grid
+{
+public:
+  rd_grid();
+  ~rd_grid();
+
+  void setup( rd_base *model, unsigned int depth = 1,
+	      float variance = 0.01 );
+
+  void set_tile_size( unsigned int tx, unsigned int ty, unsigned int tz = 1 );
+
+  // Copy the per cell reaction rates and constants from the model.
+  void set_rates( );
+
+  // Copy the diffusion tensors from the model.
+  void set_diffusion( );
+
+  // Copy one slice of the morphigens back to the model (for display
+  // or for the gradient based diffusion of set_diffusion).
+  void copy_to_model( unsigned int slice = 0 );
+
+  bool next_step_explicit_euler( );
+  bool next_step_implicit_euler( );
+
+  float value( unsigned int n,
+	       unsigned int i, unsigned int j, unsigned int k = 0 ) const
+  { return morphigen[n][index( i, j, k )]; };
+
+  unsigned int width_, height_, depth_;
+
+  unsigned int sweeps_;   //  Relaxation sweeps of the last implicit step.
+  float residual_;        //  Largest final residual of the last implicit step.
+  unsigned int cycles_;   //  Multigrid V-cycles of the last implicit step.
+
+  // When positive the implicit solves iterate until the residual is
+  // below tolerance_ (without the stagnation test of rd_base), so that
+  // the relaxations can be compared at equal residual.
+  float tolerance_;
+
+protected:
+  struct tile {
+    int i0, i1, j0, j1, k0, k1;
+  };
+
+  // A grid of the multigrid hierarchy, level 0 is the grid itself.
+  struct level {
+    int nx, ny, nz;          //  Cells.
+    int fx, fy, fz;          //  Coarsening from the finer level (1 or 2).
+    int zghost;
+    long pitch, slab, size;
+
+    std::vector< tile > tiles;
+
+    float *u, *rhs, *r;      //  Solution (correction), RHS and scratch.
+    float *d_xx, *d_yy, *d_xy, *d_zz;
+
+    long index( int i, int j, int k ) const
+    { return (k + zghost) * slab + (j + 1) * pitch + (i + 1); };
+  };
+
+  long index( int i, int j, int k ) const
+  { return (k + zghost_) * slab_ + (j + 1) * pitch_ + (i + 1); };
+
+  void release( );
+  void release_levels( );
+  void make_tiles( std::vector< tile > &tiles, int nx, int ny, int nz );
+  void make_levels( );
+
+  void exchange( float *f ) { exchange( f, levels_[0] ); };
+  void exchange( float *f, const level &L );
+  void check_boundary( );
+
+  void diffusion_row( float *out, const float *u, long c, int n );
+  void relax_row( float *out, const float *u, const float *rhs,
+		  long c, int n, float diff );
+
+  void implicit_rhs( );
+  void implicit_solve( unsigned int m, float diff );
+  float implicit_residual( unsigned int m, float diff );
+
+  bool relax       ( unsigned int m, float diff );
+  bool relax_gs    ( unsigned int m, float diff );
+  bool relax_gs_rb ( unsigned int m, float diff );
+  bool relax_jacobi( unsigned int m, float diff );
+
+  int relax_rb( level &L, float diff );
+
+  float mg_solve( unsigned int m, float diff );
+  void mg_cycle( unsigned int l, float diff );
+  void mg_coefficients( );
+  void mg_residual( level &L, float diff );
+  void mg_average( const level &F, const float *src,
+		   const level &C, float *dst, float scale );
+  void mg_prolong( const level &C, level &F );
+
+  rd_base *model_;
+
+  long pitch_, slab_, size_;  //  Row and slice strides, total floats.
+  int zghost_;                //  One for volumes, zero for images.
+
+  unsigned int tile_x_, tile_y_, tile_z_;
+
+  std::vector< tile > tiles_;
+
+  std::vector< level > levels_;
+  bool mg_valid_;        //  Coarse grid tensors are up to date.
+
+  float *morphigen[2];   //  Morphogen concentration.
+  float *next[2];        //  Next values (double buffer).
+  float *rhs_func[2];    //  Implicit RHS.
+
+  float *react_rate;     //  Reaction rate.
+  float *react_const[2]; //  Reaction constants (alpha/beta, conv/feed).
+
+  float *d_xx, *d_yy, *d_xy, *d_zz;  //  Diffusion tensor (d_zz volumes only).
+
+  int boundary_;         //  Boundary the ghost layers were filled for.
+};
+
+#endif  // DEFINE_RD_GRID_H
@@ -136,3 +136,27 @@ inline float rd_turing::reaction( unsigned int n,
     return (  betaVal - aVal * bVal);
   }
 }
+
+
+/******************************************************************************
+Turing's reaction equations over a row, rc0 is alpha and rc1 beta.
+******************************************************************************/
+void rd_turing::reaction_row( const float * __restrict a,
+			      const float * __restrict b,
+			      const float * __restrict rc0,
+			      const float * __restrict rc1,
+			      float * __restrict ra,
+			      float * __restrict rb, unsigned int n )
+{
+  for( unsigned int i=0; i<n; i++ ) {
+    float ab = a[i] * b[i];
+
+    ra[i] = -rc0[i] + ab - a[i];
+    rb[i] =  rc1[i] - ab;
+  }
+}
+
+float **rd_turing::reaction_constants( unsigned int c )
+{
+  return c ? beta : alpha;
+}
@@ -0,0 +1,130 @@
+//-----------------------------------------------------------------------------
+// File: CpuRayCaster.h
+// Desc: multi-threaded CPU ray casting of tetrahedral meshes
+//-----------------------------------------------------------------------------
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//-----------------------------------------------------------------------------
+
+#ifndef CPURAYCASTER_H
+#define CPURAYCASTER_H
+
+#include <vector>
+#include "Tetra.h"
+#include "lut.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#  define CPURC_SSE
+#endif
+
+// default size (in pixels) of the square image tiles handed to each thread
+#define CPURC_TILE_SIZE 16
+
+// rays are terminated once their accumulated opacity reaches this value,
+// the same threshold used by the RayCasting_PS shader
+#define CPURC_OPACITY_THRESHOLD 0.95f
+
+//-----------------------------------------------------------------------------
+// Name: CpuRayCaster
+// Desc: renders an IndexedTetraSet with the same pre-integrated traversal
+//       as RayCasting.fx, but on the CPU. Rays enter the mesh through the
+//       boundary faces (found with a BVH) and walk from tetrahedron to
+//       tetrahedron through the face adjacency. Leaving the mesh through a
+//       boundary face restarts the search for the next entry point, which
+//       plays the role of the depth peeling levels of the GPU version.
+//-----------------------------------------------------------------------------
+class CpuRayCaster {
+
+protected:
+
+  //boundary face used to find entry points
+  struct BoundaryFace {
+    float v0[3], e1[3], e2[3];   //first vertex and the two edges
+    int   nTetra, nFace;         //owner tetrahedron and face index
+  };
+
+  //bounding volume hierarchy node over the boundary faces
+  struct BVHNode {
+    float min[3], max[3];
+    int   nFirst;                //first child (inner) or first face (leaf)
+    int   nCount;                //0 for inner nodes, face count for leaves
+  };
+
+  //number of tetrahedra
+  int m_nTetra;
+
+  //face planes, 16 floats (one cache line) per tetrahedron, copied from
+  //IndexedTetraSet::_plane_ARR: a[4], b[4], c[4], d[4], outward normals
+  float *m_pfPlanes;
+
+  //scalar field plane per tetrahedron: s(x) = g.x + w, stored as gx,gy,gz,w
+  float *m_pfGradient;
+
+  //tetrahedron adjacent to each face (-1 on the boundary)
+  int *m_pnNeighbor;
+
+  //boundary faces and their hierarchy
+  std::vector<BoundaryFace> m_aBoundary;
+  std::vector<BVHNode>      m_aNodes;
+
+  //pre-integrated transfer function as float rgba, indexed like LUT3D::get
+  float *m_pfLut;
+  float  m_fLutLengthScale;      //converts a segment length into a slice
+
+  //control traversal
+  int m_nMaxDepth;               //maximum number of mesh entries (0 = all)
+  int m_nTileSize;
+
+  //statistics of the last frame
+  double m_dFrameTime;
+  long long m_nSteps;
+
+  int  BuildBVH(int nFirst, int nCount, std::vector<int> &aOrder,
+                const std::vector<float> &aCentroids);
+  int  FindEntry(const float *eye, const float *dir, float tMin, float &t) const;
+  bool ExitFace(int t, const float *eye, const float *dir, int &f, float &lambda) const;
+  void SampleLut(float sFront, float sBack, float length, float *c) const;
+  int  CastRay(const float *eye, const float *dir, float *color) const;
+
+public:
+
+  //class constructor
+  CpuRayCaster();
+
+  //class destructor
+  ~CpuRayCaster();
+
+  //build the traversal structures. The mesh must have its faces and plane
+  //equations computed (or be read from a cache); lut is the 3D pre-integrated transfer function and
+  //maxEdgeLength the value it was computed with
+  bool Init(IndexedTetraSet *its, LUT3D *lut, double maxEdgeLength);
+
+  //render a width x height rgba image (premultiplied, front to back) seen
+  //from eye, looking at the origin, with the projection of HRCApp
+  void Render(vec3 eye, vec3 up, int width, int height, float *rgba);
+
+  void SetMaxDepth(int nDepth) { m_nMaxDepth = nDepth; }
+  void SetTileSize(int nSize)  { m_nTileSize = nSize > 0 ? nSize : CPURC_TILE_SIZE; }
+
+  //seconds spent in the last Render call
+  double GetFrameTime() const { return m_dFrameTime; }
+
+  //number of tetrahedra traversed in the last Render call
+  long long GetSteps() const { return m_nSteps; }
+};
+
+//return a wall clock time in seconds
+double CpuRayCasterTime();
+
+#endif
@@ -23,6 +23,8 @@
 
 #ifdef WIN32
 #  include <windows.h>
+#else
+typedef float FLOAT;
 #endif
 
 #include <vector>
@@ -134,8 +136,23 @@ public:
 
   double		_maxDistance;
 
-  int  _getF(unsigned a, unsigned b, unsigned c, unsigned d,
-	     map< unsigned, vector<int>, less<int> > &vertices_useset_MAP);
+  // flat per tetrahedron arrays, built by computeFaces() and
+  // computeFacesPlaneEquations() or mapped from a cache file:
+  //  _adj_ARR[4*t+i]  = 4*tAdj + fAdj, the half face glued to face i of t,
+  //                     or -1 on the boundary
+  //  _plane_ARR[16*t] = a[4], b[4], c[4], d[4] of the four face planes
+  //                     (ax+by+cz+d = 0, normals pointing out of t)
+  // both are 64-byte aligned, so the planes of a tetrahedron are one
+  // cache line
+  int               *_adj_ARR;
+  float             *_plane_ARR;
+
+  // file mapping the arrays above point into (NULL if they were allocated)
+  void              *_cache_PTR;
+  size_t            _cacheSize;
+  void              *_cacheHandle[2];
+
+  void freeArrays();
 
   inline double getMaxDistance() {return _maxDistance; }
   inline double  getMinX() { return _minX; }
@@ -146,9 +163,11 @@ public:
   inline int nMeshCells() { return _nMeshCells; }
   inline int nBoundaryFaces() { return _nBoundaryFaces; }
 
-  IndexedTetraSet() {}
+  IndexedTetraSet() : _adj_ARR(NULL), _plane_ARR(NULL), _cache_PTR(NULL), _cacheSize(0)
+    { _cacheHandle[0] = _cacheHandle[1] = NULL; }
   ~IndexedTetraSet() 
     {
+      freeArrays();
       _vertices_VEC.erase(_vertices_VEC.begin(), _vertices_VEC.end());
       _scalar_VEC.erase(_scalar_VEC.begin(), _scalar_VEC.end());
       _tetra_VEC.erase(_tetra_VEC.begin(), _tetra_VEC.end());
@@ -174,6 +193,14 @@ public:
   bool computeFaces();
   bool computeFacesPlaneEquations();
 
+  // binary cache of a mesh read with readFromFile() and processed with
+  // computeFaces() and computeFacesPlaneEquations(). readCache() fails if
+  // the cache is missing or older than the mesh files; on success the
+  // flat arrays point into the mapped file and _face_VEC and
+  // _tetra_face_VEC are left empty (_boundary_fac_VEC is restored)
+  bool readCache(char *cachename, char *filename, MeshFormat mformat);
+  bool saveCache(char *cachename, char *filename, MeshFormat mformat);
+
   bool getBoundaryFaces(vector<TetraFace>& bfaces_VEC);
   bool getBoundaryFacesWithVertices(vector<TetraFace>& bfaces_VEC, 
 				    vector<vec3>& vert_VEC);
@@ -184,13 +211,15 @@ public:
   vec3 getTetraVertex(int t, int vInd);
   vec3 getTetraFaceNormal(int t, int fInd);
   void getTetraAdjToTetraFace (int t, int fInd, int &tAdj, int &fAdjInd);
+  inline int getTetraAdj(int t, int fInd) { return _adj_ARR[4*t+fInd]; }
+  inline const float *getTetraPlanes(int t) { return _plane_ARR + 16*t; }
   double getTetraScalarValue(int t);
   void computeIntersection(int t, vec3& eye, vec3& ray, float &lambda);
   int computeFirstIntersection(vec3& eye, vec3& ray, float &lambda);
   int computeFirstIntersection(int t, vec3& eye, vec3& ray, 
 							float &lambdaNear, float &lambdaFar);
 
-  Vertex* IndexedTetraSet::createVertexBuffer(int meshTextureSize) ;
+  Vertex* createVertexBuffer(int meshTextureSize) ;
 
   float squareDistance(vec3 begin, vec3 end);
 
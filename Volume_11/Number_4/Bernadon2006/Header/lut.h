@@ -49,7 +49,7 @@ public:
   void ComputeFixedLUT3D();
 	void ComputeLUT3D(vec4 *tf, double maxEdgeLength);
 
-	void set(int i, int j, int k, vec4& c) {
+	void set(int i, int j, int k, const vec4& c) {
 
 		_lutTF3D[i*sizeTF*sizeTF+j*sizeTF+k] = c; 
 	}
@@ -0,0 +1,556 @@
+//-----------------------------------------------------------------------------
+// File: CpuRayCaster.cpp
+// Desc: multi-threaded CPU ray casting of tetrahedral meshes
+//-----------------------------------------------------------------------------
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//-----------------------------------------------------------------------------
+
+#include "../Header/defines.h"
+#include "../Header/CpuRayCaster.h"
+#include <algorithm>
+#include <float.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef CPURC_SSE
+#  include <xmmintrin.h>
+#endif
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+using namespace std;
+
+//-----------------------------------------------------------------------------
+// aligned allocation of the per tetrahedron arrays
+//-----------------------------------------------------------------------------
+static float* AllocAligned(size_t nFloats) {
+#ifdef CPURC_SSE
+  return (float*)_mm_malloc(nFloats * sizeof(float), 64);
+#else
+  return (float*)malloc(nFloats * sizeof(float));
+#endif
+}
+
+static void FreeAligned(float *p) {
+#ifdef CPURC_SSE
+  if (p) _mm_free(p);
+#else
+  if (p) free(p);
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: CpuRayCasterTime()
+// Desc: wall clock time in seconds (clock() would add up all the threads)
+//-----------------------------------------------------------------------------
+double CpuRayCasterTime() {
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: CpuRayCaster()
+// Desc: class constructor
+//-----------------------------------------------------------------------------
+CpuRayCaster::CpuRayCaster() {
+
+  m_nTetra = 0;
+  m_pfPlanes = NULL;
+  m_pfGradient = NULL;
+  m_pnNeighbor = NULL;
+  m_pfLut = NULL;
+  m_fLutLengthScale = 0.0f;
+  m_nMaxDepth = 0;
+  m_nTileSize = CPURC_TILE_SIZE;
+  m_dFrameTime = 0.0;
+  m_nSteps = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: ~CpuRayCaster()
+// Desc: class destructor
+//-----------------------------------------------------------------------------
+CpuRayCaster::~CpuRayCaster() {
+
+  FreeAligned(m_pfPlanes);
+  FreeAligned(m_pfGradient);
+  FreeAligned(m_pfLut);
+  SafeDeleteArray(m_pnNeighbor);
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: Init()
+// Desc: copy the mesh into the flat arrays used during traversal
+//-----------------------------------------------------------------------------
+bool CpuRayCaster::Init(IndexedTetraSet *its, LUT3D *lut, double maxEdgeLength) {
+
+  if (its == NULL || lut == NULL || its->_plane_ARR == NULL || its->_adj_ARR == NULL)
+    return false;
+
+  FreeAligned(m_pfPlanes);
+  FreeAligned(m_pfGradient);
+  FreeAligned(m_pfLut);
+  SafeDeleteArray(m_pnNeighbor);
+
+  m_nTetra = its->nTetra();
+  m_pfPlanes = AllocAligned(16 * (size_t)m_nTetra);
+  m_pfGradient = AllocAligned(4 * (size_t)m_nTetra);
+  m_pnNeighbor = new int[4 * m_nTetra];
+  if (m_pfPlanes == NULL || m_pfGradient == NULL) return false;
+
+  // planes and adjacency come straight from the flat mesh arrays
+  memcpy(m_pfPlanes, its->getTetraPlanes(0), 16 * (size_t)m_nTetra * sizeof(float));
+
+  #pragma omp parallel for schedule(static)
+  for (int t = 0; t < m_nTetra; t++) {
+
+    for (int i = 0; i < 4; i++) {
+      int h = its->getTetraAdj(t, i);
+      m_pnNeighbor[4 * t + i] = (h < 0) ? -1 : (h >> 2);
+    }
+
+    // linear scalar field inside the tetrahedron, as in readFromFile
+    vec3 v0 = its->getTetraVertex(t, 0), v1 = its->getTetraVertex(t, 1);
+    vec3 v2 = its->getTetraVertex(t, 2), v3 = its->getTetraVertex(t, 3);
+    const int *tv = &its->_tetra_VEC[4 * t];
+    mat4 mat(vec4(v0, 1), vec4(v1, 1), vec4(v2, 1), vec4(v3, 1));
+    vec4 scalar(its->_scalar_VEC[tv[0]], its->_scalar_VEC[tv[1]],
+                its->_scalar_VEC[tv[2]], its->_scalar_VEC[tv[3]]);
+    vec4 grad = mat.inverse() * scalar;
+    for (int i = 0; i < 4; i++)
+      m_pfGradient[4 * t + i] = (float)grad[i];
+  }
+
+  // boundary faces, oriented as seen from the owner tetrahedron
+  m_aBoundary.clear();
+  m_aNodes.clear();
+  for (int t = 0; t < m_nTetra; t++) {
+    for (int i = 0; i < 4; i++) {
+
+      if (m_pnNeighbor[4 * t + i] >= 0) continue;
+
+      const int *tv = &its->_tetra_VEC[4 * t];
+      int fv[3], k = 0;
+      for (int j = 0; j < 4; j++)
+        if (j != i) fv[k++] = tv[j];
+
+      BoundaryFace face;
+      vec3 &a = its->_vertices_VEC[fv[0]];
+      vec3 &b = its->_vertices_VEC[fv[1]];
+      vec3 &c = its->_vertices_VEC[fv[2]];
+      for (int j = 0; j < 3; j++) {
+        face.v0[j] = (float)a[j];
+        face.e1[j] = (float)(b[j] - a[j]);
+        face.e2[j] = (float)(c[j] - a[j]);
+      }
+      face.nTetra = t;
+      face.nFace = i;
+      m_aBoundary.push_back(face);
+    }
+  }
+
+  if (!m_aBoundary.empty()) {
+    vector<int> aOrder(m_aBoundary.size());
+    for (int i = 0; i < (int)aOrder.size(); i++) aOrder[i] = i;
+    vector<float> aCentroids(3 * m_aBoundary.size());
+    for (int i = 0; i < (int)m_aBoundary.size(); i++)
+      for (int j = 0; j < 3; j++) {
+        const BoundaryFace &f = m_aBoundary[i];
+        aCentroids[3 * i + j] = f.v0[j] + (f.e1[j] + f.e2[j]) / 3.0f;
+      }
+    m_aNodes.reserve(2 * m_aBoundary.size());
+    BuildBVH(0, (int)aOrder.size(), aOrder, aCentroids);
+
+    vector<BoundaryFace> aSorted(m_aBoundary.size());
+    for (int i = 0; i < (int)aOrder.size(); i++) aSorted[i] = m_aBoundary[aOrder[i]];
+    m_aBoundary.swap(aSorted);
+  }
+
+  // transfer function
+  int n = sizeTF;
+  m_pfLut = AllocAligned(4 * (size_t)n * n * n);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      for (int k = 0; k < n; k++) {
+        vec4 c = lut->get(i, j, k);
+        float *p = m_pfLut + 4 * ((i * n + j) * n + k);
+        p[0] = (float)c[0]; p[1] = (float)c[1]; p[2] = (float)c[2]; p[3] = (float)c[3];
+      }
+
+  // ComputeLUT3D stores segments of length k*maxEdgeLength/(sizeTF-1) in slice k
+  m_fLutLengthScale = maxEdgeLength > 0.0 ? (float)((n - 1) / maxEdgeLength) : 0.0f;
+
+  return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: BuildBVH()
+// Desc: median split hierarchy over m_aBoundary[aOrder[nFirst..]]
+//-----------------------------------------------------------------------------
+struct CentroidLess {
+  const vector<float> *centroids;
+  int axis;
+  bool operator()(int a, int b) const {
+    return (*centroids)[3 * a + axis] < (*centroids)[3 * b + axis];
+  }
+};
+
+int CpuRayCaster::BuildBVH(int nFirst, int nCount, vector<int> &aOrder,
+                           const vector<float> &aCentroids) {
+
+  int nNode = (int)m_aNodes.size();
+  m_aNodes.push_back(BVHNode());
+
+  float cmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+  float cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  BVHNode node;
+  for (int j = 0; j < 3; j++) { node.min[j] = FLT_MAX; node.max[j] = -FLT_MAX; }
+
+  for (int i = nFirst; i < nFirst + nCount; i++) {
+    const BoundaryFace &f = m_aBoundary[aOrder[i]];
+    for (int j = 0; j < 3; j++) {
+      float a = f.v0[j], b = a + f.e1[j], c = a + f.e2[j];
+      node.min[j] = MIN(node.min[j], MIN(a, MIN(b, c)));
+      node.max[j] = MAX(node.max[j], MAX(a, MAX(b, c)));
+      cmin[j] = MIN(cmin[j], aCentroids[3 * aOrder[i] + j]);
+      cmax[j] = MAX(cmax[j], aCentroids[3 * aOrder[i] + j]);
+    }
+  }
+
+  if (nCount <= 4) {
+    node.nFirst = nFirst;
+    node.nCount = nCount;
+    m_aNodes[nNode] = node;
+    return nNode;
+  }
+
+  CentroidLess less;
+  less.centroids = &aCentroids;
+  less.axis = 0;
+  for (int j = 1; j < 3; j++)
+    if (cmax[j] - cmin[j] > cmax[less.axis] - cmin[less.axis]) less.axis = j;
+
+  int nHalf = nCount / 2;
+  nth_element(aOrder.begin() + nFirst, aOrder.begin() + nFirst + nHalf,
+              aOrder.begin() + nFirst + nCount, less);
+
+  BuildBVH(nFirst, nHalf, aOrder, aCentroids);   // always nNode + 1
+  node.nFirst = BuildBVH(nFirst + nHalf, nCount - nHalf, aOrder, aCentroids);
+  node.nCount = 0;
+  m_aNodes[nNode] = node;
+  return nNode;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: FindEntry()
+// Desc: nearest boundary face beyond tMin through which the ray enters the
+//       mesh. Returns its index in m_aBoundary, or -1
+//-----------------------------------------------------------------------------
+int CpuRayCaster::FindEntry(const float *eye, const float *dir, float tMin,
+                            float &tHit) const {
+
+  if (m_aNodes.empty()) return -1;
+
+  float inv[3];
+  for (int j = 0; j < 3; j++) inv[j] = 1.0f / dir[j];
+
+  int nBest = -1;
+  tHit = FLT_MAX;
+
+  int stack[64], nStack = 0;
+  stack[nStack++] = 0;
+
+  while (nStack > 0) {
+
+    const BVHNode &node = m_aNodes[stack[--nStack]];
+
+    // slab test
+    float t0 = tMin, t1 = tHit;
+    for (int j = 0; j < 3; j++) {
+      float a = (node.min[j] - eye[j]) * inv[j];
+      float b = (node.max[j] - eye[j]) * inv[j];
+      if (a > b) { float s = a; a = b; b = s; }
+      t0 = MAX(t0, a);
+      t1 = MIN(t1, b);
+    }
+    if (t0 > t1) continue;
+
+    if (node.nCount == 0) {
+      int nNode = (int)(&node - &m_aNodes[0]);
+      stack[nStack++] = node.nFirst;
+      stack[nStack++] = nNode + 1;
+      continue;
+    }
+
+    for (int i = node.nFirst; i < node.nFirst + node.nCount; i++) {
+
+      const BoundaryFace &f = m_aBoundary[i];
+
+      // only faces whose outward normal faces the ray are entries
+      const float *plane = m_pfPlanes + 16 * f.nTetra;
+      float den = dir[0] * plane[f.nFace] + dir[1] * plane[4 + f.nFace] +
+                  dir[2] * plane[8 + f.nFace];
+      if (den >= 0.0f) continue;
+
+      // ray triangle intersection (Moller & Trumbore)
+      float p[3], q[3], s[3];
+      p[0] = dir[1] * f.e2[2] - dir[2] * f.e2[1];
+      p[1] = dir[2] * f.e2[0] - dir[0] * f.e2[2];
+      p[2] = dir[0] * f.e2[1] - dir[1] * f.e2[0];
+      float det = f.e1[0] * p[0] + f.e1[1] * p[1] + f.e1[2] * p[2];
+      if (det > -1e-12f && det < 1e-12f) continue;
+      float invDet = 1.0f / det;
+      for (int j = 0; j < 3; j++) s[j] = eye[j] - f.v0[j];
+      float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+      if (u < 0.0f || u > 1.0f) continue;
+      q[0] = s[1] * f.e1[2] - s[2] * f.e1[1];
+      q[1] = s[2] * f.e1[0] - s[0] * f.e1[2];
+      q[2] = s[0] * f.e1[1] - s[1] * f.e1[0];
+      float v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * invDet;
+      if (v < 0.0f || u + v > 1.0f) continue;
+      float t = (f.e2[0] * q[0] + f.e2[1] * q[1] + f.e2[2] * q[2]) * invDet;
+      if (t > tMin && t < tHit) {
+        tHit = t;
+        nBest = i;
+      }
+    }
+  }
+
+  return nBest;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: ExitFace()
+// Desc: the face through which the ray leaves tetrahedron t: the smallest
+//       num/den over the faces with den > 0 (see computeIntersection).
+//       All four planes are tested at once with SSE
+//-----------------------------------------------------------------------------
+bool CpuRayCaster::ExitFace(int t, const float *eye, const float *dir,
+                            int &f, float &lambda) const {
+
+  const float *plane = m_pfPlanes + 16 * t;
+
+#ifdef CPURC_SSE
+  __m128 nx = _mm_load_ps(plane);
+  __m128 ny = _mm_load_ps(plane + 4);
+  __m128 nz = _mm_load_ps(plane + 8);
+  __m128 d  = _mm_load_ps(plane + 12);
+
+  __m128 den = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(dir[0])),
+                                     _mm_mul_ps(ny, _mm_set1_ps(dir[1]))),
+                          _mm_mul_ps(nz, _mm_set1_ps(dir[2])));
+  __m128 num = _mm_sub_ps(_mm_setzero_ps(),
+                          _mm_add_ps(d, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(eye[0])),
+                                                              _mm_mul_ps(ny, _mm_set1_ps(eye[1]))),
+                                                   _mm_mul_ps(nz, _mm_set1_ps(eye[2])))));
+  __m128 exits = _mm_cmpgt_ps(den, _mm_setzero_ps());
+  __m128 lam = _mm_div_ps(num, den);
+  lam = _mm_or_ps(_mm_and_ps(exits, lam), _mm_andnot_ps(exits, _mm_set1_ps(FLT_MAX)));
+
+  // horizontal minimum and its lane
+  __m128 m = _mm_min_ps(lam, _mm_shuffle_ps(lam, lam, _MM_SHUFFLE(2, 3, 0, 1)));
+  m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+  int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpeq_ps(lam, m), exits));
+  if (mask == 0) return false;
+  f = (mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3;
+  _mm_store_ss(&lambda, m);
+  return true;
+#else
+  f = -1;
+  lambda = FLT_MAX;
+  for (int i = 0; i < 4; i++) {
+    float den = plane[i] * dir[0] + plane[4 + i] * dir[1] + plane[8 + i] * dir[2];
+    if (den <= 0.0f) continue;
+    float num = -(plane[12 + i] + plane[i] * eye[0] + plane[4 + i] * eye[1] + plane[8 + i] * eye[2]);
+    if (num / den < lambda) {
+      lambda = num / den;
+      f = i;
+    }
+  }
+  return f >= 0;
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: SampleLut()
+// Desc: trilinear lookup of the pre-integrated transfer function, indexed
+//       as the lutSampler in RayCasting_PS: (front scalar, back scalar,
+//       segment length)
+//-----------------------------------------------------------------------------
+void CpuRayCaster::SampleLut(float sFront, float sBack, float length, float *c) const {
+
+  const int n = sizeTF;
+  float x[3];
+  int i0[3], i1[3];
+  float w[3];
+
+  // texel centers for the scalars, slices for the length
+  x[0] = sFront * n - 0.5f;
+  x[1] = sBack * n - 0.5f;
+  x[2] = length * m_fLutLengthScale;
+  for (int j = 0; j < 3; j++) {
+    if (x[j] < 0.0f) x[j] = 0.0f;
+    if (x[j] > n - 1) x[j] = (float)(n - 1);
+    i0[j] = (int)x[j];
+    i1[j] = i0[j] < n - 1 ? i0[j] + 1 : i0[j];
+    w[j] = x[j] - i0[j];
+  }
+
+  c[0] = c[1] = c[2] = c[3] = 0.0f;
+  for (int corner = 0; corner < 8; corner++) {
+    int i = (corner & 1) ? i1[0] : i0[0];
+    int j = (corner & 2) ? i1[1] : i0[1];
+    int k = (corner & 4) ? i1[2] : i0[2];
+    float wt = ((corner & 1) ? w[0] : 1.0f - w[0]) *
+               ((corner & 2) ? w[1] : 1.0f - w[1]) *
+               ((corner & 4) ? w[2] : 1.0f - w[2]);
+    const float *p = m_pfLut + 4 * ((i * n + j) * n + k);
+    c[0] += wt * p[0]; c[1] += wt * p[1]; c[2] += wt * p[2]; c[3] += wt * p[3];
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: CastRay()
+// Desc: front to back integration along one ray. Returns the number of
+//       tetrahedra traversed
+//-----------------------------------------------------------------------------
+int CpuRayCaster::CastRay(const float *eye, const float *dir, float *color) const {
+
+  int nSteps = 0, nDepth = 0;
+  float tMin = 0.0f;
+
+  color[0] = color[1] = color[2] = color[3] = 0.0f;
+
+  while (color[3] < CPURC_OPACITY_THRESHOLD &&
+         (m_nMaxDepth <= 0 || nDepth < m_nMaxDepth)) {
+
+    float lFront;
+    int nEntry = FindEntry(eye, dir, tMin, lFront);
+    if (nEntry < 0) break;
+    nDepth++;
+
+    int t = m_aBoundary[nEntry].nTetra;
+    const float *g = m_pfGradient + 4 * t;
+    float sFront = g[0] * (eye[0] + lFront * dir[0]) + g[1] * (eye[1] + lFront * dir[1]) +
+                   g[2] * (eye[2] + lFront * dir[2]) + g[3];
+
+    // walk through the mesh until it is left or the ray is opaque; the
+    // step limit only guards against cycles in degenerate meshes
+    for (int nWalk = 0; t >= 0 && nWalk < m_nTetra; nWalk++) {
+
+      int f;
+      float lBack;
+      if (!ExitFace(t, eye, dir, f, lBack)) break;
+      if (lBack < lFront) lBack = lFront;
+
+      g = m_pfGradient + 4 * t;
+      float sBack = g[0] * (eye[0] + lBack * dir[0]) + g[1] * (eye[1] + lBack * dir[1]) +
+                    g[2] * (eye[2] + lBack * dir[2]) + g[3];
+
+      float c[4];
+      SampleLut(sFront, sBack, lBack - lFront, c);
+      float k = 1.0f - color[3];
+      color[0] += c[0] * k; color[1] += c[1] * k;
+      color[2] += c[2] * k; color[3] += c[3] * k;
+      nSteps++;
+
+      sFront = sBack;
+      lFront = lBack;
+      t = m_pnNeighbor[4 * t + f];
+      if (color[3] >= CPURC_OPACITY_THRESHOLD) break;
+    }
+
+    tMin = lFront;
+  }
+
+  return nSteps;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: Render()
+// Desc: ray cast the image, distributing tiles across the threads
+//-----------------------------------------------------------------------------
+void CpuRayCaster::Render(vec3 eye, vec3 up, int width, int height, float *rgba) {
+
+  double dStart = CpuRayCasterTime();
+
+  // left handed look-at basis and projection, as in
+  // HRCApp::SetupViewProjectionMatrices (D3DXMatrixLookAtLH and
+  // D3DXMatrixPerspectiveLH with a near plane of 1)
+  vec3 zaxis = vec3(0.0, 0.0, 0.0) - eye;
+  zaxis.normalize();
+  vec3 xaxis = up ^ zaxis;
+  xaxis.normalize();
+  vec3 yaxis = zaxis ^ xaxis;
+
+  float fSmallest = (float)MIN(width, height);
+  float fViewW = width / fSmallest, fViewH = height / fSmallest;
+
+  float e[3], X[3], Y[3], Z[3];
+  for (int j = 0; j < 3; j++) {
+    e[j] = (float)eye[j];
+    X[j] = (float)xaxis[j];
+    Y[j] = (float)yaxis[j];
+    Z[j] = (float)zaxis[j];
+  }
+
+  int nTileSize = m_nTileSize;
+  int nTilesX = (width + nTileSize - 1) / nTileSize;
+  int nTilesY = (height + nTileSize - 1) / nTileSize;
+  int nTiles = nTilesX * nTilesY;
+  long long nSteps = 0;
+
+  // tiles are handed out dynamically, since their cost varies with the
+  // amount of mesh they cover
+  #pragma omp parallel for schedule(dynamic, 1) reduction(+:nSteps)
+  for (int nTile = 0; nTile < nTiles; nTile++) {
+
+    int x0 = (nTile % nTilesX) * nTileSize;
+    int y0 = (nTile / nTilesX) * nTileSize;
+    int x1 = MIN(x0 + nTileSize, width);
+    int y1 = MIN(y0 + nTileSize, height);
+
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+
+        float u = ((x + 0.5f) / width - 0.5f) * fViewW;
+        float v = (0.5f - (y + 0.5f) / height) * fViewH;
+        float dir[3];
+        for (int j = 0; j < 3; j++) dir[j] = u * X[j] + v * Y[j] + Z[j];
+        float len = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        for (int j = 0; j < 3; j++) dir[j] /= len;
+
+        nSteps += CastRay(e, dir, rgba + 4 * ((size_t)y * width + x));
+      }
+    }
+  }
+
+  m_nSteps = nSteps;
+  m_dFrameTime = CpuRayCasterTime() - dStart;
+}
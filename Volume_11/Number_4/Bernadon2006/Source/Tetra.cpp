@@ -22,8 +22,19 @@
 #include "../Header/Tetra.h"
 #include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
+#ifdef WIN32
 #include <D3DX9.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 using namespace std;
 
@@ -40,10 +51,8 @@ vec3 IndexedTetraSet::getTetraVertex(int t, int vInd) {
 //-----------------------------------------------------------------------------
 vec3 IndexedTetraSet::getTetraFaceNormal(int t, int fInd) {
 	// returns the normal of the face fInd of tetrahedron t 
-	if(_face_VEC[_tetra_face_VEC[4*t+fInd]]._t[0] == t)
-		return (_face_VEC[_tetra_face_VEC[4*t+fInd]].getNormal());
-	//else - invert the normal
-	return -(_face_VEC[_tetra_face_VEC[4*t+fInd]].getNormal());
+	const float *plane = _plane_ARR + 16*t;
+	return vec3(plane[fInd], plane[4+fInd], plane[8+fInd]);
 }
 
 //-----------------------------------------------------------------------------
@@ -53,7 +62,9 @@ void IndexedTetraSet::getTetraAdjToTetraFace (int t, int fInd, int &tAdj, int &f
 	// returns the index of the tetrahedron adjacent to a given
 	// face fInd of a tetrahedron t. If it is a boundary face
 	// return -1
-	_face_VEC[_tetra_face_VEC[4*t+fInd]].getAdjTetra(t, tAdj, fAdjInd);
+	int h = _adj_ARR[4*t+fInd];
+	tAdj = (h < 0) ? -1 : (h >> 2);
+	fAdjInd = (h < 0) ? -1 : (h & 3);
 }
 
 //-----------------------------------------------------------------------------
@@ -526,89 +537,223 @@ bool IndexedTetraSet::readFromFile(char *filename, MeshFormat mformat)
 
 //----------------------------------------------------------------------------
 //
-// int IndexedTetraSet::_getF()
+// face matching helpers
 //
 //----------------------------------------------------------------------------
 
-int IndexedTetraSet::_getF(unsigned a, unsigned b, unsigned c, unsigned d,
-			   map<unsigned, vector<int>, less<int> > &vertices_useset_MAP)
+// vertices of face i of a tetrahedron (a,b,c,d), in the order used by
+// TetraFace: the three face vertices followed by the opposite one
+static const int faceVertex[4][4] = {
+  {1, 2, 3, 0}, {0, 2, 3, 1}, {0, 1, 3, 2}, {0, 1, 2, 3}
+};
+
+static inline void sortedFace(const int *tv, int fInd, unsigned *k)
 {
-  map< unsigned, vector<int>, less<int> >::iterator vi;
-  vi = vertices_useset_MAP.find(a);
-  if(vi != vertices_useset_MAP.end())
-  {
-      unsigned i;
-      vector<int> & t_VEC = vertices_useset_MAP[a];
-      for(i = 0; i < t_VEC.size(); i++)
-	{
-	  int t = t_VEC[i];
-
-	  int tp[3];
-	  tp[0] = _face_VEC[t]._v[0];
-	  tp[1] = _face_VEC[t]._v[1];
-	  tp[2] = _face_VEC[t]._v[2];
-
-	  if (tp[0]==a &&
-	      (tp[1]==b && tp[2]==c ||
-	       tp[1]==c && tp[2]==b)
-	      ||
-	      tp[0]==b &&
-	      (tp[1]==a && tp[2]==c || 
-	       tp[1]==c && tp[2]==a)
-	      ||
-	      tp[0]==c &&
-	      (tp[1]==a && tp[2]==b || 
-	       tp[1]==b && tp[2]==a))
-	    return t;
-	}
-  }//end if vi
+  unsigned a = tv[faceVertex[fInd][0]];
+  unsigned b = tv[faceVertex[fInd][1]];
+  unsigned c = tv[faceVertex[fInd][2]];
+  unsigned s;
+  if (a > b) { s = a; a = b; b = s; }
+  if (b > c) { s = b; b = c; c = s; }
+  if (a > b) { s = a; a = b; b = s; }
+  k[0] = a; k[1] = b; k[2] = c;
+}
+
+static inline unsigned hashFace(const unsigned *k)
+{
+  unsigned h = k[0] * 0x9E3779B1u;
+  h ^= k[1] * 0x85EBCA77u + (h << 6) + (h >> 2);
+  h ^= k[2] * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+  return h ^ (h >> 15);
+}
+
+static inline bool compareAndSwap(volatile int *p, int oldVal, int newVal)
+{
+#ifdef WIN32
+  return InterlockedCompareExchange((volatile LONG*)p, newVal, oldVal) == oldVal;
+#else
+  return __sync_bool_compare_and_swap(p, oldVal, newVal);
+#endif
+}
+
+static void *alignedAlloc(size_t size)
+{
+#ifdef WIN32
+  return _aligned_malloc(size, 64);
+#else
+  void *p = NULL;
+  if (posix_memalign(&p, 64, size) != 0) return NULL;
+  return p;
+#endif
+}
+
+static void alignedFree(void *p)
+{
+#ifdef WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+// read only mapping of a whole file; handle[] keeps what WIN32 needs
+static void *mapCacheFile(const char *filename, size_t &size, void **handle)
+{
+#ifdef WIN32
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+			    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+  LARGE_INTEGER fsize;
+  if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0) {
+    CloseHandle(file);
+    return NULL;
+  }
+  HANDLE map = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  void *p = map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (p == NULL) {
+    if (map) CloseHandle(map);
+    CloseHandle(file);
+    return NULL;
+  }
+  size = (size_t)fsize.QuadPart;
+  handle[0] = file;
+  handle[1] = map;
+  return p;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return NULL;
+  size = (size_t)st.st_size;
+  handle[0] = handle[1] = NULL;
+  return p;
+#endif
+}
 
-  int tn = _face_VEC.size();
-  _face_VEC.push_back(TetraFace(a, b, c, d));
-  vertices_useset_MAP[ a ].push_back(tn);
-  vertices_useset_MAP[ b ].push_back(tn);
-  vertices_useset_MAP[ c ].push_back(tn);
-  return tn;
+static void unmapCacheFile(void *p, size_t size, void **handle)
+{
+#ifdef WIN32
+  UnmapViewOfFile(p);
+  if (handle[1]) CloseHandle((HANDLE)handle[1]);
+  if (handle[0]) CloseHandle((HANDLE)handle[0]);
+#else
+  munmap(p, size);
+#endif
+  handle[0] = handle[1] = NULL;
 }
 
 //----------------------------------------------------------------------------
 //
 // bool IndexedTetraSet::computeFaces()
 //
+// Matches the half faces of all tetrahedra in parallel through an open
+// addressing hash table keyed on the sorted face vertices. The first half
+// face to reach a slot owns it, the second one is glued to it. Faces are
+// then numbered in the order of their first half face, so _face_VEC is
+// the same as the one built by inserting the tetrahedra one at a time.
+//
 //----------------------------------------------------------------------------
 
 bool IndexedTetraSet::computeFaces()
 {
-  map< unsigned, vector<int>, less<int> > vertices_useset_MAP;
+  int nHalf = 4*_nT;
+  int i;
+
+  if (_cache_PTR != NULL) freeArrays();
+  if (_adj_ARR == NULL) _adj_ARR = (int*)alignedAlloc(nHalf*sizeof(int));
+  if (_adj_ARR == NULL) return false;
+
+  unsigned nSlots = 1;
+  while (nSlots < (unsigned)nHalf) nSlots <<= 1;
+  unsigned mask = nSlots - 1;
+  vector<int> table(nSlots, -1);
+  volatile int *slot_ARR = &table[0];
+  int *adj = _adj_ARR;
+  int nNonManifold = 0;
 
-  vector<int> tmp((size_t) _tetra_VEC.size(), -1);
+  #pragma omp parallel for schedule(static)
+  for (i=0; i<nHalf; i++) adj[i] = -1;
 
+  #pragma omp parallel for schedule(dynamic, 4096) reduction(+:nNonManifold)
+  for (i=0; i<nHalf; i++)
+    {
+      unsigned k[3];
+      sortedFace(&_tetra_VEC[i & ~3], i & 3, k);
+      unsigned s = hashFace(k) & mask;
+
+      for (;;)
+	{
+	  int g = slot_ARR[s];
+	  if (g == -1)
+	    {
+	      if (compareAndSwap(&slot_ARR[s], -1, i)) break;
+	      g = slot_ARR[s];
+	    }
+
+	  unsigned kg[3];
+	  sortedFace(&_tetra_VEC[g & ~3], g & 3, kg);
+	  if (kg[0] == k[0] && kg[1] == k[1] && kg[2] == k[2])
+	    {
+	      // a third tetrahedron on the same face is left unglued
+	      if (compareAndSwap(&adj[g], -1, i)) adj[i] = g;
+	      else nNonManifold++;
+	      break;
+	    }
+	  s = (s + 1) & mask;
+	}
+    }
+
+  if (nNonManifold > 0)
+    cout << "\nWarning: " << nNonManifold << " non manifold faces" << endl;
+
+  // number the faces by their owner (first) half face
+  vector<int> tmp((size_t) nHalf, -1);
   _tetra_face_VEC.swap(tmp);
 
-  int i;
+  vector<int> first_VEC((size_t) _nT + 1, 0);
+  #pragma omp parallel for schedule(static)
   for (i=0; i<_nT; i++)
     {
-		if(i == 827000)
-			int found =1;
-
-      unsigned a,b,c,d; // Four vertices
-      a = _tetra_VEC[4*i+0];      b = _tetra_VEC[4*i+1];
-      c = _tetra_VEC[4*i+2];      d = _tetra_VEC[4*i+3];
-
-      int f = _getF(b, c, d, a, vertices_useset_MAP);      
-      _face_VEC[f].addT(i, 0);
-      _tetra_face_VEC[4*i + 0] = f;
-      f = _getF(a, c, d, b, vertices_useset_MAP);          
-      _face_VEC[f].addT(i, 1);      
-      _tetra_face_VEC[4*i + 1] = f;
-      f = _getF(a, b, d, c, vertices_useset_MAP);          
-      _face_VEC[f].addT(i, 2);
-      _tetra_face_VEC[4*i + 2] = f;
-      f = _getF(a, b, c, d, vertices_useset_MAP);          
-      _face_VEC[f].addT(i, 3);
-      _tetra_face_VEC[4*i + 3] = f;
-      if (i%100 == 0) std::cout << i << " " << flush;
+      int n = 0;
+      for (int j=0; j<4; j++)
+	if (adj[4*i+j] < 0 || adj[4*i+j] > 4*i+j) n++;
+      first_VEC[i+1] = n;
     }
+  for (i=0; i<_nT; i++)
+    first_VEC[i+1] += first_VEC[i];
+
+  int nFaces = first_VEC[_nT];
+  _face_VEC.clear();
+  _face_VEC.resize(nFaces);
+
+  #pragma omp parallel for schedule(static)
+  for (i=0; i<_nT; i++)
+    {
+      const int *tv = &_tetra_VEC[4*i];
+      int f = first_VEC[i];
+      for (int j=0; j<4; j++)
+	{
+	  int h = 4*i+j;
+	  if (adj[h] >= 0 && adj[h] < h) continue;
+
+	  TetraFace &face = _face_VEC[f];
+	  face = TetraFace(tv[faceVertex[j][0]], tv[faceVertex[j][1]],
+			   tv[faceVertex[j][2]], tv[faceVertex[j][3]]);
+	  face.addT(i, j);
+	  if (adj[h] >= 0) face.addT(adj[h] >> 2, adj[h] & 3);
+	  _tetra_face_VEC[h] = f++;
+	}
+    }
+
+  #pragma omp parallel for schedule(static)
+  for (i=0; i<nHalf; i++)
+    if (adj[i] >= 0 && adj[i] < i) _tetra_face_VEC[i] = _tetra_face_VEC[adj[i]];
 
   return true;
 }
@@ -696,8 +841,7 @@ bool IndexedTetraSet::getBoundaryFacesWithVertices(vector<TetraFace>& bfaces_VEC
   int nOutVer = 0;
   _nBoundaryFaces = 0;
   vector<TetraFace>::iterator fi;
-  for(fi = _face_VEC.begin(); fi != _face_VEC.end(); fi++)
-    if(fi->nT()==1)	
+  for(fi = _boundary_fac_VEC.begin(); fi != _boundary_fac_VEC.end(); fi++)
       {
 	_nBoundaryFaces++;
 	for(int i= 0; i < 3; i++)
@@ -713,8 +857,7 @@ bool IndexedTetraSet::getBoundaryFacesWithVertices(vector<TetraFace>& bfaces_VEC
   for(i = 0; i < nOutVer; i++)
     vert_VEC.push_back(_vertices_VEC[outVerInd_VEC[i]]);
 
-  for(fi = _face_VEC.begin(); fi != _face_VEC.end(); fi++)
-    if(fi->nT()==1)	
+  for(fi = _boundary_fac_VEC.begin(); fi != _boundary_fac_VEC.end(); fi++)
       {
 	TetraFace tmp = *fi;
 	
@@ -741,8 +884,7 @@ bool IndexedTetraSet::saveOffBoundaryFaces(char *filename)
   int nOutVer = 0;
   int boundaryFaces = 0;
   vector<TetraFace>::iterator fi;
-  for(fi = _face_VEC.begin(); fi != _face_VEC.end(); fi++)
-    if(fi->nT()==1)	
+  for(fi = _boundary_fac_VEC.begin(); fi != _boundary_fac_VEC.end(); fi++)
       {
 	boundaryFaces++;
 
@@ -768,8 +910,7 @@ bool IndexedTetraSet::saveOffBoundaryFaces(char *filename)
       offFile << v[0] << " " << v[1] << " " << v[2] << endl;
     }
 
-  for(fi = _face_VEC.begin(); fi != _face_VEC.end(); fi++)
-    if(fi->nT()==1)	
+  for(fi = _boundary_fac_VEC.begin(); fi != _boundary_fac_VEC.end(); fi++)
       {
 	offFile << "3 ";
 	for(int i= 0; i < 3; i++)
@@ -857,27 +998,282 @@ bool TetraFace::computeABCD(vector<vec3> &vertices_VEC, vector<int> &tetra_VEC,
 //----------------------------------------------------------------------------
 bool IndexedTetraSet::computeFacesPlaneEquations()
 {
-	_invertNormals=0;
-	int nFaces=0;
-	vector<TetraFace>::iterator fi;
-	_nBoundaryFaces = 0;
-	for(fi = _face_VEC.begin(); fi != _face_VEC.end(); fi++)
+	int nFaces = _face_VEC.size();
+	int invertNormals = 0, nBoundaryFaces = 0;
+	int i;
+
+	#pragma omp parallel for schedule(static) reduction(+:invertNormals,nBoundaryFaces)
+	for(i = 0; i < nFaces; i++)
 	{
-		if(fi->_nt < 2) {
-			fi->computeCentroid(_vertices_VEC);
-			_nBoundaryFaces++;
-		}else{
-			fi->computeCentroid(_vertices_VEC);
-		}
+		TetraFace &face = _face_VEC[i];
+		if(face._nt < 2)
+			nBoundaryFaces++;
 
-		fi->computeABCD(_vertices_VEC, _tetra_VEC, _invertNormals);
-		nFaces++;
+		face.computeCentroid(_vertices_VEC);
+		face.computeABCD(_vertices_VEC, _tetra_VEC, invertNormals);
 	}
+	_invertNormals = invertNormals;
+	_nBoundaryFaces = nBoundaryFaces;
 
 	cout << "\n**** Inverted :"  << _invertNormals << " of " << nFaces << "\n\n" << flush;
 
+	// per tetrahedron copy of the planes, oriented outwards
+	if (_plane_ARR == NULL) _plane_ARR = (float*)alignedAlloc(16*_nT*sizeof(float));
+	if (_plane_ARR == NULL) return false;
+
+	#pragma omp parallel for schedule(static)
+	for(i = 0; i < _nT; i++)
+	{
+		float *plane = _plane_ARR + 16*i;
+		for (int j = 0; j < 4; j++)
+		{
+			TetraFace &face = _face_VEC[_tetra_face_VEC[4*i+j]];
+			float sign = (face._t[0] == i) ? 1.0f : -1.0f;
+			plane[j]    = sign * (float)face._a;
+			plane[4+j]  = sign * (float)face._b;
+			plane[8+j]  = sign * (float)face._c;
+			plane[12+j] = sign * (float)face._d;
+		}
+	}
+
 	// cache the boundary faces to avoid having to determine
 	// them multiple times
 	getBoundaryFaces(_boundary_fac_VEC);
 	return true;
-}
\ No newline at end of file
+}
+
+
+//----------------------------------------------------------------------------
+// void IndexedTetraSet::freeArrays()
+//----------------------------------------------------------------------------
+void IndexedTetraSet::freeArrays()
+{
+	if (_cache_PTR != NULL) {
+		unmapCacheFile(_cache_PTR, _cacheSize, _cacheHandle);
+		_cache_PTR = NULL;
+		_cacheSize = 0;
+	}
+	else {
+		if (_adj_ARR) alignedFree(_adj_ARR);
+		if (_plane_ARR) alignedFree(_plane_ARR);
+	}
+	_adj_ARR = NULL;
+	_plane_ARR = NULL;
+}
+
+
+//----------------------------------------------------------------------------
+//
+// mesh cache
+//
+// The file starts with a TetraCacheHeader followed by the vertices,
+// scalars, tetrahedra, gradients, boundary faces, adjacency and planes,
+// each section starting at a multiple of 64 bytes. The vectors are copied
+// out of the mapping; _adj_ARR and _plane_ARR point straight into it.
+//
+//----------------------------------------------------------------------------
+
+#define TETRA_CACHE_VERSION 1
+
+enum { CACHE_VERTICES, CACHE_SCALARS, CACHE_TETRA, CACHE_GRADIENTS,
+       CACHE_BOUNDARY, CACHE_ADJ, CACHE_PLANES, CACHE_NSECTIONS };
+
+struct TetraCacheHeader
+{
+  char      magic[8];
+  int       version;
+  int       byteOrder;
+  int       sizeofVec3, sizeofFace;
+  long long sourceSize, sourceTime;   // of the mesh files
+  int       nV, nT, nBoundaryFaces, invertNormals;
+  double    minScalar, maxScalar, maxDistance;
+  double    minX, maxX, minY, maxY, minZ, maxZ;
+  long long offset[CACHE_NSECTIONS];
+  long long size[CACHE_NSECTIONS];
+};
+
+// total size and latest modification time of the files read by
+// readFromFile() for this mesh
+static bool getSourceKey(char *filename, MeshFormat mformat,
+			 long long &size, long long &time)
+{
+  const char *suffix[3];
+  int nFiles = 0;
+  if (mformat == OFF)
+    suffix[nFiles++] = ".off";
+  else {
+    suffix[nFiles++] = "-vertex.nrrd";
+    suffix[nFiles++] = "-elem.nrrd";
+    suffix[nFiles++] = "-scalar.nrrd";
+  }
+
+  size = time = 0;
+  for (int i = 0; i < nFiles; i++) {
+    char name[1024];
+    sprintf(name, "%.1000s%s", filename, suffix[i]);
+    struct stat st;
+    if (stat(name, &st) != 0) return false;
+    size += (long long)st.st_size;
+    if ((long long)st.st_mtime > time) time = (long long)st.st_mtime;
+  }
+  return true;
+}
+
+static inline long long alignSection(long long offset)
+{
+  return (offset + 63) & ~(long long)63;
+}
+
+//----------------------------------------------------------------------------
+// bool IndexedTetraSet::readCache()
+//----------------------------------------------------------------------------
+bool IndexedTetraSet::readCache(char *cachename, char *filename, MeshFormat mformat)
+{
+  long long sourceSize, sourceTime;
+  if (!getSourceKey(filename, mformat, sourceSize, sourceTime)) return false;
+
+  size_t size;
+  void *handle[2];
+  const char *data = (const char*)mapCacheFile(cachename, size, handle);
+  if (data == NULL) return false;
+
+  const TetraCacheHeader *h = (const TetraCacheHeader*)data;
+  bool valid = size >= sizeof(TetraCacheHeader) &&
+    memcmp(h->magic, "TETCACHE", 8) == 0 &&
+    h->version == TETRA_CACHE_VERSION && h->byteOrder == 0x01020304 &&
+    h->sizeofVec3 == (int)sizeof(vec3) && h->sizeofFace == (int)sizeof(TetraFace) &&
+    h->sourceSize == sourceSize && h->sourceTime == sourceTime &&
+    h->nV > 0 && h->nT > 0 && h->nBoundaryFaces >= 0;
+
+  if (valid) {
+    long long expected[CACHE_NSECTIONS];
+    expected[CACHE_VERTICES]  = (long long)h->nV * sizeof(vec3);
+    expected[CACHE_SCALARS]   = (long long)h->nV * sizeof(double);
+    expected[CACHE_TETRA]     = (long long)h->nT * 4 * sizeof(int);
+    expected[CACHE_GRADIENTS] = (long long)h->nT * sizeof(vec3);
+    expected[CACHE_BOUNDARY]  = (long long)h->nBoundaryFaces * sizeof(TetraFace);
+    expected[CACHE_ADJ]       = (long long)h->nT * 4 * sizeof(int);
+    expected[CACHE_PLANES]    = (long long)h->nT * 16 * sizeof(float);
+    for (int i = 0; i < CACHE_NSECTIONS && valid; i++)
+      valid = h->size[i] == expected[i] && (h->offset[i] & 63) == 0 &&
+	h->offset[i] >= (long long)sizeof(TetraCacheHeader) &&
+	h->offset[i] + h->size[i] <= (long long)size;
+  }
+
+  if (!valid) {
+    unmapCacheFile((void*)data, size, handle);
+    return false;
+  }
+
+  freeArrays();
+
+  _nV = h->nV;
+  _nT = h->nT;
+  _nBoundaryFaces = h->nBoundaryFaces;
+  _invertNormals = h->invertNormals;
+  _minScalar = h->minScalar;   _maxScalar = h->maxScalar;
+  _maxDistance = h->maxDistance;
+  _minX = h->minX;  _maxX = h->maxX;
+  _minY = h->minY;  _maxY = h->maxY;
+  _minZ = h->minZ;  _maxZ = h->maxZ;
+
+  _vertices_VEC.resize(_nV);
+  memcpy((void*)&_vertices_VEC[0], data + h->offset[CACHE_VERTICES], (size_t)h->size[CACHE_VERTICES]);
+  _scalar_VEC.resize(_nV);
+  memcpy(&_scalar_VEC[0], data + h->offset[CACHE_SCALARS], (size_t)h->size[CACHE_SCALARS]);
+  _tetra_VEC.resize(4*_nT);
+  memcpy(&_tetra_VEC[0], data + h->offset[CACHE_TETRA], (size_t)h->size[CACHE_TETRA]);
+  _grad_VEC.resize(_nT);
+  memcpy((void*)&_grad_VEC[0], data + h->offset[CACHE_GRADIENTS], (size_t)h->size[CACHE_GRADIENTS]);
+  _boundary_fac_VEC.resize(_nBoundaryFaces);
+  if (_nBoundaryFaces > 0)
+    memcpy((void*)&_boundary_fac_VEC[0], data + h->offset[CACHE_BOUNDARY],
+	   (size_t)h->size[CACHE_BOUNDARY]);
+
+  _face_VEC.clear();
+  _tetra_face_VEC.clear();
+
+  _cache_PTR = (void*)data;
+  _cacheSize = size;
+  _cacheHandle[0] = handle[0];
+  _cacheHandle[1] = handle[1];
+  _adj_ARR = (int*)(data + h->offset[CACHE_ADJ]);
+  _plane_ARR = (float*)(data + h->offset[CACHE_PLANES]);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// bool IndexedTetraSet::saveCache()
+//----------------------------------------------------------------------------
+bool IndexedTetraSet::saveCache(char *cachename, char *filename, MeshFormat mformat)
+{
+  if (_adj_ARR == NULL || _plane_ARR == NULL || _nT == 0) return false;
+
+  TetraCacheHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "TETCACHE", 8);
+  h.version = TETRA_CACHE_VERSION;
+  h.byteOrder = 0x01020304;
+  h.sizeofVec3 = sizeof(vec3);
+  h.sizeofFace = sizeof(TetraFace);
+  if (!getSourceKey(filename, mformat, h.sourceSize, h.sourceTime)) return false;
+  h.nV = _nV;
+  h.nT = _nT;
+  h.nBoundaryFaces = _boundary_fac_VEC.size();
+  h.invertNormals = _invertNormals;
+  h.minScalar = _minScalar;   h.maxScalar = _maxScalar;
+  h.maxDistance = _maxDistance;
+  h.minX = _minX;  h.maxX = _maxX;
+  h.minY = _minY;  h.maxY = _maxY;
+  h.minZ = _minZ;  h.maxZ = _maxZ;
+
+  const void *section[CACHE_NSECTIONS];
+  section[CACHE_VERTICES]  = &_vertices_VEC[0];
+  section[CACHE_SCALARS]   = &_scalar_VEC[0];
+  section[CACHE_TETRA]     = &_tetra_VEC[0];
+  section[CACHE_GRADIENTS] = &_grad_VEC[0];
+  section[CACHE_BOUNDARY]  = h.nBoundaryFaces ? &_boundary_fac_VEC[0] : NULL;
+  section[CACHE_ADJ]       = _adj_ARR;
+  section[CACHE_PLANES]    = _plane_ARR;
+  h.size[CACHE_VERTICES]  = (long long)_nV * sizeof(vec3);
+  h.size[CACHE_SCALARS]   = (long long)_nV * sizeof(double);
+  h.size[CACHE_TETRA]     = (long long)_nT * 4 * sizeof(int);
+  h.size[CACHE_GRADIENTS] = (long long)_nT * sizeof(vec3);
+  h.size[CACHE_BOUNDARY]  = (long long)h.nBoundaryFaces * sizeof(TetraFace);
+  h.size[CACHE_ADJ]       = (long long)_nT * 4 * sizeof(int);
+  h.size[CACHE_PLANES]    = (long long)_nT * 16 * sizeof(float);
+
+  if ((int)_scalar_VEC.size() != _nV || (int)_grad_VEC.size() != _nT) return false;
+
+  long long offset = alignSection(sizeof(h));
+  for (int i = 0; i < CACHE_NSECTIONS; i++) {
+    h.offset[i] = offset;
+    offset = alignSection(offset + h.size[i]);
+  }
+
+  // write to a temporary file, so an interrupted save never leaves a
+  // cache that looks valid
+  char tmpname[1024];
+  sprintf(tmpname, "%.1000s.tmp", cachename);
+  FILE *f = fopen(tmpname, "wb");
+  if (f == NULL) return false;
+
+  static const char zero[64] = {0};
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+  long long pos = sizeof(h);
+  for (int i = 0; i < CACHE_NSECTIONS && ok; i++) {
+    ok = fwrite(zero, 1, (size_t)(h.offset[i] - pos), f) == (size_t)(h.offset[i] - pos);
+    if (ok && h.size[i] > 0)
+      ok = fwrite(section[i], 1, (size_t)h.size[i], f) == (size_t)h.size[i];
+    pos = h.offset[i] + h.size[i];
+  }
+  if (fclose(f) != 0) ok = false;
+
+  if (ok) {
+    remove(cachename);
+    ok = rename(tmpname, cachename) == 0;
+  }
+  if (!ok) remove(tmpname);
+  return ok;
+}
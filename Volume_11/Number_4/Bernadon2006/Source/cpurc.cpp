@@ -0,0 +1,211 @@
+//-----------------------------------------------------------------------------
+// File: cpurc.cpp
+// Desc: command line driver of the CPU ray caster
+//-----------------------------------------------------------------------------
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../Header/defines.h"
+#include "../Header/CpuRayCaster.h"
+
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// readTetrahedralMesh
+// Load the tetrahedral mesh into the internal data structure (as in trc.cpp)
+//-----------------------------------------------------------------------------
+static IndexedTetraSet* readTetrahedralMesh(char *filename) {
+
+  IndexedTetraSet *t = new IndexedTetraSet();
+
+  // binary cache next to the mesh, rebuilt whenever the mesh changes
+  char cachename[1024];
+  sprintf(cachename, "%.1000s.tcache", filename);
+  if (t->readCache(cachename, filename, OFF))
+    return t;
+
+  if (t->readFromFile(filename, OFF)==false) {
+
+    printf("\nUnable to open mesh %s", filename);
+    exit(-1);
+  }
+  t->computeFaces();
+  t->computeFacesPlaneEquations();
+
+  if (!t->saveCache(cachename, filename, OFF))
+    printf("\nUnable to write mesh cache %s", cachename);
+
+  return t;
+}
+
+
+//-----------------------------------------------------------------------------
+// SaveImage
+// Write the image, composited over black, as a binary ppm
+//-----------------------------------------------------------------------------
+static bool SaveImage(const char *filename, const float *rgba, int width, int height) {
+
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) return false;
+
+  fprintf(fp, "P6\n%d %d\n255\n", width, height);
+  for (int i = 0; i < width * height; i++) {
+    for (int j = 0; j < 3; j++) {
+      float c = rgba[4 * i + j];
+      int n = (int)(255.0f * (c < 0.0f ? 0.0f : c > 1.0f ? 1.0f : c) + 0.5f);
+      fputc(n, fp);
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// SetViewPosition
+// Camera of view position nViewPos of HRCApp::SaveStatistics, around the
+// mesh bounding box as set up in HRCApp::LoadMesh
+//-----------------------------------------------------------------------------
+static void SetViewPosition(IndexedTetraSet *its, int nViewPos, vec3 &eye, vec3 &up) {
+
+  float diffX = (float)(its->_maxX - its->_minX);
+  float diffY = (float)(its->_maxY - its->_minY);
+  float diffZ = (float)(its->_maxZ - its->_minZ);
+
+  float m_fBBDiagonal = sqrt(diffX * diffX + diffY * diffY + diffZ * diffZ);
+  float m_fBBMaxX = (float)(its->_maxX), m_fBBMinX = (float)(its->_minX);
+  float m_fBBMaxY = (float)(its->_maxY), m_fBBMinY = (float)(its->_minY);
+  float m_fBBMaxZ = (float)(its->_maxZ), m_fBBMinZ = (float)(its->_minZ);
+  float norma = m_fBBDiagonal / 2;
+
+  up = vec3(0.0, 1.0, 0.0);
+  switch(nViewPos){
+    // faces
+    case 0:  eye = vec3(0.0, 0.0, m_fBBMinZ - m_fBBDiagonal); break;
+    case 1:  eye = vec3(0.0, 0.0, m_fBBMaxZ + m_fBBDiagonal); break;
+    case 2:  eye = vec3(m_fBBMinX - m_fBBDiagonal, 0.0, 0.0); break;
+    case 3:  eye = vec3(m_fBBMaxX + m_fBBDiagonal, 0.0, 0.0); break;
+    case 4:  eye = vec3(0.0, m_fBBMinY - m_fBBDiagonal, 0.0); up = vec3(0.0, 0.0, 1.0); break;
+    // HRCApp uses the X extent here too; kept so the views match
+    case 5:  eye = vec3(0.0, m_fBBMaxX + m_fBBDiagonal, 0.0); up = vec3(0.0, 0.0, 1.0); break;
+    // diagonal
+    default: {
+      int nCorner = nViewPos - 6;
+      eye = vec3(((nCorner & 4) ? m_fBBMaxX : m_fBBMinX) / norma * m_fBBDiagonal,
+                 ((nCorner & 2) ? m_fBBMaxY : m_fBBMinY) / norma * m_fBBDiagonal,
+                 ((nCorner & 1) ? m_fBBMaxZ : m_fBBMinZ) / norma * m_fBBDiagonal);
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+// SaveStatistics
+// Time the 14 view positions of HRCApp::SaveStatistics for a range of tile
+// sizes, in a format that can be put side by side with the HRC.exe file
+//-----------------------------------------------------------------------------
+static void SaveStatistics(CpuRayCaster &rc, IndexedTetraSet *its, const char *filename,
+                           float *rgba) {
+
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) {
+    printf("\nUnable to open %s", filename);
+    return;
+  }
+  fprintf(fp, "ViewPos\tTileSize\tminTime\tmaxTime\tsteps\n");
+
+  for (int nTileSize = 8; nTileSize <= 64; nTileSize *= 2) {
+
+    rc.SetTileSize(nTileSize);
+    for (int nViewPos = 0; nViewPos < 14; nViewPos++) {
+
+      vec3 eye, up;
+      SetViewPosition(its, nViewPos, eye, up);
+
+      // a few frames per position, so that min and max mean something
+      long minTime = 9999999, maxTime = 0;
+      for (int i = 0; i < 3; i++) {
+        rc.Render(eye, up, SCREEN_DIMENSION, SCREEN_DIMENSION, rgba);
+        long frameTime = (long)(rc.GetFrameTime() * 1000.0 + 0.5);
+        minTime = (frameTime < minTime) ? frameTime : minTime;
+        maxTime = (frameTime > maxTime) ? frameTime : maxTime;
+      }
+      fprintf(fp, "%i\t%i\t%li\t%li\t%lli\n", nViewPos, nTileSize, minTime, maxTime,
+              rc.GetSteps());
+    }
+  }
+
+  fclose(fp);
+}
+
+
+//-----------------------------------------------------------------------------
+// main
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv) {
+
+  if (argc < 5) {
+    printf("usage: %s mesh colormap opacity posZ [image.ppm] [statFile]\n", argv[0]);
+    return -1;
+  }
+
+  IndexedTetraSet *its = readTetrahedralMesh(argv[1]);
+
+  LUT1D tf;
+  tf.BuildTransferFunction(argv[2], argv[3], its->_maxScalar, its->_minScalar,
+                           its->_maxDistance);
+  LUT3D *lut = new LUT3D(sizeTF, sizeTF, sizeTF);
+  lut->ComputeLUT3D(tf._tf, its->_maxDistance);
+
+  CpuRayCaster rc;
+  double dStart = CpuRayCasterTime();
+  if (!rc.Init(its, lut, its->_maxDistance)) {
+    printf("\nUnable to initialize the ray caster");
+    return -1;
+  }
+  printf("\n%d tetrahedra, setup %.1f ms", its->nTetra(),
+         1000.0 * (CpuRayCasterTime() - dStart));
+
+  float *rgba = new float[4 * SCREEN_DIMENSION * SCREEN_DIMENSION];
+
+  // first frame is the one written out, with the depth limit of HRC.exe
+  rc.SetMaxDepth(MAX_DEPTH);
+  vec3 eye(0.0, 0.0, atof(argv[4])), up(0.0, 1.0, 0.0);
+  rc.Render(eye, up, SCREEN_DIMENSION, SCREEN_DIMENSION, rgba);
+
+  int nThreads = 1;
+#ifdef _OPENMP
+  nThreads = omp_get_max_threads();
+#endif
+  printf("\n%dx%d, %d threads: %.1f ms/frame, %lld tetrahedra traversed\n",
+         SCREEN_DIMENSION, SCREEN_DIMENSION, nThreads,
+         1000.0 * rc.GetFrameTime(), rc.GetSteps());
+
+  if (argc > 5 && !SaveImage(argv[5], rgba, SCREEN_DIMENSION, SCREEN_DIMENSION))
+    printf("Unable to write %s\n", argv[5]);
+
+  if (argc > 6)
+    SaveStatistics(rc, its, argv[6], rgba);
+
+  delete [] rgba;
+  delete lut;
+  delete its;
+  return 0;
+}
@@ -182,6 +182,12 @@ IndexedTetraSet* readTetrahedralMesh(char *filename) {
 
   IndexedTetraSet *t = new IndexedTetraSet();
 
+  // binary cache next to the mesh, rebuilt whenever the mesh changes
+  char cachename[1024];
+  sprintf(cachename, "%.1000s.tcache", filename);
+  if (t->readCache(cachename, filename, OFF))
+    return t;
+
   if (t->readFromFile(filename, OFF)==false) {
 
     printf("\nUnable to open mesh %s", filename);
@@ -190,6 +196,9 @@ IndexedTetraSet* readTetrahedralMesh(char *filename) {
   t->computeFaces();
   t->computeFacesPlaneEquations();
 
+  if (!t->saveCache(cachename, filename, OFF))
+    printf("\nUnable to write mesh cache %s", cachename);
+
   return t;
 }
 
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include "Geometry.h"
 #include "LBVH.h"
+#include "MeshCache.h"
 
 using namespace std;
 
@@ -23,12 +24,13 @@ LBVH::LBVH()
 	objectsPerLeaf = 1;
 	triangles = NULL;
 	boundingVolumes = NULL;
+	cacheFile = NULL;
 }
 //--------------------------------------------------------------------------//
 
 LBVH::~LBVH()
 {
-	if (bvh) delete[] bvh;
+	releaseNodes();
 	if (triangles) delete triangles;
 	// boundingVolumes deleted by Scene
 }
@@ -342,8 +344,7 @@ void LBVH::initHierarchy(int obsPerLeaf)
 	dy = extent.y() / BOX_DIVISIONS;
 	dz = extent.z() / BOX_DIVISIONS;
 
-	if (bvh) delete[] bvh;
-	bvh = NULL;
+	releaseNodes();
 
 	// 4/3 as many nodes as leaves
 	int numObjects = getNumObjects();
@@ -384,3 +385,49 @@ void LBVH::calculateBounds(void)
 	}
 }
 //--------------------------------------------------------------------------//
+
+void LBVH::releaseNodes(void)
+{
+	if (cacheFile) delete cacheFile; // unmaps the cached nodes
+	else if (bvh) delete[] bvh;
+	cacheFile = NULL;
+	bvh = NULL;
+}
+//--------------------------------------------------------------------------//
+
+void LBVH::getCacheInfo(LBVHcacheInfo &info)
+{
+	for (int i=0; i<3; i++) {
+		info.boundsMin[i] = bounds.min[i];
+		info.boundsMax[i] = bounds.max[i];
+	}
+	info.dx = dx;
+	info.dy = dy;
+	info.dz = dz;
+	info.bvhSize = bvhSize;
+	info.objectsPerLeaf = objectsPerLeaf;
+	info.numLeaves = numLeaves;
+	info.firstLeaf = firstLeaf;
+	info.firstLeafOnBottomRow = firstLeafOnBottomRow;
+}
+//--------------------------------------------------------------------------//
+
+// Uses nodes in place instead of building the hierarchy. If file is not
+// NULL the LBVH takes ownership of it and keeps it mapped while in use.
+void LBVH::attachCache(const LBVHcacheInfo &info, LBVHnode *nodes, MappedFile *file)
+{
+	releaseNodes();
+	bounds.min.set(info.boundsMin[0], info.boundsMin[1], info.boundsMin[2]);
+	bounds.max.set(info.boundsMax[0], info.boundsMax[1], info.boundsMax[2]);
+	dx = info.dx;
+	dy = info.dy;
+	dz = info.dz;
+	bvhSize = nodes ? info.bvhSize : 0;
+	objectsPerLeaf = info.objectsPerLeaf;
+	numLeaves = info.numLeaves;
+	firstLeaf = info.firstLeaf;
+	firstLeafOnBottomRow = info.firstLeafOnBottomRow;
+	bvh = nodes;
+	cacheFile = file;
+}
+//--------------------------------------------------------------------------//
@@ -37,6 +37,23 @@ public:
 	}
 };
 
+//--------------------------------------------------------------------------//
+// LBVHcacheInfo - the state of a built LBVH, as stored in a mesh cache
+//--------------------------------------------------------------------------//
+
+class MappedFile;
+
+struct LBVHcacheInfo
+{
+	float boundsMin[3], boundsMax[3];
+	float dx,dy,dz;
+	int bvhSize;
+	int objectsPerLeaf;
+	int numLeaves;
+	int firstLeaf;
+	int firstLeafOnBottomRow;
+};
+
 //--------------------------------------------------------------------------//
 // LBVH - a lightweight bounding volume
 //--------------------------------------------------------------------------//
@@ -56,6 +73,9 @@ protected:
 	TriangleMesh *triangles;        // a triangle mesh that we are bounding OR
 	vector<LBVH*> *boundingVolumes; // the bounding volumes that we are bounding
 
+	MappedFile *cacheFile; // the mesh cache holding bvh (NULL if bvh is owned)
+	void releaseNodes(void);
+
 public:
 	LBVH();
 	~LBVH();
@@ -75,6 +95,11 @@ public:
 	void determineObjectsPerNode(void);
 	void initHierarchy(int obsPerLeaf);
 
+	// Caching (see MeshCache.h)
+	void getCacheInfo(LBVHcacheInfo &info);
+	void attachCache(const LBVHcacheInfo &info, LBVHnode *nodes, MappedFile *file);
+	const LBVHnode *getNodes(void) const {return bvh;}
+
 	// Other
 	void calculateBounds(void); 
 	BoundingBox &getBounds(void) {
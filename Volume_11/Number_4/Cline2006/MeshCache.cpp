@@ -0,0 +1,646 @@
+
+//--------------------------------------------------------------------------//
+// MeshCache.cpp: memory mapped binary PLY loading and LBVH mesh caching
+//--------------------------------------------------------------------------//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "Geometry.h"
+#include "LBVH.h"
+#include "MeshCache.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------//
+// MappedFile implementations
+//--------------------------------------------------------------------------//
+
+MappedFile::MappedFile()
+{
+	data = NULL;
+	size = 0;
+#ifdef _WIN32
+	fileHandle = mapHandle = NULL;
+#endif
+}
+//--------------------------------------------------------------------------//
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+//--------------------------------------------------------------------------//
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *fileName)
+{
+	LARGE_INTEGER fileSize;
+
+	close();
+	fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) { fileHandle = NULL; return false; }
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+	mapHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapHandle) { close(); return false; }
+	data = (const unsigned char*) MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!data) { close(); return false; }
+	size = (size_t) fileSize.QuadPart;
+	return true;
+}
+//--------------------------------------------------------------------------//
+
+void MappedFile::close(void)
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapHandle) CloseHandle(mapHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+	data = NULL;
+	size = 0;
+	fileHandle = mapHandle = NULL;
+}
+
+#else
+
+bool MappedFile::open(const char *fileName)
+{
+	struct stat st;
+
+	close();
+	int fd = ::open(fileName, O_RDONLY);
+	if (fd < 0) return false;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping stays valid after the descriptor is closed
+	if (p == MAP_FAILED) return false;
+	data = (const unsigned char*) p;
+	size = (size_t) st.st_size;
+	return true;
+}
+//--------------------------------------------------------------------------//
+
+void MappedFile::close(void)
+{
+	if (data) munmap((void*) data, size);
+	data = NULL;
+	size = 0;
+}
+
+#endif
+
+//--------------------------------------------------------------------------//
+// PLY header description
+//--------------------------------------------------------------------------//
+
+enum PlyType {
+	PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16,
+	PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+
+struct PlyProperty
+{
+	char name[64];
+	int type;      // the value type, or the index type of a list
+	int countType; // PLY_NONE unless this is a list property
+};
+
+struct PlyElement
+{
+	char name[64];
+	int count;
+	vector<PlyProperty> properties;
+};
+
+//--------------------------------------------------------------------------//
+
+static int plyTypeFromName(const char *name)
+{
+	if (!strcmp(name, "char")   || !strcmp(name, "int8"))    return PLY_INT8;
+	if (!strcmp(name, "uchar")  || !strcmp(name, "uint8"))   return PLY_UINT8;
+	if (!strcmp(name, "short")  || !strcmp(name, "int16"))   return PLY_INT16;
+	if (!strcmp(name, "ushort") || !strcmp(name, "uint16"))  return PLY_UINT16;
+	if (!strcmp(name, "int")    || !strcmp(name, "int32"))   return PLY_INT32;
+	if (!strcmp(name, "uint")   || !strcmp(name, "uint32"))  return PLY_UINT32;
+	if (!strcmp(name, "float")  || !strcmp(name, "float32")) return PLY_FLOAT32;
+	if (!strcmp(name, "double") || !strcmp(name, "float64")) return PLY_FLOAT64;
+	return PLY_NONE;
+}
+//--------------------------------------------------------------------------//
+
+static int plyTypeSize(int type)
+{
+	switch (type) {
+		case PLY_INT8:  case PLY_UINT8:   return 1;
+		case PLY_INT16: case PLY_UINT16:  return 2;
+		case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+		case PLY_FLOAT64: return 8;
+	}
+	return 0;
+}
+//--------------------------------------------------------------------------//
+
+static inline double readPlyValue(const unsigned char *p, int type, bool swap)
+{
+	unsigned char b[8] = {0};
+	int i, n = plyTypeSize(type);
+
+	if (swap) for (i=0; i<n; i++) b[i] = p[n-1-i];
+	else      memcpy(b, p, n);
+
+	switch (type) {
+		case PLY_INT8:    return (double) *(signed char*)b;
+		case PLY_UINT8:   return (double) *(unsigned char*)b;
+		case PLY_INT16:   { short v;          memcpy(&v, b, 2); return v; }
+		case PLY_UINT16:  { unsigned short v; memcpy(&v, b, 2); return v; }
+		case PLY_INT32:   { int v;            memcpy(&v, b, 4); return v; }
+		case PLY_UINT32:  { unsigned int v;   memcpy(&v, b, 4); return v; }
+		case PLY_FLOAT32: { float v;          memcpy(&v, b, 4); return v; }
+		case PLY_FLOAT64: { double v;         memcpy(&v, b, 8); return v; }
+	}
+	return 0.0;
+}
+//--------------------------------------------------------------------------//
+
+static inline float readPlyFloat(const unsigned char *p, int type, bool swap)
+{
+	if (type == PLY_FLOAT32 && !swap) {
+		float v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+	return (float) readPlyValue(p, type, swap);
+}
+//--------------------------------------------------------------------------//
+
+static inline int readPlyInt(const unsigned char *p, int type, bool swap)
+{
+	if (type == PLY_INT32 && !swap) {
+		int v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+	return (int) readPlyValue(p, type, swap);
+}
+//--------------------------------------------------------------------------//
+
+// Reads the header lines up to end_header. Returns the offset of the
+// first data byte, or 0 on failure.
+static size_t parsePlyHeader(const MappedFile &file, int &format,
+							 vector<PlyElement> &elements)
+{
+	char line[256], word[64], type1[64], type2[64], name[64];
+	size_t pos = 0;
+	int count;
+
+	format = -1;
+	if (file.size < 4 || strncmp((const char*) file.data, "ply", 3)) return 0;
+
+	while (pos < file.size) {
+		// copy the next line
+		size_t len = 0;
+		while (pos+len < file.size && file.data[pos+len] != '\n') len++;
+		if (pos+len >= file.size) return 0;
+		size_t n = MIN(len, sizeof(line)-1);
+		memcpy(line, file.data+pos, n);
+		line[n] = '\0';
+		if (n > 0 && line[n-1] == '\r') line[n-1] = '\0';
+		pos += len + 1;
+
+		if (!strncmp(line, "end_header", 10)) {
+			return (format < 0) ? 0 : pos;
+		} else if (!strncmp(line, "format", 6)) {
+			if (sscanf(line, "%*s%63s", word) != 1) return 0;
+			if      (!strcmp(word, "ascii"))                format = 0;
+			else if (!strcmp(word, "binary_little_endian")) format = 1;
+			else if (!strcmp(word, "binary_big_endian"))    format = 2;
+			else return 0;
+		} else if (!strncmp(line, "element", 7)) {
+			if (sscanf(line, "%*s%63s%d", name, &count) != 2 || count < 0) return 0;
+			PlyElement element;
+			strcpy(element.name, name);
+			element.count = count;
+			elements.push_back(element);
+		} else if (!strncmp(line, "property", 8)) {
+			if (elements.empty()) return 0;
+			PlyProperty property;
+			if (sscanf(line, "%*s%63s", word) != 1) return 0;
+			if (!strcmp(word, "list")) {
+				if (sscanf(line, "%*s%*s%63s%63s%63s", type1, type2, name) != 3) return 0;
+				property.countType = plyTypeFromName(type1);
+				property.type = plyTypeFromName(type2);
+				if (property.countType == PLY_NONE) return 0;
+			} else {
+				if (sscanf(line, "%*s%63s%63s", type1, name) != 2) return 0;
+				property.countType = PLY_NONE;
+				property.type = plyTypeFromName(type1);
+			}
+			if (property.type == PLY_NONE) return 0;
+			strcpy(property.name, name);
+			elements.back().properties.push_back(property);
+		}
+		// comment and obj_info lines are ignored
+	}
+	return 0;
+}
+//--------------------------------------------------------------------------//
+
+// Advances pos past every record of an element that we do not load.
+static bool skipPlyElement(const MappedFile &file, size_t &pos,
+						   const PlyElement &element, bool swap)
+{
+	int i, j;
+	size_t fixedSize = 0;
+	bool hasList = false;
+
+	for (j=0; j<(int)element.properties.size(); j++) {
+		if (element.properties[j].countType != PLY_NONE) hasList = true;
+		else fixedSize += plyTypeSize(element.properties[j].type);
+	}
+	if (!hasList) {
+		if ((file.size - pos) / MAX(fixedSize, (size_t)1) < (size_t) element.count) return false;
+		pos += fixedSize * element.count;
+		return true;
+	}
+
+	for (i=0; i<element.count; i++) {
+		for (j=0; j<(int)element.properties.size(); j++) {
+			const PlyProperty &p = element.properties[j];
+			if (p.countType == PLY_NONE) {
+				pos += plyTypeSize(p.type);
+			} else {
+				if (pos + plyTypeSize(p.countType) > file.size) return false;
+				int n = readPlyInt(file.data+pos, p.countType, swap);
+				if (n < 0) return false;
+				pos += plyTypeSize(p.countType) + (size_t) n * plyTypeSize(p.type);
+			}
+			if (pos > file.size) return false;
+		}
+	}
+	return true;
+}
+//--------------------------------------------------------------------------//
+
+static int findPlyProperty(const PlyElement &element, const char *name, int *offset)
+{
+	int j;
+	*offset = 0;
+	for (j=0; j<(int)element.properties.size(); j++) {
+		if (!strcmp(element.properties[j].name, name)) return j;
+		*offset += plyTypeSize(element.properties[j].type);
+	}
+	return -1;
+}
+
+//--------------------------------------------------------------------------//
+// Binary PLY loading
+//--------------------------------------------------------------------------//
+
+static bool readPlyVertices(TriangleMesh *mesh, const MappedFile &file,
+							size_t pos, const PlyElement &element, bool swap)
+{
+	int j, k;
+	int offset[6], type[6];
+	const char *names[6] = {"x", "y", "z", "nx", "ny", "nz"};
+	size_t stride = 0;
+
+	for (j=0; j<(int)element.properties.size(); j++) {
+		if (element.properties[j].countType != PLY_NONE) return false;
+		stride += plyTypeSize(element.properties[j].type);
+	}
+	for (k=0; k<6; k++) {
+		j = findPlyProperty(element, names[k], &offset[k]);
+		type[k] = (j < 0) ? PLY_NONE : element.properties[j].type;
+	}
+	if (type[0]==PLY_NONE || type[1]==PLY_NONE || type[2]==PLY_NONE) return false;
+	bool hasNormals = (type[3]!=PLY_NONE && type[4]!=PLY_NONE && type[5]!=PLY_NONE);
+
+	int numVertices = element.count;
+	mesh->vertices.resize(numVertices);
+	if (hasNormals) mesh->normals.resize(numVertices);
+	const unsigned char *base = file.data + pos;
+
+	#pragma omp parallel for schedule(static)
+	for (int i=0; i<numVertices; i++) {
+		const unsigned char *r = base + (size_t)i * stride;
+		mesh->vertices[i].set(readPlyFloat(r+offset[0], type[0], swap),
+							  readPlyFloat(r+offset[1], type[1], swap),
+							  readPlyFloat(r+offset[2], type[2], swap));
+		if (hasNormals) {
+			mesh->normals[i].set(readPlyFloat(r+offset[3], type[3], swap),
+								 readPlyFloat(r+offset[4], type[4], swap),
+								 readPlyFloat(r+offset[5], type[5], swap));
+		}
+	}
+	return true;
+}
+//--------------------------------------------------------------------------//
+
+static bool readPlyFaces(TriangleMesh *mesh, const MappedFile &file,
+						 size_t pos, const PlyElement &element, bool swap)
+{
+	int i, j, list = -1;
+	size_t before = 0, after = 0;
+
+	// a face record is [scalars] count index*count [scalars]
+	for (j=0; j<(int)element.properties.size(); j++) {
+		const PlyProperty &p = element.properties[j];
+		if (p.countType != PLY_NONE) {
+			if (list >= 0) return false;
+			if (strcmp(p.name, "vertex_indices") && strcmp(p.name, "vertex_index")) return false;
+			list = j;
+		} else if (list < 0) {
+			before += plyTypeSize(p.type);
+		} else {
+			after += plyTypeSize(p.type);
+		}
+	}
+	if (list < 0) return false;
+	int countType = element.properties[list].countType;
+	int indexType = element.properties[list].type;
+	size_t countSize = plyTypeSize(countType);
+	size_t indexSize = plyTypeSize(indexType);
+
+	// PASS 1: locate each face record and count its triangles. The
+	// records have variable length, so this walk is sequential, but it
+	// only touches the vertex count of every face.
+	int numFaces = element.count;
+	vector<size_t> faceStart(numFaces);
+	vector<int> triStart(numFaces+1);
+	int numTriangles = 0;
+	for (i=0; i<numFaces; i++) {
+		if (pos + before + countSize > file.size) return false;
+		int n = readPlyInt(file.data + pos + before, countType, swap);
+		if (n < 0) return false;
+		faceStart[i] = pos + before + countSize;
+		triStart[i] = numTriangles;
+		if (n > 2) numTriangles += n - 2;
+		pos += before + countSize + (size_t)n * indexSize + after;
+		if (pos > file.size) return false;
+	}
+	triStart[numFaces] = numTriangles;
+
+	// PASS 2: fan triangulate every face into its slot in parallel
+	int numVertices = (int) mesh->vertices.size();
+	int badIndex = 0;
+	mesh->triangles.resize(numTriangles);
+
+	#pragma omp parallel for schedule(static) reduction(|:badIndex)
+	for (int f=0; f<numFaces; f++) {
+		const unsigned char *idx = file.data + faceStart[f];
+		int t = triStart[f];
+		int verts = t==triStart[f+1] ? 0 : triStart[f+1] - t + 2;
+		if (verts == 0) continue;
+		int v0 = readPlyInt(idx, indexType, swap);
+		int v1 = readPlyInt(idx + indexSize, indexType, swap);
+		if ((unsigned)v0 >= (unsigned)numVertices || (unsigned)v1 >= (unsigned)numVertices) badIndex = 1;
+		for (int k=2; k<verts; k++) {
+			int v2 = readPlyInt(idx + k*indexSize, indexType, swap);
+			if ((unsigned)v2 >= (unsigned)numVertices) badIndex = 1;
+			mesh->triangles[t++].setVertices(v0, v1, v2);
+			v1 = v2;
+		}
+	}
+
+	return !badIndex;
+}
+//--------------------------------------------------------------------------//
+
+int parsePlyBinary(TriangleMesh *mesh, const char *meshFile)
+{
+	MappedFile file;
+	vector<PlyElement> elements;
+	int i, format;
+	int vertexElement = -1, faceElement = -1;
+
+	if (!file.open(meshFile)) return PLY_LOAD_FAILED;
+	size_t pos = parsePlyHeader(file, format, elements);
+	if (pos == 0) return PLY_LOAD_FAILED;
+	if (format == 0) return PLY_LOAD_ASCII;
+
+	unsigned int one = 1;
+	bool hostLittleEndian = (*(unsigned char*)&one == 1);
+	bool swap = (format == 1) != hostLittleEndian;
+
+	mesh->vertices.clear();
+	mesh->normals.clear();
+	mesh->triangles.clear();
+
+	for (i=0; i<(int)elements.size(); i++) {
+		if (!strcmp(elements[i].name, "vertex") && vertexElement < 0) {
+			vertexElement = i;
+			if (!readPlyVertices(mesh, file, pos, elements[i], swap)) return PLY_LOAD_FAILED;
+		} else if (!strcmp(elements[i].name, "face") && faceElement < 0) {
+			// the vertex element always precedes the faces in practice;
+			// the index check in readPlyFaces depends on it
+			if (vertexElement < 0) return PLY_LOAD_FAILED;
+			faceElement = i;
+			if (!readPlyFaces(mesh, file, pos, elements[i], swap)) return PLY_LOAD_FAILED;
+			break; // nothing after the faces is needed
+		}
+		if (!skipPlyElement(file, pos, elements[i], swap)) return PLY_LOAD_FAILED;
+	}
+
+	return (vertexElement >= 0 && faceElement >= 0) ? PLY_LOAD_OK : PLY_LOAD_FAILED;
+}
+
+//--------------------------------------------------------------------------//
+// Mesh cache
+//--------------------------------------------------------------------------//
+
+#define MESH_CACHE_VERSION   1
+#define MESH_CACHE_BYTEORDER 0x01020304
+#define MESH_CACHE_ALIGN     64
+
+static const char meshCacheMagic[8] = {'L','B','V','H','M','S','H','\0'};
+
+struct MeshCacheHeader
+{
+	char magic[8];
+	int version;
+	int byteOrder;
+	int headerSize;     // sizeof(MeshCacheHeader)
+	int elementSize[3]; // sizeof Point3, Triangle and LBVHnode
+	MeshCacheKey key;
+	LBVHcacheInfo lbvh;
+	int numVertices, numNormals, numTriangles, pad;
+	long long vertexOffset, normalOffset, triangleOffset, nodeOffset;
+	long long fileSize;
+};
+
+//--------------------------------------------------------------------------//
+
+bool getMeshCacheKey(MeshCacheKey &key, const char *meshFile,
+					 unsigned int transformHash, int objectsPerLeaf)
+{
+	struct stat st;
+	if (stat(meshFile, &st) != 0) return false;
+
+	memset(&key, 0, sizeof(key));
+	key.sourceSize = (long long) st.st_size;
+	key.sourceTime = (long long) st.st_mtime;
+	key.transformHash = transformHash;
+	key.objectsPerLeaf = objectsPerLeaf;
+	return true;
+}
+//--------------------------------------------------------------------------//
+
+static bool cacheSectionValid(const MeshCacheHeader &H, long long offset,
+							  long long count, int elementSize)
+{
+	if (count == 0) return true;
+	if (offset < (long long) sizeof(MeshCacheHeader)) return false;
+	if (offset % MESH_CACHE_ALIGN != 0) return false;
+	return offset + count * elementSize <= H.fileSize;
+}
+//--------------------------------------------------------------------------//
+
+bool loadMeshCache(const char *cacheFile, const MeshCacheKey &key,
+				   TriangleMesh *mesh, LBVH *boundingVolume)
+{
+	MeshCacheHeader H;
+	MappedFile *file = new MappedFile();
+
+	if (!file->open(cacheFile) || file->size < sizeof(H)) {
+		delete file;
+		return false;
+	}
+	memcpy(&H, file->data, sizeof(H));
+
+	bool valid =
+		!memcmp(H.magic, meshCacheMagic, sizeof(meshCacheMagic)) &&
+		H.version == MESH_CACHE_VERSION &&
+		H.byteOrder == MESH_CACHE_BYTEORDER &&
+		H.headerSize == (int) sizeof(MeshCacheHeader) &&
+		H.elementSize[0] == (int) sizeof(Point3) &&
+		H.elementSize[1] == (int) sizeof(Triangle) &&
+		H.elementSize[2] == (int) sizeof(LBVHnode) &&
+		H.fileSize == (long long) file->size &&
+		H.key.sourceSize == key.sourceSize &&
+		H.key.sourceTime == key.sourceTime &&
+		H.key.transformHash == key.transformHash &&
+		H.key.objectsPerLeaf == key.objectsPerLeaf &&
+		H.lbvh.objectsPerLeaf == key.objectsPerLeaf &&
+		H.numVertices >= 0 && H.numTriangles >= 0 && H.lbvh.bvhSize >= 0 &&
+		(H.numNormals == 0 || H.numNormals == H.numVertices) &&
+		cacheSectionValid(H, H.vertexOffset, H.numVertices, sizeof(Point3)) &&
+		cacheSectionValid(H, H.normalOffset, H.numNormals, sizeof(Point3)) &&
+		cacheSectionValid(H, H.triangleOffset, H.numTriangles, sizeof(Triangle)) &&
+		cacheSectionValid(H, H.nodeOffset, H.lbvh.bvhSize, sizeof(LBVHnode));
+	if (!valid) {
+		delete file;
+		return false;
+	}
+
+	// The intersection code indexes the mesh through std::vector, so the
+	// mesh arrays are block copied; the hierarchy itself stays mapped.
+	const Point3 *V = (const Point3*) (file->data + H.vertexOffset);
+	const Point3 *N = (const Point3*) (file->data + H.normalOffset);
+	const Triangle *T = (const Triangle*) (file->data + H.triangleOffset);
+	mesh->vertices.assign(V, V + H.numVertices);
+	if (H.numNormals) mesh->normals.assign(N, N + H.numNormals);
+	else mesh->normals.clear();
+	mesh->triangles.assign(T, T + H.numTriangles);
+
+	if (H.lbvh.bvhSize > 0) {
+		LBVHnode *nodes = (LBVHnode*) (file->data + H.nodeOffset);
+		boundingVolume->attachCache(H.lbvh, nodes, file);
+	} else {
+		boundingVolume->attachCache(H.lbvh, NULL, NULL);
+		delete file;
+	}
+	return true;
+}
+//--------------------------------------------------------------------------//
+
+static bool writeCacheSection(FILE *F, long long &offset, const void *data,
+							  size_t count, size_t elementSize)
+{
+	static const char zeros[MESH_CACHE_ALIGN] = {0};
+	long long pos = ftell(F);
+	long long pad = (MESH_CACHE_ALIGN - pos % MESH_CACHE_ALIGN) % MESH_CACHE_ALIGN;
+
+	if (count == 0) {
+		offset = 0;
+		return true;
+	}
+	if (pad && fwrite(zeros, 1, (size_t) pad, F) != (size_t) pad) return false;
+	offset = pos + pad;
+	return fwrite(data, elementSize, count, F) == count;
+}
+//--------------------------------------------------------------------------//
+
+bool saveMeshCache(const char *cacheFile, const MeshCacheKey &key,
+				   TriangleMesh *mesh, LBVH *boundingVolume)
+{
+	MeshCacheHeader H;
+	char tempFile[1024];
+
+	memset(&H, 0, sizeof(H));
+	memcpy(H.magic, meshCacheMagic, sizeof(meshCacheMagic));
+	H.version = MESH_CACHE_VERSION;
+	H.byteOrder = MESH_CACHE_BYTEORDER;
+	H.headerSize = sizeof(MeshCacheHeader);
+	H.elementSize[0] = sizeof(Point3);
+	H.elementSize[1] = sizeof(Triangle);
+	H.elementSize[2] = sizeof(LBVHnode);
+	H.key = key;
+	boundingVolume->getCacheInfo(H.lbvh);
+	H.numVertices = (int) mesh->vertices.size();
+	H.numNormals = (int) mesh->normals.size();
+	H.numTriangles = (int) mesh->triangles.size();
+
+	// write to a temporary file and rename it, so that a concurrent
+	// launch never maps a partially written cache
+	if (strlen(cacheFile) + 5 > sizeof(tempFile)) return false;
+	sprintf(tempFile, "%s.tmp", cacheFile);
+	FILE *F = fopen(tempFile, "wb");
+	if (!F) return false;
+
+	bool ok = fwrite(&H, sizeof(H), 1, F) == 1;
+	if (ok) ok = writeCacheSection(F, H.vertexOffset, H.numVertices ? &mesh->vertices[0] : NULL,
+								   H.numVertices, sizeof(Point3));
+	if (ok) ok = writeCacheSection(F, H.normalOffset, H.numNormals ? &mesh->normals[0] : NULL,
+								   H.numNormals, sizeof(Point3));
+	if (ok) ok = writeCacheSection(F, H.triangleOffset, H.numTriangles ? &mesh->triangles[0] : NULL,
+								   H.numTriangles, sizeof(Triangle));
+	if (ok) ok = writeCacheSection(F, H.nodeOffset, boundingVolume->getNodes(),
+								   H.lbvh.bvhSize, sizeof(LBVHnode));
+	if (ok) {
+		H.fileSize = ftell(F);
+		ok = fseek(F, 0, SEEK_SET) == 0 && fwrite(&H, sizeof(H), 1, F) == 1;
+	}
+	if (fclose(F) != 0) ok = false;
+	if (!ok) {
+		remove(tempFile);
+		return false;
+	}
+
+#ifdef _WIN32
+	remove(cacheFile); // rename does not replace existing files on windows
+#endif
+	if (rename(tempFile, cacheFile) != 0) {
+		remove(tempFile);
+		return false;
+	}
+	return true;
+}
+//--------------------------------------------------------------------------//
@@ -0,0 +1,75 @@
+
+//--------------------------------------------------------------------------//
+// MeshCache.h: memory mapped binary PLY loading and LBVH mesh caching
+//--------------------------------------------------------------------------//
+
+#ifndef _MESH_CACHE_
+#define _MESH_CACHE_
+
+#include <stddef.h>
+#include "Geometry.h"
+
+//--------------------------------------------------------------------------//
+// MappedFile - a read only memory mapping of a whole file
+//--------------------------------------------------------------------------//
+
+class MappedFile
+{
+public:
+	const unsigned char *data; // the mapped bytes (NULL if not open)
+	size_t size;               // the number of mapped bytes
+#ifdef _WIN32
+	void *fileHandle, *mapHandle;
+#endif
+
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char *fileName);
+	void close(void);
+};
+
+//--------------------------------------------------------------------------//
+// Binary PLY loading
+//--------------------------------------------------------------------------//
+
+#define PLY_LOAD_FAILED 0  // missing file, unsupported or corrupt layout
+#define PLY_LOAD_OK     1  // mesh was filled in
+#define PLY_LOAD_ASCII  2  // the file is ascii, use parsePly() instead
+
+// Maps a binary (little or big endian) PLY file and converts its vertex
+// and face elements in bulk. Polygons are fan triangulated in parallel
+// (v0,v1,v2), (v0,v2,v3), ... exactly as parsePly does.
+int parsePlyBinary(TriangleMesh *mesh, const char *meshFile);
+
+//--------------------------------------------------------------------------//
+// Mesh cache
+//
+// A cache file stores a TriangleMesh (in the triangle order produced by
+// LBVH::initHierarchy) together with the built LBVH nodes. Loading maps
+// the file and points the LBVH directly at the cached nodes, so the
+// hierarchy is neither rebuilt nor copied. The cache is valid only while
+// the source file size and modification time, objectsPerLeaf and the
+// hash of the transforms applied to the mesh all match.
+//--------------------------------------------------------------------------//
+
+struct MeshCacheKey
+{
+	long long sourceSize;   // size of the source PLY file in bytes
+	long long sourceTime;   // modification time of the source PLY file
+	unsigned int transformHash; // hash of the scale/translate commands
+	int objectsPerLeaf;
+};
+
+bool getMeshCacheKey(MeshCacheKey &key, const char *meshFile,
+					 unsigned int transformHash, int objectsPerLeaf);
+
+// Returns false if the cache is missing, stale or corrupt; mesh and
+// boundingVolume are left untouched in that case.
+bool loadMeshCache(const char *cacheFile, const MeshCacheKey &key,
+				   TriangleMesh *mesh, LBVH *boundingVolume);
+
+bool saveMeshCache(const char *cacheFile, const MeshCacheKey &key,
+				   TriangleMesh *mesh, LBVH *boundingVolume);
+
+#endif
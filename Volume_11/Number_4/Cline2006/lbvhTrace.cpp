@@ -10,6 +10,7 @@
 #include <time.h>
 #include "Geometry.h"
 #include "LBVH.h"
+#include "MeshCache.h"
 
 Camera theCamera;
 Scene theScene;
@@ -17,7 +18,7 @@ Scene theScene;
 bool parse(char *fileName);
 bool parseCamera(FILE *F);
 bool parseDirectionalLight(FILE *F);
-bool parsePolyMesh(FILE *F, int objectsPerLeaf);
+bool parsePolyMesh(FILE *F, int objectsPerLeaf, bool useMeshCache);
 bool parsePly(TriangleMesh *mesh, char *meshName);
 
 //--------------------------------------------------------------------------//
@@ -62,6 +63,7 @@ bool parse(char *fileName)
 	printf("PARSING '%s' ... ", fileName);
 
 	int objectsPerLeaf = 1;
+	int meshCache = 0;
 	char buff[256], dummy[256];
 	FILE *F = fopen(fileName, "r");
 	if (!F) return false;
@@ -70,7 +72,7 @@ bool parse(char *fileName)
 		if (stringStartsWith(buff, "directionalLight")) {
 			if (!parseDirectionalLight(F)) return false;
 		} else if (stringStartsWith(buff, "polyMesh")) {
-			if (!parsePolyMesh(F, objectsPerLeaf)) return false;
+			if (!parsePolyMesh(F, objectsPerLeaf, meshCache != 0)) return false;
 		} else if (stringStartsWith(buff, "backgroundColor")) {
 			float r,g,b;
 			sscanf(buff, "%s%f%f%f", dummy, &r, &g, &b);
@@ -82,6 +84,8 @@ bool parse(char *fileName)
 		} else if (stringStartsWith(buff, "objectsPerLeaf")) {
 			sscanf(buff, "%s%d", dummy, &objectsPerLeaf);
 			if (objectsPerLeaf < 1) objectsPerLeaf = 1;
+		} else if (stringStartsWith(buff, "meshCache")) {
+			sscanf(buff, "%s%d", dummy, &meshCache);
 		} else if (stringStartsWith(buff, "camera")) {
 			if (!parseCamera(F)) return false;
 		}
@@ -157,24 +161,58 @@ bool parseDirectionalLight(FILE *F)
 
 //--------------------------------------------------------------------------//
 
-bool parsePolyMesh(FILE *F, int objectsPerLeaf)
+// FNV-1a hash of the scale/translate commands, used to validate caches
+unsigned int hashTransform(unsigned int hash, char op, const Point3 &P)
 {
-	char buff[256], dummy[256], meshFile[256];
+	unsigned char bytes[1 + sizeof(P.A)];
+	bytes[0] = (unsigned char) op;
+	memcpy(&bytes[1], P.A, sizeof(P.A));
+	for (int i=0; i<(int)sizeof(bytes); i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+//--------------------------------------------------------------------------//
+
+bool loadPly(TriangleMesh *mesh, char *meshFile)
+{
+	int status = parsePlyBinary(mesh, meshFile);
+	if (status == PLY_LOAD_ASCII) return parsePly(mesh, meshFile);
+	return status == PLY_LOAD_OK;
+}
+
+//--------------------------------------------------------------------------//
+
+bool parsePolyMesh(FILE *F, int objectsPerLeaf, bool useMeshCache)
+{
+	char buff[256], dummy[256], meshFile[256], cacheFile[300];
 	Point3 scale, trans, diff, spec;
 	TriangleMesh *triangleMesh = new TriangleMesh();
 	LBVH *boundingVolume = new LBVH();
 	boundingVolume->setTriangleMesh(triangleMesh);
 
+	// the transforms are applied after the mesh is loaded (or taken from
+	// the cache), in the order they appear
+	vector<char> ops;
+	vector<Point3> opValues;
+	unsigned int transformHash = 2166136261u;
+	meshFile[0] = '\0';
+
 	while (fgets(buff, 255, F)) {
 		if (stringStartsWith(buff, "plyFile")) {
 			sscanf(buff, "%s%s", dummy, meshFile);
-			if (!parsePly(triangleMesh, meshFile)) return false;
 		} else if (stringStartsWith(buff, "scale")) {
 			sscanf(buff, "%s%f%f%f", dummy, &scale[0], &scale[1], &scale[2]);
-			triangleMesh->scale(scale);
+			ops.push_back('s');
+			opValues.push_back(scale);
+			transformHash = hashTransform(transformHash, 's', scale);
 		} else if (stringStartsWith(buff, "translate")) {
 			sscanf(buff, "%s%f%f%f", dummy, &trans[0], &trans[1], &trans[2]);
-			triangleMesh->translate(trans);
+			ops.push_back('t');
+			opValues.push_back(trans);
+			transformHash = hashTransform(transformHash, 't', trans);
 		} else if (stringStartsWith(buff, "diffuse")) {
 			sscanf(buff, "%s%f%f%f", dummy, &diff[0], &diff[1], &diff[2]);
 			triangleMesh->material.diffuse = diff;
@@ -186,7 +224,25 @@ bool parsePolyMesh(FILE *F, int objectsPerLeaf)
 			sscanf(buff, "%s%f", dummy, &exponent);
 			triangleMesh->material.exponent = exponent;
 		} else if (stringStartsWith(buff, "end_polyMesh")) {
-			boundingVolume->initHierarchy(objectsPerLeaf);
+			if (!meshFile[0]) return false;
+			MeshCacheKey key;
+			bool haveKey = useMeshCache &&
+				getMeshCacheKey(key, meshFile, transformHash, objectsPerLeaf);
+			// one cache file per transform and leaf size, so a mesh loaded
+			// several times with different transforms keeps them all
+			sprintf(cacheFile, "%s.%08x_%d.lbvh", meshFile, transformHash, objectsPerLeaf);
+
+			if (!haveKey || !loadMeshCache(cacheFile, key, triangleMesh, boundingVolume)) {
+				if (!loadPly(triangleMesh, meshFile)) return false;
+				for (int i=0; i<(int)ops.size(); i++) {
+					if (ops[i] == 's') triangleMesh->scale(opValues[i]);
+					else triangleMesh->translate(opValues[i]);
+				}
+				boundingVolume->initHierarchy(objectsPerLeaf);
+				if (haveKey && !saveMeshCache(cacheFile, key, triangleMesh, boundingVolume)) {
+					printf("\nUnable to write mesh cache '%s'\n", cacheFile);
+				}
+			}
 			theScene.meshes.push_back(boundingVolume);
 			return true;
 		}
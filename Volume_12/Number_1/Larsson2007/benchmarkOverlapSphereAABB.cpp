@@ -9,11 +9,14 @@
 /* History:                                                     */
 /*   2005-12-05: First version of source code created           */
 /*   2006-05-08: Updated code to include SSE overlap test       */
+/*   Added batched (SoA) tests, compiles with GCC and Clang     */
 /*                                                              */
 /****************************************************************/
 
+#ifdef _WIN32
 #define WIN_LEAN_AND_MEAN
 #include <windows.h>
+#endif
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -22,14 +25,62 @@
 #include "timing.h"
 
 #include "overlapSphereBox.h"
+#include "overlapSphereBoxBatch.h"
 
 #define  NUMBER_OF_METHODS    5
 #define  NUMBER_OF_BV_PAIRS 2000000
 #define  REPETITIONS          10
+#define  NUMBER_OF_BATCH_KERNELS 3
+#define  NUMBER_OF_BATCH_SIZES   5
 
 Sphere3D sphereArray[NUMBER_OF_BV_PAIRS];
 Box3D    boxArray[NUMBER_OF_BV_PAIRS];
 
+// The same spheres and boxes as structure of arrays, for the batched tests
+float sphereSoA[4][NUMBER_OF_BV_PAIRS]; // c.x, c.y, c.z, r
+float boxSoA[6][NUMBER_OF_BV_PAIRS];    // min.x, min.y, min.z, max.x, max.y, max.z
+int   indexArray[NUMBER_OF_BV_PAIRS];
+
+typedef int (*SphereAABBsKernel)(const Sphere3D &, const Box3DArray &, int, int *);
+typedef int (*SpheresAABBKernel)(const Sphere3DArray &, int, const Box3D &, int *);
+
+// Kernels that were not compiled in are 0
+SphereAABBsKernel sphereAABBsKernel[NUMBER_OF_BATCH_KERNELS] = {
+	overlapSphereAABBs_Scalar,
+#if defined(__AVX2__)
+	overlapSphereAABBs_AVX2,
+#else
+	0,
+#endif
+#if defined(__AVX512F__)
+	overlapSphereAABBs_AVX512
+#else
+	0
+#endif
+};
+
+SpheresAABBKernel spheresAABBKernel[NUMBER_OF_BATCH_KERNELS] = {
+	overlapSpheresAABB_Scalar,
+#if defined(__AVX2__)
+	overlapSpheresAABB_AVX2,
+#else
+	0,
+#endif
+#if defined(__AVX512F__)
+	overlapSpheresAABB_AVX512
+#else
+	0
+#endif
+};
+
+char batchKernelName[NUMBER_OF_BATCH_KERNELS][255] = {
+	"Scalar",
+	"AVX2",
+	"AVX512"
+};
+
+int batchSizes[NUMBER_OF_BATCH_SIZES] = { 8, 64, 512, 4096, 32768 };
+
 char algorithmName[NUMBER_OF_METHODS][255] = {
 	"overlapSphereAABB_Arvo",
 	"overlapSphereAABB_QRI", 
@@ -55,17 +106,46 @@ void printResult(char * s, int overlaps, double time)
 	printf("Overlap percentage: %f\n", 100.0f * (float)overlaps / (float) NUMBER_OF_BV_PAIRS);	
 	printf("Total running time: %f\n", time);
 	printf("Average time per overlap test: %.10lf\n", (double)time / NUMBER_OF_BV_PAIRS);
+	printf("Overlap tests per second: %.0f\n", NUMBER_OF_BV_PAIRS / time);
 	printf("\n");
 }
 
+// Sphere i is tested against the i:th batch of boxes (one vs many), or box i against
+// the i:th batch of spheres (many vs one), until NUMBER_OF_BV_PAIRS tests are done.
+void benchmarkBatch(int kernel, int batchSize, int manySpheres)
+{
+	int i, k;
+	int numBatches = NUMBER_OF_BV_PAIRS / batchSize;
+	int overlaps = 0;
+	Timing watch;
+
+	watch.start();
+	for (k = 0; k < REPETITIONS; k++) {
+		for (i = 0; i < numBatches; i++) {
+			int first = i * batchSize;
+			if (manySpheres) {
+				Sphere3DArray spheres = { { sphereSoA[0] + first, sphereSoA[1] + first, sphereSoA[2] + first }, sphereSoA[3] + first };
+				overlaps += spheresAABBKernel[kernel](spheres, batchSize, boxArray[i], indexArray);
+			} else {
+				Box3DArray boxes = { { boxSoA[0] + first, boxSoA[1] + first, boxSoA[2] + first },
+					{ boxSoA[3] + first, boxSoA[4] + first, boxSoA[5] + first } };
+				overlaps += sphereAABBsKernel[kernel](sphereArray[i], boxes, batchSize, indexArray);
+			}
+		}
+	}
+	double time = watch.stop() / REPETITIONS;
+	printf("%s\t%s\t%d\t%.0f\t%d\n", manySpheres ? "overlapSpheresAABB" : "overlapSphereAABBs",
+		batchKernelName[kernel], batchSize, numBatches * batchSize / time, overlaps / REPETITIONS);
+}
+
 inline float MaxZero(const float& f)
 {
-	long i = *(long *) &f;
+	int i = *(int *) &f;
 	i &= ~(i >> 31);
 	return (*(float *) &i);
 }
 
-void main(void)
+int main(void)
 {
 	int i, k;
 	Timing watch;
@@ -140,6 +220,17 @@ void main(void)
 		boxArray[i].max.x = mid.x + ext.x;
 		boxArray[i].max.y = mid.y + ext.y;
 		boxArray[i].max.z = mid.z + ext.z;
+
+		sphereSoA[0][i] = sphereArray[i].c.x;
+		sphereSoA[1][i] = sphereArray[i].c.y;
+		sphereSoA[2][i] = sphereArray[i].c.z;
+		sphereSoA[3][i] = sphereArray[i].r;
+		boxSoA[0][i] = boxArray[i].min.x;
+		boxSoA[1][i] = boxArray[i].min.y;
+		boxSoA[2][i] = boxArray[i].min.z;
+		boxSoA[3][i] = boxArray[i].max.x;
+		boxSoA[4][i] = boxArray[i].max.y;
+		boxSoA[5][i] = boxArray[i].max.z;
 	}
 
 	/* ==== Method 1 ==== */
@@ -218,5 +309,22 @@ void main(void)
 	int noOverlapsReal = noOverlaps[0];
 	int noOverlapsConservative = noOverlaps[3];
 	printf("False positives reported in conservative test: %.3f percent\n", 100.0f * (noOverlapsConservative - noOverlapsReal) / (float)noOverlapsReal);
+	printf("\n");
+
+	/* ==== Batched tests ==== */
+	printf("=== Batched tests ===\n\n");
+	printf("Function\t\tKernel\tBatch\tTests/s\tOverlaps\n");
+	for (int manySpheres = 0; manySpheres < 2; manySpheres++) {
+		for (k = 0; k < NUMBER_OF_BATCH_KERNELS; k++) {
+			if (manySpheres ? spheresAABBKernel[k] == 0 : sphereAABBsKernel[k] == 0) {
+				printf("%s\t(not compiled)\n", batchKernelName[k]);
+				continue;
+			}
+			for (i = 0; i < NUMBER_OF_BATCH_SIZES; i++) {
+				benchmarkBatch(k, batchSizes[i], manySpheres);
+			}
+		}
+	}
 	getchar();
+	return 0;
 }
\ No newline at end of file
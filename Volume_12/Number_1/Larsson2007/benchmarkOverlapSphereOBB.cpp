@@ -9,11 +9,14 @@
 /* History:                                                     */
 /*   2005-12-05: First version of source code created           */
 /*   2006-05-08: Updated code to include SSE overlap test       */
+/*   Added batched (SoA) tests, compiles with GCC and Clang     */
 /*                                                              */
 /****************************************************************/
 
+#ifdef _WIN32
 #define WIN_LEAN_AND_MEAN
 #include <windows.h>
+#endif
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -23,14 +26,62 @@
 #include "rotation.h"
 
 #include "overlapSphereBox.h"
+#include "overlapSphereBoxBatch.h"
 
 #define  NUMBER_OF_METHODS    5
 #define  NUMBER_OF_BV_PAIRS 2000000
 #define  REPETITIONS          10
+#define  NUMBER_OF_BATCH_KERNELS 3
+#define  NUMBER_OF_BATCH_SIZES   5
 
 Sphere3D sphereArray[NUMBER_OF_BV_PAIRS];
 OBox3D    boxArray[NUMBER_OF_BV_PAIRS];
 
+// The same spheres and boxes as structure of arrays, for the batched tests
+float sphereSoA[4][NUMBER_OF_BV_PAIRS]; // c.x, c.y, c.z, r
+float boxSoA[15][NUMBER_OF_BV_PAIRS];   // mid, ext, xaxis, yaxis, zaxis
+int   indexArray[NUMBER_OF_BV_PAIRS];
+
+typedef int (*SphereOBBsKernel)(const Sphere3D &, const OBox3DArray &, int, int *);
+typedef int (*SpheresOBBKernel)(const Sphere3DArray &, int, const OBox3D &, int *);
+
+// Kernels that were not compiled in are 0
+SphereOBBsKernel sphereOBBsKernel[NUMBER_OF_BATCH_KERNELS] = {
+	overlapSphereOBBs_Scalar,
+#if defined(__AVX2__)
+	overlapSphereOBBs_AVX2,
+#else
+	0,
+#endif
+#if defined(__AVX512F__)
+	overlapSphereOBBs_AVX512
+#else
+	0
+#endif
+};
+
+SpheresOBBKernel spheresOBBKernel[NUMBER_OF_BATCH_KERNELS] = {
+	overlapSpheresOBB_Scalar,
+#if defined(__AVX2__)
+	overlapSpheresOBB_AVX2,
+#else
+	0,
+#endif
+#if defined(__AVX512F__)
+	overlapSpheresOBB_AVX512
+#else
+	0
+#endif
+};
+
+char batchKernelName[NUMBER_OF_BATCH_KERNELS][255] = {
+	"Scalar",
+	"AVX2",
+	"AVX512"
+};
+
+int batchSizes[NUMBER_OF_BATCH_SIZES] = { 8, 64, 512, 4096, 32768 };
+
 char algorithmName[NUMBER_OF_METHODS][255] = {
 	"overlapSphereOBB_G_Arvo", 
 	"overlapSphereOBB_QRI", 
@@ -56,10 +107,45 @@ void printResult(char * s, int overlaps, double time)
 	printf("Overlap percentage: %f\n", 100.0f * (float)overlaps / (float) NUMBER_OF_BV_PAIRS);	
 	printf("Total running time: %f\n", time);
 	printf("Average time per overlap test: %.10lf\n", (double)time / NUMBER_OF_BV_PAIRS);
+	printf("Overlap tests per second: %.0f\n", NUMBER_OF_BV_PAIRS / time);
 	printf("\n");
 }
 
-void main(void)
+// Sphere i is tested against the i:th batch of boxes (one vs many), or box i against
+// the i:th batch of spheres (many vs one), until NUMBER_OF_BV_PAIRS tests are done.
+void benchmarkBatch(int kernel, int batchSize, int manySpheres)
+{
+	int i, j, k;
+	int numBatches = NUMBER_OF_BV_PAIRS / batchSize;
+	int overlaps = 0;
+	Timing watch;
+
+	watch.start();
+	for (k = 0; k < REPETITIONS; k++) {
+		for (i = 0; i < numBatches; i++) {
+			int first = i * batchSize;
+			if (manySpheres) {
+				Sphere3DArray spheres = { { sphereSoA[0] + first, sphereSoA[1] + first, sphereSoA[2] + first }, sphereSoA[3] + first };
+				overlaps += spheresOBBKernel[kernel](spheres, batchSize, boxArray[i], indexArray);
+			} else {
+				OBox3DArray boxes;
+				for (j = 0; j < 3; j++) {
+					boxes.mid[j] = boxSoA[j] + first;
+					boxes.ext[j] = boxSoA[3 + j] + first;
+					boxes.xaxis[j] = boxSoA[6 + j] + first;
+					boxes.yaxis[j] = boxSoA[9 + j] + first;
+					boxes.zaxis[j] = boxSoA[12 + j] + first;
+				}
+				overlaps += sphereOBBsKernel[kernel](sphereArray[i], boxes, batchSize, indexArray);
+			}
+		}
+	}
+	double time = watch.stop() / REPETITIONS;
+	printf("%s\t%s\t%d\t%.0f\t%d\n", manySpheres ? "overlapSpheresOBB" : "overlapSphereOBBs",
+		batchKernelName[kernel], batchSize, numBatches * batchSize / time, overlaps / REPETITIONS);
+}
+
+int main(void)
 {
 	int i, k;
 	Timing watch;
@@ -201,6 +287,17 @@ void main(void)
 		v[0] = boxArray[i].zaxis.x; v[1] = boxArray[i].zaxis.y; v[2] = boxArray[i].zaxis.z;
 		mulMatVec(m, v, v);
 		boxArray[i].zaxis.x = v[0]; boxArray[i].zaxis.y = v[1]; boxArray[i].zaxis.z = v[2];
+
+		sphereSoA[0][i] = sphereArray[i].c.x;
+		sphereSoA[1][i] = sphereArray[i].c.y;
+		sphereSoA[2][i] = sphereArray[i].c.z;
+		sphereSoA[3][i] = sphereArray[i].r;
+		const Point3D *p[5] = { &boxArray[i].mid, &boxArray[i].ext, &boxArray[i].xaxis, &boxArray[i].yaxis, &boxArray[i].zaxis };
+		for (k = 0; k < 5; k++) {
+			boxSoA[3 * k + 0][i] = p[k]->x;
+			boxSoA[3 * k + 1][i] = p[k]->y;
+			boxSoA[3 * k + 2][i] = p[k]->z;
+		}
 	}
 
 	/* ==== Method 1 ==== */
@@ -279,6 +376,23 @@ void main(void)
 	int noOverlapsReal = noOverlaps[0];
 	int noOverlapsConservative = noOverlaps[3];
 	printf("False positives reported in conservative test: %.3f percent\n", 100.0f * (noOverlapsConservative - noOverlapsReal) / (float)noOverlapsReal);
+	printf("\n");
+
+	/* ==== Batched tests ==== */
+	printf("=== Batched tests ===\n\n");
+	printf("Function\t\tKernel\tBatch\tTests/s\tOverlaps\n");
+	for (int manySpheres = 0; manySpheres < 2; manySpheres++) {
+		for (k = 0; k < NUMBER_OF_BATCH_KERNELS; k++) {
+			if (manySpheres ? spheresOBBKernel[k] == 0 : sphereOBBsKernel[k] == 0) {
+				printf("%s\t(not compiled)\n", batchKernelName[k]);
+				continue;
+			}
+			for (i = 0; i < NUMBER_OF_BATCH_SIZES; i++) {
+				benchmarkBatch(k, batchSizes[i], manySpheres);
+			}
+		}
+	}
 
 	getchar();
+	return 0;
 }
\ No newline at end of file
@@ -24,31 +24,41 @@
 /* History:                                                      */
 /*   2005-12-05: First version of source code created            */
 /*   2006-05-08: Added SSE versions of the overlap tests         */
+/*   Portable alignment, compiles with GCC and Clang             */
 /*                                                               */
 /*****************************************************************/
 
+#ifndef _OVERLAP_SPHERE_BOX_H
+#define _OVERLAP_SPHERE_BOX_H
+
 #include <xmmintrin.h>
 
+#if defined(_MSC_VER)
+#define ALIGN16 __declspec(align(16))
+#else
+#define ALIGN16 __attribute__((aligned(16)))
+#endif
+
 typedef struct Point3D {
 	float x, y, z;
 } Point3D;
 
 typedef struct Sphere3D {
-	__declspec(align(16)) Point3D c;
+	ALIGN16 Point3D c;
 	float r;
 } Sphere3D;
 
 typedef struct Box3D {
-	__declspec(align(16)) Point3D min;
-	__declspec(align(16)) Point3D max;
+	ALIGN16 Point3D min;
+	ALIGN16 Point3D max;
 } Box3D;
 
 typedef struct OBox3D {
-	__declspec(align(16)) Point3D mid;
-	__declspec(align(16)) Point3D ext;
-	__declspec(align(16)) Point3D xaxis;
-	__declspec(align(16)) Point3D yaxis;
-	__declspec(align(16)) Point3D zaxis;
+	ALIGN16 Point3D mid;
+	ALIGN16 Point3D ext;
+	ALIGN16 Point3D xaxis;
+	ALIGN16 Point3D yaxis;
+	ALIGN16 Point3D zaxis;
 } OBox3D;
 
 inline int overlapSphereAABB_Arvo(const Sphere3D & sphere, const Box3D & box) {
@@ -367,3 +377,5 @@ static bool overlapSphereOBB_SSE(const Sphere3D& sphere, const OBox3D& box)
 	float r = sphere.r;
 	return (p->x + p->y + p->z <= r * r);
 }
+
+#endif
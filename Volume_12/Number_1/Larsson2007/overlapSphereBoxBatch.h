@@ -0,0 +1,489 @@
+/*****************************************************************/
+/* "On Faster Sphere-Box Overlap Testing" by                     */
+/* Thomas Larsson, Tomas Akenine-Moller and Eric Lengyel.        */
+/*                                                               */
+/* Batched Sphere-AABB and Sphere-OBB overlap tests              */
+/*                                                               */
+/* One sphere is tested against many boxes, or many spheres      */
+/* against one box. The many are stored as structure of arrays   */
+/* (Box3DArray, OBox3DArray, Sphere3DArray), and the indices of  */
+/* the overlapping ones are written, in order, to 'indices',     */
+/* which must have room for 'n' elements. The number of          */
+/* overlaps is returned.                                         */
+/*                                                               */
+/* The tests are the same as in overlapSphereAABB_SSE and        */
+/* overlapSphereOBB_SSE, i.e. exact. Each exists as _Scalar,     */
+/* _AVX2 (when compiled with __AVX2__) and _AVX512 (when         */
+/* compiled with __AVX512F__) kernels, testing 1, 8 and 16       */
+/* pairs at a time. The versions without suffix use the widest   */
+/* kernel that was compiled.                                     */
+/*                                                               */
+/* Functions:                                                    */
+/*                                                               */
+/* int overlapSphereAABBs(Sphere3D & sphere,                     */
+/*      Box3DArray & boxes, int n, int * indices);               */
+/* int overlapSphereOBBs(Sphere3D & sphere,                      */
+/*      OBox3DArray & oboxes, int n, int * indices);             */
+/* int overlapSpheresAABB(Sphere3DArray & spheres, int n,        */
+/*      Box3D & box, int * indices);                             */
+/* int overlapSpheresOBB(Sphere3DArray & spheres, int n,         */
+/*      OBox3D & obox, int * indices);                           */
+/*                                                               */
+/*****************************************************************/
+
+#ifndef _OVERLAP_SPHERE_BOX_BATCH_H
+#define _OVERLAP_SPHERE_BOX_BATCH_H
+
+#include "overlapSphereBox.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+typedef struct Sphere3DArray {
+	const float *c[3];
+	const float *r;
+} Sphere3DArray;
+
+typedef struct Box3DArray {
+	const float *min[3];
+	const float *max[3];
+} Box3DArray;
+
+typedef struct OBox3DArray {
+	const float *mid[3];
+	const float *ext[3];
+	const float *xaxis[3];
+	const float *yaxis[3];
+	const float *zaxis[3];
+} OBox3DArray;
+
+inline void getOBox3DArrays(const OBox3DArray & oboxes, const float * arrays[15])
+{
+	for (int k = 0; k < 3; k++) {
+		arrays[k] = oboxes.mid[k];
+		arrays[3 + k] = oboxes.ext[k];
+		arrays[6 + k] = oboxes.xaxis[k];
+		arrays[9 + k] = oboxes.yaxis[k];
+		arrays[12 + k] = oboxes.zaxis[k];
+	}
+}
+
+/* ==== Squared sphere center to box distances, one pair ==== */
+
+inline float distSqrPointAABB(float cx, float cy, float cz,
+	float minx, float miny, float minz, float maxx, float maxy, float maxz)
+{
+	float ex = (minx - cx > 0 ? minx - cx : 0) + (cx - maxx > 0 ? cx - maxx : 0);
+	float ey = (miny - cy > 0 ? miny - cy : 0) + (cy - maxy > 0 ? cy - maxy : 0);
+	float ez = (minz - cz > 0 ? minz - cz : 0) + (cz - maxz > 0 ? cz - maxz : 0);
+	return ex * ex + ey * ey + ez * ez;
+}
+
+inline float distSqrPointOBB(float cx, float cy, float cz, const float mid[3],
+	const float ext[3], const float xaxis[3], const float yaxis[3], const float zaxis[3])
+{
+	float vx = cx - mid[0], vy = cy - mid[1], vz = cz - mid[2];
+	float d, e, dmin = 0;
+
+	d = vx * xaxis[0] + vy * xaxis[1] + vz * xaxis[2];
+	e = (d + ext[0] < 0 ? d + ext[0] : 0) + (d - ext[0] > 0 ? d - ext[0] : 0);
+	dmin += e * e;
+	d = vx * yaxis[0] + vy * yaxis[1] + vz * yaxis[2];
+	e = (d + ext[1] < 0 ? d + ext[1] : 0) + (d - ext[1] > 0 ? d - ext[1] : 0);
+	dmin += e * e;
+	d = vx * zaxis[0] + vy * zaxis[1] + vz * zaxis[2];
+	e = (d + ext[2] < 0 ? d + ext[2] : 0) + (d - ext[2] > 0 ? d - ext[2] : 0);
+	dmin += e * e;
+	return dmin;
+}
+
+/* ==== Scalar kernels ==== */
+
+inline int overlapSphereAABBs_Scalar(const Sphere3D & sphere, const Box3DArray & boxes, int n, int * indices)
+{
+	float r2 = sphere.r * sphere.r;
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		float d = distSqrPointAABB(sphere.c.x, sphere.c.y, sphere.c.z,
+			boxes.min[0][i], boxes.min[1][i], boxes.min[2][i],
+			boxes.max[0][i], boxes.max[1][i], boxes.max[2][i]);
+		indices[count] = i;
+		count += (d <= r2);
+	}
+	return count;
+}
+
+inline int overlapSphereOBBs_Scalar(const Sphere3D & sphere, const OBox3DArray & oboxes, int n, int * indices)
+{
+	float r2 = sphere.r * sphere.r;
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		float mid[3] = { oboxes.mid[0][i], oboxes.mid[1][i], oboxes.mid[2][i] };
+		float ext[3] = { oboxes.ext[0][i], oboxes.ext[1][i], oboxes.ext[2][i] };
+		float xaxis[3] = { oboxes.xaxis[0][i], oboxes.xaxis[1][i], oboxes.xaxis[2][i] };
+		float yaxis[3] = { oboxes.yaxis[0][i], oboxes.yaxis[1][i], oboxes.yaxis[2][i] };
+		float zaxis[3] = { oboxes.zaxis[0][i], oboxes.zaxis[1][i], oboxes.zaxis[2][i] };
+		float d = distSqrPointOBB(sphere.c.x, sphere.c.y, sphere.c.z, mid, ext, xaxis, yaxis, zaxis);
+		indices[count] = i;
+		count += (d <= r2);
+	}
+	return count;
+}
+
+inline int overlapSpheresAABB_Scalar(const Sphere3DArray & spheres, int n, const Box3D & box, int * indices)
+{
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		float d = distSqrPointAABB(spheres.c[0][i], spheres.c[1][i], spheres.c[2][i],
+			box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z);
+		indices[count] = i;
+		count += (d <= spheres.r[i] * spheres.r[i]);
+	}
+	return count;
+}
+
+inline int overlapSpheresOBB_Scalar(const Sphere3DArray & spheres, int n, const OBox3D & obox, int * indices)
+{
+	const float mid[3] = { obox.mid.x, obox.mid.y, obox.mid.z };
+	const float ext[3] = { obox.ext.x, obox.ext.y, obox.ext.z };
+	const float xaxis[3] = { obox.xaxis.x, obox.xaxis.y, obox.xaxis.z };
+	const float yaxis[3] = { obox.yaxis.x, obox.yaxis.y, obox.yaxis.z };
+	const float zaxis[3] = { obox.zaxis.x, obox.zaxis.y, obox.zaxis.z };
+	int count = 0;
+	for (int i = 0; i < n; i++) {
+		float d = distSqrPointOBB(spheres.c[0][i], spheres.c[1][i], spheres.c[2][i],
+			mid, ext, xaxis, yaxis, zaxis);
+		indices[count] = i;
+		count += (d <= spheres.r[i] * spheres.r[i]);
+	}
+	return count;
+}
+
+/* ==== AVX2 kernels, 8 pairs at a time ==== */
+
+#if defined(__AVX2__)
+
+inline __m256 distSqrPointAABB_AVX2(__m256 cx, __m256 cy, __m256 cz,
+	__m256 minx, __m256 miny, __m256 minz, __m256 maxx, __m256 maxy, __m256 maxz)
+{
+	__m256 zero = _mm256_setzero_ps();
+	__m256 ex = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(minx, cx), zero), _mm256_max_ps(_mm256_sub_ps(cx, maxx), zero));
+	__m256 ey = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(miny, cy), zero), _mm256_max_ps(_mm256_sub_ps(cy, maxy), zero));
+	__m256 ez = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(minz, cz), zero), _mm256_max_ps(_mm256_sub_ps(cz, maxz), zero));
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), _mm256_mul_ps(ez, ez));
+}
+
+/* 'obb' holds mid, ext, xaxis, yaxis and zaxis, three components each. */
+inline __m256 distSqrPointOBB_AVX2(__m256 cx, __m256 cy, __m256 cz, const __m256 obb[15])
+{
+	__m256 zero = _mm256_setzero_ps();
+	__m256 vx = _mm256_sub_ps(cx, obb[0]);
+	__m256 vy = _mm256_sub_ps(cy, obb[1]);
+	__m256 vz = _mm256_sub_ps(cz, obb[2]);
+	__m256 dmin = zero;
+	for (int k = 0; k < 3; k++) {
+		const __m256 *axis = obb + 6 + 3 * k;
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, axis[0]), _mm256_mul_ps(vy, axis[1])), _mm256_mul_ps(vz, axis[2]));
+		__m256 e = _mm256_add_ps(_mm256_min_ps(_mm256_add_ps(d, obb[3 + k]), zero), _mm256_max_ps(_mm256_sub_ps(d, obb[3 + k]), zero));
+		dmin = _mm256_add_ps(dmin, _mm256_mul_ps(e, e));
+	}
+	return dmin;
+}
+
+/* Appends base + j to indices for the bits j set in mask, without branching per bit. */
+inline int compactIndices8(int mask, int base, int * indices, int count)
+{
+	if (mask == 0) return count;
+	for (int j = 0; j < 8; j++) {
+		indices[count] = base + j;
+		count += (mask >> j) & 1;
+	}
+	return count;
+}
+
+inline int overlapSphereAABBs_AVX2(const Sphere3D & sphere, const Box3DArray & boxes, int n, int * indices)
+{
+	__m256 cx = _mm256_set1_ps(sphere.c.x);
+	__m256 cy = _mm256_set1_ps(sphere.c.y);
+	__m256 cz = _mm256_set1_ps(sphere.c.z);
+	__m256 r2 = _mm256_set1_ps(sphere.r * sphere.r);
+	int count = 0;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 d = distSqrPointAABB_AVX2(cx, cy, cz,
+			_mm256_loadu_ps(boxes.min[0] + i), _mm256_loadu_ps(boxes.min[1] + i), _mm256_loadu_ps(boxes.min[2] + i),
+			_mm256_loadu_ps(boxes.max[0] + i), _mm256_loadu_ps(boxes.max[1] + i), _mm256_loadu_ps(boxes.max[2] + i));
+		count = compactIndices8(_mm256_movemask_ps(_mm256_cmp_ps(d, r2, _CMP_LE_OQ)), i, indices, count);
+	}
+	Box3DArray tail = boxes;
+	for (int k = 0; k < 3; k++) {
+		tail.min[k] += i;
+		tail.max[k] += i;
+	}
+	int tailCount = overlapSphereAABBs_Scalar(sphere, tail, n - i, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+inline int overlapSphereOBBs_AVX2(const Sphere3D & sphere, const OBox3DArray & oboxes, int n, int * indices)
+{
+	const float *arrays[15];
+	getOBox3DArrays(oboxes, arrays);
+	__m256 cx = _mm256_set1_ps(sphere.c.x);
+	__m256 cy = _mm256_set1_ps(sphere.c.y);
+	__m256 cz = _mm256_set1_ps(sphere.c.z);
+	__m256 r2 = _mm256_set1_ps(sphere.r * sphere.r);
+	__m256 obb[15];
+	int count = 0;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		for (int k = 0; k < 15; k++) obb[k] = _mm256_loadu_ps(arrays[k] + i);
+		__m256 d = distSqrPointOBB_AVX2(cx, cy, cz, obb);
+		count = compactIndices8(_mm256_movemask_ps(_mm256_cmp_ps(d, r2, _CMP_LE_OQ)), i, indices, count);
+	}
+	OBox3DArray tail = oboxes;
+	for (int k = 0; k < 3; k++) {
+		tail.mid[k] += i; tail.ext[k] += i;
+		tail.xaxis[k] += i; tail.yaxis[k] += i; tail.zaxis[k] += i;
+	}
+	int tailCount = overlapSphereOBBs_Scalar(sphere, tail, n - i, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+inline int overlapSpheresAABB_AVX2(const Sphere3DArray & spheres, int n, const Box3D & box, int * indices)
+{
+	__m256 minx = _mm256_set1_ps(box.min.x), miny = _mm256_set1_ps(box.min.y), minz = _mm256_set1_ps(box.min.z);
+	__m256 maxx = _mm256_set1_ps(box.max.x), maxy = _mm256_set1_ps(box.max.y), maxz = _mm256_set1_ps(box.max.z);
+	int count = 0;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 d = distSqrPointAABB_AVX2(_mm256_loadu_ps(spheres.c[0] + i), _mm256_loadu_ps(spheres.c[1] + i),
+			_mm256_loadu_ps(spheres.c[2] + i), minx, miny, minz, maxx, maxy, maxz);
+		__m256 r = _mm256_loadu_ps(spheres.r + i);
+		count = compactIndices8(_mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_mul_ps(r, r), _CMP_LE_OQ)), i, indices, count);
+	}
+	Sphere3DArray tail = spheres;
+	for (int k = 0; k < 3; k++) tail.c[k] += i;
+	tail.r += i;
+	int tailCount = overlapSpheresAABB_Scalar(tail, n - i, box, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+inline int overlapSpheresOBB_AVX2(const Sphere3DArray & spheres, int n, const OBox3D & obox, int * indices)
+{
+	const Point3D *p[5] = { &obox.mid, &obox.ext, &obox.xaxis, &obox.yaxis, &obox.zaxis };
+	__m256 obb[15];
+	for (int k = 0; k < 5; k++) {
+		obb[3 * k + 0] = _mm256_set1_ps(p[k]->x);
+		obb[3 * k + 1] = _mm256_set1_ps(p[k]->y);
+		obb[3 * k + 2] = _mm256_set1_ps(p[k]->z);
+	}
+	int count = 0;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 d = distSqrPointOBB_AVX2(_mm256_loadu_ps(spheres.c[0] + i), _mm256_loadu_ps(spheres.c[1] + i),
+			_mm256_loadu_ps(spheres.c[2] + i), obb);
+		__m256 r = _mm256_loadu_ps(spheres.r + i);
+		count = compactIndices8(_mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_mul_ps(r, r), _CMP_LE_OQ)), i, indices, count);
+	}
+	Sphere3DArray tail = spheres;
+	for (int k = 0; k < 3; k++) tail.c[k] += i;
+	tail.r += i;
+	int tailCount = overlapSpheresOBB_Scalar(tail, n - i, obox, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+#endif // __AVX2__
+
+/* ==== AVX-512 kernels, 16 pairs at a time ==== */
+
+#if defined(__AVX512F__)
+
+inline __m512 distSqrPointAABB_AVX512(__m512 cx, __m512 cy, __m512 cz,
+	__m512 minx, __m512 miny, __m512 minz, __m512 maxx, __m512 maxy, __m512 maxz)
+{
+	__m512 zero = _mm512_setzero_ps();
+	__m512 ex = _mm512_add_ps(_mm512_max_ps(_mm512_sub_ps(minx, cx), zero), _mm512_max_ps(_mm512_sub_ps(cx, maxx), zero));
+	__m512 ey = _mm512_add_ps(_mm512_max_ps(_mm512_sub_ps(miny, cy), zero), _mm512_max_ps(_mm512_sub_ps(cy, maxy), zero));
+	__m512 ez = _mm512_add_ps(_mm512_max_ps(_mm512_sub_ps(minz, cz), zero), _mm512_max_ps(_mm512_sub_ps(cz, maxz), zero));
+	return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ex, ex), _mm512_mul_ps(ey, ey)), _mm512_mul_ps(ez, ez));
+}
+
+/* 'obb' holds mid, ext, xaxis, yaxis and zaxis, three components each. */
+inline __m512 distSqrPointOBB_AVX512(__m512 cx, __m512 cy, __m512 cz, const __m512 obb[15])
+{
+	__m512 zero = _mm512_setzero_ps();
+	__m512 vx = _mm512_sub_ps(cx, obb[0]);
+	__m512 vy = _mm512_sub_ps(cy, obb[1]);
+	__m512 vz = _mm512_sub_ps(cz, obb[2]);
+	__m512 dmin = zero;
+	for (int k = 0; k < 3; k++) {
+		const __m512 *axis = obb + 6 + 3 * k;
+		__m512 d = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(vx, axis[0]), _mm512_mul_ps(vy, axis[1])), _mm512_mul_ps(vz, axis[2]));
+		__m512 e = _mm512_add_ps(_mm512_min_ps(_mm512_add_ps(d, obb[3 + k]), zero), _mm512_max_ps(_mm512_sub_ps(d, obb[3 + k]), zero));
+		dmin = _mm512_add_ps(dmin, _mm512_mul_ps(e, e));
+	}
+	return dmin;
+}
+
+/* Appends base + j to indices for the bits j set in mask. */
+inline int compactIndices16(__mmask16 mask, int base, int * indices, int count)
+{
+	if (mask == 0) return count;
+	__m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	_mm512_mask_compressstoreu_epi32(indices + count, mask, _mm512_add_epi32(_mm512_set1_epi32(base), lanes));
+	unsigned int bits = mask;
+	bits = bits - ((bits >> 1) & 0x5555);
+	bits = (bits & 0x3333) + ((bits >> 2) & 0x3333);
+	bits = (bits + (bits >> 4)) & 0x0F0F;
+	return count + ((bits + (bits >> 8)) & 0x1F);
+}
+
+inline int overlapSphereAABBs_AVX512(const Sphere3D & sphere, const Box3DArray & boxes, int n, int * indices)
+{
+	__m512 cx = _mm512_set1_ps(sphere.c.x);
+	__m512 cy = _mm512_set1_ps(sphere.c.y);
+	__m512 cz = _mm512_set1_ps(sphere.c.z);
+	__m512 r2 = _mm512_set1_ps(sphere.r * sphere.r);
+	int count = 0;
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512 d = distSqrPointAABB_AVX512(cx, cy, cz,
+			_mm512_loadu_ps(boxes.min[0] + i), _mm512_loadu_ps(boxes.min[1] + i), _mm512_loadu_ps(boxes.min[2] + i),
+			_mm512_loadu_ps(boxes.max[0] + i), _mm512_loadu_ps(boxes.max[1] + i), _mm512_loadu_ps(boxes.max[2] + i));
+		count = compactIndices16(_mm512_cmp_ps_mask(d, r2, _CMP_LE_OQ), i, indices, count);
+	}
+	Box3DArray tail = boxes;
+	for (int k = 0; k < 3; k++) {
+		tail.min[k] += i;
+		tail.max[k] += i;
+	}
+	int tailCount = overlapSphereAABBs_Scalar(sphere, tail, n - i, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+inline int overlapSphereOBBs_AVX512(const Sphere3D & sphere, const OBox3DArray & oboxes, int n, int * indices)
+{
+	const float *arrays[15];
+	getOBox3DArrays(oboxes, arrays);
+	__m512 cx = _mm512_set1_ps(sphere.c.x);
+	__m512 cy = _mm512_set1_ps(sphere.c.y);
+	__m512 cz = _mm512_set1_ps(sphere.c.z);
+	__m512 r2 = _mm512_set1_ps(sphere.r * sphere.r);
+	__m512 obb[15];
+	int count = 0;
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		for (int k = 0; k < 15; k++) obb[k] = _mm512_loadu_ps(arrays[k] + i);
+		__m512 d = distSqrPointOBB_AVX512(cx, cy, cz, obb);
+		count = compactIndices16(_mm512_cmp_ps_mask(d, r2, _CMP_LE_OQ), i, indices, count);
+	}
+	OBox3DArray tail = oboxes;
+	for (int k = 0; k < 3; k++) {
+		tail.mid[k] += i; tail.ext[k] += i;
+		tail.xaxis[k] += i; tail.yaxis[k] += i; tail.zaxis[k] += i;
+	}
+	int tailCount = overlapSphereOBBs_Scalar(sphere, tail, n - i, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+inline int overlapSpheresAABB_AVX512(const Sphere3DArray & spheres, int n, const Box3D & box, int * indices)
+{
+	__m512 minx = _mm512_set1_ps(box.min.x), miny = _mm512_set1_ps(box.min.y), minz = _mm512_set1_ps(box.min.z);
+	__m512 maxx = _mm512_set1_ps(box.max.x), maxy = _mm512_set1_ps(box.max.y), maxz = _mm512_set1_ps(box.max.z);
+	int count = 0;
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512 d = distSqrPointAABB_AVX512(_mm512_loadu_ps(spheres.c[0] + i), _mm512_loadu_ps(spheres.c[1] + i),
+			_mm512_loadu_ps(spheres.c[2] + i), minx, miny, minz, maxx, maxy, maxz);
+		__m512 r = _mm512_loadu_ps(spheres.r + i);
+		count = compactIndices16(_mm512_cmp_ps_mask(d, _mm512_mul_ps(r, r), _CMP_LE_OQ), i, indices, count);
+	}
+	Sphere3DArray tail = spheres;
+	for (int k = 0; k < 3; k++) tail.c[k] += i;
+	tail.r += i;
+	int tailCount = overlapSpheresAABB_Scalar(tail, n - i, box, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+inline int overlapSpheresOBB_AVX512(const Sphere3DArray & spheres, int n, const OBox3D & obox, int * indices)
+{
+	const Point3D *p[5] = { &obox.mid, &obox.ext, &obox.xaxis, &obox.yaxis, &obox.zaxis };
+	__m512 obb[15];
+	for (int k = 0; k < 5; k++) {
+		obb[3 * k + 0] = _mm512_set1_ps(p[k]->x);
+		obb[3 * k + 1] = _mm512_set1_ps(p[k]->y);
+		obb[3 * k + 2] = _mm512_set1_ps(p[k]->z);
+	}
+	int count = 0;
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512 d = distSqrPointOBB_AVX512(_mm512_loadu_ps(spheres.c[0] + i), _mm512_loadu_ps(spheres.c[1] + i),
+			_mm512_loadu_ps(spheres.c[2] + i), obb);
+		__m512 r = _mm512_loadu_ps(spheres.r + i);
+		count = compactIndices16(_mm512_cmp_ps_mask(d, _mm512_mul_ps(r, r), _CMP_LE_OQ), i, indices, count);
+	}
+	Sphere3DArray tail = spheres;
+	for (int k = 0; k < 3; k++) tail.c[k] += i;
+	tail.r += i;
+	int tailCount = overlapSpheresOBB_Scalar(tail, n - i, obox, indices + count);
+	for (int j = 0; j < tailCount; j++) indices[count + j] += i;
+	return count + tailCount;
+}
+
+#endif // __AVX512F__
+
+/* ==== Widest compiled kernel ==== */
+
+inline int overlapSphereAABBs(const Sphere3D & sphere, const Box3DArray & boxes, int n, int * indices)
+{
+#if defined(__AVX512F__)
+	return overlapSphereAABBs_AVX512(sphere, boxes, n, indices);
+#elif defined(__AVX2__)
+	return overlapSphereAABBs_AVX2(sphere, boxes, n, indices);
+#else
+	return overlapSphereAABBs_Scalar(sphere, boxes, n, indices);
+#endif
+}
+
+inline int overlapSphereOBBs(const Sphere3D & sphere, const OBox3DArray & oboxes, int n, int * indices)
+{
+#if defined(__AVX512F__)
+	return overlapSphereOBBs_AVX512(sphere, oboxes, n, indices);
+#elif defined(__AVX2__)
+	return overlapSphereOBBs_AVX2(sphere, oboxes, n, indices);
+#else
+	return overlapSphereOBBs_Scalar(sphere, oboxes, n, indices);
+#endif
+}
+
+inline int overlapSpheresAABB(const Sphere3DArray & spheres, int n, const Box3D & box, int * indices)
+{
+#if defined(__AVX512F__)
+	return overlapSpheresAABB_AVX512(spheres, n, box, indices);
+#elif defined(__AVX2__)
+	return overlapSpheresAABB_AVX2(spheres, n, box, indices);
+#else
+	return overlapSpheresAABB_Scalar(spheres, n, box, indices);
+#endif
+}
+
+inline int overlapSpheresOBB(const Sphere3DArray & spheres, int n, const OBox3D & obox, int * indices)
+{
+#if defined(__AVX512F__)
+	return overlapSpheresOBB_AVX512(spheres, n, obox, indices);
+#elif defined(__AVX2__)
+	return overlapSpheresOBB_AVX2(spheres, n, obox, indices);
+#else
+	return overlapSpheresOBB_Scalar(spheres, n, obox, indices);
+#endif
+}
+
+#endif
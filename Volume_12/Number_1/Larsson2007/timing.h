@@ -3,6 +3,8 @@
 #ifndef _TIMING_H
 #define _TIMING_H
 
+#ifdef _WIN32
+
 class Timing {
 	private:
 		BOOL pentClk;				
@@ -63,5 +65,28 @@ class Timing {
 		}
 };
 
+#else
+
+#include <sys/time.h>
+
+class Timing {
+	private:
+		struct timeval clkStart;
+
+	public:
+
+		void start(void) {
+			gettimeofday(&clkStart, 0);
+		}
+
+		// returns time passed in seconds
+		double stop(void) {
+			struct timeval clkStop;
+			gettimeofday(&clkStop, 0);
+			return (double)(clkStop.tv_sec - clkStart.tv_sec) + (clkStop.tv_usec - clkStart.tv_usec) * 1e-6;
+		}
+};
+
 #endif
 
+#endif
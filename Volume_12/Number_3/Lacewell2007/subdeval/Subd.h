@@ -17,7 +17,23 @@ class Subd {
 	 const int* faceverts);
     virtual ~Subd();
     void subdivide(int levels=1);
+    // Replace the positions of the original verts (e.g. for the next frame
+    // of an animation).  The topology must be unchanged: after subdivide(),
+    // the new positions are subdivided by re-applying the stencil tables
+    // built by subdivide(), which is much cheaper than subdividing again.
+    void setBaseVerts(const float* verts);
     bool eval(int faceid, double u, double v, double* p, double* dPdU, double* dPdV);
+
+    // Build flat patch tables (control points, plus eigen basis data near
+    // EVs) for every face.  Afterwards, eval() and evalBatch() only read
+    // the tables and may be called concurrently.  subdivide() discards them.
+    bool prepare();
+    // Evaluate n samples (faceids[i], u[i], v[i]), in parallel when built
+    // with OpenMP.  p, dPdU and dPdV receive 3 doubles per sample.  Calls
+    // prepare() if needed.  Returns false if any sample failed (those are
+    // set to zero).
+    bool evalBatch(int n, const int* faceids, const double* u, const double* v,
+		   double* p, double* dPdU, double* dPdV);
     int nverts();
     int nfaces();
     int nfaceverts();
@@ -26,6 +26,10 @@
 #include <fstream>
 #include <limits>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace neighand {
 
 // This may be useful to specialize on a special float type, like a software implementation or a type with protected FPU flags. See for example the streflop library.
@@ -59,6 +63,11 @@ as to make use of template specialization, and should be inlined too.
 #endif
 #endif
 
+// Minimum number of objects for sorting them with several threads (SortedCells storage, OpenMP builds only)
+#ifndef NEIGHAND_PARALLEL_SORT_MIN
+#define NEIGHAND_PARALLEL_SORT_MIN 16384
+#endif
+
 // Internal data structures
 #include "neighand_structures.hpp"
 
@@ -79,10 +88,21 @@ as to make use of template specialization, and should be inlined too.
                    main region of interest for best performance.
     - layerZ: Reserved for a future extension. Ignored for now.
     - _Allocator: A C++ allocator for getting memory. Defaults to the standard allocator.
+    - storage: How the objects are stored in the cells. Default: LinkedCells.
+               LinkedCells maintains a linked list per cell on each insert/remove/update,
+               which is best when only a few objects move between queries.
+               SortedCells only records the new positions, and sorts all objects into
+               contiguous arrays before the next query (see rebuild). The queries then read
+               the cells sequentially instead of following pointers, which is best when most
+               objects move between the query rounds, like in particle simulations.
 
     Thread safety: All access to this object should be made within the same thread.
+                   With SortedCells and OpenMP, rebuild uses several threads internally.
+                   Exception: after prepareConcurrentQueries, the query functions (PART 3)
+                   may be called concurrently, until the next insert/remove/update/rebuild
+                   or setter call. The batch functions (PART 3b) use this internally.
 */
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ = false, class _Allocator = std::allocator<ObjectProxy<UserObject> > >
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ = false, class _Allocator = std::allocator<ObjectProxy<UserObject> >, CellStorage storage = LinkedCells>
 class NeighborhoodHandler : private _Allocator {
 public:
 COMPILE_TIME_ASSERT(exp2divx>=1)
@@ -159,6 +179,14 @@ typedef _Allocator Allocator;
     // x/y/z:  The new position of the object
     NEIGHAND_INLINE void update(ObjectProxy<UserObject>* proxy, FloatType x, FloatType y, FloatType z) NEIGHAND_ALWAYS_INLINE;
 
+    // SortedCells storage only, no effect otherwise.
+    // Sort the objects into the contiguous cell arrays: counting sort on the cell index,
+    // with the cells in Z-order so that neighbor cells are close in memory.
+    // The queries call it automatically when objects were inserted, removed or moved
+    // since the last sort. Call it yourself after a batch of updates to control when the
+    // cost is paid (ex: once per simulation step, before the query threads start).
+    NEIGHAND_INLINE void rebuild();
+
 
 //// PART 3: Neighborhood query functions
 
@@ -246,6 +274,44 @@ typedef _Allocator Allocator;
     NEIGHAND_INLINE int findNearestNeighbor(FloatType x, FloatType y, FloatType z, FloatType d, NearestNeighbor<UserObject>* neighbor) NEIGHAND_ALWAYS_INLINE;
 
 
+//// PART 3b: Batch queries and updates, multi-threaded with OpenMP (serial otherwise)
+
+    // Bring the internal tables up to date (sort of the SortedCells storage, Auto weights).
+    // The query functions of PART 3 are then read-only and may be called concurrently,
+    // until the next insert/remove/update/rebuild or setter call.
+    // Note: with NEIGHAND_SELECT_METHOD_STAT the counters are then only approximate.
+    NEIGHAND_INLINE void prepareConcurrentQueries();
+
+    // Answer n queries at once, each like the corresponding applyToNeighbors function.
+    // Query i is centered on x[i],y[i],z[i] or on proxies[i] (excluding that proxy object).
+    // f: A functor taking (uint32_t queryIndex, UserObject* object) as arguments.
+    //    It is copied once per thread, and the copies are called concurrently for
+    //    different queries. Write the results for query i in a slot of its own.
+    template<typename Functor> NEIGHAND_INLINE void applyToNeighborsBatch(const FloatType* x, const FloatType* y, const FloatType* z, uint32_t n, FloatType d, Functor f);
+    template<typename Functor> NEIGHAND_INLINE void applyToNeighborsBatch(ObjectProxy<UserObject>** proxies, uint32_t n, FloatType d, Functor f);
+
+    // Answer n nearest neighbors queries at once, like the C API findNearestNeighbors.
+    // neighbors must hold n*N entries: the N slots of query i start at neighbors[i*N].
+    // found[i] receives the number of neighbors found for query i.
+    NEIGHAND_INLINE void findNearestNeighborsBatch(const FloatType* x, const FloatType* y, const FloatType* z, uint32_t n, FloatType d, NearestNeighbor<UserObject>* neighbors, unsigned int N, uint32_t* found);
+    NEIGHAND_INLINE void findNearestNeighborsBatch(ObjectProxy<UserObject>** proxies, uint32_t n, FloatType d, NearestNeighbor<UserObject>* neighbors, unsigned int N, uint32_t* found);
+
+    // Move n objects at once: proxies[i] goes to x[i],y[i],z[i]. A proxy may appear only once.
+    // The new cells are computed in parallel. With LinkedCells the objects that stay in their
+    // cell are updated in parallel too, the others then change cell in the calling thread.
+    // With SortedCells all positions are recorded in parallel, and the next query sorts them.
+    NEIGHAND_INLINE void updateBatch(ObjectProxy<UserObject>** proxies, const FloatType* x, const FloatType* y, const FloatType* z, uint32_t n);
+
+    // Find all the pairs of objects within distance d of each other (self-join).
+    // Each pair is reported once, in no particular order, with its squared distance.
+    // Each cell is joined with the cells of the query sphere at the same distance that
+    // have a higher index, so each pair of cells is visited once.
+    // pairs: one buffer per thread, resized to the number of threads and cleared.
+    //        Each thread appends to its own buffer, without synchronization.
+    // Returns the total number of pairs.
+    NEIGHAND_INLINE uint32_t findAllPairs(FloatType d, std::vector<std::vector<NeighborPair<UserObject> > >& pairs);
+
+
 
 //// PART 4: Helpers and other utilities
 
@@ -294,6 +360,12 @@ protected:
     NEIGHAND_INLINE void removeNoDealloc(ObjectProxy<UserObject>* proxy) NEIGHAND_ALWAYS_INLINE;
     NEIGHAND_INLINE void insertNoAllocate(ObjectProxy<UserObject>* proxy, FloatType x, FloatType y, FloatType z, uint32_t idx) NEIGHAND_ALWAYS_INLINE;
     NEIGHAND_INLINE void updateWeightBaseTables() NEIGHAND_ALWAYS_INLINE;
+    NEIGHAND_INLINE void buildZOrder();
+
+    // findAllPairs helpers: pairs between an object and a cell, two cells, inside a cell
+    NEIGHAND_INLINE void joinObject(FloatType x, FloatType y, FloatType z, UserObject* object, uint32_t cellIndexPacked, FloatType dsq, std::vector<NeighborPair<UserObject> >& pairs) NEIGHAND_ALWAYS_INLINE;
+    NEIGHAND_INLINE void joinCells(uint32_t cellIndexPacked, uint32_t otherCellIndexPacked, FloatType dsq, std::vector<NeighborPair<UserObject> >& pairs) NEIGHAND_ALWAYS_INLINE;
+    NEIGHAND_INLINE void joinCell(uint32_t cellIndexPacked, FloatType dsq, std::vector<NeighborPair<UserObject> >& pairs) NEIGHAND_ALWAYS_INLINE;
 
     // Distance -> sphere cell offsets table lookup
     // indexed by dq, max entries into sphereOffsets array
@@ -332,6 +404,24 @@ protected:
     // Linked list of non-empty cells in the main region
     CellEntry<UserObject>* firstNonEmptyCell;
 
+    // SortedCells storage: x/y/z/object arrays, sorted by cell
+    FloatType* sortedX;
+    FloatType* sortedY;
+    FloatType* sortedZ;
+    UserObject** sortedObjects;
+    uint32_t sortedCapacity;
+    // Range of each cell in these arrays, indexed by packed cell index like cachedLists
+    SortedCellRange* sortedCells;
+    // Packed indices of the non-empty cells in the main region, in Z-order
+    uint32_t* sortedNonEmptyCells;
+    // All packed cell indices in Z-order, with the outside cells last
+    uint32_t* zOrderCells;
+    // Per-thread cell counts for the counting sort
+    uint32_t* sortCounts;
+    int sortThreads;
+    // An object was inserted, removed or moved since the last sort
+    bool rebuildNeeded;
+
     QueryMethod queryMethod;
     FloatType weightSphere, weightCube, weightNonEmpty, weightBrute;
     bool updateWeightBaseTablesNeeded;
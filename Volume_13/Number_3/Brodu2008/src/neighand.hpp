@@ -24,8 +24,8 @@
 
 namespace neighand {
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::NeighborhoodHandler(FloatType minx, FloatType miny, FloatType minz, FloatType cellSize, uint32_t objectInitCapacity, const char* precompFile)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::NeighborhoodHandler(FloatType minx, FloatType miny, FloatType minz, FloatType cellSize, uint32_t objectInitCapacity, const char* precompFile)
 : helper(minx, miny, minz, cellSize)
 {
 
@@ -101,15 +101,68 @@ NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::NeighborhoodHandler(FloatType
     helper.setOutsideCell(&cells[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize-1]);
 
     firstNonEmptyCell = 0; totalNonEmpty = 0;
+
+    // The sorted arrays are only allocated on first use, the cell tables right now
+    sortedX = sortedY = sortedZ = 0;
+    sortedObjects = 0;
+    sortedCapacity = 0;
+    sortedCells = 0;
+    sortedNonEmptyCells = 0;
+    zOrderCells = 0;
+    sortCounts = 0;
+    sortThreads = 0;
+    rebuildNeeded = false;
+    if (storage == SortedCells) {
+        sortedCells = typename Allocator::template rebind<SortedCellRange>::other(*this).allocate(WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize);
+        for (uint_fast32_t i=0; i<WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize; ++i) sortedCells[i].begin = sortedCells[i].end = 0;
+        sortedNonEmptyCells = typename Allocator::template rebind<uint32_t>::other(*this).allocate(WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::MaxVolume);
+        zOrderCells = typename Allocator::template rebind<uint32_t>::other(*this).allocate(WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize);
+        buildZOrder();
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::buildZOrder()
+{
+    // Decode each Morton code into cell coordinates: the code bits are dealt to x, y, z
+    // in turn, skipping a dimension when all its bits are used (unequal exp2div)
+    const uint32_t exp2div[3] = {exp2divx, exp2divy, exp2divz};
+    const uint32_t totalBits = exp2divx + exp2divy + exp2divz;
+    for (uint32_t code = 0; code < WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::MaxVolume; ++code) {
+        uint32_t coord[3] = {0, 0, 0};
+        uint32_t used[3] = {0, 0, 0};
+        uint32_t bit = 0;
+        while (bit < totalBits) for (int dim = 0; dim < 3; ++dim) if (used[dim] < exp2div[dim]) {
+            coord[dim] |= ((code >> bit) & 1) << used[dim];
+            ++used[dim]; ++bit;
+        }
+        // alway same packed index whatever wrapping scheme
+        zOrderCells[code] = coord[0] | (coord[1] << exp2divx) | (coord[2] << (exp2divx+exp2divy));
+    }
+    // dummy and real outside cells, if any, come last
+    for (uint32_t i = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::MaxVolume; i < WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize; ++i) zOrderCells[i] = i;
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::~NeighborhoodHandler()
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::~NeighborhoodHandler()
 {
     Allocator::deallocate(allProxies, proxyCapacity);
     typename Allocator::template rebind<CellEntry<UserObject> >::other(*this).deallocate(cells, WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize);
     typename Allocator::template rebind<ObjectProxy<UserObject> *>::other(*this).deallocate(cachedLists, WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize);
 
+    if (storage == SortedCells) {
+        typename Allocator::template rebind<SortedCellRange>::other(*this).deallocate(sortedCells, WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize);
+        typename Allocator::template rebind<uint32_t>::other(*this).deallocate(sortedNonEmptyCells, WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::MaxVolume);
+        typename Allocator::template rebind<uint32_t>::other(*this).deallocate(zOrderCells, WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize);
+        if (sortCounts) typename Allocator::template rebind<uint32_t>::other(*this).deallocate(sortCounts, sortThreads * WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize);
+        if (sortedCapacity) {
+            typename Allocator::template rebind<FloatType>::other(*this).deallocate(sortedX, sortedCapacity + NEIGHAND_SIMD_PADDING);
+            typename Allocator::template rebind<FloatType>::other(*this).deallocate(sortedY, sortedCapacity + NEIGHAND_SIMD_PADDING);
+            typename Allocator::template rebind<FloatType>::other(*this).deallocate(sortedZ, sortedCapacity + NEIGHAND_SIMD_PADDING);
+            typename Allocator::template rebind<UserObject*>::other(*this).deallocate(sortedObjects, sortedCapacity);
+        }
+    }
+
     for (int shaving = 0; shaving < 64; ++shaving) {
         typename Allocator::template rebind<uint32_t>::other(*this).deallocate(shavingComplement[shaving]-1, MaxDQ+2);
         typename Allocator::template rebind<uint32_t>::other(*this).deallocate(shavingOffsets[shaving]-1, *(shavingOffsets[shaving]-1));
@@ -130,8 +183,8 @@ NEIGHAND_INLINE NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::~NeighborhoodH
 }
 
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::updateWeightBaseTables() {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::updateWeightBaseTables() {
 
     // maintain weighting tables: see neighand_apply.hpp for formula
     // Cube
@@ -180,8 +233,8 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::updateWei
 
 
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::insertNoAllocate(ObjectProxy<UserObject>* proxy, FloatType x, FloatType y, FloatType z, uint32_t idx)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::insertNoAllocate(ObjectProxy<UserObject>* proxy, FloatType x, FloatType y, FloatType z, uint32_t idx)
 {
     CellEntry<UserObject>* cell = &cells[idx];
 
@@ -217,9 +270,9 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::insertNoA
 }
 
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
 template<typename RemapperFunctor>
-NEIGHAND_INLINE ObjectProxy<UserObject>* NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::insert(FloatType x, FloatType y, FloatType z, UserObject* object, RemapperFunctor remapperFunctor)
+NEIGHAND_INLINE ObjectProxy<UserObject>* NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::insert(FloatType x, FloatType y, FloatType z, UserObject* object, RemapperFunctor remapperFunctor)
 {
     // as in std::vector, when reaches capacity must reallocate new space
     // as in std::vector, use twice mem so global behavior is logarithmic in num alloc
@@ -231,6 +284,8 @@ NEIGHAND_INLINE ObjectProxy<UserObject>* NeighborhoodHandler<NEIGHAND_TEMPLATE_A
         // remap user objects to new proxies location
         for (unsigned int i=0; i<numProxies; ++i) {
             remapperFunctor(newAllProxies[i].object, &newAllProxies[i]);
+            // no list in the sorted storage
+            if (storage == SortedCells) continue;
             // translate pointer addresses
             if (newAllProxies[i].next) newAllProxies[i].next += newAllProxies - allProxies;
             if (newAllProxies[i].prev) newAllProxies[i].prev += newAllProxies - allProxies;
@@ -248,7 +303,16 @@ NEIGHAND_INLINE ObjectProxy<UserObject>* NeighborhoodHandler<NEIGHAND_TEMPLATE_A
 
     // call internal routine
     // Find cell for that x/y/z position & call internal insert
-    insertNoAllocate(proxy, x, y, z, helper.getCellIndexForWorldPosition(x, y, z) );
+    if (storage == SortedCells) {
+        proxy->x = x;
+        proxy->y = y;
+        proxy->z = z;
+        proxy->next = proxy->prev = 0;
+        proxy->cellIndex = helper.getCellIndexForWorldPosition(x, y, z);
+        proxy->cell = &cells[proxy->cellIndex];
+        rebuildNeeded = true;
+    }
+    else insertNoAllocate(proxy, x, y, z, helper.getCellIndexForWorldPosition(x, y, z) );
 
     // allow for multiple fast insert/remove, and rebuild the table only once later on if needed by Auto
     updateWeightBaseTablesNeeded = true;
@@ -256,8 +320,8 @@ NEIGHAND_INLINE ObjectProxy<UserObject>* NeighborhoodHandler<NEIGHAND_TEMPLATE_A
     return proxy;
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::removeNoDealloc(ObjectProxy<UserObject>* proxy)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::removeNoDealloc(ObjectProxy<UserObject>* proxy)
 {
     CellEntry<UserObject>* cell = proxy->cell;
 
@@ -286,12 +350,13 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::removeNoD
 
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
 template<typename RemapperFunctor>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::remove(ObjectProxy<UserObject>* proxy, RemapperFunctor remapperFunctor)
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::remove(ObjectProxy<UserObject>* proxy, RemapperFunctor remapperFunctor)
 {
     // internal remove, common with update
-    removeNoDealloc(proxy);
+    if (storage == SortedCells) rebuildNeeded = true;
+    else removeNoDealloc(proxy);
     // and now release the proxy, by moving the end of array one to this location and decreasing array size
     // Note: assumption is that proxy is valid, hence array size >0
     *proxy = allProxies[--numProxies];
@@ -301,6 +366,11 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::remove(Ob
     // the new object at that position is mapped to its new proxy
     remapperFunctor(proxy->object, proxy);
 
+    if (storage == SortedCells) {
+        updateWeightBaseTablesNeeded = true;
+        return;
+    }
+
     // maintain prev/next pointing TO the new location. Thanks double-linked lists.
     if (proxy->next) proxy->next->prev = proxy;
     if (proxy->prev) proxy->prev->next = proxy;
@@ -315,12 +385,23 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::remove(Ob
 }
 
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::update(ObjectProxy<UserObject>* proxy, FloatType x, FloatType y, FloatType z)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::update(ObjectProxy<UserObject>* proxy, FloatType x, FloatType y, FloatType z)
 {
 
     uint32_t idx = helper.getCellIndexForWorldPosition(x, y, z);
 
+    // sorted storage: just record the new position, the arrays are sorted again before the next query
+    if (storage == SortedCells) {
+        proxy->x = x;
+        proxy->y = y;
+        proxy->z = z;
+        proxy->cellIndex = idx;
+        proxy->cell = &cells[idx];
+        rebuildNeeded = true;
+        return;
+    }
+
     // if this is still the same cell index, update x/y/z and done!
     if (idx==proxy->cellIndex) {
         proxy->x = x;
@@ -338,6 +419,112 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::update(Ob
     insertNoAllocate(proxy, x, y, z, idx);
 }
 
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::rebuild()
+{
+    if (storage != SortedCells) return;
+    rebuildNeeded = false;
+
+    const uint32_t arraySize = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize;
+
+    // as in insert, grow the arrays to the proxy capacity when needed
+    if (sortedCapacity < numProxies) {
+        if (sortedCapacity) {
+            typename Allocator::template rebind<FloatType>::other(*this).deallocate(sortedX, sortedCapacity + NEIGHAND_SIMD_PADDING);
+            typename Allocator::template rebind<FloatType>::other(*this).deallocate(sortedY, sortedCapacity + NEIGHAND_SIMD_PADDING);
+            typename Allocator::template rebind<FloatType>::other(*this).deallocate(sortedZ, sortedCapacity + NEIGHAND_SIMD_PADDING);
+            typename Allocator::template rebind<UserObject*>::other(*this).deallocate(sortedObjects, sortedCapacity);
+        }
+        sortedCapacity = proxyCapacity;
+        // The SIMD loops may read a partial block past the last object
+        sortedX = typename Allocator::template rebind<FloatType>::other(*this).allocate(sortedCapacity + NEIGHAND_SIMD_PADDING);
+        sortedY = typename Allocator::template rebind<FloatType>::other(*this).allocate(sortedCapacity + NEIGHAND_SIMD_PADDING);
+        sortedZ = typename Allocator::template rebind<FloatType>::other(*this).allocate(sortedCapacity + NEIGHAND_SIMD_PADDING);
+        for (uint32_t i = sortedCapacity; i < sortedCapacity + NEIGHAND_SIMD_PADDING; ++i) sortedX[i] = sortedY[i] = sortedZ[i] = 0.0f;
+        sortedObjects = typename Allocator::template rebind<UserObject*>::other(*this).allocate(sortedCapacity);
+    }
+
+    // One count array per thread: no contention, and the threads write disjoint slots in the scatter
+    int numThreads = 1;
+#ifdef _OPENMP
+    if (numProxies >= NEIGHAND_PARALLEL_SORT_MIN) numThreads = omp_get_max_threads();
+#endif
+    if (numThreads > sortThreads) {
+        if (sortCounts) typename Allocator::template rebind<uint32_t>::other(*this).deallocate(sortCounts, sortThreads * arraySize);
+        sortThreads = numThreads;
+        sortCounts = typename Allocator::template rebind<uint32_t>::other(*this).allocate(sortThreads * arraySize);
+    }
+
+    uint32_t numNonEmpty = 0;
+    const int32_t n = int32_t(numProxies);
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        uint32_t* count = sortCounts + thread * arraySize;
+        memset(count, 0, arraySize * sizeof(uint32_t));
+
+        // Count the objects of each cell. The static schedule gives each thread the
+        // same chunk of proxies here and in the scatter loop below.
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (int32_t i = 0; i < n; ++i) ++count[allProxies[i].cellIndex];
+
+        // Exclusive prefix sum with the cells in Z-order, and the threads in order within
+        // each cell so the objects keep their relative order. The counts become the write positions.
+#ifdef _OPENMP
+#pragma omp single
+#endif
+        {
+            // the team may be smaller than requested
+            int teamSize = 1;
+#ifdef _OPENMP
+            teamSize = omp_get_num_threads();
+#endif
+            uint32_t position = 0;
+            for (uint32_t z = 0; z < arraySize; ++z) {
+                uint32_t cell = zOrderCells[z];
+                sortedCells[cell].begin = position;
+                for (int t = 0; t < teamSize; ++t) {
+                    uint32_t c = sortCounts[t * arraySize + cell];
+                    sortCounts[t * arraySize + cell] = position;
+                    position += c;
+                }
+                sortedCells[cell].end = position;
+                if ((position != sortedCells[cell].begin) && WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::isInside(cell))
+                    sortedNonEmptyCells[numNonEmpty++] = cell;
+            }
+        }
+        // implicit barrier at the end of single
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (int32_t i = 0; i < n; ++i) {
+            const ObjectProxy<UserObject>& proxy = allProxies[i];
+            uint32_t j = count[proxy.cellIndex]++;
+            sortedX[j] = proxy.x;
+            sortedY[j] = proxy.y;
+            sortedZ[j] = proxy.z;
+            sortedObjects[j] = proxy.object;
+        }
+    }
+
+    totalNonEmpty = numNonEmpty;
+
+    // The helper only checks the outside cell object pointer for emptiness
+    if (WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize > WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::MaxVolume) {
+        const SortedCellRange& outside = sortedCells[arraySize-1];
+        cells[arraySize-1].objects = (outside.end > outside.begin) ? allProxies : 0;
+    }
+}
+
 // Main query routine: apply functor to all neighbors
 // Use separate logical file for maintenance
 #include "neighand_apply.hpp"
@@ -390,14 +577,14 @@ struct ListBuilderAvoid : public ListBuilderNoAvoid<UserObject> {
 }
 
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeighbors(ObjectProxy<UserObject>* p, FloatType d, std::vector<UserObject*>& neighbors)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNeighbors(ObjectProxy<UserObject>* p, FloatType d, std::vector<UserObject*>& neighbors)
 {
     applyToNeighbors(p,d, detail::ListBuilderAvoid<UserObject>(neighbors, p->object));
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, std::vector<UserObject*>& neighbors)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, std::vector<UserObject*>& neighbors)
 {
     applyToNeighbors(x,y,z,d, detail::ListBuilderNoAvoid<UserObject>(neighbors));
 }
@@ -431,10 +618,14 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeigh
 #undef NEIGHAND_C_CALLBACK_API
 
 
+// Batch queries and updates, all pairs self-join
+#include "neighand_batch.hpp"
+
+
 // See neighand_apply for the usage of the tables
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::setWeightSphere(FloatType weight) {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::setWeightSphere(FloatType weight) {
     weightSphere = weight;
     if (updateWeightBaseTablesNeeded) updateWeightBaseTables();
     else {
@@ -445,38 +636,40 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::setWeight
     }
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::setWeightCube(FloatType weight) {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::setWeightCube(FloatType weight) {
     weightCube = weight;
     weightCubeWithLoad = weight * (1.0f + 1.52f * FloatType(numProxies) / FloatType(WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::MaxVolume));
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::setWeightNonEmpty(FloatType weight) {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::setWeightNonEmpty(FloatType weight) {
     weightNonEmpty = weight;
     if (updateWeightBaseTablesNeeded) updateWeightBaseTables();
     else for (unsigned int d32 = 0; d32<=maxWorldDist32; ++d32)
         weightNonEmptyTable[d32] = weight * weightNonEmptyTableBase[d32];
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::setWeightBrute(FloatType weight) {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::setWeightBrute(FloatType weight) {
     weightBrute = weight;
     if (updateWeightBaseTablesNeeded) updateWeightBaseTables();
     else for (unsigned int d32 = 0; d32<=maxWorldDist32; ++d32)
         weightBruteTable[d32] = weight * weightBruteTableBase[d32];
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::setQueryMethod(QueryMethod method) {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::setQueryMethod(QueryMethod method) {
     queryMethod = method;
     if (updateWeightBaseTablesNeeded) updateWeightBaseTables();
 }
 
 
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE QueryMethod NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::getAutoFactors(FloatType x, FloatType y, FloatType z, FloatType d, FloatType& factorSphere, FloatType& factorCube, FloatType& factorNonEmpty, FloatType& factorBrute) {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE QueryMethod NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::getAutoFactors(FloatType x, FloatType y, FloatType z, FloatType d, FloatType& factorSphere, FloatType& factorCube, FloatType& factorNonEmpty, FloatType& factorBrute) {
+
+    if ((storage == SortedCells) && rebuildNeeded) rebuild();
 
     // See neighand_apply.hpp, this is copy/pasted & adapted code
 
@@ -516,8 +709,10 @@ NEIGHAND_INLINE QueryMethod NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::ge
     return method;
 }
 
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE QueryMethod NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::getAutoFactorsClosest(FloatType x, FloatType y, FloatType z, FloatType d, int N, FloatType& factorSphere, FloatType& factorCube, FloatType& factorNonEmpty, FloatType& factorBrute) {
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE QueryMethod NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::getAutoFactorsClosest(FloatType x, FloatType y, FloatType z, FloatType d, int N, FloatType& factorSphere, FloatType& factorCube, FloatType& factorNonEmpty, FloatType& factorBrute) {
+
+    if ((storage == SortedCells) && rebuildNeeded) rebuild();
 
     if (updateWeightBaseTablesNeeded) updateWeightBaseTables();
     FloatType minWeight = weightCubeWithLoad * helper.getInternalParallelepipedVolume(x,y,z,d);
@@ -15,23 +15,23 @@
 #if defined(NEIGHAND_C_CALLBACK_API)
 
 #ifdef NEIGHAND_APPLY_XYZ_API
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyToNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, Callback f, void* userData)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::applyToNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, Callback f, void* userData)
 #else
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyToNeighbors(ObjectProxy<UserObject>* p, FloatType d, Callback f, void* userData)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::applyToNeighbors(ObjectProxy<UserObject>* p, FloatType d, Callback f, void* userData)
 #endif
 
 #else
 
 #ifdef NEIGHAND_APPLY_XYZ_API
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
 template<typename Functor>
-NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyToNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, Functor f)
+NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::applyToNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, Functor f)
 #else
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
 template<typename Functor>
-NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyToNeighbors(ObjectProxy<UserObject>* p, FloatType d, Functor f)
+NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::applyToNeighbors(ObjectProxy<UserObject>* p, FloatType d, Functor f)
 #endif
 
 #endif
@@ -47,6 +47,9 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
 #endif
     FloatType dsq = d*d;
 
+    // sorted storage: sort the objects first if they changed since the last query
+    if ((storage == SortedCells) && rebuildNeeded) rebuild();
+
     // Switch method right now to minimize cost when not using Auto
     // Auto then jumps to the correct label rather than recursing
     switch(queryMethod) {
@@ -220,7 +223,7 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
                         uint32_t offset = *offsetlist++;
                         uint32_t unpackedCell = centerCellIndex + offset;
                         if (WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::isUnpackedOutside(unpackedCell)) continue;
-                        register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell)];
+                        uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell);
                         #define NEIGHAND_APPLY_CHECK_FIRST
                         #include "neighand_apply_processlines_uncond.hpp"
                         #undef NEIGHAND_APPLY_CHECK_FIRST
@@ -233,7 +236,7 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
                     uint32_t offset = *offsetlist++;
                     uint32_t unpackedCell = centerCellIndex + offset;
                     if (WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::isUnpackedOutside(unpackedCell)) continue;
-                    register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell)];
+                    uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell);
                     #define NEIGHAND_APPLY_CHECK_FIRST
                     #include "neighand_apply_processlines_cond.hpp"
                     #undef NEIGHAND_APPLY_CHECK_FIRST
@@ -244,7 +247,7 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
                     uint32_t unpackedCell = centerCellIndex + offset;
                     if (WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::isUnpackedOutside(unpackedCell)) continue;
                     #include "neighand_apply_checkdist.hpp"
-                    register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell)];
+                    uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell);
                     #define NEIGHAND_APPLY_CHECK_FIRST
                     #include "neighand_apply_processlines_cond.hpp"
                     #undef NEIGHAND_APPLY_CHECK_FIRST
@@ -256,17 +259,15 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
                     uint32_t unpackedCell = centerCellIndex + offset;
                     if (WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::isUnpackedOutside(unpackedCell)) continue;
                     #include "neighand_apply_checkdist.hpp"
-                    register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell)];
+                    uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell);
                     #define NEIGHAND_APPLY_CHECK_FIRST
                     #include "neighand_apply_processlines_cond.hpp"
                     #undef NEIGHAND_APPLY_CHECK_FIRST
                 }
 
                 // Run through the external region list only if necessary
-                helper.clearOutsideFlag();
-                helper.flagOutside(x,y,z,d);
-                if (helper.outsideIsFlagged()) {
-                    register ObjectProxy<UserObject>* plist = helper.getExternalRegionObjectList();
+                if (helper.intersectsOutside(x,y,z,d)) {
+                    uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize - 1; // the real outside cell
                     #include "neighand_apply_processlines_cond.hpp"
                 }
 
@@ -290,7 +291,7 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
             for (int_fast32_t cellz = mincellz; cellz <= maxcellz; ++cellz) {
                 for (int_fast32_t celly = mincelly; celly <= maxcelly; ++celly) {
                     for (int_fast32_t cellx = mincellx; cellx <= maxcellx; ++cellx) {
-                        register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::xyzToPackedIndex(cellx,celly,cellz)];
+                        uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::xyzToPackedIndex(cellx,celly,cellz);
                         #define NEIGHAND_APPLY_CHECK_FIRST
                         #include "neighand_apply_processlines_cond.hpp"
                         #undef NEIGHAND_APPLY_CHECK_FIRST
@@ -299,10 +300,8 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
             }
 
             // Run through the external region list only if necessary
-            helper.clearOutsideFlag();
-            helper.flagOutside(x,y,z,d);
-            if (helper.outsideIsFlagged()) {
-                register ObjectProxy<UserObject>* plist = helper.getExternalRegionObjectList();
+            if (helper.intersectsOutside(x,y,z,d)) {
+                uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize - 1; // the real outside cell
                 #include "neighand_apply_processlines_cond.hpp"
             }
 
@@ -326,8 +325,15 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
             FloatType ycs = (y - helper.miny) * helper.cellSizeInv;
             FloatType zcs = (z - helper.minz) * helper.cellSizeInv;
 
-            for (CellEntry<UserObject>* entry = firstNonEmptyCell; entry!=0; entry = entry->nextNonEmpty) {
-                uint32_t cellIndexPacked = entry - cells;
+            // the sorted storage has its own list of non-empty cells, in Z-order
+            CellEntry<UserObject>* entry = firstNonEmptyCell;
+            for (uint32_t nonEmpty = 0; nonEmpty < totalNonEmpty; ++nonEmpty) {
+                uint32_t cellIndexPacked;
+                if (storage == SortedCells) cellIndexPacked = sortedNonEmptyCells[nonEmpty];
+                else {
+                    cellIndexPacked = entry - cells;
+                    entry = entry->nextNonEmpty;
+                }
                 // alway same packed index whatever wrapping scheme
                 uint32_t cx = cellIndexPacked & ((1 << exp2divx) - 1);
                 uint32_t cy = (cellIndexPacked >> exp2divx) & ((1 << exp2divy) - 1);
@@ -347,13 +353,12 @@ NEIGHAND_INLINE Functor NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::applyT
                 // reject cell if it is too far
                 if (dxA+dyA+dzA > dscs) continue;
 
-                register ObjectProxy<UserObject>* plist = entry->objects;
                 #include "neighand_apply_processlines_cond.hpp"
             }
 
             // Run through the external region list if it is non-empty
             if (helper.outsideIsNonEmpty()) {
-                register ObjectProxy<UserObject>* plist = helper.getExternalRegionObjectList();
+                uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize - 1; // the real outside cell
                 #include "neighand_apply_processlines_cond.hpp"
             }
 
@@ -11,6 +11,8 @@
     for potential rejection, in the case of cells that fall partially
     outside the query sphere.
 
+    The cell to process is given by its packed index, cellIndexPacked.
+
     Multiple inclusions were preferred instead of error-prone copy/paste.
 
     Nicolas Brodu, 2006/7
@@ -18,6 +20,54 @@
 */
 
 
+{
+if (storage == SortedCells) {
+    // contiguous range of the cell in the sorted arrays
+    const uint32_t sortedEnd = sortedCells[cellIndexPacked].end;
+#ifdef NEIGHAND_SIMD_WIDTH
+    // NEIGHAND_SIMD_WIDTH distances per block, then the functor on the compacted hits
+    const SimdFloat xs = simdSet1(x), ys = simdSet1(y), zs = simdSet1(z);
+    const SimdFloat dsqBelow = simdSet1(dsq * (1.0f - NEIGHAND_SIMD_MARGIN)), dsqAbove = simdSet1(dsq * (1.0f + NEIGHAND_SIMD_MARGIN));
+    uint32_t hitIndices[NEIGHAND_SIMD_WIDTH];
+    for (uint32_t blockIndex = sortedCells[cellIndexPacked].begin; blockIndex < sortedEnd; blockIndex += NEIGHAND_SIMD_WIDTH) {
+        SimdFloat distances = helper.squaredDistanceSimd(simdSub(xs, simdLoad(sortedX + blockIndex)), simdSub(ys, simdLoad(sortedY + blockIndex)), simdSub(zs, simdLoad(sortedZ + blockIndex)));
+        const uint32_t inside = simdLessEqual(distances, dsqAbove) & simdTailMask(sortedEnd - blockIndex);
+        if (!inside) continue;
+        uint32_t hits = simdLessEqual(distances, dsqBelow) & inside;
+        // the scalar function decides for the few objects right at the limit
+        for (uint32_t limit = inside & ~hits; limit; limit &= limit - 1) {
+            const uint32_t sortedIndex = blockIndex + __builtin_ctz(limit);
+            if (helper.squaredDistance(x-sortedX[sortedIndex], y-sortedY[sortedIndex], z-sortedZ[sortedIndex]) <= dsq) hits |= limit & (0u - limit);
+        }
+        const uint32_t numHits = simdCompactHits(hits, blockIndex, hitIndices);
+        for (uint32_t hit = 0; hit < numHits; ++hit) {
+            const uint32_t sortedIndex = hitIndices[hit];
+#ifndef NEIGHAND_APPLY_XYZ_API
+            if (sortedObjects[sortedIndex]==avoidObject) continue;
+#endif
+#ifdef NEIGHAND_C_CALLBACK_API
+            f(sortedObjects[sortedIndex], userData);
+#else
+            f(sortedObjects[sortedIndex]);
+#endif
+        }
+    }
+#else
+    for (uint32_t sortedIndex = sortedCells[cellIndexPacked].begin; sortedIndex < sortedEnd; ++sortedIndex) {
+        if ((helper.squaredDistance(x-sortedX[sortedIndex], y-sortedY[sortedIndex], z-sortedZ[sortedIndex]) <= dsq)
+#ifndef NEIGHAND_APPLY_XYZ_API
+        && (sortedObjects[sortedIndex]!=avoidObject)
+#endif
+        )
+#ifdef NEIGHAND_C_CALLBACK_API
+        f(sortedObjects[sortedIndex], userData);
+#else
+        f(sortedObjects[sortedIndex]);
+#endif
+    }
+#endif
+} else {
+register ObjectProxy<UserObject>* plist = cachedLists[cellIndexPacked];
 #if defined(NEIGHAND_APPLY_CHECK_FIRST)
 while (plist)
 #else
@@ -39,4 +89,5 @@ do
 #if !defined(NEIGHAND_APPLY_CHECK_FIRST)
 while (plist);
 #endif
-
+}
+}
@@ -11,12 +11,30 @@
     unconditionally, in the case of cells that fall entirely within
     the query sphere.
 
+    The cell to process is given by its packed index, cellIndexPacked.
+
     Multiple inclusions were preferred instead of error-prone copy/paste.
 
     Nicolas Brodu, 2006/7
     Code released according to the GNU LGPL, v2 or above.
 */
 
+{
+if (storage == SortedCells) {
+    // contiguous range of the cell in the sorted arrays
+    const uint32_t sortedEnd = sortedCells[cellIndexPacked].end;
+    for (uint32_t sortedIndex = sortedCells[cellIndexPacked].begin; sortedIndex < sortedEnd; ++sortedIndex) {
+#ifndef NEIGHAND_APPLY_XYZ_API
+        if (sortedObjects[sortedIndex]!=avoidObject)
+#endif
+#ifdef NEIGHAND_C_CALLBACK_API
+        f(sortedObjects[sortedIndex], userData);
+#else
+        f(sortedObjects[sortedIndex]);
+#endif
+    }
+} else {
+register ObjectProxy<UserObject>* plist = cachedLists[cellIndexPacked];
 #ifdef NEIGHAND_APPLY_CHECK_FIRST
 while (plist)
 #else
@@ -36,3 +54,5 @@ do
 #ifndef NEIGHAND_APPLY_CHECK_FIRST
 while (plist);
 #endif
+}
+}
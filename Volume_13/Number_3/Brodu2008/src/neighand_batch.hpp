@@ -0,0 +1,335 @@
+/*
+    Neighand: Neighborhood Handling library
+
+    The goal of this project is to find 3D neighbors efficiently.
+    Read the documentation contained in the article "Query Sphere
+    Indexing for Neighborhood Requests" for details.
+
+    This file defines the batch functions: many queries answered
+    concurrently (read-only phase), many objects moved at once
+    (write phase), and the all pairs within distance self-join.
+    The threads are OpenMP threads, the functions run serially
+    when OpenMP is not enabled.
+
+    Nicolas Brodu, 2006/7
+    Code released according to the GNU LGPL, v2 or above.
+*/
+
+namespace detail {
+
+// Functor to pass the query index to the user functor of the batch queries
+template <typename UserObject, typename Functor>
+struct BatchQueryFunctor {
+    Functor& f;
+    uint32_t query;
+    NEIGHAND_INLINE BatchQueryFunctor(Functor& _f, uint32_t _query) : f(_f), query(_query) {}
+    NEIGHAND_INLINE void operator()(UserObject* object) NEIGHAND_ALWAYS_INLINE {
+        f(query, object);
+    }
+};
+
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::prepareConcurrentQueries()
+{
+    // These are the only writes a query may do
+    if ((storage == SortedCells) && rebuildNeeded) rebuild();
+    if (updateWeightBaseTablesNeeded) updateWeightBaseTables();
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+template<typename Functor>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::applyToNeighborsBatch(const FloatType* x, const FloatType* y, const FloatType* z, uint32_t n, FloatType d, Functor f)
+{
+    prepareConcurrentQueries();
+    const int32_t numQueries = int32_t(n);
+
+    // The query costs vary with the local density: distribute small chunks dynamically
+#ifdef _OPENMP
+#pragma omp parallel for firstprivate(f) schedule(dynamic,64)
+#endif
+    for (int32_t i = 0; i < numQueries; ++i) {
+        applyToNeighbors(x[i], y[i], z[i], d, detail::BatchQueryFunctor<UserObject,Functor>(f, i));
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+template<typename Functor>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::applyToNeighborsBatch(ObjectProxy<UserObject>** proxies, uint32_t n, FloatType d, Functor f)
+{
+    prepareConcurrentQueries();
+    const int32_t numQueries = int32_t(n);
+
+#ifdef _OPENMP
+#pragma omp parallel for firstprivate(f) schedule(dynamic,64)
+#endif
+    for (int32_t i = 0; i < numQueries; ++i) {
+        applyToNeighbors(proxies[i], d, detail::BatchQueryFunctor<UserObject,Functor>(f, i));
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighborsBatch(const FloatType* x, const FloatType* y, const FloatType* z, uint32_t n, FloatType d, NearestNeighbor<UserObject>* neighbors, unsigned int N, uint32_t* found)
+{
+    prepareConcurrentQueries();
+    const int32_t numQueries = int32_t(n);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,64)
+#endif
+    for (int32_t i = 0; i < numQueries; ++i) {
+        // the N==1 version is faster, see findNearestNeighbor
+        if (N==1) found[i] = findNearestNeighbor(x[i], y[i], z[i], d, &neighbors[i]);
+        else found[i] = findNearestNeighbors(x[i], y[i], z[i], d, &neighbors[i*N], N);
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighborsBatch(ObjectProxy<UserObject>** proxies, uint32_t n, FloatType d, NearestNeighbor<UserObject>* neighbors, unsigned int N, uint32_t* found)
+{
+    prepareConcurrentQueries();
+    const int32_t numQueries = int32_t(n);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,64)
+#endif
+    for (int32_t i = 0; i < numQueries; ++i) {
+        if (N==1) found[i] = findNearestNeighbor(proxies[i], d, &neighbors[i]);
+        else found[i] = findNearestNeighbors(proxies[i], d, &neighbors[i*N], N);
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::updateBatch(ObjectProxy<UserObject>** proxies, const FloatType* x, const FloatType* y, const FloatType* z, uint32_t n)
+{
+    const int32_t numUpdates = int32_t(n);
+
+    // sorted storage: only the positions and cells are recorded, see update
+    if (storage == SortedCells) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (int32_t i = 0; i < numUpdates; ++i) {
+            ObjectProxy<UserObject>* proxy = proxies[i];
+            uint32_t idx = helper.getCellIndexForWorldPosition(x[i], y[i], z[i]);
+            proxy->x = x[i];
+            proxy->y = y[i];
+            proxy->z = z[i];
+            proxy->cellIndex = idx;
+            proxy->cell = &cells[idx];
+        }
+        if (n) rebuildNeeded = true;
+        return;
+    }
+
+    // Objects that change cell modify the shared cell lists: collect them per thread,
+    // then move them in the calling thread. The static schedule gives each thread a
+    // contiguous chunk, so the concatenation keeps the order of a serial update.
+    int numThreads = 1;
+#ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+#endif
+    std::vector<std::vector<uint32_t> > movers(numThreads);
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        std::vector<uint32_t>& threadMovers = movers[thread];
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (int32_t i = 0; i < numUpdates; ++i) {
+            ObjectProxy<UserObject>* proxy = proxies[i];
+            uint32_t idx = helper.getCellIndexForWorldPosition(x[i], y[i], z[i]);
+            // same cell: update x/y/z and done, as in update
+            if (idx==proxy->cellIndex) {
+                proxy->x = x[i];
+                proxy->y = y[i];
+                proxy->z = z[i];
+            }
+            else threadMovers.push_back(i);
+        }
+    }
+
+    for (int t = 0; t < numThreads; ++t) {
+        for (typename std::vector<uint32_t>::const_iterator it = movers[t].begin(); it != movers[t].end(); ++it)
+            update(proxies[*it], x[*it], y[*it], z[*it]);
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::joinObject(FloatType x, FloatType y, FloatType z, UserObject* object, uint32_t cellIndexPacked, FloatType dsq, std::vector<NeighborPair<UserObject> >& pairs)
+{
+    NeighborPair<UserObject> pair;
+    pair.first = object;
+    if (storage == SortedCells) {
+        const uint32_t sortedEnd = sortedCells[cellIndexPacked].end;
+        for (uint32_t sortedIndex = sortedCells[cellIndexPacked].begin; sortedIndex < sortedEnd; ++sortedIndex) {
+            pair.squaredDistance = helper.squaredDistance(x-sortedX[sortedIndex], y-sortedY[sortedIndex], z-sortedZ[sortedIndex]);
+            if (pair.squaredDistance > dsq) continue;
+            pair.second = sortedObjects[sortedIndex];
+            pairs.push_back(pair);
+        }
+    } else {
+        for (ObjectProxy<UserObject>* plist = cachedLists[cellIndexPacked]; plist; plist = plist->next) {
+            pair.squaredDistance = helper.squaredDistance(x-plist->x, y-plist->y, z-plist->z);
+            if (pair.squaredDistance > dsq) continue;
+            pair.second = plist->object;
+            pairs.push_back(pair);
+        }
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::joinCells(uint32_t cellIndexPacked, uint32_t otherCellIndexPacked, FloatType dsq, std::vector<NeighborPair<UserObject> >& pairs)
+{
+    if (storage == SortedCells) {
+        // skip empty cells before the loop setup
+        if (sortedCells[otherCellIndexPacked].begin == sortedCells[otherCellIndexPacked].end) return;
+        const uint32_t sortedEnd = sortedCells[cellIndexPacked].end;
+        for (uint32_t sortedIndex = sortedCells[cellIndexPacked].begin; sortedIndex < sortedEnd; ++sortedIndex)
+            joinObject(sortedX[sortedIndex], sortedY[sortedIndex], sortedZ[sortedIndex], sortedObjects[sortedIndex], otherCellIndexPacked, dsq, pairs);
+    } else {
+        if (!cachedLists[otherCellIndexPacked]) return;
+        for (ObjectProxy<UserObject>* plist = cachedLists[cellIndexPacked]; plist; plist = plist->next)
+            joinObject(plist->x, plist->y, plist->z, plist->object, otherCellIndexPacked, dsq, pairs);
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::joinCell(uint32_t cellIndexPacked, FloatType dsq, std::vector<NeighborPair<UserObject> >& pairs)
+{
+    NeighborPair<UserObject> pair;
+    if (storage == SortedCells) {
+        const uint32_t sortedEnd = sortedCells[cellIndexPacked].end;
+        for (uint32_t i = sortedCells[cellIndexPacked].begin; i < sortedEnd; ++i) {
+            pair.first = sortedObjects[i];
+            for (uint32_t j = i + 1; j < sortedEnd; ++j) {
+                pair.squaredDistance = helper.squaredDistance(sortedX[i]-sortedX[j], sortedY[i]-sortedY[j], sortedZ[i]-sortedZ[j]);
+                if (pair.squaredDistance > dsq) continue;
+                pair.second = sortedObjects[j];
+                pairs.push_back(pair);
+            }
+        }
+    } else {
+        for (ObjectProxy<UserObject>* p = cachedLists[cellIndexPacked]; p; p = p->next) {
+            pair.first = p->object;
+            for (ObjectProxy<UserObject>* q = p->next; q; q = q->next) {
+                pair.squaredDistance = helper.squaredDistance(p->x-q->x, p->y-q->y, p->z-q->z);
+                if (pair.squaredDistance > dsq) continue;
+                pair.second = q->object;
+                pairs.push_back(pair);
+            }
+        }
+    }
+}
+
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE uint32_t NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findAllPairs(FloatType d, std::vector<std::vector<NeighborPair<UserObject> > >& pairs)
+{
+    prepareConcurrentQueries();
+
+    int numThreads = 1;
+#ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+#endif
+    pairs.resize(numThreads);
+    for (int t = 0; t < numThreads; ++t) pairs[t].clear();
+
+    FloatType dsq = d*d;
+
+    // Sphere offsets up to the query distance, see neighand_apply.hpp. Two objects closer
+    // than d are in cells at most lastdq apart, and a cell at the same distance appears
+    // only once in the offsets, even in wrapping worlds.
+    FloatType d_cellSpace = d * helper.cellSizeInv;
+    uint32_t lastdq = uint32_t(d_cellSpace*d_cellSpace);
+    if (lastdq>MaxDQ) lastdq = MaxDQ;
+    // skip the center cell, the first offset
+    const uint32_t* firstOffset = &sphereOffsets[1];
+    const uint32_t* endOffset = &sphereOffsets[baseDistanceArray[lastdq]];
+
+    // the non-empty cells of the main region, in no particular order
+    std::vector<uint32_t> linkedNonEmptyCells;
+    const uint32_t* nonEmptyCells = sortedNonEmptyCells;
+    if (storage == LinkedCells) {
+        linkedNonEmptyCells.reserve(totalNonEmpty);
+        for (CellEntry<UserObject>* entry = firstNonEmptyCell; entry; entry = entry->nextNonEmpty)
+            linkedNonEmptyCells.push_back(uint32_t(entry - cells));
+        nonEmptyCells = linkedNonEmptyCells.empty() ? 0 : &linkedNonEmptyCells[0];
+    }
+    const int32_t numNonEmpty = int32_t(totalNonEmpty);
+
+    // Objects in the outside region, if any. The proxies are up to date for both storages.
+    std::vector<ObjectProxy<UserObject>*> outside;
+    if (WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize > WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::MaxVolume) {
+        for (uint32_t i = 0; i < numProxies; ++i)
+            if (allProxies[i].cellIndex == WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize - 1) outside.push_back(&allProxies[i]);
+    }
+    const int32_t numOutside = int32_t(outside.size());
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        std::vector<NeighborPair<UserObject> >& threadPairs = pairs[thread];
+
+        // The cell loads vary, distribute small chunks dynamically
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16) nowait
+#endif
+        for (int32_t i = 0; i < numNonEmpty; ++i) {
+            uint32_t cellIndexPacked = nonEmptyCells[i];
+            joinCell(cellIndexPacked, dsq, threadPairs);
+            uint32_t centerCellIndex = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::unpack(cellIndexPacked);
+            for (const uint32_t* offsetlist = firstOffset; offsetlist < endOffset; ++offsetlist) {
+                uint32_t unpackedCell = centerCellIndex + *offsetlist;
+                if (WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::isUnpackedOutside(unpackedCell)) continue;
+                uint32_t otherCellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell);
+                // the other cell sees this one in its own sphere: keep only one of both
+                if (otherCellIndexPacked <= cellIndexPacked) continue;
+                joinCells(cellIndexPacked, otherCellIndexPacked, dsq, threadPairs);
+            }
+        }
+
+        // Outside objects: Cube method against the main region, then the other outside objects
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16) nowait
+#endif
+        for (int32_t i = 0; i < numOutside; ++i) {
+            ObjectProxy<UserObject>* p = outside[i];
+            int32_t mincellx, mincelly, mincellz, maxcellx, maxcelly, maxcellz;
+            helper.getInternalParallelepiped(mincellx, mincelly, mincellz, maxcellx, maxcelly, maxcellz, p->x, p->y, p->z, d);
+            for (int_fast32_t cellz = mincellz; cellz <= maxcellz; ++cellz) {
+                for (int_fast32_t celly = mincelly; celly <= maxcelly; ++celly) {
+                    for (int_fast32_t cellx = mincellx; cellx <= maxcellx; ++cellx) {
+                        joinObject(p->x, p->y, p->z, p->object, WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::xyzToPackedIndex(cellx,celly,cellz), dsq, threadPairs);
+                    }
+                }
+            }
+            NeighborPair<UserObject> pair;
+            pair.first = p->object;
+            for (int32_t j = i + 1; j < numOutside; ++j) {
+                ObjectProxy<UserObject>* q = outside[j];
+                pair.squaredDistance = helper.squaredDistance(p->x-q->x, p->y-q->y, p->z-q->z);
+                if (pair.squaredDistance > dsq) continue;
+                pair.second = q->object;
+                threadPairs.push_back(pair);
+            }
+        }
+    }
+
+    uint32_t total = 0;
+    for (int t = 0; t < numThreads; ++t) total += pairs[t].size();
+    return total;
+}
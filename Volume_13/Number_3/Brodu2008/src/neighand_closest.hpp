@@ -15,15 +15,15 @@
 #ifdef NEIGHAND_APPLY_XYZ_API
 
 #if defined(NEIGHAND_CLOSEST_N_EQ_1)
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNearestNeighbor(FloatType x, FloatType y, FloatType z, FloatType d, NearestNeighbor<UserObject>* neighbor)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighbor(FloatType x, FloatType y, FloatType z, FloatType d, NearestNeighbor<UserObject>* neighbor)
 #else
 #if defined(NEIGHAND_C_CALLBACK_API)
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNearestNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, NearestNeighbor<UserObject>* neighbor, unsigned int N)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, NearestNeighbor<UserObject>* neighbor, unsigned int N)
 #else
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNearestNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, std::vector<NearestNeighbor<UserObject> >& neighbor, unsigned int N)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighbors(FloatType x, FloatType y, FloatType z, FloatType d, std::vector<NearestNeighbor<UserObject> >& neighbor, unsigned int N)
 #endif
 #endif
 
@@ -31,15 +31,15 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
 #else
 
 #if defined(NEIGHAND_CLOSEST_N_EQ_1)
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNearestNeighbor(ObjectProxy<UserObject>* p, FloatType d, NearestNeighbor<UserObject>* neighbor)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighbor(ObjectProxy<UserObject>* p, FloatType d, NearestNeighbor<UserObject>* neighbor)
 #else
 #if defined(NEIGHAND_C_CALLBACK_API)
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNearestNeighbors(ObjectProxy<UserObject>* p, FloatType d, NearestNeighbor<UserObject>* neighbor, unsigned int N)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE int NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighbors(ObjectProxy<UserObject>* p, FloatType d, NearestNeighbor<UserObject>* neighbor, unsigned int N)
 #else
-template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator>
-NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNearestNeighbors(ObjectProxy<UserObject>* p, FloatType d, std::vector<NearestNeighbor<UserObject> >& neighbor, unsigned int N)
+template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator, CellStorage storage>
+NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS,storage>::findNearestNeighbors(ObjectProxy<UserObject>* p, FloatType d, std::vector<NearestNeighbor<UserObject> >& neighbor, unsigned int N)
 #endif
 #endif
 
@@ -56,6 +56,9 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
 #endif
     FloatType dsq = d*d;
 
+    // sorted storage: sort the objects first if they changed since the last query
+    if ((storage == SortedCells) && rebuildNeeded) rebuild();
+
 #if defined(NEIGHAND_CLOSEST_N_EQ_1)
     // Initialize dist with max query distance
     FloatType neighborSquaredDistance = dsq;
@@ -229,7 +232,7 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
                         #include "neighand_apply_checkdist.hpp"
                     }
 
-                    register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell)];
+                    uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell);
 
                     #define NEIGHAND_CLOSEST_CHECK_FIRST
                     #include "neighand_closest_processlines.hpp"
@@ -273,7 +276,7 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
                         #include "neighand_apply_checkdist.hpp"
                     }
 
-                    register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell)];
+                    uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::packwrap(unpackedCell);
 
                     #define NEIGHAND_CLOSEST_CHECK_FIRST
                     #include "neighand_closest_processlines.hpp"
@@ -310,7 +313,7 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
 #endif
                 )) {
                     // Region is not empty at this point
-                    register ObjectProxy<UserObject>* plist = helper.getExternalRegionObjectList();
+                    uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize - 1; // the real outside cell
                     #include "neighand_closest_processlines.hpp"
                 }
 
@@ -341,7 +344,7 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
             for (int_fast32_t cellz = mincellz; cellz <= maxcellz; ++cellz) {
                 for (int_fast32_t celly = mincelly; celly <= maxcelly; ++celly) {
                     for (int_fast32_t cellx = mincellx; cellx <= maxcellx; ++cellx) {
-                        register ObjectProxy<UserObject>* plist = cachedLists[WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::xyzToPackedIndex(cellx,celly,cellz)];
+                        uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::xyzToPackedIndex(cellx,celly,cellz);
                         #define NEIGHAND_CLOSEST_CHECK_FIRST
                         #include "neighand_closest_processlines.hpp"
                         #undef NEIGHAND_CLOSEST_CHECK_FIRST
@@ -349,10 +352,8 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
                 }
             }
 
-            helper.clearOutsideFlag();
-            helper.flagOutside(x,y,z,d);
-            if (helper.outsideIsFlagged()) {
-                ObjectProxy<UserObject>* plist = helper.getExternalRegionObjectList();
+            if (helper.intersectsOutside(x,y,z,d)) {
+                uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize - 1; // the real outside cell
                 #include "neighand_closest_processlines.hpp"
             }
 
@@ -381,8 +382,15 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
             FloatType ycs = (y - helper.miny) * helper.cellSizeInv;
             FloatType zcs = (z - helper.minz) * helper.cellSizeInv;
 
-            for (CellEntry<UserObject>* entry = firstNonEmptyCell; entry!=0; entry = entry->nextNonEmpty) {
-                uint32_t cellIndexPacked = entry - cells;
+            // the sorted storage has its own list of non-empty cells, in Z-order
+            CellEntry<UserObject>* entry = firstNonEmptyCell;
+            for (uint32_t nonEmpty = 0; nonEmpty < totalNonEmpty; ++nonEmpty) {
+                uint32_t cellIndexPacked;
+                if (storage == SortedCells) cellIndexPacked = sortedNonEmptyCells[nonEmpty];
+                else {
+                    cellIndexPacked = entry - cells;
+                    entry = entry->nextNonEmpty;
+                }
                 // alway same packed index whatever wrapping scheme
                 uint32_t cx = cellIndexPacked & ((1 << exp2divx) - 1);
                 uint32_t cy = (cellIndexPacked >> exp2divx) & ((1 << exp2divy) - 1);
@@ -402,13 +410,12 @@ NEIGHAND_INLINE void NeighborhoodHandler<NEIGHAND_TEMPLATE_ARGUMENTS>::findNeare
                 // reject cell if it is too far
                 if (dxA+dyA+dzA > dscs) continue;
 
-                register ObjectProxy<UserObject>* plist = entry->objects;
                 #include "neighand_closest_processlines.hpp"
             }
 
             // Run through the external region list if it is non-empty
             if (helper.outsideIsNonEmpty()) {
-                register ObjectProxy<UserObject>* plist = helper.getExternalRegionObjectList();
+                uint_fast32_t cellIndexPacked = WrapHelper<NEIGHAND_TEMPLATE_ARGUMENTS>::ArraySize - 1; // the real outside cell
                 #include "neighand_closest_processlines.hpp"
             }
 
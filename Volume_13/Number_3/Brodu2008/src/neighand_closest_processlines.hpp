@@ -8,6 +8,8 @@
     This file defines a block of code for the processing of one cell,
     in the routine for finding only the N nearest neighbors.
 
+    The cell to process is given by its packed index, cellIndexPacked.
+
     Multiple inclusions were preferred instead of error-prone copy/paste.
 
     Nicolas Brodu, 2006/7
@@ -16,7 +18,49 @@
 
 
 // Case where N==1 is optimized compared to N>1 => different implementation
+{
 #if defined(NEIGHAND_CLOSEST_N_EQ_1)
+if (storage == SortedCells) {
+    // contiguous range of the cell in the sorted arrays
+    const uint32_t sortedEnd = sortedCells[cellIndexPacked].end;
+#ifdef NEIGHAND_SIMD_WIDTH
+    // The blocks only reject the objects that are too far, with a margin.
+    // The few candidates left are handled in order as the scalar loop does, the limit shrinks meanwhile.
+    const SimdFloat xs = simdSet1(x), ys = simdSet1(y), zs = simdSet1(z);
+    uint32_t hitIndices[NEIGHAND_SIMD_WIDTH];
+    for (uint32_t blockIndex = sortedCells[cellIndexPacked].begin; blockIndex < sortedEnd; blockIndex += NEIGHAND_SIMD_WIDTH) {
+        SimdFloat distances = helper.squaredDistanceSimd(simdSub(simdLoad(sortedX + blockIndex), xs), simdSub(simdLoad(sortedY + blockIndex), ys), simdSub(simdLoad(sortedZ + blockIndex), zs));
+        uint32_t hits = simdLessEqual(distances, simdSet1(neighborSquaredDistance * (1.0f + NEIGHAND_SIMD_MARGIN))) & simdTailMask(sortedEnd - blockIndex);
+        if (!hits) continue;
+        const uint32_t numHits = simdCompactHits(hits, blockIndex, hitIndices);
+        for (uint32_t hit = 0; hit < numHits; ++hit) {
+            const uint32_t sortedIndex = hitIndices[hit];
+            FloatType dist = helper.squaredDistance(sortedX[sortedIndex] - x, sortedY[sortedIndex] - y, sortedZ[sortedIndex] - z);
+            if ((dist<=neighborSquaredDistance)
+#ifndef NEIGHAND_APPLY_XYZ_API
+            && (sortedObjects[sortedIndex]!=avoidObject)
+#endif
+            ) {
+                neighborSquaredDistance = dist;
+                neighborObject = sortedObjects[sortedIndex];
+            }
+        }
+    }
+#else
+    for (uint32_t sortedIndex = sortedCells[cellIndexPacked].begin; sortedIndex < sortedEnd; ++sortedIndex) {
+        FloatType dist = helper.squaredDistance(sortedX[sortedIndex] - x, sortedY[sortedIndex] - y, sortedZ[sortedIndex] - z);
+        if ((dist<=neighborSquaredDistance)
+#ifndef NEIGHAND_APPLY_XYZ_API
+        && (sortedObjects[sortedIndex]!=avoidObject)
+#endif
+        ) {
+            neighborSquaredDistance = dist;
+            neighborObject = sortedObjects[sortedIndex];
+        }
+    }
+#endif
+} else {
+register ObjectProxy<UserObject>* plist = cachedLists[cellIndexPacked];
 #if defined(NEIGHAND_CLOSEST_CHECK_FIRST)
 while (plist)
 #else
@@ -37,9 +81,57 @@ do
 #if !defined(NEIGHAND_CLOSEST_CHECK_FIRST)
 while (plist);
 #endif
+}
 
 #else
 NearestNeighbor<UserObject> currentObject;
+if (storage == SortedCells) {
+    // contiguous range of the cell in the sorted arrays
+    const uint32_t sortedEnd = sortedCells[cellIndexPacked].end;
+#ifdef NEIGHAND_SIMD_WIDTH
+    const SimdFloat xs = simdSet1(x), ys = simdSet1(y), zs = simdSet1(z);
+    uint32_t hitIndices[NEIGHAND_SIMD_WIDTH];
+    for (uint32_t blockIndex = sortedCells[cellIndexPacked].begin; blockIndex < sortedEnd; blockIndex += NEIGHAND_SIMD_WIDTH) {
+        SimdFloat distances = helper.squaredDistanceSimd(simdSub(simdLoad(sortedX + blockIndex), xs), simdSub(simdLoad(sortedY + blockIndex), ys), simdSub(simdLoad(sortedZ + blockIndex), zs));
+        uint32_t hits = simdLessEqual(distances, simdSet1(dsq * (1.0f + NEIGHAND_SIMD_MARGIN))) & simdTailMask(sortedEnd - blockIndex);
+        if (!hits) continue;
+        const uint32_t numHits = simdCompactHits(hits, blockIndex, hitIndices);
+        for (uint32_t hit = 0; hit < numHits; ++hit) {
+        const uint32_t sortedIndex = hitIndices[hit];
+        currentObject.squaredDistance = helper.squaredDistance(sortedX[sortedIndex] - x, sortedY[sortedIndex] - y, sortedZ[sortedIndex] - z);
+        currentObject.object = sortedObjects[sortedIndex];
+#else
+    for (uint32_t sortedIndex = sortedCells[cellIndexPacked].begin; sortedIndex < sortedEnd; ++sortedIndex) {
+        currentObject.squaredDistance = helper.squaredDistance(sortedX[sortedIndex] - x, sortedY[sortedIndex] - y, sortedZ[sortedIndex] - z);
+        currentObject.object = sortedObjects[sortedIndex];
+#endif
+        if ((currentObject.squaredDistance<=dsq)
+#ifndef NEIGHAND_APPLY_XYZ_API
+        && (currentObject.object!=avoidObject)
+#endif
+        ){
+            uint_fast32_t i=0;
+#if defined(NEIGHAND_CLOSEST_CHECK_FOR_DUPS)
+            for (uint_fast32_t j=0; j<nfound; ++j) if (neighbor[j].object==currentObject.object) {
+                i=N; break;
+            }
+            if ((i==0) && (++nfound>N)) nfound=N;
+#else
+            if (++nfound>N) nfound=N;
+#endif
+            for (; i<nfound; ++i) if (currentObject.squaredDistance < neighbor[i].squaredDistance) {
+                NearestNeighbor<UserObject> tmp = neighbor[i];
+                neighbor[i] = currentObject;
+                currentObject = tmp;
+            }
+            if (nfound==N) dsq = neighbor[N-1].squaredDistance;
+        }
+#ifdef NEIGHAND_SIMD_WIDTH
+        }
+#endif
+    }
+} else {
+register ObjectProxy<UserObject>* plist = cachedLists[cellIndexPacked];
 #if defined(NEIGHAND_CLOSEST_CHECK_FIRST)
 while (plist)
 #else
@@ -79,5 +171,7 @@ do
 #if !defined(NEIGHAND_CLOSEST_CHECK_FIRST)
 while (plist);
 #endif
+}
 
 #endif
+}
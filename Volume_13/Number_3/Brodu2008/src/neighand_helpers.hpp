@@ -94,6 +94,9 @@ NEIGHAND_INLINE FloatType fastFloor(FloatConverter f) {
 template <typename UserObject, int exp2divx, int exp2divy, int exp2divz, bool wrapX, bool wrapY, bool wrapZ, bool layerZ, class _Allocator >
 struct WrapHelper {};
 
+// SIMD primitives for the wrap helpers, if the target supports them
+#include "neighand_simd.hpp"
+
 // Specializations
 #include "neighand_wraphelper_tttf.hpp"
 #include "neighand_wraphelper_ffff.hpp"
@@ -0,0 +1,164 @@
+/*
+    Neighand: Neighborhood Handling library
+
+    The goal of this project is to find 3D neighbors efficiently.
+    Read the documentation contained in the article "Query Sphere
+    Indexing for Neighborhood Requests" for details.
+
+    This file defines the SIMD primitives used by the SortedCells
+    storage to test NEIGHAND_SIMD_WIDTH objects at once against the
+    query distance: 16 with AVX-512, 8 with AVX2, depending on the
+    compiler target options (ex: -mavx2 or -mavx512f).
+    Define NEIGHAND_NO_SIMD to use the scalar loops anyway.
+
+    The wrap helpers build their squaredDistanceSimd functions on these,
+    with the same operations in the same order as the scalar version.
+
+    Nicolas Brodu, 2006/7
+    Code released according to the GNU LGPL, v2 or above.
+*/
+
+#ifndef NEIGHAND_SIMD_HPP
+#define NEIGHAND_SIMD_HPP
+
+#if !defined(NEIGHAND_NO_SIMD) && (defined(__AVX512F__) || defined(__AVX2__))
+
+#include <immintrin.h>
+
+#if defined(__AVX512F__)
+
+#define NEIGHAND_SIMD_WIDTH 16
+typedef __m512 SimdFloat;
+typedef __m512i SimdInt;
+
+NEIGHAND_INLINE SimdFloat simdLoad(const FloatType* p) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdLoad(const FloatType* p) {return _mm512_loadu_ps(p);}
+NEIGHAND_INLINE SimdFloat simdSet1(FloatType a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdSet1(FloatType a) {return _mm512_set1_ps(a);}
+NEIGHAND_INLINE SimdFloat simdAdd(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdAdd(SimdFloat a, SimdFloat b) {return _mm512_add_ps(a, b);}
+NEIGHAND_INLINE SimdFloat simdSub(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdSub(SimdFloat a, SimdFloat b) {return _mm512_sub_ps(a, b);}
+NEIGHAND_INLINE SimdFloat simdMul(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdMul(SimdFloat a, SimdFloat b) {return _mm512_mul_ps(a, b);}
+// One bit per lane, set where a<=b
+NEIGHAND_INLINE uint32_t simdLessEqual(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE uint32_t simdLessEqual(SimdFloat a, SimdFloat b) {return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ);}
+
+// Integer lane operations for fastExp2RemSimd
+NEIGHAND_INLINE SimdInt simdAsInt(SimdFloat a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdAsInt(SimdFloat a) {return _mm512_castps_si512(a);}
+NEIGHAND_INLINE SimdFloat simdAsFloat(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdAsFloat(SimdInt a) {return _mm512_castsi512_ps(a);}
+NEIGHAND_INLINE SimdInt simdSet1Int(uint32_t a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdSet1Int(uint32_t a) {return _mm512_set1_epi32(a);}
+NEIGHAND_INLINE SimdInt simdAndInt(SimdInt a, SimdInt b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdAndInt(SimdInt a, SimdInt b) {return _mm512_and_si512(a, b);}
+NEIGHAND_INLINE SimdInt simdOrInt(SimdInt a, SimdInt b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdOrInt(SimdInt a, SimdInt b) {return _mm512_or_si512(a, b);}
+NEIGHAND_INLINE SimdInt simdSubInt(SimdInt a, SimdInt b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdSubInt(SimdInt a, SimdInt b) {return _mm512_sub_epi32(a, b);}
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftLeftInt(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftLeftInt(SimdInt a) {return _mm512_slli_epi32(a, shift);}
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftRightInt(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftRightInt(SimdInt a) {return _mm512_srli_epi32(a, shift);}
+// C truncation to int, and back to float
+NEIGHAND_INLINE SimdInt simdTruncate(SimdFloat a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdTruncate(SimdFloat a) {return _mm512_cvttps_epi32(a);}
+NEIGHAND_INLINE SimdFloat simdIntToFloat(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdIntToFloat(SimdInt a) {return _mm512_cvtepi32_ps(a);}
+
+// Write the indices base+lane of the lanes set in hits, in order, and return how many
+NEIGHAND_INLINE uint32_t simdCompactHits(uint32_t hits, uint32_t base, uint32_t* indices) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE uint32_t simdCompactHits(uint32_t hits, uint32_t base, uint32_t* indices) {
+    const __m512i lanes = _mm512_set_epi32(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+    _mm512_mask_compressstoreu_epi32(indices, __mmask16(hits), _mm512_add_epi32(lanes, _mm512_set1_epi32(base)));
+    return __builtin_popcount(hits);
+}
+
+#else // AVX2
+
+#define NEIGHAND_SIMD_WIDTH 8
+typedef __m256 SimdFloat;
+typedef __m256i SimdInt;
+
+NEIGHAND_INLINE SimdFloat simdLoad(const FloatType* p) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdLoad(const FloatType* p) {return _mm256_loadu_ps(p);}
+NEIGHAND_INLINE SimdFloat simdSet1(FloatType a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdSet1(FloatType a) {return _mm256_set1_ps(a);}
+NEIGHAND_INLINE SimdFloat simdAdd(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdAdd(SimdFloat a, SimdFloat b) {return _mm256_add_ps(a, b);}
+NEIGHAND_INLINE SimdFloat simdSub(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdSub(SimdFloat a, SimdFloat b) {return _mm256_sub_ps(a, b);}
+NEIGHAND_INLINE SimdFloat simdMul(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdMul(SimdFloat a, SimdFloat b) {return _mm256_mul_ps(a, b);}
+NEIGHAND_INLINE uint32_t simdLessEqual(SimdFloat a, SimdFloat b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE uint32_t simdLessEqual(SimdFloat a, SimdFloat b) {return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ));}
+
+NEIGHAND_INLINE SimdInt simdAsInt(SimdFloat a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdAsInt(SimdFloat a) {return _mm256_castps_si256(a);}
+NEIGHAND_INLINE SimdFloat simdAsFloat(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdAsFloat(SimdInt a) {return _mm256_castsi256_ps(a);}
+NEIGHAND_INLINE SimdInt simdSet1Int(uint32_t a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdSet1Int(uint32_t a) {return _mm256_set1_epi32(a);}
+NEIGHAND_INLINE SimdInt simdAndInt(SimdInt a, SimdInt b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdAndInt(SimdInt a, SimdInt b) {return _mm256_and_si256(a, b);}
+NEIGHAND_INLINE SimdInt simdOrInt(SimdInt a, SimdInt b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdOrInt(SimdInt a, SimdInt b) {return _mm256_or_si256(a, b);}
+NEIGHAND_INLINE SimdInt simdSubInt(SimdInt a, SimdInt b) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdSubInt(SimdInt a, SimdInt b) {return _mm256_sub_epi32(a, b);}
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftLeftInt(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftLeftInt(SimdInt a) {return _mm256_slli_epi32(a, shift);}
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftRightInt(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+template <int shift> NEIGHAND_INLINE SimdInt simdShiftRightInt(SimdInt a) {return _mm256_srli_epi32(a, shift);}
+NEIGHAND_INLINE SimdInt simdTruncate(SimdFloat a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdInt simdTruncate(SimdFloat a) {return _mm256_cvttps_epi32(a);}
+NEIGHAND_INLINE SimdFloat simdIntToFloat(SimdInt a) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE SimdFloat simdIntToFloat(SimdInt a) {return _mm256_cvtepi32_ps(a);}
+
+// No compress instruction before AVX-512: one bit scan per hit
+NEIGHAND_INLINE uint32_t simdCompactHits(uint32_t hits, uint32_t base, uint32_t* indices) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE uint32_t simdCompactHits(uint32_t hits, uint32_t base, uint32_t* indices) {
+    uint32_t numHits = 0;
+    while (hits) {
+        indices[numHits++] = base + __builtin_ctz(hits);
+        hits &= hits - 1;
+    }
+    return numHits;
+}
+
+#endif
+
+// Lanes [0, count) when fewer than NEIGHAND_SIMD_WIDTH objects remain
+NEIGHAND_INLINE uint32_t simdTailMask(uint32_t count) NEIGHAND_ALWAYS_INLINE;
+NEIGHAND_INLINE uint32_t simdTailMask(uint32_t count) {
+    return (count >= NEIGHAND_SIMD_WIDTH) ? ((1u << NEIGHAND_SIMD_WIDTH) - 1) : ((1u << count) - 1);
+}
+
+// fastExp2Rem from neighand_helpers.hpp, on all lanes. Same operations, same results.
+template <int exp2> NEIGHAND_INLINE SimdFloat fastExp2RemSimd(SimdFloat x) NEIGHAND_ALWAYS_INLINE;
+template <int exp2> NEIGHAND_INLINE SimdFloat fastExp2RemSimd(SimdFloat x) {
+    SimdInt xi = simdAsInt(x);
+    SimdInt exp2Shifted = simdSet1Int(exp2<<23);
+    // subnormal mask: the sign of the exponent subtraction, minus one
+    SimdInt normalMask = simdSubInt(simdShiftRightInt<31>(simdSubInt(simdAndInt(xi, simdSet1Int(0x7f800000)), exp2Shifted)), simdSet1Int(1));
+    SimdFloat xOver2exp2 = simdAsFloat(simdAndInt(simdSubInt(xi, exp2Shifted), normalMask));
+    SimdFloat half = simdAsFloat(simdOrInt(simdAndInt(xi, simdSet1Int(0x80000000)), simdSet1Int(0x3F000000)));
+    return simdSub(x, simdIntToFloat(simdShiftLeftInt<exp2>(simdTruncate(simdAdd(xOver2exp2, half)))));
+}
+
+// The compiler may contract the scalar squaredDistance into FMAs differently than
+// the SIMD version, a few ULPs apart. Lanes within this relative margin of the
+// query distance are checked again with the scalar function so both give the same lists.
+#define NEIGHAND_SIMD_MARGIN 9.5367431640625e-07f
+
+// The SortedCells arrays are padded so the last block of a cell may be read past the end
+#define NEIGHAND_SIMD_PADDING (NEIGHAND_SIMD_WIDTH - 1)
+
+#else
+
+#define NEIGHAND_SIMD_PADDING 0
+
+#endif
+
+#endif
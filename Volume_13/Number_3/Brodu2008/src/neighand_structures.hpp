@@ -69,6 +69,14 @@ struct NearestNeighbor {
     FloatType squaredDistance;
 };
 
+// A pair of objects within the query distance, see findAllPairs
+template <typename UserObject>
+struct NeighborPair {
+    UserObject* first;
+    UserObject* second;
+    FloatType squaredDistance;
+};
+
 // Example of remapper for objects that have a "proxy" field
 template<typename UserObject> struct ProxiedObjectRemapper {
     void operator()(UserObject* object, ObjectProxy<UserObject>* updated_proxy){
@@ -78,6 +86,19 @@ template<typename UserObject> struct ProxiedObjectRemapper {
 
 enum QueryMethod {Auto, Sphere, Cube, NonEmpty, Brute};
 
+// How the objects are stored in the cells, see the NeighborhoodHandler template arguments
+// - LinkedCells: each cell is a double-linked list of proxies, maintained on each insert/remove/update.
+// - SortedCells: the objects are copied cell after cell into contiguous x/y/z/object arrays,
+//                the cells being ordered along a Z-order curve. The arrays are rebuilt in one go
+//                (counting sort) before the first query following any change.
+enum CellStorage {LinkedCells, SortedCells};
+
+// Range of a cell in the contiguous arrays of the SortedCells storage
+struct SortedCellRange {
+    uint32_t begin;
+    uint32_t end;
+};
+
 // Previous version used reinterpret_cast, which is C++ way
 // However this badly interferes with aliasing, and -fno-strict-aliasing was necessary
 // Using a union is handled by the compiler and allows to assume aliasing
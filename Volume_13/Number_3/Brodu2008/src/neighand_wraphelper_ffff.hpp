@@ -162,6 +162,12 @@ COMPILE_TIME_ASSERT(exp2divx*2+exp2divy*2+exp2divz+1<=29)
         return dx * dx + dy * dy + dz * dz;
     }
 
+#ifdef NEIGHAND_SIMD_WIDTH
+    NEIGHAND_INLINE SimdFloat squaredDistanceSimd(SimdFloat dx, SimdFloat dy, SimdFloat dz) NEIGHAND_ALWAYS_INLINE {
+        return simdAdd(simdAdd(simdMul(dx,dx), simdMul(dy,dy)), simdMul(dz,dz));
+    }
+#endif
+
 
     NEIGHAND_INLINE FloatType squaredDXCellSpace(FloatType dx) NEIGHAND_ALWAYS_INLINE {
         return dx*dx;
@@ -219,7 +225,12 @@ COMPILE_TIME_ASSERT(exp2divx*2+exp2divy*2+exp2divz+1<=29)
     }
 
     // xyz are in world coordinates, inside, not in cell units
-    NEIGHAND_INLINE void flagOutside(FloatConverter x, FloatConverter y, FloatConverter z, FloatType d) NEIGHAND_ALWAYS_INLINE {
+    NEIGHAND_INLINE void flagOutside(FloatType x, FloatType y, FloatType z, FloatType d) NEIGHAND_ALWAYS_INLINE {
+        outsideFlag = intersectsOutside(x, y, z, d);
+    }
+
+    // Same test as flagOutside, without storing the flag: safe for concurrent queries
+    NEIGHAND_INLINE uint32_t intersectsOutside(FloatConverter x, FloatConverter y, FloatConverter z, FloatType d) NEIGHAND_ALWAYS_INLINE {
 
         // center+radius used to check if sphere intersects one of the 6 planes
         FloatConverter maxTestx(maxx - (x.f+d));
@@ -229,9 +240,9 @@ COMPILE_TIME_ASSERT(exp2divx*2+exp2divy*2+exp2divz+1<=29)
         y.f -= miny + d;
         z.f -= minz + d;
 
-        outsideFlag = (outsideCell->objects!=0);
+        uint32_t flag = (outsideCell->objects!=0);
         // use float sign bit.
-        outsideFlag &= uint32_t(x.i| y.i | z.i | (maxTestx.i-1) | (maxTesty.i-1) | (maxTestz.i-1)) >> 31;
+        return flag & (uint32_t(x.i| y.i | z.i | (maxTestx.i-1) | (maxTesty.i-1) | (maxTestz.i-1)) >> 31);
     }
 
     NEIGHAND_INLINE bool dsqImpliesOutside(FloatType x, FloatType y, FloatType z, FloatType dsq) NEIGHAND_ALWAYS_INLINE {
@@ -136,6 +136,15 @@ COMPILE_TIME_ASSERT(exp2divx*2+exp2divy*2+exp2divz<=29)
         return (dx*dx+dy*dy) * cellSizeSquared + dz*dz;
     }
 
+#ifdef NEIGHAND_SIMD_WIDTH
+    NEIGHAND_INLINE SimdFloat squaredDistanceSimd(SimdFloat dx, SimdFloat dy, SimdFloat dz) NEIGHAND_ALWAYS_INLINE {
+        SimdFloat scale = simdSet1(cellSizeInv);
+        dx = fastExp2RemSimd<exp2divx>(simdMul(dx, scale));
+        dy = fastExp2RemSimd<exp2divy>(simdMul(dy, scale));
+        return simdAdd(simdMul(simdAdd(simdMul(dx,dx), simdMul(dy,dy)), simdSet1(cellSizeSquared)), simdMul(dz,dz));
+    }
+#endif
+
     NEIGHAND_INLINE FloatType squaredDXCellSpace(FloatType dx) NEIGHAND_ALWAYS_INLINE {
         dx = fastExp2Rem<exp2divx>(dx);
         return dx*dx;
@@ -178,14 +187,19 @@ COMPILE_TIME_ASSERT(exp2divx*2+exp2divy*2+exp2divz<=29)
     }
 
     // xyz are in world coordinates, inside, not in cell units
-    NEIGHAND_INLINE void flagOutside(FloatType x, FloatType y, FloatConverter z, FloatType d) NEIGHAND_ALWAYS_INLINE {
+    NEIGHAND_INLINE void flagOutside(FloatType x, FloatType y, FloatType z, FloatType d) NEIGHAND_ALWAYS_INLINE {
+        outsideFlag = intersectsOutside(x, y, z, d);
+    }
+
+    // Same test as flagOutside, without storing the flag: safe for concurrent queries
+    NEIGHAND_INLINE uint32_t intersectsOutside(FloatType x, FloatType y, FloatConverter z, FloatType d) NEIGHAND_ALWAYS_INLINE {
 
         // center+radius used to check if sphere intersects one of the 2 Z planes
         FloatConverter maxTestz(maxz - (z.f+d));
         z.f -= minz + d;
 
-        outsideFlag = (outsideCell->objects!=0);
-        outsideFlag &= uint32_t(z.i | (maxTestz.i-1)) >> 31;
+        uint32_t flag = (outsideCell->objects!=0);
+        return flag & (uint32_t(z.i | (maxTestz.i-1)) >> 31);
     }
 
     NEIGHAND_INLINE bool dsqImpliesOutside(FloatType x, FloatType y, FloatType z, FloatType dsq) NEIGHAND_ALWAYS_INLINE {
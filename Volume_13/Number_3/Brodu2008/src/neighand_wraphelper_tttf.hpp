@@ -87,6 +87,17 @@ COMPILE_TIME_ASSERT(exp2divx*2+exp2divy*2+exp2divz<=29)
         return (dx*dx+dy*dy+dz*dz) * cellSizeSquared;
     }
 
+#ifdef NEIGHAND_SIMD_WIDTH
+    // Same as above on NEIGHAND_SIMD_WIDTH objects at once
+    NEIGHAND_INLINE SimdFloat squaredDistanceSimd(SimdFloat dx, SimdFloat dy, SimdFloat dz) NEIGHAND_ALWAYS_INLINE {
+        SimdFloat scale = simdSet1(cellSizeInv);
+        dx = fastExp2RemSimd<exp2divx>(simdMul(dx, scale));
+        dy = fastExp2RemSimd<exp2divy>(simdMul(dy, scale));
+        dz = fastExp2RemSimd<exp2divz>(simdMul(dz, scale));
+        return simdMul(simdAdd(simdAdd(simdMul(dx,dx), simdMul(dy,dy)), simdMul(dz,dz)), simdSet1(cellSizeSquared));
+    }
+#endif
+
     NEIGHAND_INLINE FloatType squaredDXCellSpace(FloatType dx) NEIGHAND_ALWAYS_INLINE {
         dx = fastExp2Rem<exp2divx>(dx);
         return dx*dx;
@@ -119,6 +130,9 @@ COMPILE_TIME_ASSERT(exp2divx*2+exp2divy*2+exp2divz<=29)
     }
     NEIGHAND_INLINE void flagOutside(FloatType,FloatType,FloatType,FloatType) NEIGHAND_ALWAYS_INLINE {
     }
+    NEIGHAND_INLINE bool intersectsOutside(FloatType,FloatType,FloatType,FloatType) NEIGHAND_ALWAYS_INLINE {
+        return false;
+    }
     NEIGHAND_INLINE bool dsqImpliesOutside(FloatType x, FloatType y, FloatType z, FloatType dsq) NEIGHAND_ALWAYS_INLINE {
         return false;
     }
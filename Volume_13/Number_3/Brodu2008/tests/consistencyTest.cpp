@@ -15,6 +15,7 @@
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <iterator>
 using namespace std;
 
 #include <math.h>
@@ -22,6 +23,11 @@ using namespace std;
 #include "neighand.h"
 using namespace neighand;
 
+// Cell storage to check, see the NeighborhoodHandler template arguments
+#ifndef CONSISTENCY_TEST_STORAGE
+#define CONSISTENCY_TEST_STORAGE LinkedCells
+#endif
+
 
 struct Agent {
     int number;
@@ -74,6 +80,46 @@ int32_t getULPDiff(FloatConverter x, FloatConverter y) {
     return x.i - y.i;
 }
 
+// Batch query functor: each query has its own list, so the threads never share one
+struct BatchVectorFunctor {
+    vector<vector<int> >* nbagents;
+    BatchVectorFunctor(vector<vector<int> >* nb) : nbagents(nb) {}
+    void operator()(uint32_t query, Agent* agent) {
+        (*nbagents)[query].push_back(agent->number);
+    }
+};
+
+// Distance of a list entry, for reporting the discrepancies
+struct QueryEntryDistance {
+    FloatType x,y,z;
+    QueryEntryDistance(FloatType _x, FloatType _y, FloatType _z) : x(_x), y(_y), z(_z) {}
+    FloatType operator()(long long a) {
+        return squaredDistance<CONSISTENCY_TEST_WRAP>(x-agents[a].x, y-agents[a].y, z-agents[a].z);
+    }
+};
+
+// Pairs are encoded as first * Nagents + second, with first < second
+struct PairEntryDistance {
+    FloatType operator()(long long p) {
+        int a = int(p / Nagents), b = int(p % Nagents);
+        return squaredDistance<CONSISTENCY_TEST_WRAP>(agents[a].x-agents[b].x, agents[a].y-agents[b].y, agents[a].z-agents[b].z);
+    }
+};
+
+// Compare two sorted lists like the main loop does. Return false on failure
+template<class EntryDistance>
+bool compareLists(const vector<long long>& nhlist, const vector<long long>& sqlist, FloatType distance, EntryDistance entryDistance, int32_t ULP_precision, int& numULPdiff, const char* name) {
+    vector<long long> diff;
+    set_symmetric_difference(nhlist.begin(), nhlist.end(), sqlist.begin(), sqlist.end(), back_inserter(diff));
+    bool failed = false;
+    for (unsigned int i=0; i<diff.size(); ++i) {
+        int32_t ulp = getULPDiff(entryDistance(diff[i]), distance*distance);
+        if (abs(ulp)>ULP_precision) failed = true; else ++numULPdiff;
+    }
+    if (failed) cout << "FAILED for " << name << ", dsq="<<(distance*distance)<<": " << diff.size() << " entries in one list but not in the other" << endl;
+    return !failed;
+}
+
 void help() {
 cout <<
 "Usage:\n"
@@ -102,7 +148,7 @@ int main(int argc, char** argv) {
     srand(seed);
 
     // 32x32x32 bloc, from 10 to 54.8 (random values)
-    typedef NeighborhoodHandler<Agent,5,5,5,CONSISTENCY_TEST_WRAP> NH;
+    typedef NeighborhoodHandler<Agent,5,5,5,CONSISTENCY_TEST_WRAP,false,std::allocator<ObjectProxy<Agent> >,CONSISTENCY_TEST_STORAGE> NH;
     NH nh(10.f, 10.f, 10.f, 1.4f);//, "consistency.bin");
     sizeX = 44.8;
     sizeY = 44.8;
@@ -267,8 +313,91 @@ int main(int argc, char** argv) {
         }
     }
 
+    // Batch functions: move all agents at once, then compare the batch queries
+    // and the all pairs self-join with the simple algorithm
+    {
+        vector<ObjectProxy<Agent>*> proxies(Nagents);
+        vector<FloatType> bx(Nagents), by(Nagents), bz(Nagents);
+        for (int a=0; a<Nagents; ++a) {
+            proxies[a] = agents[a].proxy;
+            // small moves: most agents stay in their cell
+            bx[a] = agents[a].x = agents[a].x + 0.7f * (rand() / (RAND_MAX + 1.0f));
+            by[a] = agents[a].y = agents[a].y + 0.7f * (rand() / (RAND_MAX + 1.0f));
+            bz[a] = agents[a].z = agents[a].z + 0.7f * (rand() / (RAND_MAX + 1.0f));
+        }
+        nh.updateBatch(&proxies[0], &bx[0], &by[0], &bz[0], Nagents);
+
+        const int Nbatch = 1000;
+        FloatType distance = 4.5f;
+        vector<FloatType> qx(Nbatch), qy(Nbatch), qz(Nbatch);
+        for (int i=0; i<Nbatch; ++i) {
+            qx[i] = 64.8f * (rand() / (RAND_MAX + 1.0f));
+            qy[i] = 64.8f * (rand() / (RAND_MAX + 1.0f));
+            qz[i] = 64.8f * (rand() / (RAND_MAX + 1.0f));
+        }
+        nh.setQueryMethod(Auto);
+        vector<vector<int> > batchNeighbors(Nbatch);
+        nh.applyToNeighborsBatch(&qx[0], &qy[0], &qz[0], Nbatch, distance, BatchVectorFunctor(&batchNeighbors));
+        vector<NearestNeighbor<Agent> > batchClosest(Nbatch);
+        vector<uint32_t> batchFound(Nbatch);
+        nh.findNearestNeighborsBatch(&qx[0], &qy[0], &qz[0], Nbatch, distance, &batchClosest[0], 1, &batchFound[0]);
+
+        for (int i=0; i<Nbatch; ++i) {
+            vector<long long> nhlist(batchNeighbors[i].begin(), batchNeighbors[i].end()), sqlist;
+            FloatType dmin = distance*distance; int amin = -1;
+            for (int a = 0; a<Nagents; ++a) {
+                FloatType dsq = squaredDistance<CONSISTENCY_TEST_WRAP>(agents[a].x-qx[i], agents[a].y-qy[i], agents[a].z-qz[i]);
+                if (dsq<=distance*distance) sqlist.push_back(a);
+                if (dsq <= dmin) {dmin = dsq; amin = a;}
+            }
+            sort(nhlist.begin(), nhlist.end());
+            if (!compareLists(nhlist, sqlist, distance, QueryEntryDistance(qx[i],qy[i],qz[i]), ULP_precision, numULPdiff, "batch query")) globalFailed = true;
+            nhlist.clear(); sqlist.clear();
+            if (batchFound[i]) nhlist.push_back(batchClosest[i].object->number);
+            if (amin!=-1) sqlist.push_back(amin);
+            if (!compareLists(nhlist, sqlist, distance, QueryEntryDistance(qx[i],qy[i],qz[i]), ULP_precision, numULPdiff, "batch closest query")) globalFailed = true;
+        }
+
+        // small, one cell and several cells distances
+        FloatType pairDistances[3] = {0.6f, 1.4f, 3.1f};
+        for (int k=0; k<3; ++k) {
+            vector<vector<NeighborPair<Agent> > > pairs;
+            uint32_t npairs = nh.findAllPairs(pairDistances[k], pairs);
+            vector<long long> nhlist, sqlist;
+            nhlist.reserve(npairs);
+            for (unsigned int t=0; t<pairs.size(); ++t) for (unsigned int i=0; i<pairs[t].size(); ++i) {
+                int a = pairs[t][i].first->number, b = pairs[t][i].second->number;
+                if (a>b) swap(a,b);
+                nhlist.push_back((long long)a * Nagents + b);
+            }
+            // The library may compute a pair distance in either order, and in the wrapping
+            // dimensions both orders may round differently: ignore the pairs at the limit
+            // for which the two orders disagree.
+            FloatType dsqLimit = pairDistances[k] * pairDistances[k];
+            vector<long long> ambiguous;
+            for (int a = 0; a<Nagents; ++a) for (int b = a+1; b<Nagents; ++b) {
+                bool ab = squaredDistance<CONSISTENCY_TEST_WRAP>(agents[a].x-agents[b].x, agents[a].y-agents[b].y, agents[a].z-agents[b].z)<=dsqLimit;
+                bool ba = squaredDistance<CONSISTENCY_TEST_WRAP>(agents[b].x-agents[a].x, agents[b].y-agents[a].y, agents[b].z-agents[a].z)<=dsqLimit;
+                if (ab && ba) sqlist.push_back((long long)a * Nagents + b);
+                else if (ab || ba) ambiguous.push_back((long long)a * Nagents + b);
+            }
+            sort(nhlist.begin(), nhlist.end());
+            // a pair must not be reported twice
+            if (adjacent_find(nhlist.begin(), nhlist.end()) != nhlist.end()) {
+                cout << "FAILED for all pairs, dsq="<<dsqLimit<<": duplicate pair" << endl;
+                globalFailed = true;
+            }
+            if (!ambiguous.empty()) {
+                vector<long long> kept;
+                set_difference(nhlist.begin(), nhlist.end(), ambiguous.begin(), ambiguous.end(), back_inserter(kept));
+                nhlist.swap(kept);
+            }
+            if (!compareLists(nhlist, sqlist, pairDistances[k], PairEntryDistance(), ULP_precision, numULPdiff, "all pairs")) globalFailed = true;
+        }
+    }
+
     if (!globalFailed) {
-        cout << Nqueries << " random tests OK";
+        cout << Nqueries << " random tests and the batch tests OK";
         if (numULPdiff>0) cout << " (" << numULPdiff << " discrepancies below or equal to "<< ULP_precision << " ULP)";
         else cout << " (perfect match)";
         cout << endl;
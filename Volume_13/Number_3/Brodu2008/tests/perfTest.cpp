@@ -5,7 +5,11 @@
     Read the documentation contained in the article "Query Sphere
     Indexing for Neighborhood Requests" for details.
 
-    This program compares the different query methods performances
+    This program compares the different query methods performances,
+    the two cell storage modes (linked lists and sorted arrays),
+    and the batch functions.
+    Compile with -mavx2 or -mavx512f for the SIMD distance checks in the
+    sorted arrays, they show best with a high LOAD_RATIO (see the Makefile).
 
     Nicolas Brodu, 2006/7
     Code released according to the GNU GPL, v2 or above.
@@ -35,7 +39,11 @@ using namespace neighand;
 //#define WRAP_ARGUMENTS false,false,false
 #endif
 
-const FloatType loadRatio = 5.0f;
+#ifndef LOAD_RATIO
+#define LOAD_RATIO 5.0f
+#endif
+
+const FloatType loadRatio = LOAD_RATIO;
 const int nmoves = 30;
 
 // derived values
@@ -54,6 +62,7 @@ struct Agent {
     inline float& y() {return coord[1];}
     inline float& z() {return coord[2];}
     ObjectProxy<Agent>* proxy;
+    ObjectProxy<Agent>* sortedProxy; // in the SortedCells handler
     // KD tree interface
     typedef float value_type;
     inline float operator[](const int dim) const { return coord[dim]; }
@@ -61,6 +70,13 @@ struct Agent {
 
 typedef KDTree::KDTree<3, Agent> KD_Tree;
 
+// Remapper for the second handler, see ProxiedObjectRemapper
+struct SortedProxyRemapper {
+    void operator()(Agent* agent, ObjectProxy<Agent>* updated_proxy){
+        agent->sortedProxy = updated_proxy;
+    }
+};
+
 // The callback function for LQ - builds a vector of Agent* like NH
 void callbackFunctionLQ(void* clientObject, float distanceSquared, void* clientQueryState) {
     reinterpret_cast<vector<Agent*>* >(clientQueryState)->push_back(reinterpret_cast<Agent*>(clientObject));
@@ -96,6 +112,82 @@ FloatType getRate(timeval& start, timeval& stop, int reps = 1)
     return FloatType(reps) / time;
 }
 
+// Same move, update and query loop as in main, on a handler with the SortedCells storage.
+// The objects are sorted by the first query after the updates, so the sort is included in the rate.
+template<class Handler>
+FloatType sortedStorageRate(Handler& nh, QueryMethod method, Agent* agents, FloatType query_distance)
+{
+    timeval start, stop;
+    nh.setQueryMethod(method);
+    srand(42); gettimeofday(&start,0);
+    for (int movestep = 0; movestep<nmoves; ++movestep) {
+
+        // update the agents positions
+        for (int i=0; i<Nagents; ++i) {
+            agents[i].x() = 10.0f + worldSize*cellSize * (rand() / (RAND_MAX + 1.0f));
+            agents[i].y() = 10.0f + worldSize*cellSize * (rand() / (RAND_MAX + 1.0f));
+            agents[i].z() = 10.0f + worldSize*cellSize * (rand() / (RAND_MAX + 1.0f));
+        }
+
+        // Update the structures
+        for (int i=0; i<Nagents; ++i) nh.update(agents[i].sortedProxy, agents[i].x(), agents[i].y(), agents[i].z());
+
+        // each agent queries its neighbors
+        for (int i=0; i<Nagents; ++i) {
+            vector<Agent*> neighbors;
+            nh.findNeighbors(agents[i].x(), agents[i].y(), agents[i].z(), query_distance, neighbors);
+        }
+
+    }
+    gettimeofday(&stop,0);
+    return getRate(start, stop, nmoves*Nagents);
+}
+
+// Batch query functor: one neighbor list per query, like findNeighbors
+struct BatchListFunctor {
+    vector<vector<Agent*> >* lists;
+    BatchListFunctor(vector<vector<Agent*> >* l) : lists(l) {}
+    void operator()(uint32_t query, Agent* agent) {
+        (*lists)[query].push_back(agent);
+    }
+};
+
+// Same move, update and query loop with the batch functions: all agents are moved with
+// updateBatch, then either all queries are answered with applyToNeighborsBatch, or all
+// the pairs are found with findAllPairs (each pair is then found once instead of twice).
+// The rate is given in agents per second like the other loops.
+template<class Handler>
+FloatType batchRate(Handler& nh, vector<ObjectProxy<Agent>*>& proxies, Agent* agents, FloatType query_distance, bool allPairs)
+{
+    timeval start, stop;
+    vector<FloatType> x(Nagents), y(Nagents), z(Nagents);
+    vector<vector<Agent*> > neighbors(Nagents);
+    vector<vector<NeighborPair<Agent> > > pairs;
+    nh.setQueryMethod(Auto);
+    srand(42); gettimeofday(&start,0);
+    for (int movestep = 0; movestep<nmoves; ++movestep) {
+
+        // update the agents positions
+        for (int i=0; i<Nagents; ++i) {
+            x[i] = agents[i].x() = 10.0f + worldSize*cellSize * (rand() / (RAND_MAX + 1.0f));
+            y[i] = agents[i].y() = 10.0f + worldSize*cellSize * (rand() / (RAND_MAX + 1.0f));
+            z[i] = agents[i].z() = 10.0f + worldSize*cellSize * (rand() / (RAND_MAX + 1.0f));
+        }
+
+        // Update the structures
+        nh.updateBatch(&proxies[0], &x[0], &y[0], &z[0], Nagents);
+
+        if (allPairs) nh.findAllPairs(query_distance, pairs);
+        else {
+            for (int i=0; i<Nagents; ++i) neighbors[i].clear();
+            nh.applyToNeighborsBatch(&x[0], &y[0], &z[0], Nagents, query_distance, BatchListFunctor(&neighbors));
+        }
+
+    }
+    gettimeofday(&stop,0);
+    return getRate(start, stop, nmoves*Nagents);
+}
+
 template<bool wrapx, bool wrapy, bool wrapz> struct MethodSwitcher {
     enum { SupportKDLQ = 0 };
 };
@@ -109,11 +201,17 @@ template<> struct MethodSwitcher<false,false,false> {
 int main() {
 
     cout << "Initializing (cell load = " << loadRatio << ", number of agents = " << Nagents << ")"<<endl;
+#ifdef NEIGHAND_SIMD_WIDTH
+    cout << "Sorted cells distances computed " << NEIGHAND_SIMD_WIDTH << " at a time" << endl;
+#endif
     if (!MethodSwitcher<WRAP_ARGUMENTS>::SupportKDLQ) cout << "Note: The KD-Tree and LQ bin-lattice methods are always non-wrapping and not available in the wrapping cases" << endl;
 
     typedef NeighborhoodHandler<Agent,TEMPLATE_SIZE,WRAP_ARGUMENTS> NH;
     NH nh(10.f, 10.f, 10.f, cellSize);
 
+    typedef NeighborhoodHandler<Agent,TEMPLATE_SIZE,WRAP_ARGUMENTS,false,std::allocator<ObjectProxy<Agent> >,SortedCells> NHSorted;
+    NHSorted nhSorted(10.f, 10.f, 10.f, cellSize);
+
     lqDB* db = lqCreateDatabase(10.f, 10.f, 10.f, worldSize*cellSize, worldSize*cellSize, worldSize*cellSize, worldSizeInt, worldSizeInt, worldSizeInt);
 
     Agent* agents = new Agent[Nagents];
@@ -130,10 +228,22 @@ int main() {
     // Insertion
     for (int i=0; i<Nagents; ++i) {
         agents[i].proxy = nh.insert(agents[i].x(), agents[i].y(), agents[i].z(), &agents[i], ProxiedObjectRemapper<Agent>());
+        agents[i].sortedProxy = nhSorted.insert(agents[i].x(), agents[i].y(), agents[i].z(), &agents[i], SortedProxyRemapper());
         lqInitClientProxy(&proxiesLQ[i], &agents[i]);
         lqUpdateForNewLocation(db, &proxiesLQ[i], agents[i].x(), agents[i].y(), agents[i].z());
     }
 
+    // Proxies for the batch functions. The handlers do not remap them after the insertions.
+    vector<ObjectProxy<Agent>*> proxies(Nagents), sortedProxies(Nagents);
+    for (int i=0; i<Nagents; ++i) {
+        proxies[i] = agents[i].proxy;
+        sortedProxies[i] = agents[i].sortedProxy;
+    }
+    int numThreads = 1;
+#ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+#endif
+
 
     float dparm[3];
     dparm[0] = 0.8f;                         // close range below one cell
@@ -392,6 +502,31 @@ int main() {
             histogram << " " << reprate << flush;
         }
 
+        // Same methods with the sorted cell storage, in the last columns
+        QueryMethod methods[5] = {Auto, Sphere, Cube, NonEmpty, Brute};
+        const char* methodNames[5] = {"Auto", "Sphere", "Cube", "Non-Empty", "Brute"};
+        cout << endl << "Sorted cells:";
+        for (int m = 0; m < 5; ++m) {
+            reprate = sortedStorageRate(nhSorted, methods[m], agents, query_distance);
+            cout << (m ? ", " : " ") << methodNames[m] << ": " << reprate << flush;
+            histogram << " " << reprate << flush;
+        }
+
+        // Batch functions on both storages, in the last columns
+        cout << endl << "Batch (" << numThreads << " threads):";
+        reprate = batchRate(nh, proxies, agents, query_distance, false);
+        cout << " queries: " << reprate << flush;
+        histogram << " " << reprate << flush;
+        reprate = batchRate(nh, proxies, agents, query_distance, true);
+        cout << ", all pairs: " << reprate << flush;
+        histogram << " " << reprate << flush;
+        reprate = batchRate(nhSorted, sortedProxies, agents, query_distance, false);
+        cout << ", sorted cells queries: " << reprate << flush;
+        histogram << " " << reprate << flush;
+        reprate = batchRate(nhSorted, sortedProxies, agents, query_distance, true);
+        cout << ", sorted cells all pairs: " << reprate << flush;
+        histogram << " " << reprate << flush;
+
         cout << endl;
         histogram << endl;
     }
@@ -17,14 +17,21 @@
 
 #include <cfloat>
 #include <climits>
+#include <cstdio>
+#include <cstring>
 
 #include <algorithm>
+using std::partition;
 using std::sort;
 
 #include <iostream>
 using std::endl;
 using std::ostream;
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif // defined(_OPENMP)
+
 #include <Common/FileIO/BVH.h>
 #include <Common/Utility/OutputCC.h>
 
@@ -33,19 +40,87 @@ namespace FileIO
   const float BVH::isecCost         = 10.f;
   const float BVH::travCost         = 10.f;
   const uint  BVH::defaultThreshold = 8;
+  const uint  BVH::defaultBins      = 32;
+  const uint  BVH::taskSize         = 4096;
+  const uint  BVH::cacheVersion     = 1;
+
+  // Bin of a centroid coordinate; the last bin is closed
+  inline uint binIndex(float pos, float min, float scale, uint nbins)
+  {
+    const uint bin = uint((pos - min)*scale);
+    return (bin < nbins ? bin : nbins - 1);
+  }
+
+  // Share of [0, size) for the calling thread of a parallel region
+  inline void threadRange(int& begin, int& end, int size)
+  {
+#if defined(_OPENMP)
+    const int nthreads = omp_get_num_threads();
+    const int thread   = omp_get_thread_num();
+    begin = int((long long)size*thread/nthreads);
+    end   = int((long long)size*(thread + 1)/nthreads);
+#else
+    begin = 0;
+    end   = size;
+#endif // defined(_OPENMP)
+  }
+
+  // True for the objects on the left of a binned split
+  struct BinnedSplit
+  {
+    bool operator()(const BVH::Object* object) const
+    {
+      return (binIndex((object->box.center())[axis], min, scale, nbins) <= bin);
+    }
+
+    uint  axis;
+    float min;
+    float scale;
+    uint  nbins;
+    uint  bin;
+  };
 
-  BVH::BVH(const vector<Object*>& objectsIn, uint threshold_) :
+  // FNV-1a hash of a 32-bit word
+  inline void hashWord(uint64_t& hash, uint word)
+  {
+    for (uint i = 0; i < 4; ++i)
+    {
+      hash ^= (word >> 8*i) & 0xff;
+      hash *= 1099511628211ULL;
+    }
+  }
+
+  inline void hashFloat(uint64_t& hash, float value)
+  {
+    uint word;
+    memcpy(&word, &value, sizeof(uint));
+    hashWord(hash, word);
+  }
+
+  BVH::BVH(const vector<Object*>& objectsIn, uint threshold_, uint nbins_,
+           const string& cacheName) :
     root(0),
     threshold(threshold_),
+    nbins(nbins_),
     numNodes(0),
     numLeaves(0),
     leafMin(UINT_MAX),
     leafMax(0),
     maxDepth(0),
     totalCost(0),
+    cached(false),
     objects(objectsIn)
   {
+    if (cacheName != "" && read(cacheName))
+    {
+      cached = true;
+      return;
+    }
+
     build(objects);
+
+    if (cacheName != "")
+      write(cacheName);
   }
 
   BVH::~BVH()
@@ -74,7 +149,28 @@ namespace FileIO
   void BVH::build(vector<Object*> objectsIn)
   {
     root = new Node();
-    build(root, objectsIn, 0);
+    if (nbins > 0)
+    {
+      // Split the top levels one node at a time, binning with all of the
+      // threads, and queue the smaller subtrees as tasks.  The largest tasks
+      // go first so that the threads finish together.
+      vector<Task*> tasks;
+      buildBinned(root, objectsIn, 0, &tasks);
+      sort(tasks.begin(), tasks.end(), CompareTasks());
+
+      const int ntasks = tasks.size();
+#pragma omp parallel for schedule(dynamic, 1)
+      for (int i = 0; i < ntasks; ++i)
+      {
+        buildBinned(tasks[i]->node, tasks[i]->objects, tasks[i]->depth, 0);
+        delete tasks[i];
+      }
+    }
+    else
+    {
+      build(root, objectsIn, 0);
+    }
+
     updateBounds(root);
     computeCost(totalCost, root, root->box.computeSA());
   }
@@ -88,22 +184,10 @@ namespace FileIO
     if (bestAxis == -1)
     {
       // Make a leaf node
-      for (uint i = 0; i < size; ++i)
-      {
-        node->objIDs.push_back(objectsIn[i]->objID);
-        node->box.extend(objectsIn[i]->box);
-      }
+      makeLeaf(node, objectsIn);
 
       objectsIn.clear();
       objectsIn.reserve(0);
-      node->axis = 0;
-      ++numNodes;
-      ++numLeaves;
-
-      leafMin = Min(leafMin, uint(node->objIDs.size()));
-      leafMax = Max(leafMax, uint(node->objIDs.size()));
-
-      sort(node->objIDs.begin(), node->objIDs.end());
     }
     else
     {
@@ -140,6 +224,243 @@ namespace FileIO
     maxDepth = Max(maxDepth, depth);
   }
 
+  void BVH::buildBinned(Node* node, vector<Object*>& objectsIn, uint depth,
+                        vector<Task*>* tasks)
+  {
+    const uint size = objectsIn.size();
+    if (tasks && size < taskSize)
+    {
+      Task* task  = new Task();
+      task->node  = node;
+      task->depth = depth;
+      task->objects.swap(objectsIn);
+      tasks->push_back(task);
+
+      return;
+    }
+
+    uint split    = 0;
+    int  bestAxis = partitionBinned(split, objectsIn, tasks != 0);
+
+    if (bestAxis == -1)
+    {
+      // Make a leaf node
+      makeLeaf(node, objectsIn);
+      updateDepth(depth);
+
+      vector<Object*>().swap(objectsIn);
+      return;
+    }
+
+    // Make an interior node
+    node->axis = bestAxis;
+#pragma omp atomic
+    ++numNodes;
+
+    node->left  = new Node();
+    node->right = new Node();
+    vector<Object*> leftObjects(objectsIn.begin(), objectsIn.begin() + split);
+    vector<Object*> rightObjects(objectsIn.begin() + split, objectsIn.end());
+
+    vector<Object*>().swap(objectsIn);
+
+    // Recursively build hierarchy
+    ++depth;
+    buildBinned(node->left,  leftObjects,  depth, tasks);
+    buildBinned(node->right, rightObjects, depth, tasks);
+  }
+
+  int BVH::partitionBinned(uint& split, vector<Object*>& objectsIn,
+                           bool parallel)
+  {
+    const int size = objectsIn.size();
+    if (size <= int(threshold))
+      return -1;
+
+    // Bounds of the objects and of their centroids
+    BBox global;
+    BBox centroids;
+    if (parallel)
+    {
+#pragma omp parallel
+      {
+        BBox localGlobal;
+        BBox localCentroids;
+        int  begin, end;
+        threadRange(begin, end, size);
+        boundObjects(localGlobal, localCentroids, objectsIn, begin, end);
+
+#pragma omp critical(FileIO_BVH_bins)
+        {
+          global.extend(localGlobal);
+          centroids.extend(localCentroids);
+        }
+      }
+    }
+    else
+    {
+      boundObjects(global, centroids, objectsIn, 0, size);
+    }
+
+    const Point  cmin   = centroids.getMin();
+    const Vector extent = centroids.diagonal();
+    float scale[3];
+    for (uint axis = 0; axis < 3; ++axis)
+      scale[axis] = (extent[axis] > 0 ? nbins/extent[axis] : 0.f);
+
+    // Fill the bins of the three axes in one pass
+    vector<Bin> bins(3*nbins);
+    for (uint i = 0; i < bins.size(); ++i)
+      bins[i].count = 0;
+
+    if (parallel)
+    {
+#pragma omp parallel
+      {
+        vector<Bin> localBins(bins.size());
+        for (uint i = 0; i < localBins.size(); ++i)
+          localBins[i].count = 0;
+
+        int begin, end;
+        threadRange(begin, end, size);
+        fillBins(localBins, cmin, scale, objectsIn, begin, end);
+
+#pragma omp critical(FileIO_BVH_bins)
+        for (uint i = 0; i < bins.size(); ++i)
+        {
+          bins[i].box.extend(localBins[i].box);
+          bins[i].count += localBins[i].count;
+        }
+      }
+    }
+    else
+    {
+      fillBins(bins, cmin, scale, objectsIn, 0, size);
+    }
+
+    // Evaluate the splits between bins, as buildEvents does between events
+    float bestCost = isecCost * size;
+    int   bestAxis = -1;
+    uint  bestBin  = 0;
+
+    const float globalArea = global.computeSA();
+    vector<float> leftArea(nbins);
+    vector<uint>  leftCount(nbins);
+    for (uint axis = 0; axis < 3; ++axis)
+    {
+      if (scale[axis] == 0.f)
+        continue;
+
+      const Bin* axisBins = &bins[axis*nbins];
+
+      BBox left;
+      uint numLeft = 0;
+      for (uint i = 0; i < nbins - 1; ++i)
+      {
+        left.extend(axisBins[i].box);
+        numLeft      += axisBins[i].count;
+        leftArea[i]   = left.computeSA();
+        leftCount[i]  = numLeft;
+      }
+
+      BBox right;
+      uint numRight = 0;
+      for (uint i = nbins - 1; i > 0; --i)
+      {
+        right.extend(axisBins[i].box);
+        numRight += axisBins[i].count;
+
+        if (leftCount[i-1] > 0 && numRight > 0)
+        {
+          float currentCost = (leftCount[i-1] * leftArea[i-1] +
+                               numRight * right.computeSA());
+          currentCost /= globalArea;
+          currentCost *= isecCost;
+          currentCost += travCost;
+
+          if (currentCost < bestCost)
+          {
+            bestCost = currentCost;
+            bestAxis = axis;
+            bestBin  = i-1;
+          }
+        }
+      }
+    }
+
+    if (bestAxis == -1)
+      return -1;
+
+    BinnedSplit binned;
+    binned.axis  = bestAxis;
+    binned.min   = cmin[bestAxis];
+    binned.scale = scale[bestAxis];
+    binned.nbins = nbins;
+    binned.bin   = bestBin;
+
+    split = partition(objectsIn.begin(), objectsIn.end(), binned) -
+      objectsIn.begin();
+
+    return bestAxis;
+  }
+
+  void BVH::boundObjects(BBox& global, BBox& centroids,
+                         const vector<Object*>& objectsIn,
+                         int begin, int end) const
+  {
+    for (int i = begin; i < end; ++i)
+    {
+      global.extend(objectsIn[i]->box);
+      centroids.extend(objectsIn[i]->box.center());
+    }
+  }
+
+  void BVH::fillBins(vector<Bin>& bins, const Point& cmin, const float* scale,
+                     const vector<Object*>& objectsIn,
+                     int begin, int end) const
+  {
+    for (int i = begin; i < end; ++i)
+    {
+      const BBox& box = objectsIn[i]->box;
+      const Point c   = box.center();
+      for (uint axis = 0; axis < 3; ++axis)
+      {
+        Bin& bin = bins[axis*nbins +
+                        binIndex(c[axis], cmin[axis], scale[axis], nbins)];
+        bin.box.extend(box);
+        ++bin.count;
+      }
+    }
+  }
+
+  void BVH::makeLeaf(Node* node, const vector<Object*>& objectsIn)
+  {
+    const uint size = objectsIn.size();
+    for (uint i = 0; i < size; ++i)
+    {
+      node->objIDs.push_back(objectsIn[i]->objID);
+      node->box.extend(objectsIn[i]->box);
+    }
+
+    node->axis = 0;
+    sort(node->objIDs.begin(), node->objIDs.end());
+
+#pragma omp critical(FileIO_BVH_stats)
+    {
+      ++numNodes;
+      ++numLeaves;
+
+      leafMin = Min(leafMin, size);
+      leafMax = Max(leafMax, size);
+    }
+  }
+
+  void BVH::updateDepth(uint depth)
+  {
+#pragma omp critical(FileIO_BVH_stats)
+    maxDepth = Max(maxDepth, depth);
+  }
+
   uint BVH::partitionSAH(int& bestAxis, vector<Object*>& objectsIn)
   {
     const uint size = objectsIn.size();
@@ -320,12 +641,163 @@ namespace FileIO
     }
   }
 
+  /////////////////////////////////////////////////////////////////////////////
+  // Cache file format
+  //
+  //   "bvh"
+  //   cache version
+  //   checksum of the objects, threshold, and number of bins
+  //   number of nodes, number of leaves, leaf min, leaf max, max depth
+  //   nodes in depth-first order:  axis, number of objects, object ids
+  //
+  // Only the topology is stored; the bounds and the sah cost are recomputed
+  // from the objects when the file is read.
+
+  uint64_t BVH::checksum() const
+  {
+    uint64_t hash = 14695981039346656037ULL;
+    hashWord(hash, cacheVersion);
+    hashWord(hash, threshold);
+    hashWord(hash, nbins);
+    hashWord(hash, objects.size());
+    for (uint i = 0; i < objects.size(); ++i)
+    {
+      const Point min = objects[i]->box.getMin();
+      const Point max = objects[i]->box.getMax();
+      for (uint j = 0; j < 3; ++j)
+      {
+        hashFloat(hash, min[j]);
+        hashFloat(hash, max[j]);
+      }
+
+      hashWord(hash, objects[i]->objID);
+    }
+
+    return hash;
+  }
+
+  bool BVH::read(const string& fileName)
+  {
+    FILE* fin = fopen(fileName.c_str(), "rb");
+    if (!fin)
+      return false;
+
+    char     text[4];
+    uint     version = 0;
+    uint64_t hash    = 0;
+    uint     stats[5];
+    bool     valid   = (fread((void*)text,     sizeof(char),     4, fin) == 4 &&
+                        fread((void*)&version, sizeof(uint),     1, fin) == 1 &&
+                        fread((void*)&hash,    sizeof(uint64_t), 1, fin) == 1 &&
+                        fread((void*)stats,    sizeof(uint),     5, fin) == 5 &&
+                        strncmp(text, "bvh", 4) == 0 &&
+                        version == cacheVersion &&
+                        hash    == checksum());
+
+    if (valid)
+    {
+      root  = new Node();
+      valid = readNode(fin, root);
+    }
+
+    fclose(fin);
+
+    if (!valid)
+    {
+      delete root;
+      root = 0;
+
+      Warning("Ignoring stale BVH cache \"" << fileName << '"' << endl);
+      return false;
+    }
+
+    numNodes  = stats[0];
+    numLeaves = stats[1];
+    leafMin   = stats[2];
+    leafMax   = stats[3];
+    maxDepth  = stats[4];
+
+    updateBounds(root);
+    computeCost(totalCost, root, root->box.computeSA());
+
+    return true;
+  }
+
+  bool BVH::readNode(FILE* fin, Node* node)
+  {
+    uint header[2];
+    if (fread((void*)header, sizeof(uint), 2, fin) != 2 || header[0] > 2)
+      return false;
+
+    node->axis = header[0];
+    if (header[1] > 0)
+    {
+      node->objIDs.resize(header[1]);
+      if (fread((void*)&node->objIDs[0], sizeof(uint), header[1], fin) !=
+          header[1])
+        return false;
+
+      for (uint i = 0; i < header[1]; ++i)
+      {
+        if (node->objIDs[i] >= objects.size())
+          return false;
+      }
+
+      return true;
+    }
+
+    node->left  = new Node();
+    node->right = new Node();
+
+    return (readNode(fin, node->left) && readNode(fin, node->right));
+  }
+
+  void BVH::write(const string& fileName) const
+  {
+    FILE* fout = fopen(fileName.c_str(), "wb");
+    if (!fout)
+    {
+      Warning("Failed to open \"" << fileName << "\" for writing" << endl);
+      return;
+    }
+
+    const uint     version = cacheVersion;
+    const uint64_t hash    = checksum();
+    const uint     stats[5] = { numNodes, numLeaves, leafMin, leafMax,
+                                maxDepth };
+
+    fwrite((void*)"bvh",    sizeof(char),     4, fout);
+    fwrite((void*)&version, sizeof(uint),     1, fout);
+    fwrite((void*)&hash,    sizeof(uint64_t), 1, fout);
+    fwrite((void*)stats,    sizeof(uint),     5, fout);
+
+    writeNode(fout, root);
+
+    fclose(fout);
+  }
+
+  void BVH::writeNode(FILE* fout, const Node* node) const
+  {
+    const uint header[2] = { node->axis, uint(node->objIDs.size()) };
+    fwrite((void*)header, sizeof(uint), 2, fout);
+
+    if (header[1] > 0)
+    {
+      fwrite((void*)&node->objIDs[0], sizeof(uint), header[1], fout);
+      return;
+    }
+
+    writeNode(fout, node->left);
+    writeNode(fout, node->right);
+  }
+
   void BVH::printStats(bool all) const
   {
       Output("BVH:" << endl);
       Output("  scene bounds     = " << root->box << endl);
       Output(endl);
       Output("  leaf threshold   = " << threshold << endl);
+      Output("  sah bins         = " << nbins << endl);
       Output("  leaf range       = [" << leafMin << ", " << leafMax << ']'
              << endl);
       Output("  maximum depth    = " << maxDepth << endl);
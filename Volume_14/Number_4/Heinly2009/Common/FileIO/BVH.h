@@ -18,9 +18,14 @@
 #ifndef Common_FileIO_BVH_h
 #define Common_FileIO_BVH_h
 
+#include <cstdio>
+
 #include <iostream>
 using std::ostream;
 
+#include <string>
+using std::string;
+
 #include <vector>
 using std::vector;
 
@@ -38,6 +43,9 @@ namespace FileIO
     static const float isecCost;
     static const float travCost;
     static const uint  defaultThreshold;
+    static const uint  defaultBins;
+    static const uint  taskSize;
+    static const uint  cacheVersion;
 
     struct Object
     {
@@ -57,7 +65,12 @@ namespace FileIO
       vector<uint> objIDs;
     };
 
-    BVH(const vector<Object*>& objectsIn, uint threshold_ = defaultThreshold);
+    // nbins_ = 0 selects the event-sorted SAH sweep, otherwise the centroids
+    // are binned and the build is multi-threaded (when compiled with OpenMP);
+    // with a cacheName, a hierarchy built earlier from the same objects is
+    // read back instead of rebuilt
+    BVH(const vector<Object*>& objectsIn, uint threshold_ = defaultThreshold,
+        uint nbins_ = 0, const string& cacheName = "");
     ~BVH();
 
     void build(vector<Object*> objectsIn);
@@ -65,6 +78,8 @@ namespace FileIO
     Node* getRoot()      const;
     uint  getNumNodes()  const;
     uint  getThreshold() const;
+    uint  getNumBins()   const;
+    bool  isCached()     const;
     uint  getNumLeaves() const;
     uint  getLeafMin()   const;
     uint  getLeafMax()   const;
@@ -100,13 +115,49 @@ namespace FileIO
       bool operator()(const Event&, const Event&);
     };
 
+    struct Bin
+    {
+      BBox box;
+      uint count;
+    };
+
+    // A subtree left for the worker threads
+    struct Task
+    {
+      Node*           node;
+      vector<Object*> objects;
+      uint            depth;
+    };
+
+    struct CompareTasks
+    {
+      bool operator()(const Task*, const Task*);
+    };
+
     void build(Node* node, vector<Object*>& objectsIn, uint depth);
     uint partitionSAH(int& bestAxis, vector<Object*>& objectsIn);
     bool buildEvents(CostEval& newCost, const vector<Object*>& objectsIn,
                      uint axis);
+    void buildBinned(Node* node, vector<Object*>& objectsIn, uint depth,
+                     vector<Task*>* tasks);
+    int  partitionBinned(uint& split, vector<Object*>& objectsIn,
+                         bool parallel);
+    void boundObjects(BBox& global, BBox& centroids,
+                      const vector<Object*>& objectsIn,
+                      int begin, int end) const;
+    void fillBins(vector<Bin>& bins, const Point& cmin, const float* scale,
+                  const vector<Object*>& objectsIn, int begin, int end) const;
+    void makeLeaf(Node* node, const vector<Object*>& objectsIn);
+    void updateDepth(uint depth);
     void updateBounds(Node* node);
     void computeCost(float& totalCost, Node* node, float globalArea) const;
 
+    uint64_t checksum() const;
+    bool     read(const string& fileName);
+    bool     readNode(FILE* fin, Node* node);
+    void     write(const string& fileName) const;
+    void     writeNode(FILE* fout, const Node* node) const;
+
     void printNode(const Node* node) const;
 
     /////////////////////////////////////////////////////////////////////////////
@@ -114,12 +165,14 @@ namespace FileIO
 
     Node* root;
     uint  threshold;
+    uint  nbins;
     uint  numNodes;
     uint  numLeaves;
     uint  leafMin;
     uint  leafMax;
     uint  maxDepth;
     float totalCost;
+    bool  cached;
 
     const vector<Object*>& objects;
   };
@@ -139,6 +192,16 @@ namespace FileIO
     return threshold;
   }
 
+  inline uint BVH::getNumBins() const
+  {
+    return nbins;
+  }
+
+  inline bool BVH::isCached() const
+  {
+    return cached;
+  }
+
   inline uint BVH::getNumLeaves() const
   {
     return numLeaves;
@@ -169,6 +232,11 @@ namespace FileIO
     return (l.pos < r.pos);
   }
 
+  inline bool BVH::CompareTasks::operator()(const Task* l, const Task* r)
+  {
+    return (l->objects.size() > r->objects.size());
+  }
+
   ///////////////////////////////////////////////////////////////////////////////
   // Forward declarations
 
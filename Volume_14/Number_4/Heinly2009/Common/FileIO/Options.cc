@@ -24,7 +24,9 @@ namespace FileIO
     nspp(0),
     xres(0),
     yres(0),
-    thold(0)
+    thold(0),
+    nbins(-1),
+    cache(false)
   {
     // no-op
   }
@@ -51,8 +51,11 @@ namespace FileIO
     uint xres;
     uint yres;
 
-    // BVH leaf creation threshold
+    // BVH leaf creation threshold, builder bins (0 = sah sweep, < 0 =
+    // default), and hierarchy cache
     uint thold;
+    int  nbins;
+    bool cache;
   };
 
 } // namespace FileIO
@@ -154,6 +154,10 @@ namespace FileIO
     // BVH leaf creation threshold
     thold = (opt->thold > 0 ? opt->thold : BVH::defaultThreshold);
 
+    // BVH builder and cache
+    nbins     = (opt->nbins >= 0 ? opt->nbins : BVH::defaultBins);
+    cacheName = (opt->cache ? opt->bname : "");
+
     // Output configuration
     Output("path  = " << path << endl);
     Output("fname = " << fname << endl);
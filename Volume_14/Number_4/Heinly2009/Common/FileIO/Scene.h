@@ -68,6 +68,8 @@ namespace FileIO
     const RGB&             getSky()             const;
     const RGB&             getGround()          const;
           uint             getThreshold()       const;
+          uint             getNumBins()         const;
+    const string&          getCacheName()       const; // file name w/o suffix
 
   private:
     Mesh*           mesh;
@@ -76,6 +78,8 @@ namespace FileIO
     RGB             sky;
     RGB             ground;
     uint            thold;
+    uint            nbins;
+    string          cacheName;
   };
 
   inline const Mesh* Scene::getMesh() const
@@ -108,6 +112,16 @@ namespace FileIO
     return thold;
   }
 
+  inline uint Scene::getNumBins() const
+  {
+    return nbins;
+  }
+
+  inline const string& Scene::getCacheName() const
+  {
+    return cacheName;
+  }
+
 } // namespace FileIO
 
 #endif // Common_FileIO_Scene_h
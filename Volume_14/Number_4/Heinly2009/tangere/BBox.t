@@ -26,6 +26,7 @@ using std::ostream;
 
 #include <tangere/Flags.h>
 #include <tangere/Ray.t>
+#include <tangere/RayPacket.t>
 
 namespace tangere
 {
@@ -136,6 +137,11 @@ namespace tangere
 #endif // defined(USE_INVDIR)
     }
 
+#if defined(USE_AVX2_PACKETS)
+    // Lanes of the packet that hit the box; entry distances in t
+    inline __m256i intersect(__m256i& t, const RayPacket<T>& packet) const;
+#endif // defined(USE_AVX2_PACKETS)
+
     inline void extend(const BBox<T>& b)
     {
       bounds[0] = Min(b.bounds[0], bounds[0]);
@@ -319,6 +325,60 @@ namespace tangere
 #endif // defined(USE_INVDIR)
   }
 
+#if defined(USE_AVX2_PACKETS)
+  // Same arithmetic as the USE_INVDIR path above, four rays at a time; the
+  // early outs are folded into the final comparison
+  template<>
+  inline __m256i BBox<int>::intersect(__m256i& t,
+                                      const RayPacket<int>& packet) const
+  {
+    const __m128i* org   = packet.org32v();
+    const __m128i* sign  = packet.sign32v();
+    const __m256i* invHi = packet.invHiv();
+    const __m256i* invLo = packet.invLov();
+
+    __m256i tmin = _mm256_setzero_si256();
+    __m256i tmax = _mm256_setzero_si256();
+    for (uint k = 0; k < 3; ++k)
+    {
+      const __m128i lo    = _mm_set1_epi32(bounds[0][k]);
+      const __m128i hi    = _mm_set1_epi32(bounds[1][k]);
+      const __m128i bNear = _mm_blendv_epi8(lo, hi, sign[k]);
+      const __m128i bFar  = _mm_blendv_epi8(hi, lo, sign[k]);
+
+      // int64_t(x) >> dBits == int64_t(x >> dBits) for 32-bit x
+      const __m256i tNear =
+        mul64(_mm256_cvtepi32_epi64(_mm_srai_epi32(_mm_sub_epi32(bNear,
+                                                                 org[k]),
+                                                   dBits)),
+              invHi[k], invLo[k]);
+      const __m256i tFar  =
+        mul64(_mm256_cvtepi32_epi64(_mm_srai_epi32(_mm_sub_epi32(bFar,
+                                                                 org[k]),
+                                                   dBits)),
+              invHi[k], invLo[k]);
+
+      tmin = (k == 0 ? tNear : max64(tmin, tNear));
+      tmax = (k == 0 ? tFar  : min64(tmax, tFar));
+    }
+
+    // tmin <= tmax
+    __m256i hit = _mm256_cmpgt_epi64(tmin, tmax);
+
+#if defined(USE_D_BITS)
+    tmin = srai64(tmin, cdDiff);
+#endif // defined(USE_D_BITS)
+
+    const __m256i intMax = _mm256_set1_epi64x( INT_MAX);
+    const __m256i intMin = _mm256_set1_epi64x(-INT_MAX);
+    hit = _mm256_or_si256(hit, _mm256_cmpgt_epi64(tmin, intMax));
+    hit = _mm256_or_si256(hit, _mm256_cmpgt_epi64(intMin, tmin));
+
+    t = tmin;
+    return _mm256_xor_si256(hit, _mm256_set1_epi64x(-1));
+  }
+#endif // defined(USE_AVX2_PACKETS)
+
 } // namespace tangere
 
 #endif // tangere_BBox_h
@@ -41,6 +41,7 @@ using std::vector;
 #include <tangere/HitRecord.t>
 #include <tangere/Node.t>
 #include <tangere/Ray.t>
+#include <tangere/RayPacket.t>
 #include <tangere/SceneScaler.h>
 #include <tangere/Triangle.t>
 
@@ -142,6 +143,15 @@ namespace tangere
 #endif // defined(USE_BVH)
     }
 
+    // Closest hits of a packet of rays
+    inline void intersect(      HitRecord<T>*     hits,
+                          const RenderContext<T>& rc,
+                          const RayPacket<T>&     packet) const
+    {
+      for (uint i = 0; i < RayPacket<T>::size; ++i)
+        intersect(hits[i], rc, packet[i]);
+    }
+
     void printStats(bool all) const
     {
       Output("BVH stats:" << endl);
@@ -344,6 +354,124 @@ namespace tangere
     return n;
   }
 
+#if defined(USE_AVX2_PACKETS)
+  //////////////////////////////////////////////////////////////////////////////
+  // Template specialization - BVH<int> packets
+
+  // An explicit stack of (node, lanes, entry distances); a node is visited
+  // while any of its lanes is still closer than that lane's current hit, and
+  // the child entered first by the first lane that hits both is traversed
+  // first
+  template<>
+  inline void BVH<int>::intersect(      HitRecord<int>*     hits,
+                                  const RenderContext<int>& rc,
+                                  const RayPacket<int>&     packet) const
+  {
+    static const uint stackSize = 64;
+    if (maxDepth + 2 > stackSize)
+    {
+      for (uint i = 0; i < RayPacket<int>::size; ++i)
+        intersect(hits[i], rc, packet[i]);
+
+      return;
+    }
+
+    struct Entry
+    {
+      __m256i t;
+      __m256i lanes;
+      uint    nodeID;
+    };
+
+    Entry stack[stackSize];
+    uint  top = 0;
+
+    __m256i tMin = _mm256_setr_epi64x(hits[0].getMinT(), hits[1].getMinT(),
+                                      hits[2].getMinT(), hits[3].getMinT());
+
+    stack[top].t      = _mm256_set1_epi64x(-int64_t(INT_MAX) - 1);
+    stack[top].lanes  = _mm256_set1_epi64x(-1);
+    stack[top].nodeID = 0;
+    ++top;
+
+    while (top > 0)
+    {
+      --top;
+      const __m256i live   = _mm256_and_si256(stack[top].lanes,
+                               _mm256_cmpgt_epi64(tMin, stack[top].t));
+      const uint    nodeID = stack[top].nodeID;
+      if (!laneMask(live))
+        continue;
+
+      const Node<int>& node = nodes[nodeID];
+
+      /////////////////////////////////////////////////////////////////////////
+      // Intersect leaf node
+
+      if (node.numTris > 0)
+      {
+        for (uint i = 0; i < node.numTris; ++i)
+          triangles[node.index + i].intersect(hits, rc, packet, live);
+
+        tMin = _mm256_setr_epi64x(hits[0].getMinT(), hits[1].getMinT(),
+                                  hits[2].getMinT(), hits[3].getMinT());
+        continue;
+      }
+
+      /////////////////////////////////////////////////////////////////////////
+      // Intersect interior node
+
+      const uint lidx = node.index;
+      const uint ridx = lidx+1;
+
+      __m256i tLeft, tRight;
+      const __m256i lLanes =
+        _mm256_and_si256(_mm256_and_si256(nodes[lidx].box.intersect(tLeft,
+                                                                    packet),
+                                          live),
+                         _mm256_cmpgt_epi64(tMin, tLeft));
+      const __m256i rLanes =
+        _mm256_and_si256(_mm256_and_si256(nodes[ridx].box.intersect(tRight,
+                                                                    packet),
+                                          live),
+                         _mm256_cmpgt_epi64(tMin, tRight));
+
+      const int lBits = laneMask(lLanes);
+      const int rBits = laneMask(rLanes);
+      const int both  = lBits & rBits;
+      const int first = both & -both;
+      const bool leftFirst =
+        (!both || (laneMask(_mm256_cmpgt_epi64(tRight, tLeft)) & first));
+
+      // Push the far child, then the near one
+      const uint    nearID = (leftFirst ? lidx   : ridx  );
+      const uint    farID  = (leftFirst ? ridx   : lidx  );
+      const __m256i tNear  = (leftFirst ? tLeft  : tRight);
+      const __m256i tFar   = (leftFirst ? tRight : tLeft );
+      const int     nBits  = (leftFirst ? lBits  : rBits );
+      const int     fBits  = (leftFirst ? rBits  : lBits );
+      const __m256i nLanes = (leftFirst ? lLanes : rLanes);
+      const __m256i fLanes = (leftFirst ? rLanes : lLanes);
+
+      if (fBits)
+      {
+        stack[top].t      = tFar;
+        stack[top].lanes  = fLanes;
+        stack[top].nodeID = farID;
+        ++top;
+      }
+
+      if (nBits)
+      {
+        stack[top].t      = tNear;
+        stack[top].lanes  = nLanes;
+        stack[top].nodeID = nearID;
+        ++top;
+      }
+    }
+  }
+#endif // defined(USE_AVX2_PACKETS)
+
 } // namespace tangere
 
 #endif // tangere_BVH_t
@@ -19,6 +19,7 @@
 #define tangere_Flags_h
 
 #define MAX_DEPTH 10
+#define TILE_SIZE 16
 // #define RENDER_ALL
 
 #define USE_32_BIT_SHADERS
@@ -28,10 +29,17 @@
 #define USE_BVH
 #define USE_D_BITS
 #define USE_INVDIR
+#define USE_PACKETS
 //#define USE_GEOMETRY_LIGHTS
 #ifndef USE_GEOMETRY_LIGHTS
 #  define OFFSET_EYE_LIGHT
 #endif
 // #define USE_HARDCODED_PATH
 
+// Integer packets are traced with AVX2 when the compiler targets it
+#if defined(USE_PACKETS) && defined(USE_BVH) && defined(USE_INVDIR) && \
+    defined(__AVX2__)
+#  define USE_AVX2_PACKETS
+#endif
+
 #endif // tangere_Flags_h
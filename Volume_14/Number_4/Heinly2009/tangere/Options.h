@@ -36,13 +36,17 @@ namespace tangere
     bool   iInput;
     string iWrite;
     bool   overwrite;
+
+    // Render options
+    bool   packets;
   };
 
   inline Options::Options() :
     FileIO::Options(),
     iInput(false),
     iWrite(""),
-    overwrite(true)
+    overwrite(true),
+    packets(true)
   {
     // no-op
   }
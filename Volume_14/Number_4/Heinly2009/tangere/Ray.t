@@ -55,6 +55,11 @@ namespace tangere
 #endif // defined(USE_INVDIR)
     }
 
+    inline Ray()
+    {
+      // no-op
+    }
+
     inline ~Ray()
     {
       // no-op
@@ -133,6 +138,11 @@ namespace tangere
 #endif // defined(USE_INVDIR)
     }
 
+    inline Ray()
+    {
+      // no-op
+    }
+
     inline ~Ray()
     {
       // no-op
@@ -0,0 +1,284 @@
+
+/*
+ *  Copyright 2009, 2010 Grove City College
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef tangere_RayPacket_t
+#define tangere_RayPacket_t
+
+#if defined(USE_AVX2_PACKETS)
+#include <immintrin.h>
+#endif // defined(USE_AVX2_PACKETS)
+
+#include <Common/Types.h>
+
+#include <tangere/Constants.h>
+#include <tangere/Flags.h>
+#include <tangere/Ray.t>
+
+namespace tangere
+{
+
+  ///////////////////////////////////////////////////////////////////////////////
+  // Class template definition
+
+  // A 2x2 packet of primary rays; the rays themselves are owned by the caller
+  template<typename T>
+  class RayPacket
+  {
+  public:
+    static const uint size = 4;
+
+    inline RayPacket(const Ray<T>* rays_) :
+      rays(rays_)
+    {
+      // no-op
+    }
+
+    inline ~RayPacket()
+    {
+      // no-op
+    }
+
+    inline const Ray<T>& operator[](uint i) const { return rays[i]; }
+
+  private:
+    const Ray<T>* rays;
+  };
+
+#if defined(USE_AVX2_PACKETS)
+
+  ///////////////////////////////////////////////////////////////////////////////
+  // 64-bit lane helpers
+  //
+  // AVX2 has neither a 64-bit arithmetic shift nor a 64-bit multiply, so both
+  // are built from 32x32->64 multiplies (_mm256_mul_epi32) and logical shifts.
+  // Results wrap exactly as the scalar int64_t arithmetic does, which keeps
+  // the packet path bit-for-bit identical to the scalar one.
+
+  // a >> n for signed lanes, 0 <= n < 64
+  inline __m256i srai64(__m256i a, int n)
+  {
+#if defined(__AVX512VL__)
+    return _mm256_sra_epi64(a, _mm_cvtsi32_si128(n));
+#else
+    const __m256i sign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), a);
+    return _mm256_or_si256(_mm256_srl_epi64(a,    _mm_cvtsi32_si128(n)),
+                           _mm256_sll_epi64(sign, _mm_cvtsi32_si128(64 - n)));
+#endif // defined(__AVX512VL__)
+  }
+
+  // static_cast<int>(a), sign-extended back to 64 bits
+  inline __m256i cvt32(__m256i a)
+  {
+    return _mm256_blend_epi32(a,
+                              _mm256_srai_epi32(_mm256_slli_epi64(a, 32), 31),
+                              0xAA);
+  }
+
+  inline __m256i min64(__m256i a, __m256i b)
+  {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+  }
+
+  inline __m256i max64(__m256i a, __m256i b)
+  {
+    return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+  }
+
+  // A 64-bit multiplicand split as hi*2^21 + lo, 0 <= lo < 2^21; hi must fit
+  // in 32 bits.  _mm256_mul_epi32 reads only the low half of each lane, so a
+  // logical shift does for hi.
+  static const int splitBits = 21;
+
+  inline void split64(__m256i& hi, __m256i& lo, __m256i b)
+  {
+    hi = _mm256_srli_epi64(b, splitBits);
+    lo = _mm256_and_si256(b, _mm256_set1_epi64x((1 << splitBits) - 1));
+  }
+
+  // a*b (mod 2^64) for 32-bit a and split b
+  inline __m256i mul64(__m256i a, __m256i bHi, __m256i bLo)
+  {
+    return _mm256_add_epi64(_mm256_slli_epi64(_mm256_mul_epi32(a, bHi),
+                                              splitBits),
+                            _mm256_mul_epi32(a, bLo));
+  }
+
+  // MUL31(a, b) for 32-bit a and b; the result is truncated to 32 bits,
+  // which the upper bits of the shifts cannot reach, so logical shifts do
+  inline __m256i mul31(__m256i a, __m256i b)
+  {
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i ab  = _mm256_mul_epi32(a, b);
+    return cvt32(_mm256_srli_epi64(_mm256_add_epi64(_mm256_srli_epi64(ab, 30),
+                                                    one), 1));
+  }
+
+  inline int laneMask(__m256i mask)
+  {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(mask));
+  }
+
+  inline __m256i abs64(__m256i a)
+  {
+    const __m256i sign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), a);
+    return _mm256_sub_epi64(_mm256_xor_si256(a, sign), sign);
+  }
+
+  // double(a), rounded
+  inline __m256d cvt64(__m256i a)
+  {
+    // Split at bit 32:  the high half is offset by 3*2^67 and the low half
+    // by 2^52 so that both become exact doubles
+    const __m256d offsetHi = _mm256_set1_pd(442721857769029238784.);
+    const __m256d offsetLo = _mm256_set1_pd(4503599627370496.);
+
+    __m256i hi = _mm256_srai_epi32(a, 16);
+    hi = _mm256_blend_epi16(hi, _mm256_setzero_si256(), 0x33);
+    hi = _mm256_add_epi64(hi, _mm256_castpd_si256(offsetHi));
+
+    const __m256i lo = _mm256_blend_epi16(a, _mm256_castpd_si256(offsetLo),
+                                          0x88);
+
+    return _mm256_add_pd(_mm256_sub_pd(_mm256_castsi256_pd(hi),
+                                       _mm256_add_pd(offsetHi, offsetLo)),
+                         _mm256_castsi256_pd(lo));
+  }
+
+  // q = numer/denom, truncated as the scalar division is, for the lanes whose
+  // quotient is estimated to lie in [qMin, qMax] (a subrange of the 32-bit
+  // integers); returns those lanes.  Lanes estimated in (qMax, qMax + 4] are
+  // returned in edge; the estimate cannot tell those from their neighbors.
+  //
+  // The double-precision quotient is within 1 of the exact one, so one
+  // correction step against the exact remainder suffices
+  inline int div64(__m256i& q, int& edge, __m256i numer, __m256i denom,
+                   __m256i lanes, double qMin, double qMax)
+  {
+    const __m256d qd   = _mm256_div_pd(cvt64(numer), cvt64(denom));
+    const __m256d live = _mm256_castsi256_pd(lanes);
+
+    const int inside =
+      _mm256_movemask_pd(_mm256_and_pd(live,
+        _mm256_and_pd(_mm256_cmp_pd(qd, _mm256_set1_pd(qMin), _CMP_GE_OQ),
+                      _mm256_cmp_pd(qd, _mm256_set1_pd(qMax), _CMP_LE_OQ))));
+    edge =
+      _mm256_movemask_pd(_mm256_and_pd(live,
+        _mm256_and_pd(_mm256_cmp_pd(qd, _mm256_set1_pd(qMax), _CMP_GT_OQ),
+                      _mm256_cmp_pd(qd, _mm256_set1_pd(qMax + 4),
+                                    _CMP_LE_OQ))));
+    if (!inside)
+      return 0;
+
+    const __m256d safe = _mm256_blendv_pd(_mm256_setzero_pd(), qd, live);
+    const __m256i q0   = _mm256_cvtepi32_epi64(_mm256_cvttpd_epi32(safe));
+
+    __m256i dHi, dLo;
+    split64(dHi, dLo, denom);
+
+    const __m256i rem  = _mm256_sub_epi64(numer, mul64(q0, dHi, dLo));
+    const __m256i zero = _mm256_setzero_si256();
+
+    // Direction of the quotient:  +1 or -1
+    const __m256i step =
+      _mm256_or_si256(_mm256_srai_epi32(_mm256_shuffle_epi32(
+                        _mm256_xor_si256(numer, denom), 0xF5), 31),
+                      _mm256_set1_epi64x(1));
+
+    // Too far from zero:  a nonzero remainder of the wrong sign
+    const __m256i over  =
+      _mm256_andnot_si256(_mm256_cmpeq_epi64(rem, zero),
+                          _mm256_cmpgt_epi64(zero,
+                                             _mm256_xor_si256(rem, numer)));
+    // Too close to zero:  a remainder as large as the divisor
+    const __m256i under =
+      _mm256_andnot_si256(_mm256_cmpgt_epi64(abs64(denom), abs64(rem)),
+                          _mm256_set1_epi64x(-1));
+
+    q = _mm256_sub_epi64(q0, _mm256_and_si256(over,  step));
+    q = _mm256_add_epi64(q,  _mm256_andnot_si256(over,
+                                _mm256_and_si256(under, step)));
+
+    return inside;
+  }
+
+  ///////////////////////////////////////////////////////////////////////////////
+  // Template specialization - RayPacket<int>
+
+  template<>
+  class RayPacket<int>
+  {
+  public:
+    static const uint size = 4;
+
+    inline RayPacket(const Ray<int>* rays_) :
+      rays(rays_)
+    {
+      for (uint k = 0; k < 3; ++k)
+      {
+        const Ray<int>* r = rays;
+
+        org32[k]  = _mm_setr_epi32(r[0].org()[k], r[1].org()[k],
+                                   r[2].org()[k], r[3].org()[k]);
+        sign32[k] = _mm_setr_epi32(-int(r[0].sign()[k]), -int(r[1].sign()[k]),
+                                   -int(r[2].sign()[k]), -int(r[3].sign()[k]));
+        org64[k]  = _mm256_cvtepi32_epi64(org32[k]);
+        dir64[k]  = _mm256_cvtepi32_epi64(
+                      _mm_setr_epi32(r[0].dir()[k], r[1].dir()[k],
+                                     r[2].dir()[k], r[3].dir()[k]));
+
+#if defined(USE_INVDIR)
+        split64(invHi[k], invLo[k],
+                _mm256_setr_epi64x(r[0].inv()[k], r[1].inv()[k],
+                                   r[2].inv()[k], r[3].inv()[k]));
+#endif // defined(USE_INVDIR)
+      }
+    }
+
+    inline ~RayPacket()
+    {
+      // no-op
+    }
+
+    inline const Ray<int>& operator[](uint i) const { return rays[i]; }
+
+    inline const __m128i* org32v()  const { return org32;  }
+    inline const __m128i* sign32v() const { return sign32; }
+    inline const __m256i* org64v()  const { return org64;  }
+    inline const __m256i* dir64v()  const { return dir64;  }
+#if defined(USE_INVDIR)
+    inline const __m256i* invHiv()  const { return invHi;  }
+    inline const __m256i* invLov()  const { return invLo;  }
+#endif // defined(USE_INVDIR)
+
+  private:
+    __m128i org32[3];  // origins
+    __m128i sign32[3]; // all ones where the direction is negative
+    __m256i org64[3];  // origins, sign-extended
+    __m256i dir64[3];  // directions, sign-extended
+#if defined(USE_INVDIR)
+    __m256i invHi[3];  // inverse directions, split for mul64
+    __m256i invLo[3];
+#endif // defined(USE_INVDIR)
+
+    const Ray<int>* rays;
+  };
+
+#endif // defined(USE_AVX2_PACKETS)
+
+} // namespace tangere
+
+#endif // tangere_RayPacket_t
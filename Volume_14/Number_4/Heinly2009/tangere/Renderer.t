@@ -26,9 +26,16 @@
 #include <Saturn.h>
 #endif // USE_SATURN
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif // defined(_OPENMP)
+
 #include <string>
 using std::string;
 
+#include <vector>
+using std::vector;
+
 #include <Common/FileIO/BVH.h>
 #include <Common/FileIO/Image.t>
 #include <Common/FileIO/Mesh.h>
@@ -47,6 +54,7 @@ using std::string;
 #include <tangere/Material.t>
 #include <tangere/Options.h>
 #include <tangere/Ray.t>
+#include <tangere/RayPacket.t>
 #include <tangere/Scene.t>
 #include <tangere/Shader.t>
 
@@ -61,7 +69,8 @@ namespace tangere
   {
   public:
     inline Renderer(const Scene<T>* scene_, const Options& opt) :
-      scene(scene_)
+      scene(scene_),
+      packets(opt.packets)
     {
       bname = opt.bname + "_" + (typeid(T).name())[0];
     }
@@ -89,14 +98,42 @@ namespace tangere
       const uint            xRes   = image->w();
       const uint            yRes   = image->h();
 
-      const RenderContext<T> rc(scene);
-
       const float xMin = -1.f + 1.f/xRes;
       const float dx   = 2.f/xRes;
 
       const float yMin = -1.f + 1.f/yRes;
       const float dy   = 2.f/yRes;
 
+      // Pixel coordinates, summed along a row and a column as a scanline
+      // loop would, so the image does not depend on the tiling
+      vector<float> xs(xRes);
+      vector<float> ys(yRes);
+
+      float x = xMin;
+      for (uint i = 0; i < xRes; ++i, x += dx)
+        xs[i] = x;
+
+      float y = yMin;
+      for (uint j = 0; j < yRes; ++j, y += dy)
+        ys[j] = y;
+
+      // Tiles are handed out one at a time from a shared queue (a dynamic
+      // schedule), so idle threads pick up the remaining work; each pixel
+      // depends only on its own coordinates, so the image is the same for
+      // any number of threads
+      const uint xTiles = (xRes + TILE_SIZE - 1)/TILE_SIZE;
+      const uint yTiles = (yRes + TILE_SIZE - 1)/TILE_SIZE;
+      const int  nTiles = xTiles*yTiles;
+
+      int nThreads = 1;
+#if defined(_OPENMP)
+      nThreads = omp_get_max_threads();
+#endif // defined(_OPENMP)
+
+      vector<float> busy(nThreads, 0.f);
+      vector<uint>  tiles(nThreads, 0);
+      int           done = 0;
+
       Output(endl);
 #if defined(USE_BENCHMARK_MODE)
       Output("Benchmarking:  ");
@@ -104,34 +141,86 @@ namespace tangere
       Output("Progress:       0%" << flush);
 #endif // defined(USE_BENCHMARK)
 
-      float y = yMin;
-      for (uint j = 0; j < yRes; ++j)
+#pragma omp parallel
       {
-#if !defined(USE_BENCHMARK_MODE)
-        Output("\b\b\b");
-        Output(setw(2) << (100*j/yRes) << "%" << flush);
-#endif // !defined(USE_BENCHMARK_MODE)
+        int thread = 0;
+#if defined(_OPENMP)
+        thread = omp_get_thread_num();
+#endif // defined(_OPENMP)
+
+        // Per-thread render context
+        const RenderContext<T> rc(scene);
 
-        float x = xMin;
-        for (uint i = 0; i < xRes; ++i)
+#pragma omp for schedule(dynamic, 1)
+        for (int t = 0; t < nTiles; ++t)
         {
-          Ray<T> ray = camera->generate(x, y);
-          HitRecord<T> hit;
-          bvh->intersect(hit, rc, ray);
-          if (hit.getTriangle())
+          Timer tileTimer;
+
+          const uint iMin = (t % xTiles)*TILE_SIZE;
+          const uint jMin = (t / xTiles)*TILE_SIZE;
+          const uint iMax = Min(iMin + TILE_SIZE, xRes);
+          const uint jMax = Min(jMin + TILE_SIZE, yRes);
+
+          if (packets)
           {
-            const Shader<T>*   shader   = hit.getShader();
-            const uint&        mID      = hit.getMaterialID();
-            const Material<T>& material = bvh->getMaterials()[mID];
-            image->set(i, j, shader->shade(rc, ray, hit, material, 0));
+            // 2x2 packets; at odd image edges the missing rays repeat
+            // their neighbors and are not shaded
+            for (uint j = jMin; j < jMax; j += 2)
+            {
+              const uint j1 = Min(j + 1, jMax - 1);
+              for (uint i = iMin; i < iMax; i += 2)
+              {
+                const uint i1    = Min(i + 1, iMax - 1);
+                const uint pi[4] = { i, i1, i,  i1 };
+                const uint pj[4] = { j, j,  j1, j1 };
+
+                Ray<T> rays[RayPacket<T>::size];
+                for (uint k = 0; k < RayPacket<T>::size; ++k)
+                  rays[k] = camera->generate(xs[pi[k]], ys[pj[k]]);
+
+                const RayPacket<T> packet(rays);
+                HitRecord<T>       hits[RayPacket<T>::size];
+                bvh->intersect(hits, rc, packet);
+
+                for (uint k = 0; k < RayPacket<T>::size; ++k)
+                {
+                  if ((k & 1 && i1 == i) || (k & 2 && j1 == j))
+                    continue;
+
+                  image->set(pi[k], pj[k], shade(rc, rays[k], hits[k]));
+                }
+              }
+            }
           }
           else
-            image->set(i, j, scene->getBackground(ray.dir()));
+          {
+            for (uint j = jMin; j < jMax; ++j)
+            {
+              for (uint i = iMin; i < iMax; ++i)
+              {
+                Ray<T> ray = camera->generate(xs[i], ys[j]);
+                HitRecord<T> hit;
+                bvh->intersect(hit, rc, ray);
+                image->set(i, j, shade(rc, ray, hit));
+              }
+            }
+          }
 
-          x += dx;
-        }
+          busy[thread] += tileTimer.getElapsed();
+          ++tiles[thread];
 
-        y += dy;
+#if !defined(USE_BENCHMARK_MODE)
+#pragma omp critical(tangere_Renderer_progress)
+          {
+            ++done;
+            if (100*done/nTiles != 100*(done - 1)/nTiles)
+            {
+              Output("\b\b\b");
+              Output(setw(2) << Min(100*done/nTiles, 99) << "%" << flush);
+            }
+          }
+#endif // !defined(USE_BENCHMARK_MODE)
+        }
       }
 
 #if defined(USE_BENCHMARK_MODE)
@@ -140,7 +229,22 @@ namespace tangere
       Output("\b\b\b" << "100%" << endl);
 #endif // defined(USE_BENCHMARK_MODE)
 
-      Output("Render time:   " << timer.getElapsed() << endl);
+      const float elapsed = timer.getElapsed();
+      Output("Render time:   " << elapsed << endl);
+      Output("Primary rays:  " << 1e-6f*xRes*yRes/elapsed << " Mrays/s ("
+             << (packets ? "2x2 packets" : "single rays")
+#if defined(USE_AVX2_PACKETS)
+             << (packets && typeid(T) == typeid(int) ? ", avx2" : "")
+#endif // defined(USE_AVX2_PACKETS)
+             << ')' << endl);
+      Output("Threads:       " << nThreads << " (" << nTiles << " tiles of "
+             << TILE_SIZE << 'x' << TILE_SIZE << ')' << endl);
+      for (int i = 0; i < nThreads; ++i)
+      {
+        Output("  thread[" << i << "] = " << tiles[i] << " tiles, "
+               << (elapsed > 0 ? 100.f*busy[i]/elapsed : 0.f) << "% busy"
+               << endl);
+      }
 
 #ifdef USE_CHUD
       chudStopRemotePerfMonitor();
@@ -156,8 +260,22 @@ namespace tangere
     }
 
   private:
+    inline RGB<T> shade(const RenderContext<T>& rc,
+                        const Ray<T>&           ray,
+                        const HitRecord<T>&     hit) const
+    {
+      if (!hit.getTriangle())
+        return scene->getBackground(ray.dir());
+
+      const Shader<T>*   shader   = hit.getShader();
+      const uint&        mID      = hit.getMaterialID();
+      const Material<T>& material = scene->getBVH()->getMaterials()[mID];
+      return shader->shade(rc, ray, hit, material, 0);
+    }
+
           string    bname;
     const Scene<T>* scene;
+          bool      packets;
   };
 
 } // namespace tangere
@@ -20,6 +20,12 @@
 
 #include <cstring>
 
+#include <limits>
+using std::numeric_limits;
+
+#include <string>
+using std::string;
+
 #include <vector>
 using std::vector;
 
@@ -150,13 +156,24 @@ namespace tangere
 
       Output("Building BVH...");
 
-      FileIO::BVH ioBVH(objects, ioScene->getThreshold());
+      // The objects of the float and integer scenes are scaled differently,
+      // so each has its own cache file
+      string cacheName = ioScene->getCacheName();
+      if (cacheName != "")
+        cacheName += (numeric_limits<T>::is_integer ? "_i.bvh" : "_f.bvh");
+
+      Timer timer;
+      FileIO::BVH ioBVH(objects,
+                        ioScene->getThreshold(),
+                        ioScene->getNumBins(),
+                        cacheName);
       bvh = new BVH<T>(ioBVH, triangles, materials, scaler);
 
       triangles.resize(0);
       materials.resize(0);
 
-      Output("  done" << endl);
+      Output("  done (" << timer.getElapsed() << " s"
+             << (ioBVH.isCached() ? ", cached" : "") << ')' << endl);
       Output(endl);
       bvh->printStats(false);
 
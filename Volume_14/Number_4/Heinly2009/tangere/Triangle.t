@@ -30,6 +30,7 @@ using std::ostream;
 #include <tangere/Context.t>
 #include <tangere/HitRecord.t>
 #include <tangere/Ray.t>
+#include <tangere/RayPacket.t>
 
 namespace tangere
 {
@@ -355,6 +356,122 @@ namespace tangere
       hit.hit(thit, this, Vector<int>(alpha, gamma, beta), mID);
     }
 
+#if defined(USE_AVX2_PACKETS)
+    // The packet version of the test above; everything up to the barycentric
+    // signs is done four rays at a time, except for the 64-bit division, which
+    // has no SIMD equivalent
+    inline void intersect(      HitRecord<int>*     hits,
+                          const RenderContext<int>& rc,
+                          const RayPacket<int>&     packet,
+                                __m256i             active) const
+    {
+      const __m256i* omega  = packet.dir64v();
+      const __m256i* origin = packet.org64v();
+      const uint     p      = mod3[r+1];
+      const uint     q      = mod3[r+2];
+
+      const __m256i npv   = _mm256_set1_epi64x(np);
+      const __m256i nqv   = _mm256_set1_epi64x(nq);
+      const __m256i denom = _mm256_add_epi64(omega[r],
+                            _mm256_add_epi64(mul31(omega[p], npv),
+                                             mul31(omega[q], nqv)));
+
+      active = _mm256_andnot_si256(_mm256_cmpeq_epi64(denom,
+                                                      _mm256_setzero_si256()),
+                                   active);
+      const int live = laneMask(active);
+      if (!live)
+        return;
+
+      const __m256i numer =
+        _mm256_sub_epi64(_mm256_slli_epi64(_mm256_sub_epi64(
+                                             _mm256_set1_epi64x(d), origin[r]),
+                                           mMinusOne),
+                         _mm256_add_epi64(_mm256_mul_epi32(origin[p], npv),
+                                          _mm256_mul_epi32(origin[q], nqv)));
+
+      // Lanes whose hit distance lies in [Epsilon, INT_MAX]; the few near
+      // INT_MAX are divided one at a time
+      const int eps = ::Constants<int>::Epsilon;
+
+      __m256i t64  = _mm256_setzero_si256();
+      int     edge  = 0;
+      int     valid = div64(t64, edge, numer, denom, active,
+                            eps - 2., INT_MAX - 4.);
+
+      valid &= ~laneMask(_mm256_cmpgt_epi64(_mm256_set1_epi64x(eps), t64));
+
+      int64_t th[4];
+      _mm256_storeu_si256((__m256i*)th, t64);
+      if (edge)
+      {
+        int64_t n[4];
+        int64_t dn[4];
+        _mm256_storeu_si256((__m256i*)n,  numer);
+        _mm256_storeu_si256((__m256i*)dn, denom);
+
+        for (uint k = 0; k < 4; ++k)
+        {
+          if (!(edge & (1 << k)))
+            continue;
+
+          th[k] = n[k]/dn[k];
+          if (th[k] >= eps && th[k] <= INT_MAX)
+            valid |= 1 << k;
+        }
+      }
+
+      if (!valid)
+        return;
+
+      const __m256i thit = _mm256_loadu_si256((const __m256i*)th);
+      const __m256i kp   = _mm256_sub_epi64(
+                             _mm256_add_epi64(origin[p], mul31(thit, omega[p])),
+                             _mm256_set1_epi64x(int64_t(pp)));
+      const __m256i kq   = _mm256_sub_epi64(
+                             _mm256_add_epi64(origin[q], mul31(thit, omega[q])),
+                             _mm256_set1_epi64x(int64_t(pq)));
+
+      __m256i kpHi, kpLo, kqHi, kqLo;
+      split64(kpHi, kpLo, kp);
+      split64(kqHi, kqLo, kq);
+
+      const __m256i e0pv = _mm256_set1_epi64x(e0p);
+      const __m256i e0qv = _mm256_set1_epi64x(e0q);
+      const __m256i e1pv = _mm256_set1_epi64x(e1p);
+      const __m256i e1qv = _mm256_set1_epi64x(e1q);
+
+      const __m256i u = _mm256_sub_epi64(mul64(e0pv, kqHi, kqLo),
+                                         mul64(e0qv, kpHi, kpLo));
+      const __m256i v = _mm256_sub_epi64(mul64(e1qv, kpHi, kpLo),
+                                         mul64(e1pv, kqHi, kqLo));
+
+      // u >= 0 && v >= 0
+      valid &= ~laneMask(_mm256_or_si256(u, v));
+      if (!valid)
+        return;
+
+      int64_t uk[4];
+      int64_t vk[4];
+      _mm256_storeu_si256((__m256i*)uk, u);
+      _mm256_storeu_si256((__m256i*)vk, v);
+
+      for (uint k = 0; k < 4; ++k)
+      {
+        if (!(valid & (1 << k)))
+          continue;
+
+        if (((uk[k] + vk[k]) >> edgeBias) > (int64_t(1) << mMinusOne))
+          continue;
+
+        int beta  = int(uk[k] >> edgeBias);
+        int gamma = int(vk[k] >> edgeBias);
+        int alpha = INT_MAX - beta - gamma;
+        hits[k].hit(int(th[k]), this, Vector<int>(alpha, gamma, beta), mID);
+      }
+    }
+#endif // defined(USE_AVX2_PACKETS)
+
     inline Vector<int> normal(const RenderContext<int>& rc,
                               const Ray<int>& ray,
                               const Point<int>& hitPoint,
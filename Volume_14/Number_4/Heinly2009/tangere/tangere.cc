@@ -156,10 +156,13 @@ void usage(int ec)
   Output(endl);
   Output("usage:  tangere [options] <scene>" << endl);
   Output("options:" << endl);
+  Output("  -bins <i>             bvh builder bins (0 = sah sweep)" << endl);
+  Output("  -cache                read/write \"_f.bvh\"/\"_i.bvh\" cache files" << endl);
   Output("  -ground <f> <f> <f>   ground emission" << endl);
   Output("  --help | -h           print this message and exit" << endl);
   Output("  -o <s>                output file basename" << endl);
   Output("  -res <i>x<i>          image resolution" << endl);
+  Output("  -scalar               trace primary rays one at a time" << endl);
   Output("  -sky <f> <f> <f>      sky emission" << endl);
   Output("  -spp <i>              samples per pixel" << endl);
   Output("  -threshold <i>        bvh leaf creation threshold" << endl);
@@ -205,7 +208,21 @@ void parseCmdLn(Options& opt, int argc, char* argv[])
     string arg(argv[i]);
     uint   nremain = argc - i - 1;
 
-    if (arg == "-ground")
+    if (arg == "-bins")
+    {
+      if (nremain < 1)
+      {
+        Error("\"-bins\" expects 1 argument" << endl);
+        usage(-1);
+      }
+      
+      opt.nbins = atoi(argv[++i]);
+    }
+    else if (arg == "-cache")
+    {
+      opt.cache = true;
+    }
+    else if (arg == "-ground")
     {
       if (nremain < 3)
       {
@@ -257,6 +274,10 @@ void parseCmdLn(Options& opt, int argc, char* argv[])
       opt.xres = atoi(xres.c_str());
       opt.yres = atoi(yres.c_str());
     }
+    else if (arg == "-scalar")
+    {
+      opt.packets = false;
+    }
     else if (arg == "-sky")
     {
       if (nremain < 3)
@@ -0,0 +1,411 @@
+// David Eberly, Geometric Tools, Redmond WA 98052
+// Copyright (c) 1998-2018
+// Distributed under the Boost Software License, Version 1.0.
+// http://www.boost.org/LICENSE_1_0.txt
+// http://www.geometrictools.com/License/Boost/LICENSE_1_0.txt
+// File Version: 3.0.0 (2016/06/19)
+
+#pragma once
+
+#include <Mathematics/GteChebyshevRatio.h>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Batch versions of SLERP<float>::Estimate<N> and SLERP<float>::EstimateR<N>
+// (see GteSlerpEstimate.h) for quaternions stored as structure-of-arrays,
+// that is, quaternion i is (x[i],y[i],z[i],w[i]).  The polynomial estimate
+// of ChebyshevRatio<float>::GetEstimate<N> is evaluated for 16 quaternions
+// at a time when compiled with AVX-512 (__AVX512F__), 8 at a time with AVX2
+// (__AVX2__), and one at a time otherwise.  The remaining elements of a
+// batch are processed one at a time.  The results are the same as those of
+// the single-quaternion functions up to floating-point rounding.
+//
+// The output arrays may be the same as the input arrays, but must not
+// otherwise overlap them.
+//
+// PoseBlend<N> is a driver for animation systems, it blends two skeleton
+// poses (bone rotations) by splitting the bones among threads, each thread
+// calling SlerpEstimateBatch<N>::Estimate on a contiguous range of bones.
+
+namespace gte
+{
+
+template <int N>
+class SlerpEstimateBatch
+{
+public:
+    // The angle between q0[i] and q1[i] is in [0,pi).  There are no angle
+    // restrictions and nothing is precomputed.
+    static void Estimate(int numElements, float const* t,
+        float const* x0, float const* y0, float const* z0, float const* w0,
+        float const* x1, float const* y1, float const* z1, float const* w1,
+        float* x, float* y, float* z, float* w);
+
+    // The angle between q0[i] and q1[i] must be in [0,pi/2].  See the
+    // comments for SLERP<Real>::EstimateR about the preprocessing.
+    static void EstimateR(int numElements, float const* t,
+        float const* x0, float const* y0, float const* z0, float const* w0,
+        float const* x1, float const* y1, float const* z1, float const* w1,
+        float* x, float* y, float* z, float* w);
+
+private:
+    // Evaluate ChebyshevRatio<float>::GetEstimate<N> for a single element.
+    // When Restricted is false, the sign of Dot(q0,q1) is handled as in
+    // SLERP<Real>::Estimate.
+    template <bool Restricted>
+    static void Run(int i0, int i1, float const* t,
+        float const* x0, float const* y0, float const* z0, float const* w0,
+        float const* x1, float const* y1, float const* z1, float const* w1,
+        float* x, float* y, float* z, float* w);
+
+    // The coefficients used by ChebyshevRatio<float>::GetEstimate<N>, in
+    // the loop: term *= (b[i] - a[i] * term^2) * y.  They are computed on
+    // the first call of GetCoefficients, which is thread-safe.
+    struct Coefficients
+    {
+        Coefficients();
+        float a[N], b[N];
+    };
+    static Coefficients const& GetCoefficients();
+};
+
+// Storage for the bone rotations of one or more skeletons.
+class QuaternionSoA
+{
+public:
+    QuaternionSoA(int numElements = 0)
+    {
+        Resize(numElements);
+    }
+
+    void Resize(int numElements)
+    {
+        x.resize(numElements);
+        y.resize(numElements);
+        z.resize(numElements);
+        w.resize(numElements);
+    }
+
+    inline int GetNumElements() const
+    {
+        return static_cast<int>(x.size());
+    }
+
+    std::vector<float> x, y, z, w;
+};
+
+template <int N>
+class PoseBlend
+{
+public:
+    // A 'numThreads' of 0 means std::thread::hardware_concurrency().  Small
+    // inputs are blended on the calling thread, because launching threads
+    // costs more than the blending.
+    PoseBlend(unsigned int numThreads = 0, int minElementsPerThread = 4096);
+
+    // Compute pose[i] = slerp(t[i], pose0[i], pose1[i]) for all bones i.
+    // The poses must have the same number of bones; the output pose is
+    // resized as needed.
+    void Execute(float const* t, QuaternionSoA const& pose0,
+        QuaternionSoA const& pose1, QuaternionSoA& pose) const;
+
+    // The same as Execute, but with a single blend weight for all bones.
+    void Execute(float t, QuaternionSoA const& pose0,
+        QuaternionSoA const& pose1, QuaternionSoA& pose) const;
+
+private:
+    unsigned int mNumThreads;
+    int mMinElementsPerThread;
+};
+
+
+template <int N>
+SlerpEstimateBatch<N>::Coefficients::Coefficients()
+{
+    static_assert(1 <= N && N <= 16, "Invalid degree.");
+
+    // Keep these in sync with ChebyshevRatio<Real>::GetEstimate.
+    double const onePlusMu[16] =
+    {
+        1.62943436108234530,
+        1.73965850021313961,
+        1.79701067629566813,
+        1.83291820510335812,
+        1.85772477879039977,
+        1.87596835698904785,
+        1.88998444919711206,
+        1.90110745351730037,
+        1.91015881189952352,
+        1.91767344933047190,
+        1.92401541194159076,
+        1.92944142668012797,
+        1.93413793373091059,
+        1.93824371262559758,
+        1.94186426368404708,
+        1.94508125972497303
+    };
+
+    for (int i = 0; i < N; ++i)
+    {
+        float const k = (float)(i + 1);
+        float const mu = (i == N - 1 ? (float)onePlusMu[N - 1] : 1.0f);
+        a[i] = mu / (k * (2.0f * k + 1.0f));
+        b[i] = mu * k / (2.0f * k + 1.0f);
+    }
+}
+
+template <int N>
+typename SlerpEstimateBatch<N>::Coefficients const&
+SlerpEstimateBatch<N>::GetCoefficients()
+{
+    static Coefficients const coefficients;
+    return coefficients;
+}
+
+template <int N>
+void SlerpEstimateBatch<N>::Estimate(int numElements, float const* t,
+    float const* x0, float const* y0, float const* z0, float const* w0,
+    float const* x1, float const* y1, float const* z1, float const* w1,
+    float* x, float* y, float* z, float* w)
+{
+    Run<false>(0, numElements, t, x0, y0, z0, w0, x1, y1, z1, w1,
+        x, y, z, w);
+}
+
+template <int N>
+void SlerpEstimateBatch<N>::EstimateR(int numElements, float const* t,
+    float const* x0, float const* y0, float const* z0, float const* w0,
+    float const* x1, float const* y1, float const* z1, float const* w1,
+    float* x, float* y, float* z, float* w)
+{
+    Run<true>(0, numElements, t, x0, y0, z0, w0, x1, y1, z1, w1,
+        x, y, z, w);
+}
+
+template <int N>
+template <bool Restricted>
+void SlerpEstimateBatch<N>::Run(int i0, int i1, float const* t,
+    float const* x0, float const* y0, float const* z0, float const* w0,
+    float const* x1, float const* y1, float const* z1, float const* w1,
+    float* x, float* y, float* z, float* w)
+{
+    int i = i0;
+
+#if defined(__AVX512F__)
+    Coefficients const& coefficients = GetCoefficients();
+    float const* a = coefficients.a;
+    float const* b = coefficients.b;
+    __m512 const one16 = _mm512_set1_ps(1.0f);
+    __m512i const signBit16 = _mm512_set1_epi32(0x80000000);
+    for (; i + 16 <= i1; i += 16)
+    {
+        __m512 const q0x = _mm512_loadu_ps(x0 + i);
+        __m512 const q0y = _mm512_loadu_ps(y0 + i);
+        __m512 const q0z = _mm512_loadu_ps(z0 + i);
+        __m512 const q0w = _mm512_loadu_ps(w0 + i);
+        __m512 const q1x = _mm512_loadu_ps(x1 + i);
+        __m512 const q1y = _mm512_loadu_ps(y1 + i);
+        __m512 const q1z = _mm512_loadu_ps(z1 + i);
+        __m512 const q1w = _mm512_loadu_ps(w1 + i);
+
+        __m512 cs = _mm512_mul_ps(q0x, q1x);
+        cs = _mm512_fmadd_ps(q0y, q1y, cs);
+        cs = _mm512_fmadd_ps(q0z, q1z, cs);
+        cs = _mm512_fmadd_ps(q0w, q1w, cs);
+        __m512i sign = _mm512_setzero_si512();
+        if (!Restricted)
+        {
+            // cs = |cs|, and the sign is applied to f1 below.
+            sign = _mm512_and_si512(_mm512_castps_si512(cs), signBit16);
+            cs = _mm512_castsi512_ps(_mm512_xor_si512(
+                _mm512_castps_si512(cs), sign));
+        }
+        __m512 const yy = _mm512_sub_ps(one16, cs);
+
+        __m512 const tt = _mm512_loadu_ps(t + i);
+        __m512 term0 = _mm512_sub_ps(one16, tt);
+        __m512 term1 = tt;
+        __m512 const sqr0 = _mm512_mul_ps(term0, term0);
+        __m512 const sqr1 = _mm512_mul_ps(term1, term1);
+        __m512 f0 = term0, f1 = term1;
+        for (int k = 0; k < N; ++k)
+        {
+            __m512 const ak = _mm512_set1_ps(a[k]);
+            __m512 const bk = _mm512_set1_ps(b[k]);
+            term0 = _mm512_mul_ps(term0,
+                _mm512_mul_ps(_mm512_fnmadd_ps(ak, sqr0, bk), yy));
+            term1 = _mm512_mul_ps(term1,
+                _mm512_mul_ps(_mm512_fnmadd_ps(ak, sqr1, bk), yy));
+            f0 = _mm512_add_ps(f0, term0);
+            f1 = _mm512_add_ps(f1, term1);
+        }
+        if (!Restricted)
+        {
+            f1 = _mm512_castsi512_ps(_mm512_xor_si512(
+                _mm512_castps_si512(f1), sign));
+        }
+
+        _mm512_storeu_ps(x + i, _mm512_fmadd_ps(q0x, f0, _mm512_mul_ps(q1x, f1)));
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(q0y, f0, _mm512_mul_ps(q1y, f1)));
+        _mm512_storeu_ps(z + i, _mm512_fmadd_ps(q0z, f0, _mm512_mul_ps(q1z, f1)));
+        _mm512_storeu_ps(w + i, _mm512_fmadd_ps(q0w, f0, _mm512_mul_ps(q1w, f1)));
+    }
+#endif
+
+#if defined(__AVX2__)
+#if !defined(__AVX512F__)
+    Coefficients const& coefficients = GetCoefficients();
+    float const* a = coefficients.a;
+    float const* b = coefficients.b;
+#endif
+    __m256 const one8 = _mm256_set1_ps(1.0f);
+    __m256 const signBit8 = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= i1; i += 8)
+    {
+        __m256 const q0x = _mm256_loadu_ps(x0 + i);
+        __m256 const q0y = _mm256_loadu_ps(y0 + i);
+        __m256 const q0z = _mm256_loadu_ps(z0 + i);
+        __m256 const q0w = _mm256_loadu_ps(w0 + i);
+        __m256 const q1x = _mm256_loadu_ps(x1 + i);
+        __m256 const q1y = _mm256_loadu_ps(y1 + i);
+        __m256 const q1z = _mm256_loadu_ps(z1 + i);
+        __m256 const q1w = _mm256_loadu_ps(w1 + i);
+
+        __m256 cs = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(q0x, q1x), _mm256_mul_ps(q0y, q1y)),
+            _mm256_add_ps(_mm256_mul_ps(q0z, q1z), _mm256_mul_ps(q0w, q1w)));
+        __m256 sign = _mm256_setzero_ps();
+        if (!Restricted)
+        {
+            // cs = |cs|, and the sign is applied to f1 below.
+            sign = _mm256_and_ps(cs, signBit8);
+            cs = _mm256_xor_ps(cs, sign);
+        }
+        __m256 const yy = _mm256_sub_ps(one8, cs);
+
+        __m256 const tt = _mm256_loadu_ps(t + i);
+        __m256 term0 = _mm256_sub_ps(one8, tt);
+        __m256 term1 = tt;
+        __m256 const sqr0 = _mm256_mul_ps(term0, term0);
+        __m256 const sqr1 = _mm256_mul_ps(term1, term1);
+        __m256 f0 = term0, f1 = term1;
+        for (int k = 0; k < N; ++k)
+        {
+            __m256 const ak = _mm256_set1_ps(a[k]);
+            __m256 const bk = _mm256_set1_ps(b[k]);
+            term0 = _mm256_mul_ps(term0, _mm256_mul_ps(
+                _mm256_sub_ps(bk, _mm256_mul_ps(ak, sqr0)), yy));
+            term1 = _mm256_mul_ps(term1, _mm256_mul_ps(
+                _mm256_sub_ps(bk, _mm256_mul_ps(ak, sqr1)), yy));
+            f0 = _mm256_add_ps(f0, term0);
+            f1 = _mm256_add_ps(f1, term1);
+        }
+        if (!Restricted)
+        {
+            f1 = _mm256_xor_ps(f1, sign);
+        }
+
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_mul_ps(q0x, f0), _mm256_mul_ps(q1x, f1)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_mul_ps(q0y, f0), _mm256_mul_ps(q1y, f1)));
+        _mm256_storeu_ps(z + i, _mm256_add_ps(_mm256_mul_ps(q0z, f0), _mm256_mul_ps(q1z, f1)));
+        _mm256_storeu_ps(w + i, _mm256_add_ps(_mm256_mul_ps(q0w, f0), _mm256_mul_ps(q1w, f1)));
+    }
+#endif
+
+    for (; i < i1; ++i)
+    {
+        float cs = x0[i] * x1[i] + y0[i] * y1[i] + z0[i] * z1[i] +
+            w0[i] * w1[i];
+        float sign = 1.0f;
+        if (!Restricted && cs < 0.0f)
+        {
+            cs = -cs;
+            sign = -1.0f;
+        }
+
+        float f0, f1;
+        ChebyshevRatio<float>::GetEstimate<N>(t[i], 1.0f - cs,
+            f0, f1);
+        f1 *= sign;
+
+        float const q0x = x0[i], q0y = y0[i], q0z = z0[i], q0w = w0[i];
+        x[i] = q0x * f0 + x1[i] * f1;
+        y[i] = q0y * f0 + y1[i] * f1;
+        z[i] = q0z * f0 + z1[i] * f1;
+        w[i] = q0w * f0 + w1[i] * f1;
+    }
+}
+
+template <int N>
+PoseBlend<N>::PoseBlend(unsigned int numThreads, int minElementsPerThread)
+    :
+    mNumThreads(numThreads > 0 ? numThreads :
+        std::max(1u, std::thread::hardware_concurrency())),
+    mMinElementsPerThread(std::max(1, minElementsPerThread))
+{
+}
+
+template <int N>
+void PoseBlend<N>::Execute(float const* t, QuaternionSoA const& pose0,
+    QuaternionSoA const& pose1, QuaternionSoA& pose) const
+{
+    int const numElements = pose0.GetNumElements();
+    pose.Resize(numElements);
+
+    // Keep the ranges a multiple of 16, so only the last range has a
+    // remainder that is not processed with SIMD.
+    int const maxThreads = std::max(1,
+        numElements / mMinElementsPerThread);
+    int const numThreads = std::min(static_cast<int>(mNumThreads),
+        maxThreads);
+    int const rangeSize = ((numElements + numThreads - 1) / numThreads
+        + 15) & ~15;
+
+    auto blendRange = [&](int i0, int i1)
+    {
+        SlerpEstimateBatch<N>::Estimate(i1 - i0, t + i0,
+            &pose0.x[i0], &pose0.y[i0], &pose0.z[i0], &pose0.w[i0],
+            &pose1.x[i0], &pose1.y[i0], &pose1.z[i0], &pose1.w[i0],
+            &pose.x[i0], &pose.y[i0], &pose.z[i0], &pose.w[i0]);
+    };
+
+    if (numThreads == 1)
+    {
+        if (numElements > 0)
+        {
+            blendRange(0, numElements);
+        }
+        return;
+    }
+
+    // The calling thread processes the first range.
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (int i0 = rangeSize; i0 < numElements; i0 += rangeSize)
+    {
+        int const i1 = std::min(numElements, i0 + rangeSize);
+        threads.push_back(std::thread(blendRange, i0, i1));
+    }
+    blendRange(0, std::min(numElements, rangeSize));
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+template <int N>
+void PoseBlend<N>::Execute(float t, QuaternionSoA const& pose0,
+    QuaternionSoA const& pose1, QuaternionSoA& pose) const
+{
+    std::vector<float> weights(pose0.GetNumElements(), t);
+    Execute(weights.data(), pose0, pose1, pose);
+}
+
+
+}
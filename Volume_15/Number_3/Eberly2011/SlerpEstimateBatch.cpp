@@ -0,0 +1,178 @@
+// Performance program for GteSlerpEstimateBatch.h.  For each degree N, the
+// batch estimate is compared to per-element calls to the standard Slerp of
+// GteQuaternion.h and to SLERP<float>::Estimate<N>, and the multithreaded
+// PoseBlend<N> is timed on the same data.  The results are written to
+// performanceBatch.txt.  Compile with AVX2 (or AVX-512) enabled to get the
+// SIMD paths, for example /arch:AVX2 with MSVS or -mavx2 -mfma with g++.
+
+#include <Mathematics/GteSlerpEstimate.h>
+#include <Mathematics/GteSlerpEstimateBatch.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+using namespace gte;
+
+//----------------------------------------------------------------------------
+static float SymmetricRandom ()
+{
+    return 2.0f*((float)rand()/(float)RAND_MAX) - 1.0f;
+}
+//----------------------------------------------------------------------------
+static float UnitRandom ()
+{
+    return (float)rand()/(float)RAND_MAX;
+}
+//----------------------------------------------------------------------------
+static Quaternion<float> RandomQuaternion ()
+{
+    Quaternion<float> q(SymmetricRandom(), SymmetricRandom(),
+        SymmetricRandom(), SymmetricRandom());
+    Normalize(q);
+    return q;
+}
+//----------------------------------------------------------------------------
+struct BenchmarkData
+{
+    int numElements;
+    std::vector<float> t;
+    QuaternionSoA pose0, pose1, pose;
+    std::vector<Quaternion<float>> q0, q1, slerpSTD, slerpEST;
+};
+//----------------------------------------------------------------------------
+static float MaxError (BenchmarkData const& data)
+{
+    float maxError = 0.0f;
+    for (int i = 0; i < data.numElements; ++i)
+    {
+        Quaternion<float> const& q = data.slerpSTD[i];
+        float error = std::max(
+            std::max(fabs(q[0] - data.pose.x[i]), fabs(q[1] - data.pose.y[i])),
+            std::max(fabs(q[2] - data.pose.z[i]), fabs(q[3] - data.pose.w[i])));
+        maxError = std::max(maxError, error);
+    }
+    return maxError;
+}
+//----------------------------------------------------------------------------
+template <int N>
+static void BenchmarkDegree (BenchmarkData& data, int numIterations,
+    FILE* outFile)
+{
+    int const numElements = data.numElements;
+    clock_t start, final;
+
+    // Per-element SLERP<float>::Estimate<N>.
+    start = clock();
+    for (int j = 0; j < numIterations; ++j)
+    {
+        for (int i = 0; i < numElements; ++i)
+        {
+            data.slerpEST[i] = SLERP<float>::Estimate<N>(data.t[i],
+                data.q0[i], data.q1[i]);
+        }
+    }
+    final = clock();
+    fprintf(outFile, "N = %2d : Estimate time = %d , dummy = %f\n",
+        N, (int)(final - start), data.slerpEST[0][0]);
+
+    // SlerpEstimateBatch<N>::Estimate on the calling thread.
+    start = clock();
+    for (int j = 0; j < numIterations; ++j)
+    {
+        SlerpEstimateBatch<N>::Estimate(numElements, data.t.data(),
+            data.pose0.x.data(), data.pose0.y.data(),
+            data.pose0.z.data(), data.pose0.w.data(),
+            data.pose1.x.data(), data.pose1.y.data(),
+            data.pose1.z.data(), data.pose1.w.data(),
+            data.pose.x.data(), data.pose.y.data(),
+            data.pose.z.data(), data.pose.w.data());
+    }
+    final = clock();
+    fprintf(outFile, "N = %2d : Batch time = %d , max error = %g\n",
+        N, (int)(final - start), MaxError(data));
+
+    // PoseBlend<N>, all hardware threads.  The wall clock time is reported,
+    // clock() measures the processor time of all threads on some platforms.
+    PoseBlend<N> blend;
+    auto wallStart = std::chrono::steady_clock::now();
+    for (int j = 0; j < numIterations; ++j)
+    {
+        blend.Execute(data.t.data(), data.pose0, data.pose1, data.pose);
+    }
+    auto wallFinal = std::chrono::steady_clock::now();
+    fprintf(outFile, "N = %2d : PoseBlend time (ms) = %d , max error = %g\n",
+        N, (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+        wallFinal - wallStart).count(), MaxError(data));
+}
+//----------------------------------------------------------------------------
+int main (int, char**)
+{
+    // The bone rotations of a crowd of skeletons, one blend weight per bone.
+    BenchmarkData data;
+    data.numElements = 1 << 16;
+    data.t.resize(data.numElements);
+    data.pose0.Resize(data.numElements);
+    data.pose1.Resize(data.numElements);
+    data.pose.Resize(data.numElements);
+    data.q0.resize(data.numElements);
+    data.q1.resize(data.numElements);
+    data.slerpSTD.resize(data.numElements);
+    data.slerpEST.resize(data.numElements);
+    for (int i = 0; i < data.numElements; ++i)
+    {
+        data.t[i] = UnitRandom();
+        data.q0[i] = RandomQuaternion();
+        data.q1[i] = RandomQuaternion();
+        data.pose0.x[i] = data.q0[i][0];
+        data.pose0.y[i] = data.q0[i][1];
+        data.pose0.z[i] = data.q0[i][2];
+        data.pose0.w[i] = data.q0[i][3];
+        data.pose1.x[i] = data.q1[i][0];
+        data.pose1.y[i] = data.q1[i][1];
+        data.pose1.z[i] = data.q1[i][2];
+        data.pose1.w[i] = data.q1[i][3];
+    }
+
+    // Time the functions.  The writing of one of the SLERP components to
+    // disk prevents the smart optimizing compiler from removing the loop
+    // execution code.
+    const int numIterations = (1 << 8);
+    FILE* outFile = fopen("performanceBatch.txt", "wt");
+
+    // The standard SLERP, per element.
+    clock_t start = clock();
+    for (int j = 0; j < numIterations; ++j)
+    {
+        for (int i = 0; i < data.numElements; ++i)
+        {
+            data.slerpSTD[i] = Slerp(data.t[i], data.q0[i], data.q1[i]);
+        }
+    }
+    clock_t final = clock();
+    fprintf(outFile, "Slerp time = %d , dummy = %f\n",
+        (int)(final - start), data.slerpSTD[0][0]);
+
+    BenchmarkDegree<1>(data, numIterations, outFile);
+    BenchmarkDegree<2>(data, numIterations, outFile);
+    BenchmarkDegree<3>(data, numIterations, outFile);
+    BenchmarkDegree<4>(data, numIterations, outFile);
+    BenchmarkDegree<5>(data, numIterations, outFile);
+    BenchmarkDegree<6>(data, numIterations, outFile);
+    BenchmarkDegree<7>(data, numIterations, outFile);
+    BenchmarkDegree<8>(data, numIterations, outFile);
+    BenchmarkDegree<9>(data, numIterations, outFile);
+    BenchmarkDegree<10>(data, numIterations, outFile);
+    BenchmarkDegree<11>(data, numIterations, outFile);
+    BenchmarkDegree<12>(data, numIterations, outFile);
+    BenchmarkDegree<13>(data, numIterations, outFile);
+    BenchmarkDegree<14>(data, numIterations, outFile);
+    BenchmarkDegree<15>(data, numIterations, outFile);
+    BenchmarkDegree<16>(data, numIterations, outFile);
+
+    fclose(outFile);
+    return 0;
+}
+//----------------------------------------------------------------------------
@@ -0,0 +1,559 @@
+/****************************************************************************/
+/* Copyright (c) 2011, Ola Olsson
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/****************************************************************************/
+#include "ClusteredLightGrid.h"
+
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+#include <linmath/float4.h>
+#include <utils/Assert.h>
+#include <utils/Math.h>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif // _OPENMP
+
+using chag::max;
+using chag::min;
+
+#define MY_PROFILE_SCOPE(a)
+#define MY_PROFILE_COUNTER(a, c)
+
+
+
+inline int getMaxThreads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else // !_OPENMP
+  return 1;
+#endif // _OPENMP
+}
+
+
+
+inline int getThreadNum()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else // !_OPENMP
+  return 0;
+#endif // _OPENMP
+}
+
+
+
+/**
+ * Stores the exclusive prefix sum of 'values' in 'result' (which may be the same vector), and
+ * returns the total. Each thread sums one block, the block sums are scanned serially, and then
+ * each block is scanned starting from its offset.
+ */
+static int exclusiveScan(const std::vector<int> &values, std::vector<int> &result)
+{
+  const int count = int(values.size());
+  const int numBlocks = getMaxThreads();
+  const int blockSize = (count + numBlocks - 1) / numBlocks;
+  std::vector<int> blockOffsets(numBlocks + 1, 0);
+
+  result.resize(count);
+
+#pragma omp parallel for
+  for (int b = 0; b < numBlocks; ++b)
+  {
+    const int end = min(count, (b + 1) * blockSize);
+    int sum = 0;
+    for (int i = b * blockSize; i < end; ++i)
+    {
+      sum += values[i];
+    }
+    blockOffsets[b + 1] = sum;
+  }
+  for (int b = 0; b < numBlocks; ++b)
+  {
+    blockOffsets[b + 1] += blockOffsets[b];
+  }
+#pragma omp parallel for
+  for (int b = 0; b < numBlocks; ++b)
+  {
+    const int end = min(count, (b + 1) * blockSize);
+    int offset = blockOffsets[b];
+    for (int i = b * blockSize; i < end; ++i)
+    {
+      const int value = values[i];
+      result[i] = offset;
+      offset += value;
+    }
+  }
+  return blockOffsets[numBlocks];
+}
+
+
+
+/**
+ * Spreads the lower 10 bits of 'v' out to every third bit.
+ */
+inline uint32_t expandBits(uint32_t v)
+{
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+
+
+inline uint32_t mortonCode(const chag::float3 &p)
+{
+  const uint32_t x = uint32_t(chag::clamp(p.x, 0.0f, 1023.0f));
+  const uint32_t y = uint32_t(chag::clamp(p.y, 0.0f, 1023.0f));
+  const uint32_t z = uint32_t(chag::clamp(p.z, 0.0f, 1023.0f));
+  return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+}
+
+
+
+inline ClusteredLightGrid::LightBounds combine(const ClusteredLightGrid::LightBounds &a, const ClusteredLightGrid::LightBounds &b)
+{
+  ClusteredLightGrid::LightBounds result = { min(a.min, b.min), max(a.max, b.max), min(a.sliceBegin, b.sliceBegin), max(a.sliceEnd, b.sliceEnd) };
+  return result;
+}
+
+
+
+/**
+ * Tests if the bounds cover the tile (x,y) and overlap the slices [sliceBegin, sliceEnd).
+ */
+inline bool overlapsTile(const ClusteredLightGrid::LightBounds &b, uint32_t x, uint32_t y, uint32_t sliceBegin, uint32_t sliceEnd)
+{
+  return x >= b.min.x && x < b.max.x && y >= b.min.y && y < b.max.y && b.sliceBegin < sliceEnd && b.sliceEnd > sliceBegin;
+}
+
+
+
+inline bool overlapsAabb(const Light &l, const chag::Aabb &aabb)
+{
+  const chag::float3 d = max(aabb.min - l.position, l.position - aabb.max);
+  const chag::float3 zeros = { 0.0f, 0.0f, 0.0f };
+  const chag::float3 outside = max(d, zeros);
+  return dot(outside, outside) <= l.range * l.range;
+}
+
+
+
+/**
+ * The bounds of the part of the tile frustum that lies between the depths d0 and d1, the extents
+ * of the frustum grow linearly with depth, so only the ends need be considered.
+ */
+inline chag::Aabb computeClusterAabb(const chag::float2 &tileMin, const chag::float2 &tileMax, float d0, float d1)
+{
+  chag::Aabb result =
+  {
+    { min(tileMin.x * d0, tileMin.x * d1), min(tileMin.y * d0, tileMin.y * d1), -d1 },
+    { max(tileMax.x * d0, tileMax.x * d1), max(tileMax.y * d0, tileMax.y * d1), -d0 }
+  };
+  return result;
+}
+
+
+
+void ClusteredLightGrid::build(const chag::uint2 tileSize, const chag::uint2 resolution, uint32_t numSlices, const Lights &lights,
+  const chag::float4x4 &modelView, const chag::float4x4 &projection, float near, float far,
+  const std::vector<chag::float2> &gridMinMaxZ)
+{
+  using namespace chag;
+  MY_PROFILE_SCOPE("ClusteredLightGridBuild");
+
+  m_gridMinMaxZ = gridMinMaxZ;
+  m_minMaxGridValid = !gridMinMaxZ.empty();
+
+  m_tileSize = tileSize;
+  MY_PROFILE_COUNTER("ClusterTileX", m_tileSize.x);
+  MY_PROFILE_COUNTER("ClusterTileY", m_tileSize.y);
+  m_gridDim = (resolution + tileSize - 1) / tileSize;
+  MY_PROFILE_COUNTER("ClusterDimX", m_gridDim.x);
+  MY_PROFILE_COUNTER("ClusterDimY", m_gridDim.y);
+  m_numSlices = clamp(numSlices, 1U, uint32_t(MaxSlicesPerTile));
+  MY_PROFILE_COUNTER("ClusterDimZ", m_numSlices);
+  m_maxClusterLightCount = 0;
+
+  ASSERT(!m_minMaxGridValid || m_gridMinMaxZ.size() == m_gridDim.x * m_gridDim.y);
+
+  // exponential spacing, slice i starts at near * (far / near) ^ (i / numSlices)
+  m_near = near;
+  m_sliceScale = float(m_numSlices) / logf(far / near);
+  m_sliceDepths.resize(m_numSlices + 1);
+  for (uint32_t i = 0; i < m_numSlices; ++i)
+  {
+    m_sliceDepths[i] = near * expf(float(i) / m_sliceScale);
+  }
+  m_sliceDepths[m_numSlices] = far;
+
+  const int numTiles = int(m_gridDim.x * m_gridDim.y);
+  {
+    MY_PROFILE_SCOPE("BuildTileFrusta");
+    const float4x4 invProjection = inverse(projection);
+
+    m_tileFrusta.resize(numTiles);
+#pragma omp parallel for
+    for (int i = 0; i < numTiles; ++i)
+    {
+      const uint32_t x = uint32_t(i) % m_gridDim.x;
+      const uint32_t y = uint32_t(i) / m_gridDim.x;
+      const float2 lo = make_vector(float(x * tileSize.x), float(y * tileSize.y));
+      const float2 hi = make_vector(float(min((x + 1) * tileSize.x, resolution.x)), float(min((y + 1) * tileSize.y, resolution.y)));
+      const float2 ndc[4] =
+      {
+        make_vector(lo.x, lo.y), make_vector(hi.x, lo.y), make_vector(hi.x, hi.y), make_vector(lo.x, hi.y)
+      };
+
+      TileFrustum &tf = m_tileFrusta[i];
+      tf.min = make_vector(FLT_MAX, FLT_MAX);
+      tf.max = make_vector(-FLT_MAX, -FLT_MAX);
+      for (int j = 0; j < 4; ++j)
+      {
+        const float4 p = invProjection * make_vector(2.0f * ndc[j].x / float(resolution.x) - 1.0f, 2.0f * ndc[j].y / float(resolution.y) - 1.0f, -1.0f, 1.0f);
+        const float3 v = make_vector(p.x, p.y, p.z) / p.w;
+        // scale to unit distance, so scaling by a depth gives the point at that depth
+        const float2 corner = make_vector(v.x, v.y) / -v.z;
+        tf.min = min(tf.min, corner);
+        tf.max = max(tf.max, corner);
+      }
+    }
+  }
+
+  buildLights(resolution, lights, modelView, projection, near);
+  buildLightBvh();
+
+  m_clusterCounts.resize(numTiles * m_numSlices);
+  std::vector<int> tileThreads(numTiles);
+  std::vector<int> tileOffsets(numTiles);
+  {
+    MY_PROFILE_SCOPE("AssignClusters");
+    const int numThreads = getMaxThreads();
+    m_threadResults.resize(numThreads);
+    m_threadScratch.resize(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+    {
+      m_threadResults[i].clear();
+    }
+
+    // tiles vary a lot in cost, so hand them out one by one.
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < numTiles; ++i)
+    {
+      const int thread = getThreadNum();
+      tileThreads[i] = thread;
+      tileOffsets[i] = int(m_threadResults[thread].size());
+      assignTile(uint32_t(i), m_threadResults[thread], m_threadScratch[thread]);
+    }
+  }
+
+  {
+    MY_PROFILE_SCOPE("CompactClusters");
+    const int totalus = exclusiveScan(m_clusterCounts, m_clusterOffsets);
+    m_clusterLightIndexLists.resize(totalus);
+    MY_PROFILE_COUNTER("ClusterDataCount", totalus);
+
+#pragma omp parallel for
+    for (int i = 0; i < numTiles; ++i)
+    {
+      const int begin = m_clusterOffsets[i * m_numSlices];
+      const int end = i + 1 < numTiles ? m_clusterOffsets[(i + 1) * m_numSlices] : totalus;
+      if (end > begin)
+      {
+        const int *src = &m_threadResults[tileThreads[i]][tileOffsets[i]];
+        std::copy(src, src + (end - begin), &m_clusterLightIndexLists[begin]);
+      }
+    }
+
+    // for debug/profiling etc.
+    for (size_t i = 0; i < m_clusterCounts.size(); ++i)
+    {
+      m_maxClusterLightCount = max(m_maxClusterLightCount, uint32_t(m_clusterCounts[i]));
+    }
+  }
+}
+
+
+
+uint32_t ClusteredLightGrid::getSlice(float viewZ) const
+{
+  const float depth = -viewZ;
+  if (depth <= m_near)
+  {
+    return 0;
+  }
+  return min(uint32_t(logf(depth / m_near) * m_sliceScale), m_numSlices - 1);
+}
+
+
+
+const chag::Aabb ClusteredLightGrid::getClusterAabb(uint32_t x, uint32_t y, uint32_t z) const
+{
+  const TileFrustum &tf = m_tileFrusta[x + y * m_gridDim.x];
+  return computeClusterAabb(tf.min, tf.max, m_sliceDepths[z], m_sliceDepths[z + 1]);
+}
+
+
+
+void ClusteredLightGrid::buildLights(const chag::uint2 resolution, const Lights &lights, const chag::float4x4 &modelView, const chag::float4x4 &projection, float near)
+{
+  MY_PROFILE_SCOPE("BuildLights");
+
+  using namespace chag;
+
+  const int numLights = int(lights.size());
+  Lights transformed(numLights);
+  std::vector<LightBounds> bounds(numLights);
+  std::vector<int> visible(numLights);
+
+#pragma omp parallel for
+  for (int i = 0; i < numLights; ++i)
+  {
+    const Light &l = lights[i];
+    float3 vp = transformPoint(modelView, l.position);
+    LightGrid::ScreenRect rect = findScreenSpaceBounds(projection, vp, l.range, resolution.x, resolution.y, near);
+
+    visible[i] = rect.min.x < rect.max.x && rect.min.y < rect.max.y;
+    transformed[i] = make_light(vp, l);
+
+    LightBounds &b = bounds[i];
+    b.min = min(rect.min / m_tileSize, m_gridDim);
+    b.max = min((rect.max + m_tileSize - 1) / m_tileSize, m_gridDim);
+    b.sliceBegin = getSlice(vp.z + l.range);
+    b.sliceEnd = getSlice(vp.z - l.range) + 1;
+  }
+
+  // compact the visible lights, keeping their order.
+  std::vector<int> offsets;
+  const int numVisible = exclusiveScan(visible, offsets);
+  m_viewSpaceLights.resize(numVisible);
+  m_lightBounds.resize(numVisible);
+
+#pragma omp parallel for
+  for (int i = 0; i < numLights; ++i)
+  {
+    if (visible[i])
+    {
+      m_viewSpaceLights[offsets[i]] = transformed[i];
+      m_lightBounds[offsets[i]] = bounds[i];
+    }
+  }
+  MY_PROFILE_COUNTER("ClusterLightCount", numVisible);
+}
+
+
+
+void ClusteredLightGrid::buildLightBvh()
+{
+  using namespace chag;
+  MY_PROFILE_SCOPE("BuildLightBvh");
+
+  m_bvhLevels.clear();
+  const int numLights = int(m_viewSpaceLights.size());
+  if (!numLights)
+  {
+    return;
+  }
+
+  // sort the lights along a Morton curve, such that consecutive lights are close together.
+  Aabb bounds = make_inverse_extreme_aabb();
+  for (int i = 0; i < numLights; ++i)
+  {
+    bounds = combine(bounds, m_viewSpaceLights[i].position);
+  }
+  const float3 extent = max(bounds.max - bounds.min, make_vector(1e-6f, 1e-6f, 1e-6f));
+  const float3 scale = make_vector(1023.0f / extent.x, 1023.0f / extent.y, 1023.0f / extent.z);
+
+  std::vector<std::pair<uint32_t, int> > keys(numLights);
+#pragma omp parallel for
+  for (int i = 0; i < numLights; ++i)
+  {
+    keys[i] = std::make_pair(mortonCode((m_viewSpaceLights[i].position - bounds.min) * scale), i);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  Lights sortedLights(numLights);
+  std::vector<LightBounds> sortedBounds(numLights);
+#pragma omp parallel for
+  for (int i = 0; i < numLights; ++i)
+  {
+    sortedLights[i] = m_viewSpaceLights[keys[i].second];
+    sortedBounds[i] = m_lightBounds[keys[i].second];
+  }
+  m_viewSpaceLights.swap(sortedLights);
+  m_lightBounds.swap(sortedBounds);
+
+  // then build levels bottom up, each node bounds BvhBranchFactor consecutive lights or nodes.
+  int count = numLights;
+  do
+  {
+    const int childCount = count;
+    count = (count + BvhBranchFactor - 1) / BvhBranchFactor;
+    m_bvhLevels.push_back(std::vector<LightBounds>(count));
+
+    const std::vector<LightBounds> &children = m_bvhLevels.size() > 1 ? m_bvhLevels[m_bvhLevels.size() - 2] : m_lightBounds;
+    std::vector<LightBounds> &nodes = m_bvhLevels.back();
+#pragma omp parallel for
+    for (int i = 0; i < count; ++i)
+    {
+      const int end = min(childCount, (i + 1) * int(BvhBranchFactor));
+      LightBounds b = children[i * BvhBranchFactor];
+      for (int j = i * BvhBranchFactor + 1; j < end; ++j)
+      {
+        b = combine(b, children[j]);
+      }
+      nodes[i] = b;
+    }
+  }
+  while (count > 1);
+  MY_PROFILE_COUNTER("LightBvhLevels", int(m_bvhLevels.size()));
+}
+
+
+
+void ClusteredLightGrid::assignTile(uint32_t tileIndex, std::vector<int> &result, std::vector<int> &scratch)
+{
+  using namespace chag;
+
+  int *counts = &m_clusterCounts[tileIndex * m_numSlices];
+  std::fill(counts, counts + m_numSlices, 0);
+
+  if (m_viewSpaceLights.empty())
+  {
+    return;
+  }
+
+  uint32_t sliceBegin = 0;
+  uint32_t sliceEnd = m_numSlices;
+  if (m_minMaxGridValid)
+  {
+    // Note: x is the nearest (i.e. greatest) view space z, tiles without geometry produce an inverted range.
+    const float2 &zRange = m_gridMinMaxZ[tileIndex];
+    if (!(zRange.x >= zRange.y) || -zRange.y < m_near)
+    {
+      return;
+    }
+    sliceBegin = getSlice(zRange.x);
+    sliceEnd = getSlice(zRange.y) + 1;
+  }
+  const uint32_t x = tileIndex % m_gridDim.x;
+  const uint32_t y = tileIndex / m_gridDim.x;
+
+  // 1. find the lights overlapping the tile frustum, the children are pushed in reverse
+  //    such that the lights are found in order.
+  scratch.clear();
+  {
+    struct StackEntry
+    {
+      int level;
+      int index;
+    };
+    // each level adds at most BvhBranchFactor - 1 entries, and 32 levels is more lights than can be indexed.
+    StackEntry stack[1 + 32 * (BvhBranchFactor - 1)];
+    const int numLevels = int(m_bvhLevels.size());
+    ASSERT(numLevels <= 32);
+
+    int top = 0;
+    stack[top].level = numLevels - 1;
+    stack[top].index = 0;
+    ++top;
+    while (top > 0)
+    {
+      --top;
+      const int level = stack[top].level;
+      const int index = stack[top].index;
+      if (!overlapsTile(m_bvhLevels[level][index], x, y, sliceBegin, sliceEnd))
+      {
+        continue;
+      }
+      if (level == 0)
+      {
+        const int end = min(int(m_viewSpaceLights.size()), (index + 1) * int(BvhBranchFactor));
+        for (int i = index * BvhBranchFactor; i < end; ++i)
+        {
+          if (overlapsTile(m_lightBounds[i], x, y, sliceBegin, sliceEnd))
+          {
+            scratch.push_back(i);
+          }
+        }
+      }
+      else
+      {
+        const int end = min(int(m_bvhLevels[level - 1].size()), (index + 1) * int(BvhBranchFactor));
+        for (int i = end - 1; i >= index * int(BvhBranchFactor); --i)
+        {
+          stack[top].level = level - 1;
+          stack[top].index = i;
+          ++top;
+        }
+      }
+    }
+  }
+
+  // 2. test each light against the clusters in its depth range, storing (slice, light) pairs after the lights
+  const TileFrustum &tf = m_tileFrusta[tileIndex];
+  Aabb clusterAabbs[MaxSlicesPerTile];
+  ASSERT(sliceEnd - sliceBegin <= MaxSlicesPerTile);
+  for (uint32_t s = sliceBegin; s < sliceEnd; ++s)
+  {
+    clusterAabbs[s - sliceBegin] = computeClusterAabb(tf.min, tf.max, m_sliceDepths[s], m_sliceDepths[s + 1]);
+  }
+
+  const size_t numCandidates = scratch.size();
+  for (size_t i = 0; i < numCandidates; ++i)
+  {
+    const int lightIndex = scratch[i];
+    const Light &l = m_viewSpaceLights[lightIndex];
+    const uint32_t lo = max(sliceBegin, m_lightBounds[lightIndex].sliceBegin);
+    const uint32_t hi = min(sliceEnd, m_lightBounds[lightIndex].sliceEnd);
+    for (uint32_t s = lo; s < hi; ++s)
+    {
+      if (overlapsAabb(l, clusterAabbs[s - sliceBegin]))
+      {
+        counts[s] += 1;
+        scratch.push_back(int(s));
+        scratch.push_back(lightIndex);
+      }
+    }
+  }
+
+  // 3. counting sort the pairs by slice into the result, lights stay in order within each cluster.
+  const size_t numPairsEnd = scratch.size();
+  const size_t base = result.size();
+  result.resize(base + (numPairsEnd - numCandidates) / 2);
+
+  scratch.resize(numPairsEnd + m_numSlices);
+  int *sliceOffsets = &scratch[numPairsEnd];
+  int offset = int(base);
+  for (uint32_t s = 0; s < m_numSlices; ++s)
+  {
+    sliceOffsets[s] = offset;
+    offset += counts[s];
+  }
+  for (size_t i = numCandidates; i < numPairsEnd; i += 2)
+  {
+    result[sliceOffsets[scratch[i]]++] = scratch[i + 1];
+  }
+}
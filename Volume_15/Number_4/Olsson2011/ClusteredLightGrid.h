@@ -0,0 +1,190 @@
+/****************************************************************************/
+/* Copyright (c) 2011, Ola Olsson
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/****************************************************************************/
+#ifndef _ClusteredLightGrid_h_
+#define _ClusteredLightGrid_h_
+
+#include "Config.h"
+#include <utils/IntTypes.h>
+#include <linmath/int2.h>
+#include <linmath/float3.h>
+#include <linmath/float4x4.h>
+#include <linmath/Aabb.h>
+#include "Light.h"
+#include "LightGrid.h"
+
+
+/**
+ * Clustered variant of the light grid, each screen space tile is further subdivided into
+ * depth slices, spaced exponentially between the near and far planes, such that each
+ * cluster is roughly cube shaped in view space.
+ *
+ * Unlike the LightGrid, all storage is sized dynamically, so any resolution may be used.
+ * The build is multi threaded (using OpenMP, when enabled), and lights are found through
+ * a bounding volume hierarchy over the lights, which keeps the cost of building sub linear
+ * in the number of lights for each cluster, making it practical with 100k+ lights.
+ *
+ * Clusters are stored tile-major, i.e. all slices for a tile are consecutive, see clusterIndex().
+ */
+class ClusteredLightGrid
+{
+public:
+  /**
+   * The number of children of each inner node in the light BVH, also the number of lights in each leaf.
+   */
+  enum { BvhBranchFactor = 8 };
+  /**
+   * Upper limit on the number of depth slices.
+   */
+  enum { MaxSlicesPerTile = 256 };
+
+  /**
+   * Bounds of a light, or a node in the light BVH, as ranges ([begin, end)) of tiles and depth slices.
+   */
+  struct LightBounds
+  {
+    chag::uint2 min;
+    chag::uint2 max;
+    uint32_t sliceBegin;
+    uint32_t sliceEnd;
+  };
+
+  ClusteredLightGrid() : m_numSlices(0), m_maxClusterLightCount(0), m_minMaxGridValid(false) {};
+  /**
+   * Call to build the grid structure.
+   * 'numSlices' (at most MaxSlicesPerTile) depth slices are placed between 'near' and 'far', which must be the near and far
+   * planes of the perspective 'projection'.
+   *
+   * The 'gridMinMaxZ' is optional, if not empty, the min and max range is used to prune clusters.
+   * The values are expected to be in view space, and it must have the dimensions of the tile grid,
+   * i.e. (resolution + tileSize - 1) / tileSize, as for the LightGrid.
+   */
+  void build(const chag::uint2 tileSize, const chag::uint2 resolution, uint32_t numSlices, const Lights &lights,
+    const chag::float4x4 &modelView, const chag::float4x4 &projection, float near, float far,
+    const std::vector<chag::float2> &gridMinMaxZ);
+
+  /**
+   * Access to grid wide properties, set at last call to 'build'.
+   */
+  const chag::uint2 &getTileSize() const { return m_tileSize; }
+  const chag::uint2 &getGridDim() const { return m_gridDim; }
+  uint32_t getNumSlices() const { return m_numSlices; }
+  uint32_t getNumClusters() const { return uint32_t(m_clusterCounts.size()); }
+  uint32_t getMaxClusterLightCount() const { return m_maxClusterLightCount; }
+  uint32_t getTotalClusterLightIndexListLength() const { return uint32_t(m_clusterLightIndexLists.size()); }
+
+  /**
+   * Returns the depth slice containing the view space depth 'viewZ' (which is negative in front of the camera).
+   */
+  uint32_t getSlice(float viewZ) const;
+  /**
+   * Returns the (positive) distance to the near side of the slice, getSliceDepth(getNumSlices()) returns the far plane.
+   */
+  float getSliceDepth(uint32_t slice) const { return m_sliceDepths[slice]; }
+
+  /**
+   * cluster accessor functions, returns data for an individual cluster, z is the depth slice.
+   */
+  uint32_t clusterIndex(uint32_t x, uint32_t y, uint32_t z) const { return (x + y * m_gridDim.x) * m_numSlices + z; }
+  int clusterLightCount(uint32_t x, uint32_t y, uint32_t z) const { return m_clusterCounts[clusterIndex(x, y, z)]; }
+  const int *clusterLightIndexList(uint32_t x, uint32_t y, uint32_t z) const { return &m_clusterLightIndexLists[m_clusterOffsets[clusterIndex(x, y, z)]]; }
+  /**
+   * Returns the view space bounds of the cluster, which is what lights are tested against.
+   */
+  const chag::Aabb getClusterAabb(uint32_t x, uint32_t y, uint32_t z) const;
+
+  /**
+   * Grid data pointer accessors, used for uploading to GPU.
+   */
+  const int *clusterDataPtr() const { return m_clusterOffsets.empty() ? 0 : &m_clusterOffsets[0]; }
+  const int *clusterCountsDataPtr() const { return m_clusterCounts.empty() ? 0 : &m_clusterCounts[0]; }
+  const int *clusterLightIndexListsPtr() const { return m_clusterLightIndexLists.empty() ? 0 : &m_clusterLightIndexLists[0]; }
+
+  /**
+   * Returns the list of lights, transformed to view space, that are present in the grid,
+   * i.e. produces an on screen rectangle. The light indices in the cluster light lists index
+   * into this list. Note that the lights are re-ordered (along a Morton curve) compared to the
+   * input to build().
+   */
+  const Lights &getViewSpaceLights() const { return m_viewSpaceLights; }
+
+  /**
+   * Indicated whether there are any lights visible, i.e. with on-screen rects.
+   */
+  bool empty() const { return m_viewSpaceLights.empty(); }
+  /**
+   * if true, then the contents of the min/max grid were used to prune clusters.
+   */
+  bool minMaxGridValid() const { return m_minMaxGridValid; }
+
+protected:
+  /**
+   * The x and y extents of the tile frustum in view space at distance 1 from the eye (z = -1).
+   */
+  struct TileFrustum
+  {
+    chag::float2 min;
+    chag::float2 max;
+  };
+
+  /**
+   * Transforms lights to view space, culls those without on-screen rectangles and compacts
+   * the survivors into m_viewSpaceLights, with their bounds in m_lightBounds.
+   */
+  void buildLights(const chag::uint2 resolution, const Lights &lights, const chag::float4x4 &modelView, const chag::float4x4 &projection, float near);
+  /**
+   * Sorts the lights along a Morton curve and builds m_bvhLevels bottom up.
+   */
+  void buildLightBvh();
+  /**
+   * Finds the lights for all clusters in the tile, and stores them in 'result', ordered by cluster.
+   * The per cluster counts are written to m_clusterCounts. 'scratch' is temporary storage.
+   */
+  void assignTile(uint32_t tileIndex, std::vector<int> &result, std::vector<int> &scratch);
+
+  chag::uint2 m_tileSize;
+  chag::uint2 m_gridDim;
+  uint32_t m_numSlices;
+  float m_near;
+  float m_sliceScale;
+  std::vector<float> m_sliceDepths;
+  std::vector<TileFrustum> m_tileFrusta;
+
+  std::vector<chag::float2> m_gridMinMaxZ;
+  std::vector<int> m_clusterOffsets;
+  std::vector<int> m_clusterCounts;
+  std::vector<int> m_clusterLightIndexLists;
+  uint32_t m_maxClusterLightCount;
+  bool m_minMaxGridValid;
+
+  Lights m_viewSpaceLights;
+  std::vector<LightBounds> m_lightBounds;
+  // level 0 holds the leaves, each bounding BvhBranchFactor lights, the last level holds the root.
+  std::vector<std::vector<LightBounds> > m_bvhLevels;
+
+  // per thread storage, kept between builds to avoid re-allocation.
+  std::vector<std::vector<int> > m_threadResults;
+  std::vector<std::vector<int> > m_threadScratch;
+};
+
+
+#endif // _ClusteredLightGrid_h_
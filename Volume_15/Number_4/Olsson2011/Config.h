@@ -32,6 +32,10 @@
 #define LIGHT_GRID_MAX_DIM_X ((1920 + LIGHT_GRID_TILE_DIM_X - 1) / LIGHT_GRID_TILE_DIM_X)
 #define LIGHT_GRID_MAX_DIM_Y ((1080 + LIGHT_GRID_TILE_DIM_Y - 1) / LIGHT_GRID_TILE_DIM_Y)
 
+// Depth slices of the ClusteredLightGrid checked by the CPU benchmark ('b'), at most
+// ClusteredLightGrid::MaxSlicesPerTile.
+#define CLUSTERED_GRID_NUM_SLICES 64
+
 // the maximum number if lights supported, this is limited by constant buffer size, commonly
 // this is 64kb, but AMD only seem to allow 2048 lights...
 #define NUM_POSSIBLE_LIGHTS (1024)
@@ -0,0 +1,683 @@
+/****************************************************************************/
+/* Copyright (c) 2011, Ola Olsson
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/****************************************************************************/
+#include "CpuTiledDeferred.h"
+
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+#include <emmintrin.h>
+#include <utils/Assert.h>
+#include <utils/Math.h>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif // _OPENMP
+
+using chag::max;
+using chag::min;
+
+#define MY_PROFILE_SCOPE(a)
+#define MY_PROFILE_COUNTER(a, c)
+
+
+
+inline int getMaxThreads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else // !_OPENMP
+  return 1;
+#endif // _OPENMP
+}
+
+
+
+inline int getThreadNum()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else // !_OPENMP
+  return 0;
+#endif // _OPENMP
+}
+
+
+
+/**
+ * Scalar version of doLight in tiledShading.glsl, used by shadeAllLights().
+ */
+static chag::float3 doLight(const chag::float3 &position, const chag::float3 &normal, const chag::float3 &diffuse, const chag::float3 &specular, float shininess, const chag::float3 &viewDir, const Light &light)
+{
+  using namespace chag;
+
+  float3 lightDir = light.position - position;
+  float dist = length(lightDir);
+  lightDir = lightDir / dist;
+
+  float ndotL = max(dot(normal, lightDir), 0.0f);
+  float att = max(1.0f - max(0.0f, dist / light.range), 0.0f);
+
+  float3 fresnelSpec = specular + (make_vector3(1.0f) - specular) * powf(clamp(1.0f + dot(-viewDir, normal), 0.0f, 1.0f), 5.0f);
+  float3 h = normalize(lightDir + viewDir);
+
+  float normalizationFactor = ((shininess + 2.0f) / 8.0f);
+
+  float3 spec = fresnelSpec * powf(max(0.0f, dot(h, normal)), shininess) * normalizationFactor;
+
+  return att * ndotL * light.color * (diffuse + spec);
+}
+
+
+
+inline uint32_t packSrgb(const chag::float3 &color)
+{
+  const chag::float3 c = chag::clamp(color, chag::make_vector3(0.0f), chag::make_vector3(1.0f));
+  const uint32_t r = uint32_t(powf(c.x, 1.0f / 2.2f) * 255.0f + 0.5f);
+  const uint32_t g = uint32_t(powf(c.y, 1.0f / 2.2f) * 255.0f + 0.5f);
+  const uint32_t b = uint32_t(powf(c.z, 1.0f / 2.2f) * 255.0f + 0.5f);
+  return r | (g << 8) | (b << 16) | 0xFF000000;
+}
+
+
+
+/**
+ * Approximate log2, for x > 0, after Mineiro's 'fastapprox'.
+ */
+inline __m128 fastLog2(__m128 x)
+{
+  const __m128i xi = _mm_castps_si128(x);
+  const __m128 y = _mm_mul_ps(_mm_cvtepi32_ps(xi), _mm_set1_ps(1.1920928955078125e-7f));
+  const __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(xi, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3f000000)));
+  return _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(y, _mm_set1_ps(124.22551499f)), _mm_mul_ps(_mm_set1_ps(1.498030302f), m)),
+    _mm_div_ps(_mm_set1_ps(1.72587999f), _mm_add_ps(_mm_set1_ps(0.3520887068f), m)));
+}
+
+
+
+/**
+ * Approximate 2^p, for p < 128.
+ */
+inline __m128 fastExp2(__m128 p)
+{
+  p = _mm_max_ps(p, _mm_set1_ps(-126.0f));
+  const __m128 w = _mm_cvtepi32_ps(_mm_cvttps_epi32(p));
+  const __m128 offset = _mm_and_ps(_mm_cmplt_ps(p, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  const __m128 z = _mm_add_ps(_mm_sub_ps(p, w), offset);
+  const __m128 v = _mm_add_ps(_mm_sub_ps(_mm_add_ps(p, _mm_set1_ps(121.2740575f)), _mm_mul_ps(_mm_set1_ps(1.49012907f), z)),
+    _mm_div_ps(_mm_set1_ps(27.7280233f), _mm_sub_ps(_mm_set1_ps(4.84252568f), z)));
+  return _mm_castsi128_ps(_mm_cvttps_epi32(_mm_mul_ps(_mm_set1_ps(float(1 << 23)), v)));
+}
+
+
+
+/**
+ * x^y for x >= 0, with 0^y = 0.
+ */
+inline __m128 fastPow(__m128 x, __m128 y)
+{
+  const __m128 positive = _mm_cmpgt_ps(x, _mm_set1_ps(1e-30f));
+  return _mm_and_ps(positive, fastExp2(_mm_mul_ps(y, fastLog2(_mm_max_ps(x, _mm_set1_ps(1e-30f))))));
+}
+
+
+
+inline __m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+
+
+/**
+ * Clamps to [0,1], converts to sRGB and packs the 4 colors as RGBA8.
+ */
+inline __m128i packSrgb4(__m128 r, __m128 g, __m128 b)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 gamma = _mm_set1_ps(1.0f / 2.2f);
+  const __m128 scale = _mm_set1_ps(255.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128i ri = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(fastPow(_mm_min_ps(_mm_max_ps(r, zero), one), gamma), scale), half));
+  const __m128i gi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(fastPow(_mm_min_ps(_mm_max_ps(g, zero), one), gamma), scale), half));
+  const __m128i bi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(fastPow(_mm_min_ps(_mm_max_ps(b, zero), one), gamma), scale), half));
+  return _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)), _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_set1_epi32(0xFF000000)));
+}
+
+
+
+/**
+ * Linear interpolation of all vertex attributes, used when clipping.
+ */
+template <typename VERTEX_T>
+inline VERTEX_T lerpVertex(const VERTEX_T &a, const VERTEX_T &b, float t)
+{
+  VERTEX_T result;
+  result.clip = a.clip + (b.clip - a.clip) * t;
+  result.position = a.position + (b.position - a.position) * t;
+  result.normal = a.normal + (b.normal - a.normal) * t;
+  return result;
+}
+
+
+
+inline float edgeFunction(const chag::float2 &a, const chag::float2 &b, float px, float py)
+{
+  return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+
+
+/**
+ * With counter clockwise triangles and y up, top edges run in negative x, and left edges downwards.
+ * Pixel centers exactly on an edge are only covered by top and left edges, such that pixels on
+ * shared edges are drawn exactly once.
+ */
+inline bool isTopLeft(const chag::float2 &a, const chag::float2 &b)
+{
+  return b.y < a.y || (b.y == a.y && b.x < a.x);
+}
+
+
+
+inline bool covers(float e, bool topLeft)
+{
+  return e > 0.0f || (e == 0.0f && topLeft);
+}
+
+
+
+uint32_t CpuTiledDeferred::gBufferIndex(uint32_t x, uint32_t y) const
+{
+  const uint32_t tileIndex = x / m_tileSize.x + (y / m_tileSize.y) * m_gridDim.x;
+  return tileIndex * m_tileSize.x * m_tileSize.y + (y % m_tileSize.y) * m_tileSize.x + x % m_tileSize.x;
+}
+
+
+
+void CpuTiledDeferred::rasterize(const Mesh &mesh, const chag::float4x4 &modelView, const chag::float4x4 &projection,
+  const chag::uint2 tileSize, const chag::uint2 resolution)
+{
+  using namespace chag;
+  MY_PROFILE_SCOPE("CpuRasterize");
+
+  ASSERT(tileSize.x % 4 == 0);
+  ASSERT(mesh.positions.size() == mesh.normals.size());
+  ASSERT(mesh.positions.size() == mesh.triangleMaterials.size() * 3);
+
+  m_tileSize = tileSize;
+  m_resolution = resolution;
+  m_gridDim = (resolution + tileSize - 1) / tileSize;
+  m_numTiles = m_gridDim.x * m_gridDim.y;
+  m_materials = mesh.materials;
+
+  const size_t numPixels = size_t(m_numTiles) * tileSize.x * tileSize.y;
+  m_depth.resize(numPixels);
+  m_positionX.resize(numPixels);
+  m_positionY.resize(numPixels);
+  m_positionZ.resize(numPixels);
+  m_normalX.resize(numPixels);
+  m_normalY.resize(numPixels);
+  m_normalZ.resize(numPixels);
+  m_material.resize(numPixels);
+  m_tileMinMaxZ.resize(m_numTiles);
+  m_colors.resize(resolution.x * resolution.y);
+
+  {
+    MY_PROFILE_SCOPE("CpuTransform");
+    const float4x4 normalMatrix = transpose(inverse(modelView));
+    const int numVerts = int(mesh.positions.size());
+    m_vertices.resize(numVerts);
+#pragma omp parallel for
+    for (int i = 0; i < numVerts; ++i)
+    {
+      Vertex &v = m_vertices[i];
+      v.position = transformPoint(modelView, mesh.positions[i]);
+      v.clip = projection * make_vector4(v.position, 1.0f);
+      v.normal = transformDirection(normalMatrix, mesh.normals[i]);
+    }
+  }
+
+  {
+    MY_PROFILE_SCOPE("CpuSetupAndBin");
+    const int numThreads = getMaxThreads();
+    m_threadTriangles.resize(numThreads);
+    m_threadBins.resize(numThreads);
+#pragma omp parallel for
+    for (int t = 0; t < numThreads; ++t)
+    {
+      m_threadTriangles[t].clear();
+      m_threadBins[t].resize(m_numTiles);
+      for (uint32_t i = 0; i < m_numTiles; ++i)
+      {
+        m_threadBins[t][i].clear();
+      }
+    }
+
+    // static schedule, such that each thread gets a consecutive range of triangles, which keeps
+    // the drawing order, and thus the result, the same from frame to frame.
+    const int numTris = int(mesh.triangleMaterials.size());
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < numTris; ++i)
+    {
+      setupTriangle(&m_vertices[i * 3], mesh.triangleMaterials[i], getThreadNum());
+    }
+  }
+
+  {
+    MY_PROFILE_SCOPE("CpuRasterizeTiles");
+    const int numTiles = int(m_numTiles);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < numTiles; ++i)
+    {
+      rasterizeTile(uint32_t(i));
+    }
+  }
+}
+
+
+
+void CpuTiledDeferred::setupTriangle(const Vertex *verts, uint32_t material, int thread)
+{
+  // signed distances to the near plane in clip space, inside when z >= -w.
+  float d[3];
+  int numInside = 0;
+  for (int i = 0; i < 3; ++i)
+  {
+    d[i] = verts[i].clip.z + verts[i].clip.w;
+    numInside += d[i] >= 0.0f ? 1 : 0;
+  }
+  if (numInside == 3)
+  {
+    setupClippedTriangle(verts[0], verts[1], verts[2], material, thread);
+    return;
+  }
+  if (numInside == 0)
+  {
+    return;
+  }
+
+  // clipping a triangle against one plane produces a triangle or a quad.
+  Vertex poly[4];
+  int numPolyVerts = 0;
+  for (int i = 0; i < 3; ++i)
+  {
+    const int j = (i + 1) % 3;
+    if (d[i] >= 0.0f)
+    {
+      poly[numPolyVerts++] = verts[i];
+    }
+    if ((d[i] >= 0.0f) != (d[j] >= 0.0f))
+    {
+      poly[numPolyVerts++] = lerpVertex(verts[i], verts[j], d[i] / (d[i] - d[j]));
+    }
+  }
+  for (int i = 2; i < numPolyVerts; ++i)
+  {
+    setupClippedTriangle(poly[0], poly[i - 1], poly[i], material, thread);
+  }
+}
+
+
+
+void CpuTiledDeferred::setupClippedTriangle(const Vertex &v0, const Vertex &v1, const Vertex &v2, uint32_t material, int thread)
+{
+  using namespace chag;
+
+  const Vertex *verts[3] = { &v0, &v1, &v2 };
+  Triangle tri;
+  float2 lo = make_vector(FLT_MAX, FLT_MAX);
+  float2 hi = make_vector(-FLT_MAX, -FLT_MAX);
+  for (int i = 0; i < 3; ++i)
+  {
+    const Vertex &v = *verts[i];
+    if (v.clip.w <= 0.0f)
+    {
+      return;
+    }
+    const float invW = 1.0f / v.clip.w;
+    tri.screen[i] = make_vector((v.clip.x * invW * 0.5f + 0.5f) * float(m_resolution.x), (v.clip.y * invW * 0.5f + 0.5f) * float(m_resolution.y));
+    tri.invW[i] = invW;
+    tri.position[i] = v.position * invW;
+    tri.normal[i] = v.normal * invW;
+    lo = min(lo, tri.screen[i]);
+    hi = max(hi, tri.screen[i]);
+  }
+
+  // back facing or degenerate
+  if (edgeFunction(tri.screen[0], tri.screen[1], tri.screen[2].x, tri.screen[2].y) <= 0.0f)
+  {
+    return;
+  }
+
+  const float2 res = make_vector(float(m_resolution.x), float(m_resolution.y));
+  lo = clamp(lo, make_vector(0.0f, 0.0f), res);
+  hi = clamp(hi, make_vector(0.0f, 0.0f), res);
+  tri.min = make_vector(uint32_t(floorf(lo.x)), uint32_t(floorf(lo.y)));
+  tri.max = make_vector(uint32_t(ceilf(hi.x)), uint32_t(ceilf(hi.y)));
+  if (tri.min.x >= tri.max.x || tri.min.y >= tri.max.y)
+  {
+    return;
+  }
+  tri.material = material;
+
+  std::vector<Triangle> &triangles = m_threadTriangles[thread];
+  const uint32_t index = uint32_t(triangles.size());
+  triangles.push_back(tri);
+
+  const uint2 tileMin = tri.min / m_tileSize;
+  const uint2 tileMax = (tri.max - 1) / m_tileSize;
+  for (uint32_t y = tileMin.y; y <= tileMax.y; ++y)
+  {
+    for (uint32_t x = tileMin.x; x <= tileMax.x; ++x)
+    {
+      m_threadBins[thread][x + y * m_gridDim.x].push_back(index);
+    }
+  }
+}
+
+
+
+void CpuTiledDeferred::rasterizeTile(uint32_t tileIndex)
+{
+  using namespace chag;
+
+  const uint32_t tileX = tileIndex % m_gridDim.x;
+  const uint32_t tileY = tileIndex / m_gridDim.x;
+  const uint2 tileMin = make_vector(tileX * m_tileSize.x, tileY * m_tileSize.y);
+  const uint2 tileMax = min(tileMin + m_tileSize, m_resolution);
+  const uint32_t base = tileIndex * m_tileSize.x * m_tileSize.y;
+  const uint32_t end = base + m_tileSize.x * m_tileSize.y;
+
+  // empty pixels are given a valid position and normal, so they can be shaded (and masked) along with the rest.
+  std::fill(&m_depth[0] + base, &m_depth[0] + end, 0.0f);
+  std::fill(&m_positionX[0] + base, &m_positionX[0] + end, 0.0f);
+  std::fill(&m_positionY[0] + base, &m_positionY[0] + end, 0.0f);
+  std::fill(&m_positionZ[0] + base, &m_positionZ[0] + end, -1.0f);
+  std::fill(&m_normalX[0] + base, &m_normalX[0] + end, 0.0f);
+  std::fill(&m_normalY[0] + base, &m_normalY[0] + end, 0.0f);
+  std::fill(&m_normalZ[0] + base, &m_normalZ[0] + end, 1.0f);
+  std::fill(&m_material[0] + base, &m_material[0] + end, -1);
+
+  for (size_t t = 0; t < m_threadBins.size(); ++t)
+  {
+    const std::vector<uint32_t> &bin = m_threadBins[t][tileIndex];
+    const std::vector<Triangle> &triangles = m_threadTriangles[t];
+    for (size_t i = 0; i < bin.size(); ++i)
+    {
+      const Triangle &tri = triangles[bin[i]];
+      const uint2 lo = max(tri.min, tileMin);
+      const uint2 hi = min(tri.max, tileMax);
+
+      // edge i is opposite vertex i, and its value is the (scaled) barycentric coordinate of that vertex.
+      const float2 *s = tri.screen;
+      const float invArea = 1.0f / edgeFunction(s[0], s[1], s[2].x, s[2].y);
+      const bool topLeft0 = isTopLeft(s[1], s[2]);
+      const bool topLeft1 = isTopLeft(s[2], s[0]);
+      const bool topLeft2 = isTopLeft(s[0], s[1]);
+      const float dx0 = -(s[2].y - s[1].y);
+      const float dx1 = -(s[0].y - s[2].y);
+      const float dx2 = -(s[1].y - s[0].y);
+
+      for (uint32_t y = lo.y; y < hi.y; ++y)
+      {
+        const float py = float(y) + 0.5f;
+        const float px = float(lo.x) + 0.5f;
+        float e0 = edgeFunction(s[1], s[2], px, py);
+        float e1 = edgeFunction(s[2], s[0], px, py);
+        float e2 = edgeFunction(s[0], s[1], px, py);
+        uint32_t index = base + (y - tileMin.y) * m_tileSize.x + (lo.x - tileMin.x);
+        for (uint32_t x = lo.x; x < hi.x; ++x, ++index, e0 += dx0, e1 += dx1, e2 += dx2)
+        {
+          if (!covers(e0, topLeft0) || !covers(e1, topLeft1) || !covers(e2, topLeft2))
+          {
+            continue;
+          }
+          const float l0 = e0 * invArea;
+          const float l1 = e1 * invArea;
+          const float l2 = e2 * invArea;
+          const float invW = l0 * tri.invW[0] + l1 * tri.invW[1] + l2 * tri.invW[2];
+          if (invW <= m_depth[index])
+          {
+            continue;
+          }
+          const float w = 1.0f / invW;
+          const float3 p = (tri.position[0] * l0 + tri.position[1] * l1 + tri.position[2] * l2) * w;
+          const float3 n = normalize(tri.normal[0] * l0 + tri.normal[1] * l1 + tri.normal[2] * l2);
+
+          m_depth[index] = invW;
+          m_positionX[index] = p.x;
+          m_positionY[index] = p.y;
+          m_positionZ[index] = p.z;
+          m_normalX[index] = n.x;
+          m_normalY[index] = n.y;
+          m_normalZ[index] = n.z;
+          m_material[index] = int(tri.material);
+        }
+      }
+    }
+  }
+
+  // Note: x is the nearest (i.e. greatest) view space z, as produced by downsample_minmax_fragment.glsl.
+  float2 minMax = make_vector(-FLT_MAX, FLT_MAX);
+  for (uint32_t i = base; i < end; ++i)
+  {
+    if (m_material[i] >= 0)
+    {
+      minMax.x = max(minMax.x, m_positionZ[i]);
+      minMax.y = min(minMax.y, m_positionZ[i]);
+    }
+  }
+  m_tileMinMaxZ[tileIndex] = minMax;
+}
+
+
+
+void CpuTiledDeferred::shadeTiled(const LightGrid &grid, const chag::float3 &ambient)
+{
+  using namespace chag;
+  MY_PROFILE_SCOPE("CpuShadeTiled");
+
+  ASSERT(grid.getTileSize() == m_tileSize);
+  ASSERT(grid.getGridDim() == m_gridDim);
+
+  const Lights &lights = grid.getViewSpaceLights();
+  const int numTiles = int(m_numTiles);
+
+  // tiles vary a lot in cost, so hand them out one by one.
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int tileIndex = 0; tileIndex < numTiles; ++tileIndex)
+  {
+    const uint32_t tileX = uint32_t(tileIndex) % m_gridDim.x;
+    const uint32_t tileY = uint32_t(tileIndex) / m_gridDim.x;
+    const uint2 tileMin = make_vector(tileX * m_tileSize.x, tileY * m_tileSize.y);
+    const uint2 tileMax = min(tileMin + m_tileSize, m_resolution);
+    const uint32_t base = uint32_t(tileIndex) * m_tileSize.x * m_tileSize.y;
+
+    const int lightCount = grid.tileLightCount(tileX, tileY);
+    const int *lightIndices = lightCount ? grid.tileLightIndexList(tileX, tileY) : 0;
+
+    for (uint32_t y = tileMin.y; y < tileMax.y; ++y)
+    {
+      for (uint32_t x = tileMin.x; x < tileMax.x; x += 4)
+      {
+        const uint32_t index = base + (y - tileMin.y) * m_tileSize.x + (x - tileMin.x);
+        uint32_t *out = &m_colors[y * m_resolution.x + x];
+        const uint32_t numOut = min(4U, tileMax.x - x);
+
+        // gather material properties.
+        float dr[4], dg[4], db[4], sr[4], sg[4], sb[4], shininess[4];
+        int valid[4];
+        int anyValid = 0;
+        for (int j = 0; j < 4; ++j)
+        {
+          const int m = m_material[index + j];
+          valid[j] = m >= 0 ? -1 : 0;
+          anyValid |= valid[j];
+          const Material &mat = m >= 0 ? m_materials[m] : m_materials[0];
+          dr[j] = mat.diffuse.x;
+          dg[j] = mat.diffuse.y;
+          db[j] = mat.diffuse.z;
+          sr[j] = mat.specular.x;
+          sg[j] = mat.specular.y;
+          sb[j] = mat.specular.z;
+          shininess[j] = mat.shininess;
+        }
+        if (!anyValid)
+        {
+          for (uint32_t j = 0; j < numOut; ++j)
+          {
+            out[j] = 0xFF000000;
+          }
+          continue;
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 tiny = _mm_set1_ps(1e-20f);
+
+        const __m128 px = _mm_loadu_ps(&m_positionX[index]);
+        const __m128 py = _mm_loadu_ps(&m_positionY[index]);
+        const __m128 pz = _mm_loadu_ps(&m_positionZ[index]);
+        const __m128 nx = _mm_loadu_ps(&m_normalX[index]);
+        const __m128 ny = _mm_loadu_ps(&m_normalY[index]);
+        const __m128 nz = _mm_loadu_ps(&m_normalZ[index]);
+        const __m128 diffR = _mm_loadu_ps(dr);
+        const __m128 diffG = _mm_loadu_ps(dg);
+        const __m128 diffB = _mm_loadu_ps(db);
+        const __m128 specR = _mm_loadu_ps(sr);
+        const __m128 specG = _mm_loadu_ps(sg);
+        const __m128 specB = _mm_loadu_ps(sb);
+        const __m128 shin = _mm_loadu_ps(shininess);
+
+        // view direction, fresnel and normalization do not depend on the light
+        const __m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(dot3(px, py, pz, px, py, pz), tiny)));
+        const __m128 vx = _mm_sub_ps(zero, _mm_mul_ps(px, invLen));
+        const __m128 vy = _mm_sub_ps(zero, _mm_mul_ps(py, invLen));
+        const __m128 vz = _mm_sub_ps(zero, _mm_mul_ps(pz, invLen));
+        const __m128 f = _mm_min_ps(_mm_max_ps(_mm_sub_ps(one, dot3(vx, vy, vz, nx, ny, nz)), zero), one);
+        const __m128 f2 = _mm_mul_ps(f, f);
+        const __m128 f5 = _mm_mul_ps(_mm_mul_ps(f2, f2), f);
+        const __m128 fresnelR = _mm_add_ps(specR, _mm_mul_ps(_mm_sub_ps(one, specR), f5));
+        const __m128 fresnelG = _mm_add_ps(specG, _mm_mul_ps(_mm_sub_ps(one, specG), f5));
+        const __m128 fresnelB = _mm_add_ps(specB, _mm_mul_ps(_mm_sub_ps(one, specB), f5));
+        const __m128 normalization = _mm_mul_ps(_mm_add_ps(shin, _mm_set1_ps(2.0f)), _mm_set1_ps(1.0f / 8.0f));
+
+        __m128 r = zero;
+        __m128 g = zero;
+        __m128 b = zero;
+        for (int i = 0; i < lightCount; ++i)
+        {
+          const Light &light = lights[lightIndices[i]];
+          const __m128 lx = _mm_sub_ps(_mm_set1_ps(light.position.x), px);
+          const __m128 ly = _mm_sub_ps(_mm_set1_ps(light.position.y), py);
+          const __m128 lz = _mm_sub_ps(_mm_set1_ps(light.position.z), pz);
+          const __m128 dist2 = dot3(lx, ly, lz, lx, ly, lz);
+          // the light list is per tile, so many pixels may be outside the range
+          if (!_mm_movemask_ps(_mm_cmplt_ps(dist2, _mm_set1_ps(light.range * light.range))))
+          {
+            continue;
+          }
+          const __m128 dist = _mm_sqrt_ps(dist2);
+          const __m128 invDist = _mm_div_ps(one, _mm_max_ps(dist, tiny));
+          const __m128 ldx = _mm_mul_ps(lx, invDist);
+          const __m128 ldy = _mm_mul_ps(ly, invDist);
+          const __m128 ldz = _mm_mul_ps(lz, invDist);
+
+          const __m128 ndotL = _mm_max_ps(dot3(nx, ny, nz, ldx, ldy, ldz), zero);
+          const __m128 att = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(dist, _mm_set1_ps(1.0f / light.range))), zero);
+
+          const __m128 hx = _mm_add_ps(ldx, vx);
+          const __m128 hy = _mm_add_ps(ldy, vy);
+          const __m128 hz = _mm_add_ps(ldz, vz);
+          const __m128 invH = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(dot3(hx, hy, hz, hx, hy, hz), tiny)));
+          const __m128 ndotH = _mm_max_ps(_mm_mul_ps(dot3(hx, hy, hz, nx, ny, nz), invH), zero);
+          const __m128 spec = _mm_mul_ps(fastPow(ndotH, shin), normalization);
+
+          const __m128 scale = _mm_mul_ps(att, ndotL);
+          r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(scale, _mm_set1_ps(light.color.x)), _mm_add_ps(diffR, _mm_mul_ps(fresnelR, spec))));
+          g = _mm_add_ps(g, _mm_mul_ps(_mm_mul_ps(scale, _mm_set1_ps(light.color.y)), _mm_add_ps(diffG, _mm_mul_ps(fresnelG, spec))));
+          b = _mm_add_ps(b, _mm_mul_ps(_mm_mul_ps(scale, _mm_set1_ps(light.color.z)), _mm_add_ps(diffB, _mm_mul_ps(fresnelB, spec))));
+        }
+
+        const __m128 mask = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(valid)));
+        r = _mm_and_ps(mask, _mm_add_ps(r, _mm_mul_ps(diffR, _mm_set1_ps(ambient.x))));
+        g = _mm_and_ps(mask, _mm_add_ps(g, _mm_mul_ps(diffG, _mm_set1_ps(ambient.y))));
+        b = _mm_and_ps(mask, _mm_add_ps(b, _mm_mul_ps(diffB, _mm_set1_ps(ambient.z))));
+
+        const __m128i packed = packSrgb4(r, g, b);
+        if (numOut == 4)
+        {
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(out), packed);
+        }
+        else
+        {
+          uint32_t tmp[4];
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(tmp), packed);
+          for (uint32_t j = 0; j < numOut; ++j)
+          {
+            out[j] = tmp[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+
+
+void CpuTiledDeferred::shadeAllLights(const Lights &viewSpaceLights, const chag::float3 &ambient)
+{
+  using namespace chag;
+  MY_PROFILE_SCOPE("CpuShadeAllLights");
+
+  const int height = int(m_resolution.y);
+  const size_t numLights = viewSpaceLights.size();
+
+#pragma omp parallel for
+  for (int y = 0; y < height; ++y)
+  {
+    for (uint32_t x = 0; x < m_resolution.x; ++x)
+    {
+      const uint32_t index = gBufferIndex(x, uint32_t(y));
+      uint32_t &out = m_colors[uint32_t(y) * m_resolution.x + x];
+      const int m = m_material[index];
+      if (m < 0)
+      {
+        out = 0xFF000000;
+        continue;
+      }
+      const Material &mat = m_materials[m];
+      const float3 position = make_vector(m_positionX[index], m_positionY[index], m_positionZ[index]);
+      const float3 normal = make_vector(m_normalX[index], m_normalY[index], m_normalZ[index]);
+      const float3 viewDir = -normalize(position);
+
+      float3 color = make_vector(0.0f, 0.0f, 0.0f);
+      for (size_t i = 0; i < numLights; ++i)
+      {
+        color += doLight(position, normal, mat.diffuse, mat.specular, mat.shininess, viewDir, viewSpaceLights[i]);
+      }
+      out = packSrgb(color + mat.diffuse * ambient);
+    }
+  }
+}
@@ -0,0 +1,166 @@
+/****************************************************************************/
+/* Copyright (c) 2011, Ola Olsson
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/****************************************************************************/
+#ifndef _CpuTiledDeferred_h_
+#define _CpuTiledDeferred_h_
+
+#include "Config.h"
+#include <utils/IntTypes.h>
+#include <linmath/int2.h>
+#include <linmath/float2.h>
+#include <linmath/float3.h>
+#include <linmath/float4.h>
+#include <linmath/float4x4.h>
+#include "Light.h"
+#include "LightGrid.h"
+
+
+/**
+ * Software implementation of tiled deferred shading, it performs the same steps as the open gl
+ * path in the demo, and needs no GPU, which makes it useful for reference renders and testing.
+ *
+ *  1. rasterize() renders the mesh into a G-Buffer, which is stored tile by tile (with the same tile
+ *     size as the light grid), the min/max depth of each tile is computed on the way.
+ *  2. The LightGrid is built as usual, using getTileMinMaxZ() for the depth range test.
+ *  3. shadeTiled() shades each tile using the light list from the grid, 4 pixels at a time using SSE.
+ *
+ * Tiles are processed in parallel (using OpenMP, when enabled). shadeAllLights() implements
+ * the naive approach, where each pixel is shaded by every light, for comparison.
+ *
+ * Only the material constants are used, as the textures of the OBJModel exist only on the GPU.
+ */
+class CpuTiledDeferred
+{
+public:
+  struct Material
+  {
+    chag::float3 diffuse;
+    chag::float3 specular;
+    float shininess;
+  };
+  /**
+   * Triangle list, three consecutive vertices per triangle. Triangles are front facing when
+   * counter clockwise, as in the demo.
+   */
+  struct Mesh
+  {
+    std::vector<chag::float3> positions;
+    std::vector<chag::float3> normals;
+    // one per triangle, indexes into 'materials'.
+    std::vector<uint32_t> triangleMaterials;
+    std::vector<Material> materials;
+  };
+
+  CpuTiledDeferred() : m_numTiles(0) {}
+
+  /**
+   * Renders the mesh into the G-Buffer, the tile size must be a multiple of 4 in x, and should
+   * be the same as is used to build the LightGrid.
+   */
+  void rasterize(const Mesh &mesh, const chag::float4x4 &modelView, const chag::float4x4 &projection,
+    const chag::uint2 tileSize, const chag::uint2 resolution);
+
+  /**
+   * The view space depth range for each tile, in the layout expected by LightGrid::build.
+   * Tiles without geometry get an empty (inverted) range.
+   */
+  const std::vector<chag::float2> &getTileMinMaxZ() const { return m_tileMinMaxZ; }
+
+  /**
+   * Shades the G-Buffer using the light lists in 'grid', which must have been built with
+   * the same tile size and resolution as passed to the last call to rasterize().
+   */
+  void shadeTiled(const LightGrid &grid, const chag::float3 &ambient);
+  /**
+   * Shades each pixel, one at a time, with all the (view space) lights, the result is the same as
+   * shadeTiled(), within the precision of the approximations used there.
+   */
+  void shadeAllLights(const Lights &viewSpaceLights, const chag::float3 &ambient);
+
+  /**
+   * Result of the last shading, sRGB RGBA8, one uint32_t per pixel, rows bottom up,
+   * i.e. ready for glDrawPixels(w, h, GL_RGBA, GL_UNSIGNED_BYTE, ...).
+   */
+  const std::vector<uint32_t> &getColors() const { return m_colors; }
+  const chag::uint2 &getResolution() const { return m_resolution; }
+
+protected:
+  /**
+   * Post-setup triangle, the attributes are pre-divided by w, for perspective correct interpolation.
+   */
+  struct Triangle
+  {
+    chag::float2 screen[3];
+    float invW[3];
+    chag::float3 position[3];
+    chag::float3 normal[3];
+    uint32_t material;
+    chag::uint2 min;
+    chag::uint2 max;
+  };
+
+  struct Vertex
+  {
+    chag::float4 clip;
+    chag::float3 position;
+    chag::float3 normal;
+  };
+
+  /**
+   * Clips against the near plane, and performs triangle setup and binning for the result.
+   */
+  void setupTriangle(const Vertex *verts, uint32_t material, int thread);
+  void setupClippedTriangle(const Vertex &v0, const Vertex &v1, const Vertex &v2, uint32_t material, int thread);
+  void rasterizeTile(uint32_t tileIndex);
+  /**
+   * Index of the pixel (x,y) in the tile major G-Buffer.
+   */
+  uint32_t gBufferIndex(uint32_t x, uint32_t y) const;
+
+  chag::uint2 m_tileSize;
+  chag::uint2 m_gridDim;
+  chag::uint2 m_resolution;
+  uint32_t m_numTiles;
+
+  // transformed vertices, shared by all threads.
+  std::vector<Vertex> m_vertices;
+  // per thread storage, m_threadBins[thread][tile] contains indices into m_threadTriangles[thread].
+  std::vector<std::vector<Triangle> > m_threadTriangles;
+  std::vector<std::vector<std::vector<uint32_t> > > m_threadBins;
+
+  // G-Buffer, SoA, tile major.
+  std::vector<float> m_depth; // 1/w, i.e. 0 is infinitely far.
+  std::vector<float> m_positionX;
+  std::vector<float> m_positionY;
+  std::vector<float> m_positionZ;
+  std::vector<float> m_normalX;
+  std::vector<float> m_normalY;
+  std::vector<float> m_normalZ;
+  std::vector<int> m_material; // -1 where nothing was drawn
+  std::vector<Material> m_materials;
+
+  std::vector<chag::float2> m_tileMinMaxZ;
+  std::vector<uint32_t> m_colors;
+};
+
+
+#endif // _CpuTiledDeferred_h_
@@ -39,7 +39,7 @@ using chag::swap;
 
 
 
-static LightGrid::ScreenRect findScreenSpaceBounds(const chag::float4x4 &projection, chag::float3 pt, float rad, int width, int height, float near)
+LightGrid::ScreenRect findScreenSpaceBounds(const chag::float4x4 &projection, chag::float3 pt, float rad, int width, int height, float near)
 {
   chag::float4 reg = computeClipRegion(pt, rad, near, projection);
   reg = -reg;
@@ -120,5 +120,11 @@ protected:
   ScreenRects m_screenRects;
 };
 
+/**
+ * Computes the on-screen rectangle (in pixels) covered by the view space light sphere,
+ * clamped to the screen. The rectangle is empty if the light is not visible.
+ */
+LightGrid::ScreenRect findScreenSpaceBounds(const chag::float4x4 &projection, chag::float3 pt, float rad, int width, int height, float near);
+
 
 #endif // _LightGrid_h_
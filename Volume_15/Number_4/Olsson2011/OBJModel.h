@@ -59,6 +59,32 @@ public:
   /**
    */
   const chag::Aabb &getAabb() const { return m_aabb; }
+  /**
+   * Host side copies of the vertex data, stored as a triangle list (three consecutive vertices per triangle).
+   */
+  const std::vector<chag::float3> &getPositions() const { return m_positions; }
+  const std::vector<chag::float3> &getNormals() const { return m_normals; }
+
+  /**
+   * Range of vertices sharing a material, with the material constants, for rendering without open gl.
+   * Note that the textures only exist on the GPU.
+   */
+  struct ChunkInfo
+  {
+    uint32_t offset;
+    uint32_t count;
+    uint32_t renderFlags;
+    chag::float3 diffuseColor;
+    chag::float3 specularColor;
+    float specularExponent;
+  };
+  size_t getNumChunks() const { return m_chunks.size(); }
+  const ChunkInfo getChunkInfo(size_t i) const
+  {
+    const Chunk &c = m_chunks[i];
+    ChunkInfo result = { c.offset, c.count, c.renderFlags, c.material->color.diffuse, c.material->color.specular, c.material->specularExponent };
+    return result;
+  }
 
   // used open GL texture units, ensure they are bound appropriately for the shaders.
   enum TextureUnits
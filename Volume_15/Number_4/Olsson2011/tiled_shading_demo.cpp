@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <linmath/float4x4.h>
 #include <utils/Rendering.h>
+#include <utils/Math.h>
 #include <utils/SimpleCamera.h>
 #include <utils/PerformanceTimer.h>
 #include <utils/CheckGlError.h>
@@ -43,6 +44,8 @@
 
 #include "Light.h"
 #include "LightGrid.h"
+#include "ClusteredLightGrid.h"
+#include "CpuTiledDeferred.h"
 
 using namespace chag;
 
@@ -61,10 +64,16 @@ const chag::float3 g_ambientLight = { 0.05f, 0.05f, 0.05f };
 
 
 LightGrid g_lightGrid;
+ClusteredLightGrid g_clusteredLightGrid;
 std::vector<Light> g_lights;
 SimpleCamera g_camera;
 static PerformanceTimer g_appTimer;
 
+CpuTiledDeferred g_cpuTiledDeferred;
+CpuTiledDeferred::Mesh g_cpuMesh;
+static float g_cpuFrameTime = 0.0f;
+static bool g_runCpuBenchmark = false;
+
 ComboShader *g_simpleShader = 0; 
 ComboShader *g_deferredShader = 0;
 ComboShader *g_tiledDeferredShader = 0;
@@ -93,6 +102,7 @@ enum RenderMethod
   RM_TiledDeferred,
   RM_TiledForward,
   RM_Simple,
+  RM_CpuTiledDeferred,
   RM_Max,
 };
 static RenderMethod g_renderMethod = RM_TiledDeferred;
@@ -101,6 +111,7 @@ static const char *g_renderMethodNames[RM_Max] =
   "TiledDeferred",
   "TiledForward",
   "Simple",
+  "CpuTiledDeferred",
 };
 
 
@@ -189,6 +200,10 @@ static void printInfo(float fps, float gridBuildTime);
 static void printString(int x, int y, const char *fmt, ...);
 static void checkFBO(uint32_t fbo);
 static void downSampleDepthBuffer(std::vector<float2> &depthRanges);
+static void buildCpuMesh(const OBJModel &model, CpuTiledDeferred::Mesh &mesh);
+static void runCpuBenchmark(const float4x4 &modelView, const float4x4 &projection);
+static void checkClusteredLightGrid(const float4x4 &modelView, const float4x4 &projection);
+static bool listContainsLight(const Lights &lights, const int *list, int count, const Light &light);
 
 
 GLTimerQuery *g_glTimer = 0;
@@ -515,9 +530,55 @@ static void onGlutDisplay()
       g_simpleShader->end();
     }
     break;
+    case RM_CpuTiledDeferred:
+    {
+      // 1. rasterize G-Buffer, also produces the tile depth ranges.
+      PerformanceTimer cpuTimer;
+      cpuTimer.start();
+      const uint2 tileSize = make_vector<uint32_t>(LIGHT_GRID_TILE_DIM_X, LIGHT_GRID_TILE_DIM_Y);
+      g_cpuTiledDeferred.rasterize(g_cpuMesh, modelView, projection, tileSize, make_vector<uint32_t>(g_width, g_height));
+
+      // 2. build grid
+      buildTimer.start();
+      g_lightGrid.build(
+        tileSize, 
+        make_vector<uint32_t>(g_width, g_height),
+        g_lights,
+        modelView,
+        projection,
+        g_near,
+        g_enableDepthRangeTest ? g_cpuTiledDeferred.getTileMinMaxZ() : std::vector<float2>()
+        );
+      buildTimer.stop();
+
+      // 3. apply tiled deferred lighting
+      g_cpuTiledDeferred.shadeTiled(g_lightGrid, g_ambientLight);
+      cpuTimer.stop();
+      g_cpuFrameTime = float(cpuTimer.getElapsedTime() * 1000.0);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glViewport(0,0, g_width, g_height);
+      glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      glMatrixMode(GL_PROJECTION);
+      glLoadIdentity();
+      glMatrixMode(GL_MODELVIEW);
+      glLoadIdentity();
+      glDisable(GL_DEPTH_TEST);
+      glRasterPos2f(-1.0f, -1.0f);
+      glDrawPixels(g_width, g_height, GL_RGBA, GL_UNSIGNED_BYTE, &g_cpuTiledDeferred.getColors()[0]);
+    }
+    break;
   };
   glPopAttrib();
 
+  if (g_runCpuBenchmark)
+  {
+    g_runCpuBenchmark = false;
+    runCpuBenchmark(modelView, projection);
+  }
+
   if (g_showLights)
   {
     glPushAttrib(GL_ALL_ATTRIB_BITS);
@@ -739,6 +800,9 @@ static void onGlutKeyboard(unsigned char key, int, int)
     break;
   case 'z':
     g_enableDepthRangeTest = !g_enableDepthRangeTest;
+    break;
+  case 'b':
+    g_runCpuBenchmark = true;
     break;
 	case '+':
     {
@@ -886,6 +950,7 @@ int main(int argc, char* argv[])
     fprintf(stderr, "The file: '%s' could not be loaded.\n", g_sceneFileName.c_str());
     return 1;
   }
+  buildCpuMesh(*g_model, g_cpuMesh);
   //g_camera.init(make_vector(0.0f, 0.0f, 1.0f), make_vector(0.0f, 1.0f, 0.0f));
   g_camera.init(make_vector(0.0f, 1.0f, 0.0f), make_vector(0.0f, 0.0f, 1.0f));
 
@@ -1273,6 +1338,10 @@ static void printInfo(float fps, float gridBuildTime)
     printString(10, yOffset += yStep, "Method ('m'): %s", g_renderMethodNames[g_renderMethod]);
     printString(10, yOffset += yStep, "FPS: %6.2f", fps);
     printString(10, yOffset += yStep, "Grid Build: %6.2fms", gridBuildTime);
+    if (g_renderMethod == RM_CpuTiledDeferred)
+    {
+      printString(10, yOffset += yStep, "CPU Frame: %6.2fms", g_cpuFrameTime);
+    }
 		char msaaBuffer[64];
 		sprintf(msaaBuffer, "%dx", g_numMsaaSamples);
 		printString(10, yOffset += yStep, "MSAA Level ('c'): %s (Max: %dx)", g_numMsaaSamples == 0 ? "Off" : msaaBuffer, g_maxMsaaSamples);
@@ -1292,6 +1361,7 @@ static void printInfo(float fps, float gridBuildTime)
     printString(10, yOffset += yStep, "Shown G-Buffer ('t'): %s", gBufferNames[g_showGBuffer]);
     printString(10, yOffset += yStep, "Re-load Shaders ('l')");
     printString(10, yOffset += yStep, "Cycle Up direction ('u')");
+    printString(10, yOffset += yStep, "Compare CPU tiled/all lights shading, check clustered grid ('b')");
     printString(10, yOffset += yStep, "Scene file name: %s", g_sceneFileName.c_str());
     printString(10, yOffset += yStep, "G-Buffer Format: %s", g_rgbaFpFormat == GL_RGBA16F ? "GL_RGBA16F" : (g_rgbaFpFormat == GL_RGBA32F ? "GL_RGBA32F" : "Unknown"));
 
@@ -1366,4 +1436,248 @@ static void downSampleDepthBuffer(std::vector<float2> &depthRanges)
 		glReadPixels(0, 0, gridRes.x, gridRes.y, GL_RG, GL_FLOAT, &depthRanges[0]);
     CHECK_GL_ERROR();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
\ No newline at end of file
+}
+
+
+
+static void buildCpuMesh(const OBJModel &model, CpuTiledDeferred::Mesh &mesh)
+{
+  mesh.positions.clear();
+  mesh.normals.clear();
+  mesh.triangleMaterials.clear();
+  mesh.materials.clear();
+
+  const std::vector<float3> &positions = model.getPositions();
+  const std::vector<float3> &normals = model.getNormals();
+  for (size_t i = 0; i < model.getNumChunks(); ++i)
+  {
+    OBJModel::ChunkInfo chunk = model.getChunkInfo(i);
+    // same as drawn to the G-Buffer on the GPU, there is no opacity texture, so alpha tested chunks are drawn as opaque.
+    if (!(chunk.renderFlags & (OBJModel::RF_Opaque | OBJModel::RF_AlphaTested)))
+    {
+      continue;
+    }
+    // the default specular texture is all ones, so the specular color is not used by the shaders.
+    CpuTiledDeferred::Material m = { chunk.diffuseColor, make_vector(1.0f, 1.0f, 1.0f), chunk.specularExponent };
+    const uint32_t material = uint32_t(mesh.materials.size());
+    mesh.materials.push_back(m);
+
+    mesh.positions.insert(mesh.positions.end(), positions.begin() + chunk.offset, positions.begin() + chunk.offset + chunk.count);
+    mesh.normals.insert(mesh.normals.end(), normals.begin() + chunk.offset, normals.begin() + chunk.offset + chunk.count);
+    mesh.triangleMaterials.insert(mesh.triangleMaterials.end(), chunk.count / 3, material);
+  }
+}
+
+
+
+static void writePpm(const char *fileName, const std::vector<uint32_t> &colors, int width, int height)
+{
+  FILE *f = fopen(fileName, "wb");
+  if (!f)
+  {
+    fprintf(stderr, "Could not open '%s' for writing.\n", fileName);
+    return;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", width, height);
+  // ppm is stored top down.
+  for (int y = height - 1; y >= 0; --y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      const uint32_t c = colors[y * width + x];
+      const unsigned char rgb[3] = { (unsigned char)(c & 0xFF), (unsigned char)((c >> 8) & 0xFF), (unsigned char)((c >> 16) & 0xFF) };
+      fwrite(rgb, 1, 3, f);
+    }
+  }
+  fclose(f);
+}
+
+
+
+/**
+ * Renders the current view using the CPU backend, with the tiled path and with the naive path, where
+ * every pixel is shaded by every light. Prints the timings and the largest difference, and saves the
+ * tiled result as a reference image.
+ */
+static void runCpuBenchmark(const float4x4 &modelView, const float4x4 &projection)
+{
+  const uint2 tileSize = make_vector<uint32_t>(LIGHT_GRID_TILE_DIM_X, LIGHT_GRID_TILE_DIM_Y);
+  const uint2 resolution = make_vector<uint32_t>(g_width, g_height);
+
+  PerformanceTimer rasterTimer;
+  rasterTimer.start();
+  g_cpuTiledDeferred.rasterize(g_cpuMesh, modelView, projection, tileSize, resolution);
+  rasterTimer.stop();
+
+  PerformanceTimer gridTimer;
+  gridTimer.start();
+  g_lightGrid.build(tileSize, resolution, g_lights, modelView, projection, g_near, g_cpuTiledDeferred.getTileMinMaxZ());
+  gridTimer.stop();
+
+  PerformanceTimer tiledTimer;
+  tiledTimer.start();
+  g_cpuTiledDeferred.shadeTiled(g_lightGrid, g_ambientLight);
+  tiledTimer.stop();
+  const std::vector<uint32_t> tiledColors = g_cpuTiledDeferred.getColors();
+
+  PerformanceTimer allLightsTimer;
+  allLightsTimer.start();
+  g_cpuTiledDeferred.shadeAllLights(g_lightGrid.getViewSpaceLights(), g_ambientLight);
+  allLightsTimer.stop();
+  const std::vector<uint32_t> &allLightsColors = g_cpuTiledDeferred.getColors();
+
+  int maxDiff = 0;
+  for (size_t i = 0; i < tiledColors.size(); ++i)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      const int a = int((tiledColors[i] >> (c * 8)) & 0xFF);
+      const int b = int((allLightsColors[i] >> (c * 8)) & 0xFF);
+      maxDiff = max(maxDiff, abs(a - b));
+    }
+  }
+
+  printf("--------------------------------------\nCPU Tiled Deferred, %dx%d, %d lights (%d visible)\n", g_width, g_height, int(g_lights.size()), int(g_lightGrid.getViewSpaceLights().size()));
+  printf("  Rasterize:           %8.2fms\n", rasterTimer.getElapsedTime() * 1000.0);
+  printf("  Grid Build:          %8.2fms\n", gridTimer.getElapsedTime() * 1000.0);
+  printf("  Tiled Shading:       %8.2fms\n", tiledTimer.getElapsedTime() * 1000.0);
+  printf("  All Lights Shading:  %8.2fms\n", allLightsTimer.getElapsedTime() * 1000.0);
+  printf("  Max Difference:      %d/255\n--------------------------------------\n", maxDiff);
+
+  writePpm("cpu_tiled_deferred.ppm", tiledColors, g_width, g_height);
+
+  checkClusteredLightGrid(modelView, projection);
+}
+
+
+
+/**
+ * Builds the clustered light grid for the current view, without depth range pruning, and
+ * checks it against testing every light: each light containing a (random) point inside a
+ * cluster must be in the cluster's list, and each light in a list must overlap the cluster.
+ * Both grids cull lights by the same screen space rectangle, lights missed by the rectangle
+ * are also missing from the 2D grid tile and counted separately.
+ */
+static void checkClusteredLightGrid(const float4x4 &modelView, const float4x4 &projection)
+{
+  const uint2 tileSize = make_vector<uint32_t>(LIGHT_GRID_TILE_DIM_X, LIGHT_GRID_TILE_DIM_Y);
+  const uint2 resolution = make_vector<uint32_t>(g_width, g_height);
+
+  PerformanceTimer gridTimer;
+  gridTimer.start();
+  g_lightGrid.build(tileSize, resolution, g_lights, modelView, projection, g_near, std::vector<float2>());
+  gridTimer.stop();
+
+  PerformanceTimer clusteredTimer;
+  clusteredTimer.start();
+  g_clusteredLightGrid.build(tileSize, resolution, CLUSTERED_GRID_NUM_SLICES, g_lights, modelView, projection, g_near, g_far, std::vector<float2>());
+  clusteredTimer.stop();
+
+  const ClusteredLightGrid &grid = g_clusteredLightGrid;
+  const Lights &gridLights = grid.getViewSpaceLights();
+  const uint2 gridDim = grid.getGridDim();
+
+  // every light in view space, the grid lights are the ones with on screen rectangles, in another order.
+  Lights viewLights(g_lights.size());
+  for (size_t i = 0; i < g_lights.size(); ++i)
+  {
+    viewLights[i] = g_lights[i];
+    viewLights[i].position = transformPoint(modelView, g_lights[i].position);
+  }
+
+  // 1. points spread over the view volume, logarithmically in depth, like the slices.
+  const int numPoints = 100000;
+  const float aspect = float(g_width) / float(g_height);
+  const float tanHalfFov = tanf(g_fov * g_pi / 360.0f);
+  uint32_t seed = 12345;
+  int missing = 0;
+  int missedByRect = 0;
+  int tested = 0;
+  for (int p = 0; p < numPoints; ++p)
+  {
+    float r[3];
+    for (int k = 0; k < 3; ++k)
+    {
+      seed = seed * 1664525U + 1013904223U;
+      r[k] = float(seed >> 8) / float(1 << 24);
+    }
+    const float sx = r[0] * float(g_width);
+    const float sy = r[1] * float(g_height);
+    const float depth = g_near * powf(g_far / g_near, r[2]);
+    const float3 pt = make_vector((2.0f * sx / float(g_width) - 1.0f) * depth * tanHalfFov * aspect, (2.0f * sy / float(g_height) - 1.0f) * depth * tanHalfFov, -depth);
+
+    const uint32_t x = min(uint32_t(sx) / tileSize.x, gridDim.x - 1);
+    const uint32_t y = min(uint32_t(sy) / tileSize.y, gridDim.y - 1);
+    const uint32_t z = grid.getSlice(pt.z);
+    const int count = grid.clusterLightCount(x, y, z);
+    const int *list = count ? grid.clusterLightIndexList(x, y, z) : 0;
+    const int tileCount = g_lightGrid.tileLightCount(x, y);
+    const int *tileList = tileCount ? g_lightGrid.tileLightIndexList(x, y) : 0;
+
+    for (size_t i = 0; i < viewLights.size(); ++i)
+    {
+      const Light &l = viewLights[i];
+      const float3 d = l.position - pt;
+      // stay clear of the sphere surface, where rounding decides.
+      if (dot(d, d) < l.range * l.range * 0.999f)
+      {
+        ++tested;
+        if (!listContainsLight(g_lightGrid.getViewSpaceLights(), tileList, tileCount, l))
+        {
+          ++missedByRect;
+        }
+        else if (!listContainsLight(gridLights, list, count, l))
+        {
+          ++missing;
+        }
+      }
+    }
+  }
+
+  // 2. lights listed for clusters they do not overlap.
+  int spurious = 0;
+  for (uint32_t y = 0; y < gridDim.y; ++y)
+  {
+    for (uint32_t x = 0; x < gridDim.x; ++x)
+    {
+      for (uint32_t z = 0; z < grid.getNumSlices(); ++z)
+      {
+        const int count = grid.clusterLightCount(x, y, z);
+        const int *list = count ? grid.clusterLightIndexList(x, y, z) : 0;
+        const Aabb aabb = grid.getClusterAabb(x, y, z);
+        for (int k = 0; k < count; ++k)
+        {
+          const Light &l = gridLights[list[k]];
+          const float3 outside = max(max(aabb.min - l.position, l.position - aabb.max), make_vector(0.0f, 0.0f, 0.0f));
+          spurious += dot(outside, outside) > l.range * l.range * 1.001f ? 1 : 0;
+        }
+      }
+    }
+  }
+
+  printf("Clustered Light Grid, %d slices, %d clusters, %d lights (%d visible)\n", int(grid.getNumSlices()), int(grid.getNumClusters()), int(g_lights.size()), int(gridLights.size()));
+  printf("  Grid Build (2D):     %8.2fms\n", gridTimer.getElapsedTime() * 1000.0);
+  printf("  Clustered Build:     %8.2fms\n", clusteredTimer.getElapsedTime() * 1000.0);
+  printf("  Max Cluster Lights:  %8d\n", int(grid.getMaxClusterLightCount()));
+  printf("  Total List Length:   %8d\n", int(grid.getTotalClusterLightIndexListLength()));
+  printf("  Missing Lights:      %d (of %d light/point overlaps, %d outside the screen rects)\n", missing, tested, missedByRect);
+  printf("  Spurious Lights:     %d\n--------------------------------------\n", spurious);
+}
+
+
+
+/**
+ * The grids re-order the lights, so they are matched by (view space) position and range.
+ */
+static bool listContainsLight(const Lights &lights, const int *list, int count, const Light &light)
+{
+  for (int k = 0; k < count; ++k)
+  {
+    const Light &l = lights[list[k]];
+    if (l.position.x == light.position.x && l.position.y == light.position.y && l.position.z == light.position.z && l.range == light.range)
+    {
+      return true;
+    }
+  }
+  return false;
+}